@@ -0,0 +1,195 @@
+/**
+ * @file poshold.h
+ * @brief C ABI of libposhold
+ *
+ * Stable entry points for tooling outside C++ (poshold.py wraps them for
+ * numpy). Handles are opaque; every array is caller-owned and is read or
+ * written in place, so a batch call over N samples crosses the FFI boundary
+ * once.
+ *
+ * Functions returning int report 0 (or a non-negative count) on success and
+ * -1 on failure; poshold_last_error() then describes the failure for the
+ * calling thread. No C++ exception crosses this boundary.
+ *
+ * Struct layouts are part of the ABI: fields are only ever appended, and
+ * POSHOLD_ABI_VERSION is bumped when that happens.
+ */
+
+#ifndef POSHOLD_H
+#define POSHOLD_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(__GNUC__)
+#define POSHOLD_API __attribute__((visibility("default")))
+#else
+#define POSHOLD_API
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define POSHOLD_ABI_VERSION 1
+
+POSHOLD_API int poshold_abi_version(void);
+
+/** Message of the last failed call on this thread ("" if none). */
+POSHOLD_API const char *poshold_last_error(void);
+
+/* ---- PID ---------------------------------------------------------------- */
+
+typedef struct poshold_pid poshold_pid;
+
+/**
+ * Controller whose clock is the timestamps passed to poshold_pid_step_batch();
+ * @p start_time_us is the time dt of the first sample is measured from.
+ */
+POSHOLD_API poshold_pid *poshold_pid_create(float k_p, float k_i, float k_d,
+                                            float k_df, int64_t start_time_us);
+
+POSHOLD_API void poshold_pid_destroy(poshold_pid *pid);
+
+/**
+ * Run @p count consecutive samples through the controller.
+ *
+ * @param positions     count x 2 floats [x, y]
+ * @param velocities    count x 2 floats [vx, vy] for the derivative term, or
+ *                      NULL to differentiate the positions
+ * @param desired       count x 2 floats, or NULL to hold the origin
+ * @param timestamps_us count sample times (microseconds, increasing)
+ * @param rc_out        count x 2 uint32 roll/pitch PWM
+ */
+POSHOLD_API int poshold_pid_step_batch(poshold_pid *pid, size_t count,
+                                       const float *positions,
+                                       const float *velocities,
+                                       const float *desired,
+                                       const int64_t *timestamps_us,
+                                       uint32_t *rc_out);
+
+/*
+ * Entry points of the original pid.so used by test_pid.py: one sample per
+ * call, dt taken from the wall clock.
+ */
+POSHOLD_API void *create_pid(float k_p, float k_i, float k_d, float k_df);
+POSHOLD_API void calculate_pid(void *pid, const float *current_position,
+                               const float *desired_position,
+                               uint32_t *rc_out);
+POSHOLD_API void destroy_pid(void *pid);
+
+/* ---- Optical flow / VecMove --------------------------------------------- */
+
+/** Camera intrinsics, see Drone::CameraInfo. */
+typedef struct poshold_camera {
+  int32_t resolution_x;
+  int32_t resolution_y;
+  double min_dist;
+  double max_dist;
+  double focal_length_x;
+  double focal_length_y;
+  double principal_x;
+  double principal_y;
+  double distortion[5]; /* k1, k2, p1, p2, k3 */
+} poshold_camera;
+
+/** Telemetry of one frame, in Drone::GyroData / AltitudeData units. */
+typedef struct poshold_frame_info {
+  int64_t timestamp_us;
+  int32_t skipped_frames;
+  int32_t reserved;
+  double roll;
+  double pitch;
+  double yaw;
+  double altitude;
+  double vario;
+} poshold_frame_info;
+
+typedef struct poshold_flow_result {
+  float vec_down_x;
+  float vec_down_y;
+  float vec_move_x;
+  float vec_move_y;
+  int32_t valid; /* 0 until VecMove has produced a displacement */
+  int32_t reserved;
+} poshold_flow_result;
+
+typedef struct poshold_flow poshold_flow;
+
+/** VecMove pipeline for @p camera (NULL: the airframe's default camera). */
+POSHOLD_API poshold_flow *poshold_flow_create(const poshold_camera *camera);
+
+POSHOLD_API void poshold_flow_destroy(poshold_flow *flow);
+
+/** Fill @p camera with the intrinsics the pipeline was created with. */
+POSHOLD_API void poshold_flow_camera(const poshold_flow *flow,
+                                     poshold_camera *camera);
+
+/**
+ * Run @p count consecutive grayscale frames through VecDown/VecMove.
+ *
+ * Frame i starts at frames + i * frame_stride; its rows are row_stride bytes
+ * apart and it has the camera's resolution. Frames are read in place.
+ */
+POSHOLD_API int poshold_flow_process_batch(poshold_flow *flow, size_t count,
+                                           const uint8_t *frames,
+                                           size_t row_stride,
+                                           size_t frame_stride,
+                                           const poshold_frame_info *info,
+                                           poshold_flow_result *results);
+
+/* ---- MSP codecs ---------------------------------------------------------- */
+
+#define POSHOLD_MSP_FRAME_OVERHEAD 6
+#define POSHOLD_MSP_SET_RAW_RC_FRAME_SIZE (POSHOLD_MSP_FRAME_OVERHEAD + 16)
+
+/** A frame found by poshold_msp_decode_stream(); payload is data + offset. */
+typedef struct poshold_msp_frame {
+  uint8_t direction; /* '<', '>' or '!' */
+  uint8_t command_id;
+  uint8_t size;
+  uint8_t checksum_ok;
+  uint32_t payload_offset;
+} poshold_msp_frame;
+
+/**
+ * Encode one MSP v1 frame into @p out (capacity @p out_size).
+ * @return bytes written, or -1 if @p out_size is too small.
+ */
+POSHOLD_API int poshold_msp_encode(uint8_t direction, uint8_t command_id,
+                                   const uint8_t *payload, uint8_t size,
+                                   uint8_t *out, size_t out_size);
+
+/**
+ * Encode @p count MSP_SET_RAW_RC requests, eight channels each in
+ * msp::Channels order, into count x POSHOLD_MSP_SET_RAW_RC_FRAME_SIZE bytes.
+ */
+POSHOLD_API int poshold_msp_encode_set_raw_rc_batch(size_t count,
+                                                    const uint16_t *channels,
+                                                    uint8_t *out);
+
+/**
+ * Split a received byte stream into frames. Garbage before a frame is skipped
+ * and frames with a bad checksum are reported with checksum_ok = 0.
+ *
+ * @param consumed Bytes fully parsed; a trailing partial frame is left for the
+ *                 next call.
+ * @return number of frames written to @p frames (at most @p max_frames).
+ */
+POSHOLD_API int poshold_msp_decode_stream(const uint8_t *data, size_t size,
+                                          poshold_msp_frame *frames,
+                                          size_t max_frames, size_t *consumed);
+
+/** MSP_ATTITUDE payload to radians [roll, pitch, yaw]. */
+POSHOLD_API int poshold_msp_decode_attitude(const uint8_t *payload,
+                                            uint8_t size, double *out);
+
+/** MSP_ALTITUDE payload to [altitude m, vario m/s]. */
+POSHOLD_API int poshold_msp_decode_altitude(const uint8_t *payload,
+                                            uint8_t size, double *out);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* POSHOLD_H */
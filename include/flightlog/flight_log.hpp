@@ -0,0 +1,305 @@
+/**
+ * @file flight_log.hpp
+ * @brief Memory-mapped, append-only binary flight log
+ *
+ * File layout (version 1, little-endian):
+ * - One 4096-byte page holding FileHeader.
+ * - One page-aligned region per stream, each a plain array of a fixed-size
+ *   record type (TelemetryRecord, FlowRecord, ControllerRecord, RcRecord,
+ *   ThumbnailRecord) with the capacity chosen at creation.
+ *
+ * Every region is a C array, so readers iterate it in place: FlightLogReader
+ * hands out pointers into its mapping and flight_log.py wraps each region in
+ * a numpy memmap with a matching structured dtype.
+ */
+
+#ifndef FLIGHT_LOG_HPP
+#define FLIGHT_LOG_HPP
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+namespace flightlog {
+
+static_assert(__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__,
+              "flight logs are stored little-endian");
+
+static constexpr char MAGIC[8] = {'P', 'H', 'F', 'L', 'O', 'G', '\0', '\0'};
+static constexpr std::uint32_t VERSION = 1;
+static constexpr std::size_t PAGE_SIZE = 4096;
+static constexpr int THUMBNAIL_SIDE = 64;
+
+enum StreamType : std::uint32_t {
+  TELEMETRY,
+  FLOW,
+  CONTROLLER,
+  RC,
+  THUMBNAIL,
+  STREAM_COUNT
+};
+
+/**
+ * @brief Attitude and barometer sample, in the units of Drone::GyroData and
+ * Drone::AltitudeData (radians, meters, meters per second).
+ */
+struct TelemetryRecord {
+  static constexpr StreamType STREAM = TELEMETRY;
+
+  std::uint64_t timestamp_us;
+  float roll;
+  float pitch;
+  float yaw;
+  float altitude;
+  float vario;
+  std::uint32_t reserved;
+};
+
+/**
+ * @brief Result of one VecMove::calc(): down-vector projection in pixels and
+ * ground displacement in meters.
+ */
+struct FlowRecord {
+  static constexpr StreamType STREAM = FLOW;
+
+  std::uint64_t timestamp_us;
+  std::uint32_t frame;
+  std::uint32_t skipped_frames;
+  float interval;
+  float vec_down_x;
+  float vec_down_y;
+  float vec_move_x;
+  float vec_move_y;
+  std::uint32_t reserved;
+};
+
+/**
+ * @brief Estimated state the controller acted on and its setpoint (meters,
+ * meters per second).
+ */
+struct ControllerRecord {
+  static constexpr StreamType STREAM = CONTROLLER;
+
+  std::uint64_t timestamp_us;
+  float position_x;
+  float position_y;
+  float velocity_x;
+  float velocity_y;
+  float setpoint_x;
+  float setpoint_y;
+  float altitude;
+  std::uint32_t reserved;
+};
+
+/**
+ * @brief Channels sent with MSP_SET_RAW_RC, in msp::Channels order; channels
+ * the sender does not drive are 0.
+ */
+struct RcRecord {
+  static constexpr StreamType STREAM = RC;
+
+  std::uint64_t timestamp_us;
+  std::uint16_t channels[8];
+};
+
+/**
+ * @brief Downscaled grayscale ROI, row-major, width x height pixels of a
+ * THUMBNAIL_SIDE x THUMBNAIL_SIDE buffer.
+ */
+struct ThumbnailRecord {
+  static constexpr StreamType STREAM = THUMBNAIL;
+
+  std::uint64_t timestamp_us;
+  std::uint32_t frame;
+  std::uint16_t width;
+  std::uint16_t height;
+  std::uint8_t pixels[THUMBNAIL_SIDE * THUMBNAIL_SIDE];
+};
+
+static_assert(sizeof(TelemetryRecord) == 32, "TelemetryRecord layout");
+static_assert(sizeof(FlowRecord) == 40, "FlowRecord layout");
+static_assert(sizeof(ControllerRecord) == 40, "ControllerRecord layout");
+static_assert(sizeof(RcRecord) == 24, "RcRecord layout");
+static_assert(sizeof(ThumbnailRecord) == 16 + THUMBNAIL_SIDE * THUMBNAIL_SIDE,
+              "ThumbnailRecord layout");
+
+/**
+ * @brief Location and fill level of one record array.
+ *
+ * count is published with release ordering after the record bytes are copied,
+ * so a reader that loads it with acquire ordering may follow a live log.
+ */
+struct StreamInfo {
+  std::uint32_t record_size;
+  std::uint32_t reserved;
+  std::uint64_t offset;   ///< Byte offset of the region from the file start
+  std::uint64_t capacity; ///< Records the region can hold
+  std::atomic<std::uint64_t> count;   ///< Records written
+  std::atomic<std::uint64_t> dropped; ///< Records rejected because it was full
+};
+
+struct FileHeader {
+  char magic[8];
+  std::uint32_t version;
+  std::uint32_t stream_count;
+  std::uint64_t start_time_us; ///< steady_clock time the log was created
+  StreamInfo streams[STREAM_COUNT];
+};
+
+static_assert(std::atomic<std::uint64_t>::is_always_lock_free,
+              "counters are shared through the mapping");
+static_assert(sizeof(StreamInfo) == 40, "StreamInfo layout");
+static_assert(sizeof(FileHeader) <= PAGE_SIZE, "FileHeader must fit its page");
+
+/**
+ * @brief Records reserved per stream when a log is created.
+ *
+ * The defaults cover 20 minutes of 100 Hz telemetry and RC and 30 fps vision.
+ * A stream with capacity 0 is disabled (thumbnails are off by default).
+ */
+struct Capacity {
+  std::uint64_t telemetry = 120000;
+  std::uint64_t flow = 36000;
+  std::uint64_t controller = 120000;
+  std::uint64_t rc = 120000;
+  std::uint64_t thumbnail = 0;
+};
+
+/**
+ * @brief Convert a steady_clock time to the microsecond timestamps stored in
+ * every record.
+ */
+inline std::uint64_t to_us(std::chrono::steady_clock::time_point time) {
+  return static_cast<std::uint64_t>(
+      std::chrono::duration_cast<std::chrono::microseconds>(
+          time.time_since_epoch())
+          .count());
+}
+
+/**
+ * @class FlightLogWriter
+ * @brief Creates a log file of fixed size and appends records to its mapping.
+ *
+ * The file is allocated with posix_fallocate() and mapped with MAP_POPULATE
+ * at construction, so append() touches only resident pages: a memcpy and an
+ * atomic store, never a syscall, page-cache miss or SIGBUS on a full disk.
+ * The kernel writes the pages back on its own schedule and at destruction.
+ *
+ * Each stream must have a single writing thread; different streams may be
+ * appended from different threads.
+ */
+class FlightLogWriter {
+public:
+  /**
+   * @brief Create (or truncate) @p path and map it.
+   *
+   * @throws std::system_error with original errno if the file cannot be
+   * created, allocated or mapped.
+   */
+  explicit FlightLogWriter(const char *path, const Capacity &capacity = {});
+
+  FlightLogWriter(const FlightLogWriter &) = delete;
+  FlightLogWriter &operator=(const FlightLogWriter &) = delete;
+
+  /**
+   * @brief Unmap and close the file; errors are ignored.
+   */
+  ~FlightLogWriter() noexcept;
+
+  /**
+   * @brief Copy @p record to the end of its stream.
+   *
+   * @return false if the stream is full or disabled; the record is counted
+   * in the stream's dropped counter instead.
+   */
+  template <class Record> bool append(const Record &record) noexcept {
+    StreamInfo &stream = header_->streams[Record::STREAM];
+    const std::uint64_t n = stream.count.load(std::memory_order_relaxed);
+    if (n >= stream.capacity) {
+      stream.dropped.fetch_add(1, std::memory_order_relaxed);
+      return false;
+    }
+
+    std::memcpy(base_ + stream.offset + n * sizeof(Record), &record,
+                sizeof(Record));
+    stream.count.store(n + 1, std::memory_order_release);
+    return true;
+  }
+
+  [[nodiscard]] std::uint64_t count(StreamType stream) const noexcept;
+
+  [[nodiscard]] std::uint64_t dropped(StreamType stream) const noexcept;
+
+private:
+  int fd_ = -1;
+  std::uint8_t *base_ = nullptr;
+  std::size_t size_ = 0;
+  FileHeader *header_ = nullptr;
+};
+
+/**
+ * @brief Contiguous, read-only view of one stream's records.
+ */
+template <class Record> class RecordView {
+public:
+  RecordView(const Record *data, std::size_t size) : data_(data), size_(size) {}
+
+  [[nodiscard]] const Record *begin() const { return data_; }
+  [[nodiscard]] const Record *end() const { return data_ + size_; }
+  [[nodiscard]] std::size_t size() const { return size_; }
+  [[nodiscard]] bool empty() const { return size_ == 0; }
+  const Record &operator[](std::size_t i) const { return data_[i]; }
+
+private:
+  const Record *data_;
+  std::size_t size_;
+};
+
+/**
+ * @class FlightLogReader
+ * @brief Maps a log read-only and exposes its streams without copying.
+ *
+ * Views returned by records() point into the mapping and stay valid for the
+ * lifetime of the reader. A log that is still being written may be read;
+ * each call to records() sees the records published so far.
+ */
+class FlightLogReader {
+public:
+  /**
+   * @brief Map @p path and validate its header.
+   *
+   * @throws std::system_error with original errno if the file cannot be
+   * opened or mapped.
+   * @throws std::runtime_error if it is not a version 1 flight log or its
+   * stream table does not fit the file.
+   */
+  explicit FlightLogReader(const char *path);
+
+  FlightLogReader(const FlightLogReader &) = delete;
+  FlightLogReader &operator=(const FlightLogReader &) = delete;
+
+  ~FlightLogReader() noexcept;
+
+  template <class Record> [[nodiscard]] RecordView<Record> records() const {
+    const StreamInfo &stream = header_->streams[Record::STREAM];
+    return {reinterpret_cast<const Record *>(base_ + stream.offset),
+            static_cast<std::size_t>(
+                stream.count.load(std::memory_order_acquire))};
+  }
+
+  [[nodiscard]] std::uint64_t dropped(StreamType stream) const noexcept;
+
+  [[nodiscard]] std::uint64_t start_time_us() const noexcept;
+
+private:
+  int fd_ = -1;
+  const std::uint8_t *base_ = nullptr;
+  std::size_t size_ = 0;
+  const FileHeader *header_ = nullptr;
+};
+
+} // namespace flightlog
+
+#endif // !FLIGHT_LOG_HPP
@@ -1,15 +1,35 @@
 #ifndef BITALUGHT_MSP_HPP
 #define BITALUGHT_MSP_HPP
 
+#include <chrono>
+#include <cstddef>
 #include <cstdint>
-
-#include <sys/termios.h>
 #include <type_traits>
+#include <vector>
 
 #include "serial_stream.hpp"
 
 namespace msp {
 
+/// baud_rate that makes BitaflughtMsp probe PROBE_BAUD_RATES on startup.
+static constexpr std::uint32_t AUTO_BAUD_RATE = 0;
+
+/// Rates Betaflight offers for MSP ports, fastest first.
+static constexpr std::uint32_t PROBE_BAUD_RATES[] = {
+    2000000, 1500000, 1000000, 921600, 500000, 460800, 250000, 230400, 115200};
+
+/**
+ * @brief Outcome of probing one baud rate, see
+ * BitaflughtMsp::probe_link_speed().
+ */
+struct LinkProbeResult {
+  std::uint32_t baud_rate;     ///< Rate requested.
+  std::uint32_t actual_rate;   ///< Rate the driver set (0 if rejected).
+  unsigned attempts;           ///< MSP_API_VERSION requests sent.
+  unsigned replies;            ///< Valid replies received in time.
+  double mean_round_trip_us;   ///< Mean request-to-reply time of the replies.
+};
+
 typedef enum class CommandType : std::uint8_t {
   Response = '>',
   Request = '<',
@@ -32,13 +52,18 @@ public:
    * ready for MSP I/O.
    *
    * @param dev       Serial device path (e.g., "/dev/ttyUSB0").
-   * @param baud_rate Termios baud constant (e.g., B115200).
+   * @param baud_rate Baud rate in bits per second, or AUTO_BAUD_RATE to
+   *                  select the fastest of PROBE_BAUD_RATES with
+   *                  probe_link_speed().
    * @param timeout   Read timeout (VTIME, in deciseconds).
    *
    * @throws std::system_error if the serial stream cannot be opened/configured.
+   * @throws std::runtime_error if AUTO_BAUD_RATE finds no rate the flight
+   * controller answers at.
    */
-  explicit BitaflughtMsp(const char *dev, speed_t baud_rate = DEFAULT_BAUD_RATE,
-                         cc_t timeout = DEFAULT_TIMEOUT);
+  explicit BitaflughtMsp(const char *dev,
+                         std::uint32_t baud_rate = DEFAULT_BAUD_RATE,
+                         std::uint8_t timeout = DEFAULT_TIMEOUT);
 
   ~BitaflughtMsp();
 
@@ -69,6 +94,16 @@ public:
   void send(CommandType command_type, std::uint8_t command_id,
             const void *payload, std::uint8_t size);
 
+  /**
+   * @brief Read one MSP v1 response frame.
+   *
+   * Waits at most the constructor's timeout (at least 100 ms) for the whole
+   * frame. Up to @p max_size payload bytes are copied into @p payload and the
+   * rest of it is zeroed; @p recv_size receives the full payload size.
+   *
+   * @return false on timeout, a bad header or a checksum mismatch.
+   * @throws std::system_error if the underlying read fails.
+   */
   bool recv(std::uint8_t *command_id, void *payload, std::uint8_t max_size,
             std::uint8_t *recv_size);
 
@@ -82,10 +117,67 @@ public:
                bool wait_ACK = true);
 
   void reset();
+
+  /**
+   * @brief Request MSP_STATUS and return its first 32 flight-mode flags.
+   *
+   * Bit i is the i-th box of the MSP_BOXIDS reply, not BoxId i; see
+   * BoxIdMap.
+   *
+   * @return false if the request failed or the reply is too short.
+   */
   bool getActiveModes(std::uint32_t *active_modes);
 
+  /**
+   * @brief Switch to the fastest rate the flight controller answers reliably.
+   *
+   * Behavior:
+   * - Tries @p candidates in order (fastest first): switches the port to the
+   *   rate, then sends @p attempts MSP_API_VERSION requests one at a time.
+   * - A rate passes when every request gets a valid reply within
+   *   @p reply_timeout_ms; replies framed at the wrong rate show up as bad
+   *   headers or checksums and fail it.
+   * - The first passing rate is left in effect.
+   *
+   * The flight controller does not change its own rate: the probe finds the
+   * rate its MSP port is configured for and confirms the wiring carries it.
+   * Configure the port for the highest rate the wiring supports and let the
+   * probe fall back when it does not.
+   *
+   * @param report If not null, receives one entry per rate tried.
+   * @return The selected rate as set by the driver.
+   * @throws std::runtime_error if no candidate passes; the port is then
+   * left at the last candidate.
+   */
+  std::uint32_t probe_link_speed(const std::uint32_t *candidates,
+                                 std::size_t count, unsigned attempts = 20,
+                                 int reply_timeout_ms = 50,
+                                 std::vector<LinkProbeResult> *report = nullptr);
+
+  /// probe_link_speed() over PROBE_BAUD_RATES.
+  std::uint32_t probe_link_speed(std::vector<LinkProbeResult> *report = nullptr);
+
+  /// Baud rate of the serial link.
+  [[nodiscard]] std::uint32_t baud_rate() const noexcept;
+
 private:
+  /**
+   * Read until a valid response with @p command_id arrives or
+   * @p timeout_ms passes; other frames and garbage are skipped.
+   */
+  bool wait_response(std::uint8_t command_id, int timeout_ms);
+
+  /// recv() with the frame due by @p deadline.
+  bool recv(std::uint8_t *command_id, void *payload, std::uint8_t max_size,
+            std::uint8_t *recv_size,
+            std::chrono::steady_clock::time_point deadline);
+
+  /// Read exactly @p count bytes unless @p deadline passes first.
+  bool read_until(std::uint8_t *buffer, std::size_t count,
+                  std::chrono::steady_clock::time_point deadline);
+
   SerialStream stream_;
+  int reply_timeout_ms_; ///< Deadline of recv() and waitFor()
 };
 
 }
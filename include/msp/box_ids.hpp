@@ -2,6 +2,7 @@
 #define BOX_IDS_HPP
 
 #include <cstdint>
+#include <ostream>
 
 namespace msp {
 
@@ -70,7 +71,7 @@ enum BoxId : std::uint8_t {
   CHECKBOX_ITEM_COUNT
 };
 
-;
+static_assert(CHECKBOX_ITEM_COUNT <= 64, "ActiveModes holds one bit per box");
 
 /**
  * @brief Get the name of a box ID.
@@ -178,6 +179,174 @@ inline const char *getBoxName(BoxId boxId) {
   }
 }
 
+/**
+ * @brief Betaflight's permanent ID of a box (msp_box.c), the value MSP_BOXIDS
+ * reports for it; unlike BoxId it never changes between firmware versions.
+ *
+ * @return 255 for CHECKBOX_ITEM_COUNT and unknown values.
+ */
+constexpr std::uint8_t getBoxPermanentId(BoxId boxId) {
+  switch (boxId) {
+  case BOXARM: return 0;
+  case BOXANGLE: return 1;
+  case BOXHORIZON: return 2;
+  case BOXALTHOLD: return 3;
+  case BOXANTIGRAVITY: return 4;
+  case BOXMAG: return 5;
+  case BOXHEADFREE: return 6;
+  case BOXHEADADJ: return 7;
+  case BOXCAMSTAB: return 8;
+  case BOXPOSHOLD: return 11;
+  case BOXPASSTHRU: return 12;
+  case BOXBEEPERON: return 13;
+  case BOXLEDLOW: return 15;
+  case BOXCALIB: return 17;
+  case BOXOSD: return 19;
+  case BOXTELEMETRY: return 20;
+  case BOXSERVO1: return 23;
+  case BOXSERVO2: return 24;
+  case BOXSERVO3: return 25;
+  case BOXBLACKBOX: return 26;
+  case BOXFAILSAFE: return 27;
+  case BOXAIRMODE: return 28;
+  case BOX3D: return 29;
+  case BOXFPVANGLEMIX: return 30;
+  case BOXBLACKBOXERASE: return 31;
+  case BOXCAMERA1: return 32;
+  case BOXCAMERA2: return 33;
+  case BOXCAMERA3: return 34;
+  case BOXCRASHFLIP: return 35;
+  case BOXPREARM: return 36;
+  case BOXBEEPGPSCOUNT: return 37;
+  case BOXVTXPITMODE: return 39;
+  case BOXUSER1: return 40;
+  case BOXUSER2: return 41;
+  case BOXUSER3: return 42;
+  case BOXUSER4: return 43;
+  case BOXPIDAUDIO: return 44;
+  case BOXPARALYZE: return 45;
+  case BOXGPSRESCUE: return 46;
+  case BOXACROTRAINER: return 47;
+  case BOXVTXCONTROLDISABLE: return 48;
+  case BOXLAUNCHCONTROL: return 49;
+  case BOXMSPOVERRIDE: return 50;
+  case BOXSTICKCOMMANDDISABLE: return 51;
+  case BOXBEEPERMUTE: return 52;
+  case BOXREADY: return 53;
+  case BOXLAPTIMERRESET: return 54;
+  case BOXCHIRP: return 55;
+  case CHECKBOX_ITEM_COUNT: break;
+  }
+  return 255;
+}
+
+/**
+ * @brief Box with the given permanent ID.
+ *
+ * @return CHECKBOX_ITEM_COUNT if no box has @p permanentId.
+ */
+constexpr BoxId getBoxByPermanentId(std::uint8_t permanentId) {
+  for (int box = 0; box < CHECKBOX_ITEM_COUNT; ++box) {
+    if (getBoxPermanentId(static_cast<BoxId>(box)) == permanentId)
+      return static_cast<BoxId>(box);
+  }
+  return CHECKBOX_ITEM_COUNT;
+}
+
+/**
+ * @brief Set of active flight modes, one bit per BoxId.
+ */
+struct ActiveModes {
+  std::uint64_t bits = 0;
+
+  [[nodiscard]] constexpr bool has(BoxId boxId) const noexcept {
+    return (bits >> boxId) & 1u;
+  }
+
+  friend constexpr bool operator==(ActiveModes a, ActiveModes b) noexcept {
+    return a.bits == b.bits;
+  }
+  friend constexpr bool operator!=(ActiveModes a, ActiveModes b) noexcept {
+    return a.bits != b.bits;
+  }
+
+  friend std::ostream &operator<<(std::ostream &os, ActiveModes modes) {
+    bool first = true;
+    for (int box = 0; box < CHECKBOX_ITEM_COUNT; ++box) {
+      if (modes.has(static_cast<BoxId>(box))) {
+        if (!first)
+          os << ", ";
+        os << getBoxName(static_cast<BoxId>(box));
+        first = false;
+      }
+    }
+    if (first)
+      os << "none";
+    return os;
+  }
+};
+
+/**
+ * @brief Meaning of the flight-mode flag bits of MSP_STATUS, from the
+ * MSP_BOXIDS reply.
+ *
+ * Firmware reports only the boxes it was built with, in its own order, and
+ * flag bit i belongs to the i-th box of that list rather than to BoxId i.
+ * The map is built once per connection; translate() then turns flags into
+ * ActiveModes with one table lookup per set bit.
+ */
+class BoxIdMap {
+public:
+  /// Empty map: every flag translates to no mode.
+  BoxIdMap() = default;
+
+  /**
+   * @param permanentIds MSP_BOXIDS payload, one permanent ID per box.
+   * @param count        Payload size; boxes past the 64th are ignored.
+   */
+  BoxIdMap(const std::uint8_t *permanentIds, std::uint8_t count) {
+    size_ = count < 64 ? count : 64;
+    for (std::uint8_t i = 0; i < size_; ++i) {
+      const BoxId box = getBoxByPermanentId(permanentIds[i]);
+      boxes_[i] = box;
+      if (box != CHECKBOX_ITEM_COUNT) {
+        box_bits_[i] = std::uint64_t{1} << box;
+        supported_.bits |= box_bits_[i];
+      }
+    }
+  }
+
+  /**
+   * @brief Active modes given the flight-mode flags of MSP_STATUS
+   * (StatusData::mode_flags). Bits of unknown boxes are dropped.
+   */
+  [[nodiscard]] ActiveModes translate(std::uint64_t modeFlags) const noexcept {
+    ActiveModes modes;
+    for (; modeFlags != 0; modeFlags &= modeFlags - 1) {
+      const int bit = __builtin_ctzll(modeFlags);
+      if (bit < size_)
+        modes.bits |= box_bits_[bit];
+    }
+    return modes;
+  }
+
+  /// Box of flag bit @p bit; CHECKBOX_ITEM_COUNT if unknown or out of range.
+  [[nodiscard]] BoxId box_at(std::uint8_t bit) const noexcept {
+    return bit < size_ ? boxes_[bit] : CHECKBOX_ITEM_COUNT;
+  }
+
+  /// Boxes the firmware reported.
+  [[nodiscard]] ActiveModes supported() const noexcept { return supported_; }
+
+  [[nodiscard]] std::uint8_t size() const noexcept { return size_; }
+
+private:
+  std::uint64_t box_bits_[64] = {};
+  BoxId boxes_[64] = {};
+  ActiveModes supported_;
+  std::uint8_t size_ = 0;
+};
+
 } // namespace msp
 
 #endif // !BOX_IDS_HPP
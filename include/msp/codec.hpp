@@ -0,0 +1,72 @@
+#ifndef CODEC_HPP
+#define CODEC_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+#include "bitaflught_msp.hpp"
+#include "msp.hpp"
+
+namespace msp {
+
+/// '$' 'M' <direction> <size> <command_id> ... <checksum>
+static constexpr std::size_t FRAME_OVERHEAD = 6;
+static constexpr std::size_t MAX_FRAME_SIZE = FRAME_OVERHEAD + 255;
+static constexpr std::uint8_t SET_RAW_RC_PAYLOAD_SIZE = 16;
+
+/**
+ * @brief One MSP v1 frame located in a caller-owned buffer.
+ *
+ * @p payload points into the buffer passed to decode_frame(); nothing is
+ * copied.
+ */
+struct FrameView {
+  CommandType command_type;
+  std::uint8_t command_id;
+  std::uint8_t size;
+  const std::uint8_t *payload;
+};
+
+enum class DecodeStatus : std::uint8_t {
+  Ok,          ///< A whole frame with a valid checksum was decoded.
+  Incomplete,  ///< The buffer ends before the frame does.
+  BadHeader,   ///< The buffer does not start with '$' 'M' '<'|'>'|'!'.
+  BadChecksum, ///< The frame is complete but its checksum does not match.
+};
+
+/**
+ * @brief Serialise an MSP v1 frame into @p out.
+ *
+ * Layout: `'$' 'M' <direction> <size> <command_id> <payload> <checksum>`,
+ * where the checksum is the XOR of size, command_id and every payload byte.
+ *
+ * @param out Destination, valid for FRAME_OVERHEAD + @p size bytes.
+ * @return Number of bytes written (FRAME_OVERHEAD + @p size).
+ */
+std::size_t encode_frame(CommandType command_type, std::uint8_t command_id,
+                         const void *payload, std::uint8_t size,
+                         std::uint8_t *out) noexcept;
+
+/**
+ * @brief Parse the MSP v1 frame at the start of @p data.
+ *
+ * @param data      Received bytes.
+ * @param available Number of valid bytes in @p data.
+ * @param frame     Filled when the result is DecodeStatus::Ok.
+ * @param consumed  Bytes the frame occupies (set for Ok and BadChecksum, so
+ *                  the caller can skip it; 0 otherwise).
+ */
+DecodeStatus decode_frame(const std::uint8_t *data, std::size_t available,
+                          FrameView *frame, std::size_t *consumed) noexcept;
+
+/**
+ * @brief MSP_SET_RAW_RC payload: eight little-endian uint16 channels in
+ * Channels order.
+ *
+ * @param out Destination, valid for SET_RAW_RC_PAYLOAD_SIZE bytes.
+ */
+void encode_set_raw_rc(const Channels &channels, std::uint8_t *out) noexcept;
+
+} // namespace msp
+
+#endif // !CODEC_HPP
@@ -0,0 +1,129 @@
+/**
+ * @file mode_monitor.hpp
+ * @brief Background MSP_STATUS polling that keeps the active flight modes at
+ * hand for the control loop
+ */
+
+#ifndef MODE_MONITOR_HPP
+#define MODE_MONITOR_HPP
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+#include "box_ids.hpp"
+#include "msp.hpp"
+
+namespace msp {
+
+/**
+ * @class ModeMonitor
+ * @brief Polls MSP_STATUS on its own thread and caches the decoded modes.
+ *
+ * The box layout is fetched once with MSP_BOXIDS; every poll after that is
+ * one MSP_STATUS transaction and a bit permutation. Readers load a single
+ * atomic word, so gating on a mode (armed? MSP override?) costs the control
+ * loop nothing. A change of modes is reported to the listener from the
+ * monitor thread.
+ *
+ * Polls that keep failing mean the flight controller stopped answering:
+ * after @c lost_after of them in a row the link is reported lost, and the
+ * next successful poll reports it restored. modes() keeps the last known
+ * modes meanwhile, so check link_lost() before trusting them.
+ */
+class ModeMonitor {
+public:
+  /// Called with the previous and the new modes whenever they differ.
+  using Listener = std::function<void(ActiveModes previous, ActiveModes current)>;
+
+  enum class LinkEvent : std::uint8_t { Lost, Restored };
+
+  /// Called when the link is lost or comes back.
+  using LinkListener = std::function<void(LinkEvent event)>;
+
+  ModeMonitor() = delete;
+
+  /**
+   * @brief Fetch the box layout and the current modes, then start polling.
+   *
+   * @param msp      Link to poll; must outlive the monitor. Other threads may
+   *                 keep using it, the transactions are serialised.
+   * @param listener Optional change callback, run on the monitor thread.
+   * @param period   Time between polls.
+   * @param link_listener Optional link-lost/restored callback, run on the
+   *                 monitor thread.
+   * @param lost_after Consecutive failed polls that make the link lost.
+   *
+   * @throws std::runtime_error if MSP_BOXIDS or the first MSP_STATUS fails.
+   */
+  explicit ModeMonitor(Msp &msp, Listener listener = {},
+                       std::chrono::milliseconds period =
+                           std::chrono::milliseconds(200),
+                       LinkListener link_listener = {},
+                       unsigned lost_after = 3);
+
+  ModeMonitor(const ModeMonitor &) = delete;
+  ModeMonitor &operator=(const ModeMonitor &) = delete;
+
+  /**
+   * @brief Stop the monitor thread; a poll in flight is finished first.
+   */
+  ~ModeMonitor() noexcept;
+
+  /// Modes as of the last successful poll.
+  [[nodiscard]] ActiveModes modes() const noexcept {
+    return ActiveModes{modes_.load(std::memory_order_relaxed)};
+  }
+
+  [[nodiscard]] bool active(BoxId boxId) const noexcept {
+    return modes().has(boxId);
+  }
+
+  /// Boxes the flight controller offers.
+  [[nodiscard]] ActiveModes supported() const noexcept {
+    return box_ids_.supported();
+  }
+
+  /// steady_clock time of the last successful poll.
+  [[nodiscard]] std::chrono::steady_clock::time_point updated() const noexcept;
+
+  /// Polls that failed since construction.
+  [[nodiscard]] std::uint64_t failures() const noexcept {
+    return failures_.load(std::memory_order_relaxed);
+  }
+
+  /// True from the LinkEvent::Lost report until the next successful poll.
+  [[nodiscard]] bool link_lost() const noexcept {
+    return link_lost_.load(std::memory_order_relaxed);
+  }
+
+private:
+  void run();
+  void poll();
+
+  Msp &msp_;
+  const BoxIdMap &box_ids_;
+  Listener listener_;
+  std::chrono::milliseconds period_;
+  LinkListener link_listener_;
+  unsigned lost_after_;
+  unsigned consecutive_failures_ = 0; ///< Monitor thread only
+
+  std::atomic<std::uint64_t> modes_{0};
+  std::atomic<std::chrono::steady_clock::rep> updated_{0};
+  std::atomic<std::uint64_t> failures_{0};
+  std::atomic<bool> link_lost_{false};
+
+  std::mutex mutex_;
+  std::condition_variable wake_;
+  bool stop_ = false;
+  std::thread thread_;
+};
+
+} // namespace msp
+
+#endif // !MODE_MONITOR_HPP
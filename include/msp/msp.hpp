@@ -3,15 +3,18 @@
 
 #include <cstdint>
 #include <iostream>
+#include <memory>
+#include <mutex>
 #include <stdexcept>
 #include <string>
-#include <termios.h>
 
 #include "bitaflught_msp.hpp"
 #include "box_ids.hpp"
 
 namespace msp {
 
+class MspProxy;
+
 /**
  * @brief MSP command identifiers for Betaflight/Cleanflight protocol.
  *
@@ -24,6 +27,7 @@ enum MspCommand : std::uint8_t {
   MSP_RC = 105,
   MSP_ATTITUDE = 108,
   MSP_ALTITUDE = 109,
+  MSP_BOXIDS = 119,
   MSP_SET_RAW_RC = 200,
 };
 
@@ -124,6 +128,9 @@ struct StatusData {
   std::uint32_t flight_mode_flags; ///< Flight mode flags (first 32 bits).
   std::uint8_t pid_profile;        ///< Current PID profile index.
   std::uint16_t system_load;       ///< Average system load percentage.
+  /// Flight mode flags including the extension bytes (first 64 bits). Bit i
+  /// is the i-th box of MSP_BOXIDS, not BoxId i: decode with BoxIdMap.
+  std::uint64_t mode_flags;
 
   StatusData(std::uint8_t recv_size, std::uint8_t *payload) {
     if (recv_size >= 13) {
@@ -140,6 +147,15 @@ struct StatusData {
                                std::to_string(recv_size) +
                                " (expected >= 13)\n");
     }
+
+    // Betaflight follows with 2 bytes, a count of extra flag bytes and the
+    // bytes themselves
+    mode_flags = flight_mode_flags;
+    if (recv_size >= 16) {
+      const std::uint8_t extra = payload[15] & 0x0F;
+      for (std::uint8_t i = 0; i < extra && i < 4 && 16 + i < recv_size; ++i)
+        mode_flags |= static_cast<std::uint64_t>(payload[16 + i]) << (32 + 8 * i);
+    }
   }
 
   friend std::ostream &operator<<(std::ostream &os, const StatusData &status) {
@@ -149,20 +165,8 @@ struct StatusData {
        << ", pid_profile=" << static_cast<int>(status.pid_profile)
        << ", system_load=" << status.system_load << "%\n";
 
-    os << "Active flight modes: ";
-    bool first = true;
-    for (int i = 0; i < 32; i++) {
-      if (status.flight_mode_flags & (1u << i)) {
-        if (!first) {
-          os << ", ";
-        }
-        os << getBoxName(static_cast<BoxId>(i));
-        first = false;
-      }
-    }
-    if (first) {
-      os << "none";
-    }
+    // Names need the MSP_BOXIDS order, see Msp::activeModes()
+    os << "Flight mode flags: 0x" << std::hex << status.mode_flags << std::dec;
     return os;
   }
 };
@@ -233,7 +237,8 @@ struct AttitudeData {
  *
  * Operations use the underlying serial stream configured at construction time.
  * Methods throw std::runtime_error when the flight controller does not respond
- * or returns invalid data.
+ * or returns invalid data. Methods may be called from several threads; each
+ * transaction holds the link until its reply arrives.
  */
 class Msp {
 public:
@@ -246,14 +251,29 @@ public:
    * ready for MSP I/O.
    *
    * @param dev       Serial device path (e.g., "/dev/ttyUSB0", "/dev/serial0").
-   * @param baud_rate Termios baud constant (e.g., B115200).
+   * @param baud_rate Baud rate in bits per second, or AUTO_BAUD_RATE to probe
+   *                  for the fastest rate the flight controller answers at.
    * @param timeout   Read timeout (VTIME, in deciseconds).
    *
    * @throws std::system_error if the serial stream cannot be opened/configured.
+   * @throws std::runtime_error if AUTO_BAUD_RATE finds no working rate.
    */
   explicit Msp(const char *dev = DEFAULT_SERIAL_DEVICE,
-               speed_t baud_rate = DEFAULT_BAUD_RATE,
-               cc_t timeout = DEFAULT_TIMEOUT);
+               std::uint32_t baud_rate = DEFAULT_BAUD_RATE,
+               std::uint8_t timeout = DEFAULT_TIMEOUT);
+
+  /**
+   * @brief Construct an MSP client that goes through @p proxy with control
+   * priority instead of owning the serial device.
+   *
+   * @p proxy must outlive the client.
+   */
+  explicit Msp(MspProxy &proxy);
+
+  ~Msp();
+
+  /// Baud rate of the serial link (the probed one for AUTO_BAUD_RATE).
+  [[nodiscard]] std::uint32_t baud_rate() const noexcept;
 
   /**
    * @brief Request flight controller status information.
@@ -323,8 +343,40 @@ public:
    */
   void setRawRc(const SetRawRcData &data);
 
+  /**
+   * @brief Flight-mode layout of this flight controller.
+   *
+   * Sends MSP_BOXIDS on the first call and returns the cached map afterwards;
+   * the layout only changes with the firmware. After a failure the next call
+   * asks again.
+   *
+   * @throws std::runtime_error if the request fails or times out.
+   */
+  [[nodiscard]] const BoxIdMap &boxIds();
+
+  /**
+   * @brief Request MSP_STATUS and decode its flags with boxIds().
+   *
+   * @throws std::runtime_error if either request fails or times out.
+   */
+  [[nodiscard]] ActiveModes activeModes();
+
 private:
-  BitaflughtMsp bitaflught_msp_;
+  bool request(std::uint8_t command_id, void *payload, std::uint8_t max_size,
+               std::uint8_t *recv_size);
+  bool command(std::uint8_t command_id, void *payload, std::uint8_t size);
+
+  std::unique_ptr<BitaflughtMsp> bitaflught_msp_; ///< Null when proxied
+  MspProxy *proxy_ = nullptr;
+  /// Serialises transactions on bitaflught_msp_ (the proxy does its own),
+  /// so a ModeMonitor can poll from its thread
+  std::mutex mutex_;
+  /// Guards the boxIds() cache. Not std::call_once: with libstdc++ on
+  /// aarch64 a throwing initialiser can leave the flag stuck (GCC PR 66146),
+  /// and a failed MSP_BOXIDS has to be retried.
+  std::mutex box_ids_mutex_;
+  bool box_ids_loaded_ = false;
+  BoxIdMap box_ids_;
 };
 
 }
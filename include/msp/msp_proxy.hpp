@@ -0,0 +1,197 @@
+/**
+ * @file msp_proxy.hpp
+ * @brief Shares one flight-controller link between the control loop and
+ * local MSP clients
+ */
+
+#ifndef MSP_PROXY_HPP
+#define MSP_PROXY_HPP
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "bitaflught_msp.hpp"
+#include "codec.hpp"
+#include "serial_stream.hpp"
+
+namespace msp {
+
+static constexpr char DEFAULT_PROXY_SOCKET[] = "/tmp/poshold_msp.sock";
+
+struct ProxyOptions {
+  /// UNIX socket clients connect to; empty disables client access.
+  std::string socket_path = DEFAULT_PROXY_SOCKET;
+  /// Clients served at once; further connections wait in the backlog.
+  std::size_t max_clients = 4;
+  /// Requests a client may have queued; its socket is not read beyond that.
+  std::size_t max_client_pending = 8;
+  /// A client request without a reply after this long is answered with an
+  /// MSP error frame.
+  int client_timeout_ms = 100;
+  /// Answer client MSP_SET_RAW_RC with an error frame instead of letting it
+  /// fight the control loop's sticks.
+  bool reject_client_rc = true;
+};
+
+struct ProxyStats {
+  std::uint64_t control_transactions; ///< Control requests answered.
+  std::uint64_t client_transactions;  ///< Client requests answered.
+  std::uint64_t timeouts;             ///< Requests the FC did not answer.
+  std::uint64_t rejected;             ///< Client requests refused.
+  std::uint64_t unsolicited;          ///< FC frames matching no request.
+  std::uint64_t clients_dropped;      ///< Clients closed for not reading.
+  std::uint64_t posts_dropped;        ///< Posts refused with the queue full.
+};
+
+/**
+ * @class MspProxy
+ * @brief Owns the serial link and multiplexes it between the control loop
+ * and clients on a local UNIX socket.
+ *
+ * A link thread performs all serial and socket I/O from one poll() loop and
+ * keeps a single MSP v1 transaction on the wire at a time, so every reply is
+ * routed to whoever sent the request it answers. Queued control requests
+ * (request(), post()) always go next; client requests only use the link when
+ * no control request is waiting, so a client delays the control loop by at
+ * most the one transaction already in flight. Clients take turns in round
+ * robin.
+ *
+ * Clients speak plain MSP v1 over the socket, e.g. a configurator bridged
+ * with `socat pty,link=/tmp/ttyFC,raw unix-connect:/tmp/poshold_msp.sock`.
+ * Bytes that do not form MSP v1 request frames (including MSP v2) are
+ * skipped.
+ */
+class MspProxy {
+public:
+  MspProxy() = delete;
+
+  /**
+   * @brief Open the serial link, bind the client socket and start the link
+   * thread.
+   *
+   * @param dev       Serial device path (e.g., "/dev/serial0").
+   * @param baud_rate Baud rate in bits per second.
+   *
+   * @throws std::system_error if the device cannot be configured or the
+   * socket cannot be created, bound or listened on. A stale socket file at
+   * options.socket_path is replaced.
+   */
+  explicit MspProxy(const char *dev = DEFAULT_SERIAL_DEVICE,
+                    std::uint32_t baud_rate = DEFAULT_BAUD_RATE,
+                    ProxyOptions options = {});
+
+  MspProxy(const MspProxy &) = delete;
+  MspProxy &operator=(const MspProxy &) = delete;
+
+  /**
+   * @brief Stop the link thread, close every client and remove the socket.
+   */
+  ~MspProxy() noexcept;
+
+  /**
+   * @brief Send a request with control priority and wait for its reply.
+   *
+   * Behavior:
+   * - Queues the frame ahead of every client request.
+   * - Blocks until the FC answers or @p timeout_ms passes from the moment the
+   *   frame was written.
+   * - Copies up to @p max_size payload bytes of the reply into @p response.
+   *
+   * @param response  Reply payload (may be nullptr when @p max_size == 0).
+   * @param recv_size If not null, receives the reply's payload size.
+   * @return false on timeout or when the FC answered with an error frame.
+   */
+  bool request(std::uint8_t command_id, const void *payload,
+               std::uint8_t size, void *response, std::uint8_t max_size,
+               std::uint8_t *recv_size = nullptr, int timeout_ms = 50);
+
+  /**
+   * @brief Queue a request with control priority and return immediately; the
+   * reply is discarded.
+   *
+   * A post that is still queued is overwritten by a later one with the same
+   * @p command_id, so a slow link sends only the latest MSP_SET_RAW_RC rather
+   * than a backlog of stale sticks. Never allocates.
+   */
+  void post(std::uint8_t command_id, const void *payload, std::uint8_t size);
+
+  [[nodiscard]] std::uint32_t baud_rate() const noexcept;
+
+  [[nodiscard]] ProxyStats stats() const;
+
+private:
+  struct ControlRequest {
+    std::uint8_t command_id = 0;
+    std::uint8_t size = 0;
+    std::uint8_t payload[255];
+    bool waiting = false; ///< A caller blocks in request() on this one.
+    bool queued = false;  ///< Post slot in use until the link sends it.
+    int timeout_ms = 0;
+    // Completion, filled by the link thread
+    bool done = false;
+    bool ok = false;
+    std::uint8_t response_size = 0;
+    std::uint8_t response[255];
+  };
+
+  struct Client {
+    int fd = -1;
+    std::vector<std::uint8_t> rx;
+    std::deque<std::vector<std::uint8_t>> pending; ///< Whole request frames
+    bool broken = false; ///< A reply could not be sent; closed after the pass
+  };
+
+  enum class Owner : std::uint8_t { None, Control, Client };
+
+  static constexpr std::size_t MAX_POSTS = 8;
+  static constexpr std::size_t MAX_CONTROL_QUEUE = 16;
+
+  void run();
+  void accept_clients();
+  bool read_client(Client &client);
+  void reply_to_client(int fd, CommandType command_type, std::uint8_t command_id,
+                       const std::uint8_t *payload, std::uint8_t size);
+  void start_next();
+  void read_link();
+  /// Finish the transaction in flight; @p reply is null on timeout.
+  void complete(const FrameView *reply);
+  void close_client(std::size_t index);
+  void wake() noexcept;
+
+  ProxyOptions options_;
+  SerialStream link_;
+  int listen_fd_ = -1;
+  int wake_fd_ = -1;
+
+  // Shared with the control threads
+  mutable std::mutex mutex_;
+  std::condition_variable done_;
+  ControlRequest *control_queue_[MAX_CONTROL_QUEUE] = {};
+  std::size_t control_count_ = 0;
+  ControlRequest posts_[MAX_POSTS];
+  bool stop_ = false;
+  ProxyStats stats_ = {};
+
+  // Link thread only
+  std::vector<Client> clients_;
+  std::size_t next_client_ = 0;
+  std::vector<std::uint8_t> link_rx_;
+  Owner owner_ = Owner::None;
+  ControlRequest *in_flight_control_ = nullptr;
+  int in_flight_client_fd_ = -1;
+  std::uint8_t in_flight_command_ = 0;
+  std::chrono::steady_clock::time_point deadline_;
+
+  std::thread thread_;
+};
+
+} // namespace msp
+
+#endif // !MSP_PROXY_HPP
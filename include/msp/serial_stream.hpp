@@ -3,21 +3,19 @@
 
 #include <cstddef>
 #include <cstdint>
-// for Linux
-#include <termios.h>
 
 namespace msp {
 
 static constexpr std::uint32_t DEFAULT_BAUD_RATE = 115200;
 static constexpr char DEFAULT_SERIAL_DEVICE[] = "/dev/serial0";
-static constexpr cc_t DEFAULT_TIMEOUT = 2; // 0.2 seconds
+static constexpr std::uint8_t DEFAULT_TIMEOUT = 2; // 0.2 seconds
 
 /**
  * @brief RAII wrapper for a POSIX serial port.
  *
  * Opens a device path and configures it for raw 8N1 (non-canonical, no
- * echo/flow control), providing binary-clean read/write and a tcdrain()-based
- * flush. Operations throw std::system_error on failure (preserving errno). On
+ * echo/flow control) at any baud rate the UART can generate, providing
+ * binary-clean read/write and a drain-based flush. Operations throw std::system_error on failure (preserving errno). On
  * destruction, pending output is drained and the file descriptor is closed;
  * destructor errors are ignored.
  */
@@ -33,22 +31,31 @@ public:
    * - Disables input special handling; disables output post-processing.
    * - Sets 8 data bits, no parity, 1 stop bit;
    * - Non-canonical mode; raw I/O.
-   * - Read control: VMIN=1; VTIME=@p timeout (deciseconds).
-   *   * timeout==0 -> block until >= 1 byte;
-   *   * timeout>0  -> block until >= 1 byte or timeout;
-   * timeout.
-   * - Sets both I/O baud to @p baud_rate; flushes I/O with tcflush(TCIOFLUSH).
+   * - Read control: VMIN=@p min_bytes; VTIME=@p timeout (deciseconds).
+   *   * timeout==0 -> block until >= min_bytes bytes;
+   *   * timeout>0  -> block until >= min_bytes bytes or timeout since the
+   *     last byte (since the call when min_bytes==0).
+   * - Sets both I/O baud to @p baud_rate through termios2/BOTHER, so
+   *   non-standard rates (921600, 1000000, 2000000, ...) work on UARTs whose
+   *   clock can produce them.
+   * - Requests ASYNC_LOW_LATENCY from the driver (see low_latency()).
+   * - Flushes I/O.
    *
    * @param dev       Serial device path (e.g., "/dev/ttyUSB0", "/dev/serial0").
-   * @param baud_rate Termios baud constant (e.g., B115200).
+   * @param baud_rate Baud rate in bits per second (e.g., 115200, 921600).
    * @param timeout   VTIME in deciseconds (see behavior above).
+   * @param min_bytes VMIN (see behavior above).
    *
    * @throws std::system_error with original errno on failure to open or
-   * configure the device.
+   * configure the device, including a rate the driver rejects.
    */
   explicit SerialStream(const char *dev = DEFAULT_SERIAL_DEVICE,
-                        speed_t baud_rate = DEFAULT_BAUD_RATE,
-                        cc_t timeout = DEFAULT_TIMEOUT);
+                        std::uint32_t baud_rate = DEFAULT_BAUD_RATE,
+                        std::uint8_t timeout = DEFAULT_TIMEOUT,
+                        std::uint8_t min_bytes = 1);
+
+  SerialStream(const SerialStream &) = delete;
+  SerialStream &operator=(const SerialStream &) = delete;
 
   /**
    * @brief Flush pending output and close the serial file descriptor.
@@ -118,8 +125,68 @@ public:
    */
   size_t available();
 
+  /**
+   * @brief Wait until at least one byte is readable.
+   *
+   * Behavior:
+   * - ::poll()s the descriptor for input, independently of VMIN/VTIME.
+   * - Retries on EINTR with the remaining time.
+   *
+   * @param timeout_ms Longest wait in milliseconds (0 = just check).
+   * @return true if input is pending, false on timeout.
+   * @throws std::system_error if ::poll() fails (preserves errno).
+   */
+  bool wait_readable(int timeout_ms);
+
+  /**
+   * @brief Drop received bytes not yet read.
+   *
+   * @throws std::system_error if the flush fails (preserves errno).
+   */
+  void discard_input();
+
+  /**
+   * @brief Change the I/O baud rate of the open port.
+   *
+   * Pending output is drained first; unread input is discarded, since bytes
+   * received around the switch are framed at the wrong rate.
+   *
+   * @param baud_rate Baud rate in bits per second.
+   * @throws std::system_error if the driver rejects the rate (preserves
+   * errno); the previous rate stays in effect.
+   */
+  void set_baud_rate(std::uint32_t baud_rate);
+
+  /// Baud rate the driver reported back after the last change.
+  [[nodiscard]] std::uint32_t baud_rate() const noexcept;
+
+  /**
+   * @brief Change VMIN/VTIME of the open port (see the constructor).
+   *
+   * @throws std::system_error on failure (preserves errno).
+   */
+  void set_read_timing(std::uint8_t min_bytes, std::uint8_t timeout);
+
+  /**
+   * @brief Whether the driver accepted ASYNC_LOW_LATENCY.
+   *
+   * USB adapters then flush received bytes to user space immediately instead
+   * of after their latency timer (16 ms on FTDI); on-board UARTs that do not
+   * implement the serial ioctls report false and behave as before.
+   */
+  [[nodiscard]] bool low_latency() const noexcept;
+
+  /**
+   * @brief File descriptor of the device, for poll()-based event loops.
+   *
+   * The stream keeps ownership; do not close it or change its attributes.
+   */
+  [[nodiscard]] int native_handle() const noexcept;
+
 private:
   int serial_fd_;
+  std::uint32_t baud_rate_ = 0;
+  bool low_latency_ = false;
 };
 
 } // namespace msp
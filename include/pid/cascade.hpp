@@ -0,0 +1,152 @@
+/**
+ * @file cascade.hpp
+ * @brief Cascaded position -> velocity controller for position hold
+ */
+
+#ifndef CASCADE_HPP
+#define CASCADE_HPP
+
+#include <chrono>
+
+#include "pid/simd.hpp"
+#include "utils.hpp"
+
+/**
+ * @brief Gains and limits of one CascadeController stage (both axes)
+ */
+struct CascadeStageConfig {
+  float k_p = 0.0f;  ///< Proportional gain
+  float k_i = 0.0f;  ///< Integral gain
+  float k_d = 0.0f;  ///< Derivative gain
+  float k_df = 0.0f; ///< Derivative filter coefficient (0-1)
+
+  float integral_limit = 100.0f; ///< Symmetric anti-windup bound
+  float output_limit = 500.0f;   ///< Symmetric bound of the stage output
+};
+
+/**
+ * @brief Reference trajectory for CascadeController
+ */
+struct CascadeSetpoint {
+  simd::Vec2f position{0.0f, 0.0f};     ///< Desired [x, y]
+  simd::Vec2f velocity{0.0f, 0.0f};     ///< Feed-forward added to the
+                                        ///< velocity setpoint
+  simd::Vec2f acceleration{0.0f, 0.0f}; ///< Feed-forward added to the
+                                        ///< inner output (scaled by k_ff)
+};
+
+/**
+ * @class CascadeController
+ * @brief Outer position loop feeding an inner velocity loop, roll/pitch PWM out
+ *
+ * Follows PidController's formulation (derivative on measurement with a
+ * low-pass filter, clamped integral, PWM around 1500 clamped to 1000-2000)
+ * but keeps all state as structure-of-arrays: each parameter and state
+ * variable is one 4-lane vector laid out as [outer x, outer y, inner x,
+ * inner y], so both stages are evaluated in a single SIMD pass. It does not
+ * hold PidController instances: those always map their output to PWM and use
+ * fixed limits, while the outer stage has to output a velocity in m/s with
+ * its own output and integral bounds.
+ *
+ * The inner (velocity) loop runs on every call, i.e. at the caller's rate;
+ * the outer (position) loop only runs once @c outer_period has elapsed and
+ * its velocity setpoint is held in between. Lanes of a stage that is not due
+ * keep their state untouched. The inner loop always tracks the most recent
+ * outer output, so when both run in the same call the inner one sees the
+ * previous outer step.
+ *
+ * The outer derivative uses the measured velocity directly instead of
+ * differencing positions.
+ */
+class CascadeController {
+public:
+  /**
+   * @brief Default constructor
+   */
+  CascadeController() = default;
+
+  /**
+   * @brief Construct a cascaded controller
+   *
+   * @param position_stage Outer loop; output is a velocity setpoint
+   * @param velocity_stage Inner loop; output is a PWM offset from 1500
+   * @param outer_period   Minimum seconds between outer loop updates
+   * (0 = every call)
+   * @param k_ff           Gain from CascadeSetpoint::acceleration to PWM
+   * @param clock          Time source when no sample time is given; defaults
+   * to std::chrono::steady_clock
+   */
+  CascadeController(const CascadeStageConfig &position_stage,
+                    const CascadeStageConfig &velocity_stage,
+                    float outer_period = 0.0f, float k_ff = 0.0f,
+                    utils::Clock clock = utils::steady_now);
+
+  /**
+   * @brief Run the inner loop (and the outer loop when due), timed by the
+   * controller's clock
+   *
+   * @param current_position Current position as [x, y]
+   * @param current_velocity Current velocity as [vx, vy]
+   * @param setpoint         Desired position and feed-forward terms
+   * @return simd::Vec2u roll and pitch
+   */
+  simd::Vec2u calculate_raw_rc(simd::Vec2f current_position,
+                               simd::Vec2f current_velocity,
+                               const CascadeSetpoint &setpoint = {});
+
+  /**
+   * @brief Run the inner loop (and the outer loop when due) for a sample
+   * taken at @p sample_time
+   *
+   * @param current_position Current position as [x, y]
+   * @param current_velocity Current velocity as [vx, vy]
+   * @param setpoint         Desired position and feed-forward terms
+   * @param sample_time      Time the measurement was taken
+   * @return simd::Vec2u roll and pitch
+   */
+  simd::Vec2u calculate_raw_rc(simd::Vec2f current_position,
+                               simd::Vec2f current_velocity,
+                               const CascadeSetpoint &setpoint,
+                               std::chrono::steady_clock::time_point sample_time);
+
+  /**
+   * @brief Velocity setpoint currently held from the outer loop
+   */
+  [[nodiscard]] simd::Vec2f velocity_setpoint() const;
+
+  /**
+   * @brief Clear integral, derivative and held outputs of both stages and
+   * restart both periods from the clock
+   */
+  void reset();
+
+private:
+  enum Lane : int { OUTER_X = 0, OUTER_Y, INNER_X, INNER_Y };
+
+  simd::f32x4 k_p_ = simd::dup4(0.0f);  ///< Proportional gains
+  simd::f32x4 k_i_ = simd::dup4(0.0f);  ///< Integral gains
+  simd::f32x4 k_d_ = simd::dup4(0.0f);  ///< Derivative gains
+  simd::f32x4 k_df_ = simd::dup4(0.0f); ///< Derivative filter coefficients
+
+  simd::f32x4 integral_min_ = simd::dup4(-100.0f); ///< Anti-windup minimum
+  simd::f32x4 integral_max_ = simd::dup4(100.0f);  ///< Anti-windup maximum
+  simd::f32x4 output_min_ = simd::dup4(-500.0f);   ///< Per-stage output minimum
+  simd::f32x4 output_max_ = simd::dup4(500.0f);    ///< Per-stage output maximum
+
+  float outer_period_ = 0.0f; ///< Seconds between outer loop updates
+  float k_ff_ = 0.0f;         ///< Acceleration feed-forward gain
+
+  utils::Clock clock_ = utils::steady_now; ///< Time source for dt
+
+  std::chrono::microseconds last_inner_time{}; ///< Last inner loop update
+  std::chrono::microseconds last_outer_time{}; ///< Last outer loop update
+
+  simd::f32x4 last_value_ =
+      simd::dup4(0.0f); ///< Previous measurement for derivative calculation
+  simd::f32x4 filtered_derivative_ =
+      simd::dup4(0.0f); ///< Low-pass filtered derivative term
+  simd::f32x4 integral_ = simd::dup4(0.0f); ///< Integral accumulator vector
+  simd::f32x4 output_ = simd::dup4(0.0f);   ///< Last output of every lane
+};
+
+#endif
@@ -6,17 +6,20 @@
 #ifndef PID_HPP
 #define PID_HPP
 
-#include <arm_neon.h>
 #include <chrono>
 
+#include "pid/simd.hpp"
+#include "utils.hpp"
+
 /**
  * @class PidController
  * @brief PID (Proportional-Integral-Derivative) controller for 2D position
  * control
  *
  * This controller calculates RC PWM values based on position error between
- * current and desired positions. It uses NEON SIMD instructions for efficient
- * computation and applies derivative filtering to reduce noise. The controller
+ * current and desired positions. Both axes are computed together through the
+ * simd.hpp layer (NEON, SSE2 or scalar, chosen at compile time, with
+ * bit-identical results) and derivative filtering is applied to reduce noise. The controller
  * includes anti-windup protection for the integral term.
  *
  * @note The derivative term is calculated on measurement (not error) to avoid
@@ -24,6 +27,16 @@
  */
 class PidController {
 public:
+  /**
+   * @brief Proportional, integral and derivative contributions (PWM offsets,
+   * before clamping) of the last calculate_raw_rc()
+   */
+  struct Terms {
+    simd::Vec2f p;
+    simd::Vec2f i;
+    simd::Vec2f d;
+  };
+
   /**
    * @brief Default constructor
    */
@@ -37,8 +50,11 @@ public:
    * @param k_d Derivative gain - dampens oscillations and improves stability
    * @param k_df Derivative filter coefficient (0-1) - smooths derivative term
    * to reduce noise
+   * @param clock Time source for dt when no sample time is given; defaults to
+   * std::chrono::steady_clock
    */
-  PidController(float k_p, float k_i, float k_d, float k_df);
+  PidController(float k_p, float k_i, float k_d, float k_df,
+                utils::Clock clock = utils::steady_now);
 
   /**
    * @brief Calculate raw RC PWM values from position error
@@ -47,35 +63,93 @@ public:
    * microseconds). The controller processes X and Y axes independently and
    * outputs 4-channel RC values.
    *
-   * @param current_position Current position as [x, y] in NEON float32x2_t
-   * format
+   * @param current_position Current position as [x, y]
    * @param desired_position Desired position as [x, y], defaults to origin [0,
    * 0]
-   * @return uint32x2_t roll and pitch
+   * @return simd::Vec2u roll and pitch
    */
-  uint32x2_t calculate_raw_rc(float32x2_t current_position,
-                              float32x2_t desired_position = vdup_n_f32(0.0f));
+  simd::Vec2u calculate_raw_rc(simd::Vec2f current_position,
+                               simd::Vec2f desired_position = {0.0f, 0.0f});
+
+  /**
+   * @brief Calculate raw RC PWM values from an estimated position and velocity
+   *
+   * Same as calculate_raw_rc(current_position, desired_position), but the
+   * derivative term uses @p current_velocity (e.g. from StateEstimator)
+   * instead of differentiating consecutive positions, so per-frame noise in
+   * the position does not reach the D term.
+   *
+   * @param current_position Current position as [x, y]
+   * @param current_velocity Current velocity as [vx, vy]
+   * @param desired_position Desired position as [x, y]
+   * @return simd::Vec2u roll and pitch
+   */
+  simd::Vec2u calculate_raw_rc(simd::Vec2f current_position,
+                               simd::Vec2f current_velocity,
+                               simd::Vec2f desired_position);
+
+  /**
+   * @brief Calculate raw RC PWM values for a sample taken at @p sample_time
+   *
+   * Same as calculate_raw_rc(current_position, current_velocity,
+   * desired_position), but dt is measured between sample timestamps (e.g.
+   * Drone::getFrameTimestamp()) rather than between calls, so dropped or
+   * late frames are integrated over their true interval.
+   *
+   * @param current_position Current position as [x, y]
+   * @param current_velocity Current velocity as [vx, vy]
+   * @param desired_position Desired position as [x, y]
+   * @param sample_time      Time the measurement was taken
+   * @return simd::Vec2u roll and pitch
+   */
+  simd::Vec2u calculate_raw_rc(simd::Vec2f current_position,
+                               simd::Vec2f current_velocity,
+                               simd::Vec2f desired_position,
+                               std::chrono::steady_clock::time_point sample_time);
+
+  /**
+   * @brief Terms of the last calculate_raw_rc(), zero before the first call
+   */
+  [[nodiscard]] Terms last_terms() const;
 
 private:
+  /**
+   * @brief Seconds elapsed from last_time to @p current_time; updates last_time
+   */
+  float elapsed_seconds(std::chrono::steady_clock::time_point current_time);
+
+  /**
+   * @brief Shared PID core: filters @p derivative_raw, integrates @p error
+   * and maps the sum of the terms to PWM
+   */
+  simd::Vec2u compute_output(simd::f32x2 error, simd::f32x2 derivative_raw,
+                             float dt_sec);
+
   float k_p_ = 0.0f;  ///< Proportional gain
   float k_i_ = 0.0f;  ///< Integral gain
   float k_d_ = 0.0f;  ///< Derivative gain
   float k_df_ = 0.0f; ///< Derivative filter coefficient (low-pass filter)
 
+  utils::Clock clock_ = utils::steady_now; ///< Time source for dt
+
   std::chrono::microseconds
       last_time; ///< Timestamp of last calculation for dt computation
 
-  float32x2_t last_value_ = {
-      0, 0}; ///< Previous position measurement for derivative calculation
-  float32x2_t filtered_derivative_ = {0,
-                                      0}; ///< Low-pass filtered derivative term
+  simd::f32x2 last_value_ = simd::dup(
+      0.0f); ///< Previous position measurement for derivative calculation
+  simd::f32x2 filtered_derivative_ =
+      simd::dup(0.0f); ///< Low-pass filtered derivative term
+
+  simd::f32x2 integral_ = simd::dup(0.0f); ///< Integral accumulator vector
 
-  float32x2_t integral_ = {0.0f, 0.0f}; ///< Integral accumulator vector
+  simd::f32x2 p_term_ = simd::dup(0.0f); ///< Last proportional term
+  simd::f32x2 i_term_ = simd::dup(0.0f); ///< Last integral term
+  simd::f32x2 d_term_ = simd::dup(0.0f); ///< Last derivative term
 
-  float32x2_t integral_min_ = {
-      -100.0f, -100.0f}; ///< Minimum integral value for anti-windup
-  float32x2_t integral_max_ = {
-      100.0f, 100.0f}; ///< Maximum integral value for anti-windup
+  simd::f32x2 integral_min_ =
+      simd::dup(-100.0f); ///< Minimum integral value for anti-windup
+  simd::f32x2 integral_max_ =
+      simd::dup(100.0f); ///< Maximum integral value for anti-windup
 };
 
 #endif
@@ -0,0 +1,169 @@
+/**
+ * @file pid4.hpp
+ * @brief Four-axis PID controller producing MSP RC channels
+ */
+
+#ifndef PID4_HPP
+#define PID4_HPP
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+
+#include "msp/msp.hpp"
+#include "pid/simd.hpp"
+#include "utils.hpp"
+
+/**
+ * @brief Gains, limits and PWM mapping of a single PidController4 axis
+ */
+struct PidAxisConfig {
+  float k_p = 0.0f;  ///< Proportional gain
+  float k_i = 0.0f;  ///< Integral gain
+  float k_d = 0.0f;  ///< Derivative gain
+  float k_df = 0.0f; ///< Derivative filter coefficient (0-1)
+
+  float integral_limit = 100.0f; ///< Symmetric anti-windup bound
+
+  float center = 1500.0f;     ///< PWM for zero controller output
+  float output_min = 1000.0f; ///< Lowest PWM sent to the flight controller
+  float output_max = 2000.0f; ///< Highest PWM sent to the flight controller
+
+  float wrap = 0.0f; ///< Period of angular axes (e.g. 360 for degrees), 0 = off
+};
+
+/**
+ * @class PidController4
+ * @brief PID controller for roll, pitch, throttle and yaw in one 4-lane vector
+ *
+ * Lane i holds axis i of [roll, pitch, throttle, yaw], matching the order of
+ * msp::Channels. Every lane has its own gains, integral limit, derivative
+ * filter and output range, so holding all four axes costs one pass of 128-bit
+ * SIMD (NEON float32x4_t, SSE2 __m128 or scalar, see simd.hpp).
+ *
+ * Lanes 0 and 1 follow PidController's convention ([x, y] position to roll
+ * and pitch), lane 2 is altitude and lane 3 heading. Axes with a non-zero
+ * PidAxisConfig::wrap take the shortest way around.
+ *
+ * @note The derivative term is calculated on measurement (not error) to avoid
+ *       derivative kick when the setpoint changes.
+ */
+class PidController4 {
+public:
+  enum Axis : int { ROLL = 0, PITCH, THROTTLE, YAW, AXIS_COUNT };
+
+  /**
+   * @brief Default constructor
+   */
+  PidController4() = default;
+
+  /**
+   * @brief Construct a 4-axis controller
+   *
+   * @param axes Per-axis configuration indexed by Axis
+   * @param aux  Values passed through to aux1..aux4 of every output
+   * @param clock Time source for dt when no sample time is given; defaults to
+   * std::chrono::steady_clock
+   */
+  explicit PidController4(
+      const std::array<PidAxisConfig, AXIS_COUNT> &axes,
+      const std::array<std::uint16_t, 4> &aux = {1000, 1000, 1000, 1000},
+      utils::Clock clock = utils::steady_now);
+
+  /**
+   * @brief Calculate RC channels from the current and desired state, timed by
+   * the controller's clock
+   *
+   * @param current_state Current [x, y, altitude, heading]
+   * @param desired_state Desired [x, y, altitude, heading]
+   * @return msp::Channels ready for msp::Msp::setRawRc
+   */
+  msp::Channels calculate_raw_rc(simd::Vec4f current_state,
+                                 simd::Vec4f desired_state);
+
+  /**
+   * @brief Calculate RC channels for a sample taken at @p sample_time
+   *
+   * @param current_state Current [x, y, altitude, heading]
+   * @param desired_state Desired [x, y, altitude, heading]
+   * @param sample_time   Time the measurement was taken
+   * @return msp::Channels ready for msp::Msp::setRawRc
+   */
+  msp::Channels calculate_raw_rc(simd::Vec4f current_state,
+                                 simd::Vec4f desired_state,
+                                 std::chrono::steady_clock::time_point sample_time);
+
+  /**
+   * @brief Calculate RC channels using an estimated rate for the D term,
+   * timed by the controller's clock
+   *
+   * @param current_state Current [x, y, altitude, heading]
+   * @param current_rate  Current [vx, vy, vz, yaw rate]
+   * @param desired_state Desired [x, y, altitude, heading]
+   * @return msp::Channels ready for msp::Msp::setRawRc
+   */
+  msp::Channels calculate_raw_rc(simd::Vec4f current_state,
+                                 simd::Vec4f current_rate,
+                                 simd::Vec4f desired_state);
+
+  /**
+   * @brief Calculate RC channels using an estimated rate for the D term, for
+   * a sample taken at @p sample_time
+   *
+   * @param current_state Current [x, y, altitude, heading]
+   * @param current_rate  Current [vx, vy, vz, yaw rate]
+   * @param desired_state Desired [x, y, altitude, heading]
+   * @param sample_time   Time the measurement was taken
+   * @return msp::Channels ready for msp::Msp::setRawRc
+   */
+  msp::Channels calculate_raw_rc(simd::Vec4f current_state,
+                                 simd::Vec4f current_rate,
+                                 simd::Vec4f desired_state,
+                                 std::chrono::steady_clock::time_point sample_time);
+
+  /**
+   * @brief Clear integral and derivative state, e.g. when hold is engaged
+   */
+  void reset();
+
+private:
+  float elapsed_seconds(std::chrono::steady_clock::time_point current_time);
+
+  /**
+   * @brief Bring angular lanes into [-wrap/2, wrap/2]
+   */
+  simd::f32x4 wrapped(simd::f32x4 value) const;
+
+  msp::Channels compute_output(simd::f32x4 error, simd::f32x4 derivative_raw,
+                               float dt_sec);
+
+  simd::f32x4 k_p_ = simd::dup4(0.0f);  ///< Proportional gains
+  simd::f32x4 k_i_ = simd::dup4(0.0f);  ///< Integral gains
+  simd::f32x4 k_d_ = simd::dup4(0.0f);  ///< Derivative gains
+  simd::f32x4 k_df_ = simd::dup4(0.0f); ///< Derivative filter coefficients
+
+  simd::f32x4 integral_min_ = simd::dup4(-100.0f); ///< Anti-windup minimum
+  simd::f32x4 integral_max_ = simd::dup4(100.0f);  ///< Anti-windup maximum
+
+  simd::f32x4 center_ = simd::dup4(1500.0f);     ///< PWM at zero output
+  simd::f32x4 output_min_ = simd::dup4(1000.0f); ///< Lowest PWM
+  simd::f32x4 output_max_ = simd::dup4(2000.0f); ///< Highest PWM
+
+  simd::f32x4 wrap_ = simd::dup4(0.0f);      ///< Angular period, 0 = off
+  simd::f32x4 half_wrap_ = simd::dup4(0.0f); ///< Half of wrap_
+
+  std::array<std::uint16_t, 4> aux_ = {1000, 1000, 1000, 1000};
+
+  utils::Clock clock_ = utils::steady_now; ///< Time source for dt
+
+  std::chrono::microseconds
+      last_time{}; ///< Timestamp of last calculation for dt computation
+
+  simd::f32x4 last_value_ =
+      simd::dup4(0.0f); ///< Previous measurement for derivative calculation
+  simd::f32x4 filtered_derivative_ =
+      simd::dup4(0.0f); ///< Low-pass filtered derivative term
+  simd::f32x4 integral_ = simd::dup4(0.0f); ///< Integral accumulator vector
+};
+
+#endif
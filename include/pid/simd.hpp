@@ -0,0 +1,429 @@
+/**
+ * @file simd.hpp
+ * @brief Minimal 2- and 4-lane float/uint32 SIMD layer used by the
+ * controllers
+ *
+ * The backend is picked at compile time: NEON on ARM, SSE2 on x86 and a
+ * plain scalar fallback elsewhere (or when POSHOLD_SIMD_SCALAR is defined).
+ * All backends produce bit-identical results for finite inputs:
+ * - mla_n() is an unfused multiply followed by an add (vmla on NEON), and the
+ *   project is built with -ffp-contract=off so the scalar path is not fused
+ *   behind our back either.
+ * - min()/max() follow the `a < b ? a : b` convention of SSE.
+ * - to_u32() truncates toward zero and saturates to [0, UINT32_MAX] like
+ *   vcvt_u32_f32.
+ */
+
+#ifndef SIMD_HPP
+#define SIMD_HPP
+
+#include <cstdint>
+
+#if defined(POSHOLD_SIMD_SCALAR)
+#define POSHOLD_SIMD_BACKEND_SCALAR 1
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define POSHOLD_SIMD_BACKEND_NEON 1
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define POSHOLD_SIMD_BACKEND_SSE2 1
+#else
+#define POSHOLD_SIMD_BACKEND_SCALAR 1
+#endif
+
+namespace simd {
+
+/**
+ * @brief Portable pair of floats, e.g. an [x, y] position
+ */
+struct Vec2f {
+  float x;
+  float y;
+};
+
+/**
+ * @brief Portable pair of uint32, e.g. [roll, pitch] PWM values
+ */
+struct Vec2u {
+  std::uint32_t x;
+  std::uint32_t y;
+};
+
+/**
+ * @brief Portable quadruple of floats, one per RC axis
+ * [roll, pitch, throttle, yaw]
+ */
+struct Vec4f {
+  float v[4];
+};
+
+/**
+ * @brief Portable quadruple of uint32, one per RC axis
+ */
+struct Vec4u {
+  std::uint32_t v[4];
+};
+
+#if defined(POSHOLD_SIMD_BACKEND_NEON)
+
+constexpr const char *BACKEND_NAME = "neon";
+
+using f32x2 = float32x2_t;
+using u32x2 = uint32x2_t;
+
+inline f32x2 load(Vec2f v) {
+  const float lanes[2] = {v.x, v.y};
+  return vld1_f32(lanes);
+}
+
+inline Vec2f store(f32x2 v) {
+  return {vget_lane_f32(v, 0), vget_lane_f32(v, 1)};
+}
+
+inline Vec2u store(u32x2 v) {
+  return {vget_lane_u32(v, 0), vget_lane_u32(v, 1)};
+}
+
+inline f32x2 dup(float s) { return vdup_n_f32(s); }
+inline f32x2 add(f32x2 a, f32x2 b) { return vadd_f32(a, b); }
+inline f32x2 sub(f32x2 a, f32x2 b) { return vsub_f32(a, b); }
+inline f32x2 mul_n(f32x2 a, float s) { return vmul_n_f32(a, s); }
+inline f32x2 mla_n(f32x2 acc, f32x2 a, float s) { return vmla_n_f32(acc, a, s); }
+inline f32x2 neg(f32x2 a) { return vneg_f32(a); }
+
+inline f32x2 min(f32x2 a, f32x2 b) {
+  return vbsl_f32(vclt_f32(a, b), a, b);
+}
+
+inline f32x2 max(f32x2 a, f32x2 b) {
+  return vbsl_f32(vcgt_f32(a, b), a, b);
+}
+
+inline u32x2 to_u32(f32x2 a) { return vcvt_u32_f32(a); }
+inline u32x2 dup_u32(std::uint32_t s) { return vdup_n_u32(s); }
+inline u32x2 min_u32(u32x2 a, u32x2 b) { return vmin_u32(a, b); }
+inline u32x2 max_u32(u32x2 a, u32x2 b) { return vmax_u32(a, b); }
+
+// 4-lane operations; same naming as the 2-lane ones with a lane-wise
+// multiplier instead of a scalar one
+using f32x4 = float32x4_t;
+using u32x4 = uint32x4_t;
+
+inline f32x4 load(Vec4f v) { return vld1q_f32(v.v); }
+
+inline Vec4f store(f32x4 v) {
+  Vec4f r;
+  vst1q_f32(r.v, v);
+  return r;
+}
+
+inline Vec4u store(u32x4 v) {
+  Vec4u r;
+  vst1q_u32(r.v, v);
+  return r;
+}
+
+inline f32x4 dup4(float s) { return vdupq_n_f32(s); }
+inline f32x4 add(f32x4 a, f32x4 b) { return vaddq_f32(a, b); }
+inline f32x4 sub(f32x4 a, f32x4 b) { return vsubq_f32(a, b); }
+inline f32x4 mul(f32x4 a, f32x4 b) { return vmulq_f32(a, b); }
+inline f32x4 mul_n(f32x4 a, float s) { return vmulq_n_f32(a, s); }
+inline f32x4 mla(f32x4 acc, f32x4 a, f32x4 b) { return vmlaq_f32(acc, a, b); }
+inline f32x4 mla_n(f32x4 acc, f32x4 a, float s) { return vmlaq_n_f32(acc, a, s); }
+inline f32x4 neg(f32x4 a) { return vnegq_f32(a); }
+
+inline f32x4 min(f32x4 a, f32x4 b) {
+  return vbslq_f32(vcltq_f32(a, b), a, b);
+}
+
+inline f32x4 max(f32x4 a, f32x4 b) {
+  return vbslq_f32(vcgtq_f32(a, b), a, b);
+}
+
+/// a > b ? c : 0, lane-wise
+inline f32x4 select_gt(f32x4 a, f32x4 b, f32x4 c) {
+  return vreinterpretq_f32_u32(
+      vandq_u32(vcgtq_f32(a, b), vreinterpretq_u32_f32(c)));
+}
+
+/// a > b ? c : d, lane-wise
+inline f32x4 blend_gt(f32x4 a, f32x4 b, f32x4 c, f32x4 d) {
+  return vbslq_f32(vcgtq_f32(a, b), c, d);
+}
+
+inline u32x4 to_u32(f32x4 a) { return vcvtq_u32_f32(a); }
+
+#elif defined(POSHOLD_SIMD_BACKEND_SSE2)
+
+constexpr const char *BACKEND_NAME = "sse2";
+
+// Only the two low lanes are meaningful; the upper lanes are kept at zero.
+using f32x2 = __m128;
+using u32x2 = __m128i;
+
+inline f32x2 load(Vec2f v) { return _mm_setr_ps(v.x, v.y, 0.0f, 0.0f); }
+
+inline Vec2f store(f32x2 v) {
+  alignas(16) float lanes[4];
+  _mm_store_ps(lanes, v);
+  return {lanes[0], lanes[1]};
+}
+
+inline Vec2u store(u32x2 v) {
+  alignas(16) std::uint32_t lanes[4];
+  _mm_store_si128(reinterpret_cast<__m128i *>(lanes), v);
+  return {lanes[0], lanes[1]};
+}
+
+inline f32x2 dup(float s) { return _mm_setr_ps(s, s, 0.0f, 0.0f); }
+inline f32x2 add(f32x2 a, f32x2 b) { return _mm_add_ps(a, b); }
+inline f32x2 sub(f32x2 a, f32x2 b) { return _mm_sub_ps(a, b); }
+inline f32x2 mul_n(f32x2 a, float s) { return _mm_mul_ps(a, _mm_set1_ps(s)); }
+
+inline f32x2 mla_n(f32x2 acc, f32x2 a, float s) {
+  return _mm_add_ps(acc, _mm_mul_ps(a, _mm_set1_ps(s)));
+}
+
+inline f32x2 neg(f32x2 a) { return _mm_xor_ps(a, _mm_set1_ps(-0.0f)); }
+inline f32x2 min(f32x2 a, f32x2 b) { return _mm_min_ps(a, b); }
+inline f32x2 max(f32x2 a, f32x2 b) { return _mm_max_ps(a, b); }
+
+inline u32x2 to_u32(f32x2 a) {
+  const __m128 two_31 = _mm_set1_ps(2147483648.0f);
+  const __m128 two_32 = _mm_set1_ps(4294967296.0f);
+
+  // negative and NaN lanes become +0
+  a = _mm_max_ps(a, _mm_setzero_ps());
+  const __m128 high = _mm_cmpge_ps(a, two_31);
+  const __m128 over = _mm_cmpge_ps(a, two_32);
+
+  // cvttps is signed: convert the upper half with its top bit removed
+  const __m128i low = _mm_cvttps_epi32(_mm_sub_ps(a, _mm_and_ps(high, two_31)));
+  const __m128i top = _mm_and_si128(_mm_castps_si128(high),
+                                    _mm_set1_epi32(static_cast<int>(0x80000000u)));
+  return _mm_or_si128(_mm_add_epi32(low, top), _mm_castps_si128(over));
+}
+
+inline u32x2 dup_u32(std::uint32_t s) {
+  return _mm_setr_epi32(static_cast<int>(s), static_cast<int>(s), 0, 0);
+}
+
+// SSE2 only compares signed integers, so bias both sides by 2^31
+inline u32x2 min_u32(u32x2 a, u32x2 b) {
+  const __m128i bias = _mm_set1_epi32(static_cast<int>(0x80000000u));
+  const __m128i a_gt_b = _mm_cmpgt_epi32(_mm_xor_si128(a, bias),
+                                         _mm_xor_si128(b, bias));
+  return _mm_or_si128(_mm_and_si128(a_gt_b, b), _mm_andnot_si128(a_gt_b, a));
+}
+
+inline u32x2 max_u32(u32x2 a, u32x2 b) {
+  const __m128i bias = _mm_set1_epi32(static_cast<int>(0x80000000u));
+  const __m128i a_gt_b = _mm_cmpgt_epi32(_mm_xor_si128(a, bias),
+                                         _mm_xor_si128(b, bias));
+  return _mm_or_si128(_mm_and_si128(a_gt_b, a), _mm_andnot_si128(a_gt_b, b));
+}
+
+// 4-lane operations; same naming as the 2-lane ones with a lane-wise
+// multiplier instead of a scalar one
+struct f32x4 {
+  __m128 v;
+};
+
+struct u32x4 {
+  __m128i v;
+};
+
+inline f32x4 load(Vec4f v) { return {_mm_loadu_ps(v.v)}; }
+
+inline Vec4f store(f32x4 v) {
+  Vec4f r;
+  _mm_storeu_ps(r.v, v.v);
+  return r;
+}
+
+inline Vec4u store(u32x4 v) {
+  Vec4u r;
+  _mm_storeu_si128(reinterpret_cast<__m128i *>(r.v), v.v);
+  return r;
+}
+
+inline f32x4 dup4(float s) { return {_mm_set1_ps(s)}; }
+inline f32x4 add(f32x4 a, f32x4 b) { return {_mm_add_ps(a.v, b.v)}; }
+inline f32x4 sub(f32x4 a, f32x4 b) { return {_mm_sub_ps(a.v, b.v)}; }
+inline f32x4 mul(f32x4 a, f32x4 b) { return {_mm_mul_ps(a.v, b.v)}; }
+inline f32x4 mul_n(f32x4 a, float s) { return {_mm_mul_ps(a.v, _mm_set1_ps(s))}; }
+
+inline f32x4 mla(f32x4 acc, f32x4 a, f32x4 b) {
+  return {_mm_add_ps(acc.v, _mm_mul_ps(a.v, b.v))};
+}
+
+inline f32x4 mla_n(f32x4 acc, f32x4 a, float s) {
+  return {_mm_add_ps(acc.v, _mm_mul_ps(a.v, _mm_set1_ps(s)))};
+}
+
+inline f32x4 neg(f32x4 a) { return {_mm_xor_ps(a.v, _mm_set1_ps(-0.0f))}; }
+inline f32x4 min(f32x4 a, f32x4 b) { return {_mm_min_ps(a.v, b.v)}; }
+inline f32x4 max(f32x4 a, f32x4 b) { return {_mm_max_ps(a.v, b.v)}; }
+
+/// a > b ? c : 0, lane-wise
+inline f32x4 select_gt(f32x4 a, f32x4 b, f32x4 c) {
+  return {_mm_and_ps(_mm_cmpgt_ps(a.v, b.v), c.v)};
+}
+
+/// a > b ? c : d, lane-wise
+inline f32x4 blend_gt(f32x4 a, f32x4 b, f32x4 c, f32x4 d) {
+  const __m128 mask = _mm_cmpgt_ps(a.v, b.v);
+  return {_mm_or_ps(_mm_and_ps(mask, c.v), _mm_andnot_ps(mask, d.v))};
+}
+
+inline u32x4 to_u32(f32x4 a) { return {to_u32(a.v)}; }
+
+#else
+
+constexpr const char *BACKEND_NAME = "scalar";
+
+struct f32x2 {
+  float lane[2];
+};
+
+struct u32x2 {
+  std::uint32_t lane[2];
+};
+
+inline f32x2 load(Vec2f v) { return {{v.x, v.y}}; }
+inline Vec2f store(f32x2 v) { return {v.lane[0], v.lane[1]}; }
+inline Vec2u store(u32x2 v) { return {v.lane[0], v.lane[1]}; }
+
+inline f32x2 dup(float s) { return {{s, s}}; }
+
+inline f32x2 add(f32x2 a, f32x2 b) {
+  return {{a.lane[0] + b.lane[0], a.lane[1] + b.lane[1]}};
+}
+
+inline f32x2 sub(f32x2 a, f32x2 b) {
+  return {{a.lane[0] - b.lane[0], a.lane[1] - b.lane[1]}};
+}
+
+inline f32x2 mul_n(f32x2 a, float s) {
+  return {{a.lane[0] * s, a.lane[1] * s}};
+}
+
+inline f32x2 mla_n(f32x2 acc, f32x2 a, float s) {
+  return add(acc, mul_n(a, s));
+}
+
+inline f32x2 neg(f32x2 a) { return {{-a.lane[0], -a.lane[1]}}; }
+
+inline f32x2 min(f32x2 a, f32x2 b) {
+  return {{a.lane[0] < b.lane[0] ? a.lane[0] : b.lane[0],
+           a.lane[1] < b.lane[1] ? a.lane[1] : b.lane[1]}};
+}
+
+inline f32x2 max(f32x2 a, f32x2 b) {
+  return {{a.lane[0] > b.lane[0] ? a.lane[0] : b.lane[0],
+           a.lane[1] > b.lane[1] ? a.lane[1] : b.lane[1]}};
+}
+
+inline std::uint32_t to_u32(float a) {
+  if (!(a > 0.0f))
+    return 0u;
+  if (a >= 4294967296.0f)
+    return 0xFFFFFFFFu;
+  return static_cast<std::uint32_t>(a);
+}
+
+inline u32x2 to_u32(f32x2 a) { return {{to_u32(a.lane[0]), to_u32(a.lane[1])}}; }
+inline u32x2 dup_u32(std::uint32_t s) { return {{s, s}}; }
+
+inline u32x2 min_u32(u32x2 a, u32x2 b) {
+  return {{a.lane[0] < b.lane[0] ? a.lane[0] : b.lane[0],
+           a.lane[1] < b.lane[1] ? a.lane[1] : b.lane[1]}};
+}
+
+inline u32x2 max_u32(u32x2 a, u32x2 b) {
+  return {{a.lane[0] > b.lane[0] ? a.lane[0] : b.lane[0],
+           a.lane[1] > b.lane[1] ? a.lane[1] : b.lane[1]}};
+}
+
+// 4-lane operations; same naming as the 2-lane ones with a lane-wise
+// multiplier instead of a scalar one
+struct f32x4 {
+  float lane[4];
+};
+
+struct u32x4 {
+  std::uint32_t lane[4];
+};
+
+inline f32x4 load(Vec4f v) { return {{v.v[0], v.v[1], v.v[2], v.v[3]}}; }
+
+inline Vec4f store(f32x4 v) {
+  return {{v.lane[0], v.lane[1], v.lane[2], v.lane[3]}};
+}
+
+inline Vec4u store(u32x4 v) {
+  return {{v.lane[0], v.lane[1], v.lane[2], v.lane[3]}};
+}
+
+inline f32x4 dup4(float s) { return {{s, s, s, s}}; }
+
+template <class Op> inline f32x4 lanewise(f32x4 a, f32x4 b, Op op) {
+  f32x4 r;
+  for (int i = 0; i < 4; ++i)
+    r.lane[i] = op(a.lane[i], b.lane[i]);
+  return r;
+}
+
+inline f32x4 add(f32x4 a, f32x4 b) {
+  return lanewise(a, b, [](float x, float y) { return x + y; });
+}
+
+inline f32x4 sub(f32x4 a, f32x4 b) {
+  return lanewise(a, b, [](float x, float y) { return x - y; });
+}
+
+inline f32x4 mul(f32x4 a, f32x4 b) {
+  return lanewise(a, b, [](float x, float y) { return x * y; });
+}
+
+inline f32x4 mul_n(f32x4 a, float s) { return mul(a, dup4(s)); }
+inline f32x4 mla(f32x4 acc, f32x4 a, f32x4 b) { return add(acc, mul(a, b)); }
+inline f32x4 mla_n(f32x4 acc, f32x4 a, float s) { return add(acc, mul_n(a, s)); }
+inline f32x4 neg(f32x4 a) {
+  return {{-a.lane[0], -a.lane[1], -a.lane[2], -a.lane[3]}};
+}
+
+inline f32x4 min(f32x4 a, f32x4 b) {
+  return lanewise(a, b, [](float x, float y) { return x < y ? x : y; });
+}
+
+inline f32x4 max(f32x4 a, f32x4 b) {
+  return lanewise(a, b, [](float x, float y) { return x > y ? x : y; });
+}
+
+/// a > b ? c : 0, lane-wise
+inline f32x4 select_gt(f32x4 a, f32x4 b, f32x4 c) {
+  f32x4 r;
+  for (int i = 0; i < 4; ++i)
+    r.lane[i] = a.lane[i] > b.lane[i] ? c.lane[i] : 0.0f;
+  return r;
+}
+
+/// a > b ? c : d, lane-wise
+inline f32x4 blend_gt(f32x4 a, f32x4 b, f32x4 c, f32x4 d) {
+  f32x4 r;
+  for (int i = 0; i < 4; ++i)
+    r.lane[i] = a.lane[i] > b.lane[i] ? c.lane[i] : d.lane[i];
+  return r;
+}
+
+inline u32x4 to_u32(f32x4 a) {
+  return {{to_u32(a.lane[0]), to_u32(a.lane[1]), to_u32(a.lane[2]),
+           to_u32(a.lane[3])}};
+}
+
+#endif
+
+} // namespace simd
+
+#endif // !SIMD_HPP
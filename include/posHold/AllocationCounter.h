@@ -0,0 +1,74 @@
+#ifndef ALLOCATIONCOUNTER_H
+#define ALLOCATIONCOUNTER_H
+
+#include <cstdint>
+
+// Global operator new calls of the process. Counting needs a build with
+// -DPOSHOLD_COUNT_ALLOCATIONS=ON, which replaces the global allocation
+// functions of every program linking poshold_core; otherwise count() stays
+// zero and enabled() is false.
+class AllocationCounter
+{
+public:
+    [[nodiscard]] static bool enabled();
+
+    [[nodiscard]] static std::uint64_t count();
+};
+
+// Allocation accounting of a frame loop: after warmupFrames frames, during
+// which buffers and pools fill up, no frame may allocate
+class FrameAllocationCheck
+{
+public:
+    explicit FrameAllocationCheck(const int warmupFrames = 30) :
+        m_warmupFrames{ warmupFrames }
+    {
+    }
+
+    void beginFrame()
+    {
+        m_frameStart = AllocationCounter::count();
+    }
+
+    // Returns the allocations since beginFrame()
+    std::uint64_t endFrame()
+    {
+        const std::uint64_t allocations = AllocationCounter::count() - m_frameStart;
+        if (++m_frames > m_warmupFrames && allocations > 0)
+        {
+            m_steadyStateAllocations += allocations;
+            ++m_allocatingFrames;
+        }
+        return allocations;
+    }
+
+    [[nodiscard]] int getFrames() const
+    {
+        return m_frames;
+    }
+
+    // Allocations in frames after the warm-up
+    [[nodiscard]] std::uint64_t getSteadyStateAllocations() const
+    {
+        return m_steadyStateAllocations;
+    }
+
+    [[nodiscard]] int getAllocatingFrames() const
+    {
+        return m_allocatingFrames;
+    }
+
+    [[nodiscard]] bool passed() const
+    {
+        return m_steadyStateAllocations == 0;
+    }
+
+private:
+    const int m_warmupFrames;
+    int m_frames = 0;
+    int m_allocatingFrames = 0;
+    std::uint64_t m_frameStart = 0;
+    std::uint64_t m_steadyStateAllocations = 0;
+};
+
+#endif
@@ -1,22 +1,235 @@
 #ifndef CAMERAOPTICALFLOW_H
 #define CAMERAOPTICALFLOW_H
 
+#include <cstdint>
+#include <vector>
+
 #include <opencv2/opencv.hpp>
 #include "posHold/Drone.h"
+#include "posHold/ThreadPool.h"
 
 class CameraOpticalFlow
 {
 public:
-    explicit CameraOpticalFlow(Drone& drone);
+    // Farneback parameters for one frame: ROI is resized by scale before the
+    // flow is computed and the result is brought back to full resolution
+    struct FlowSettings
+    {
+        double scale;
+        int levels;
+        int windowSize;
+        int iterations;
+    };
+
+    // One ROI of the last calc(): the centre tile around the requested point
+    // comes first, then the ring tiles next to it
+    struct Tile
+    {
+        cv::Rect roi;
+        // Where the tile's averaging disc is centred
+        cv::Point centre;
+        // Mean flow over the disc, pixels
+        cv::Point2f meanFlow;
+        // Smaller eigenvalue of the structure tensor per pixel: near zero on
+        // blank or single-edge ground, where the flow is unreliable
+        double texture = 0.0;
+        // Share of the fused flow, summing to 1 over the tiles
+        double weight = 0.0;
+        double seconds = 0.0;
+        // False if the tile fell outside the frame and was skipped
+        bool valid = false;
+    };
+
+    enum class Mode
+    {
+        // Dense Farneback flow between each frame and the one before it
+        Consecutive,
+        // Corners of a cached keyframe tracked into each new frame with
+        // pyramidal Lucas-Kanade: the displacement is measured against the
+        // keyframe rather than summed frame by frame, so it does not
+        // random-walk, and only the new frame's pyramid is built
+        Keyframe
+    };
+
+    // Largest tile count: the centre and its eight neighbours
+    static constexpr int s_maxTiles = 9;
 
-    void calc(int x, int y, int len);
+    // ROI buffers are allocated once for a half-size of maxLen pixels. tiles
+    // ROIs are computed per frame on as many threads, the calling one
+    // included; tiles is rounded down to 1, 3, 5 or 9 so the ring stays
+    // symmetric around the centre. Keyframe mode tracks a single ROI and
+    // ignores tiles
+    CameraOpticalFlow(Drone& drone, int maxLen, int tiles = 1, Mode mode = Mode::Consecutive);
 
+    // altitude in meters drives the working resolution of the ROI;
+    // len is clamped to the maxLen given at construction. accountLen is the
+    // radius of each tile's averaging disc, len if negative
+    void calc(int x, int y, int len, double altitude, int accountLen = -1);
+
+    // Dense flow of the last calc() over its tile ROIs, zero elsewhere (the
+    // previous frame's tiles are cleared first).
+    // Consecutive mode only: Keyframe mode tracks sparse corners and throws
+    // std::runtime_error here (use getFusedFlow() or
+    // getKeyframeDisplacement())
     [[nodiscard]] cv::Point2f getOpticalFlowAt(int x, int y) const;
 
+    [[nodiscard]] const cv::Mat& getOpticalFlow() const;
+
+    // Texture-weighted mean of the tile flows of the last calc(); in Keyframe
+    // mode the change of the keyframe displacement since the previous frame.
+    // Zero when getFlowConfidence() is zero
+    [[nodiscard]] cv::Point2f getFusedFlow() const;
+
+    // How far getFusedFlow() can be trusted, from 0 to 1. In Keyframe mode
+    // the share of keyframe corners that agreed on it; in Consecutive mode 1
+    // once a tile was computed. Zero when the last calc() measured nothing:
+    // the first frame, every tile outside the frame, or a keyframe lost
+    // (the frame's motion is then unknown, not zero)
+    [[nodiscard]] double getFlowConfidence() const;
+
+    [[nodiscard]] Mode getMode() const;
+
+    // Keyframe mode: ground displacement (pixels) of the last calc()'s frame
+    // relative to the keyframe, valid if hasKeyframeDisplacement()
+    [[nodiscard]] cv::Point2f getKeyframeDisplacement() const;
+
+    // Keyframe mode: false when the last calc() took the first keyframe or
+    // lost track of the previous one
+    [[nodiscard]] bool hasKeyframeDisplacement() const;
+
+    // Keyframe mode: the last calc() made its frame the new keyframe, after
+    // measuring it against the old one
+    [[nodiscard]] bool hasReanchored() const;
+
+    // Keyframe mode: share of the keyframe corners that agreed on the last
+    // displacement
+    [[nodiscard]] double getKeyframeConfidence() const;
+
+    // Keyframe mode: keyframes taken so far
+    [[nodiscard]] std::uint64_t getKeyframeCount() const;
+
+    [[nodiscard]] const std::vector<Tile>& getTiles() const;
+
+    // Settings of the centre tile in the last calc(), after load shedding and
+    // ROI limits
+    [[nodiscard]] FlowSettings getSettings() const;
+
 private:
+    // Upper altitude of each scale band; above the last one the coarsest
+    // scale is used. Bands are left only after crossing by s_altitudeHysteresis.
+    static constexpr double s_altitudeBands[] = { 2.0, 6.0 };
+    static constexpr double s_bandScales[] = { 1.0, 0.5, 0.25 };
+    static constexpr int s_bandWindowSizes[] = { 15, 11, 9 };
+    static constexpr double s_altitudeHysteresis = 0.5;
+    static constexpr int s_maxLevels = 4;
+    // Drop a pyramid level only when motion falls below this fraction of
+    // what the smaller pyramid can still track
+    static constexpr double s_levelHysteresis = 0.7;
+    // Per-frame decay of the peak-held flow magnitude
+    static constexpr double s_motionDecay = 0.9;
+    // Frames to run at halved scale and a single iteration after the camera
+    // reported dropped frames
+    static constexpr int s_sheddingFrames = 15;
+    // Ring tiles clipped by the frame edge to less than this fraction of the
+    // requested side are skipped
+    static constexpr double s_minTileFraction = 0.5;
+    // Keyframe corners are picked within len of the keyframe centre; the
+    // keyframe region extends another len so they can travel that far
+    static constexpr int s_keyframeRegionLens = 2;
+    static constexpr int s_keyframeMaxCorners = 64;
+    static constexpr double s_keyframeCornerQuality = 0.01;
+    static constexpr double s_keyframeCornerDistance = 5.0;
+    static constexpr int s_keyframeWindowSize = 21;
+    static constexpr int s_keyframeLevels = 3;
+    // Corners further than this from the median displacement are outliers
+    static constexpr float s_keyframeInlierPixels = 1.5f;
+    // Re-anchor below this many agreeing corners or this share of them...
+    static constexpr int s_keyframeMinCorners = 8;
+    static constexpr double s_keyframeMinConfidence = 0.5;
+    // ...or once the corners or the requested centre moved this fraction of
+    // the keyframe's len, so the overlap keeps a margin
+    static constexpr double s_keyframeMaxTravel = 0.5;
+
+    // Per-tile working storage, so tiles never share a buffer
+    struct TileBuffers
+    {
+        explicit TileBuffers(int maxLen);
+
+        // Max-sized backing storage; the per-frame Mats below are views into it
+        cv::Mat prevROIBuffer;
+        cv::Mat currROIBuffer;
+        cv::Mat prevScaledBuffer;
+        cv::Mat currScaledBuffer;
+        cv::Mat flowScaledBuffer;
+        cv::Mat flowROIBuffer;
+        cv::Mat gradXBuffer;
+        cv::Mat gradYBuffer;
+        cv::Mat prevROI;
+        cv::Mat currROI;
+        cv::Mat prevScaled;
+        cv::Mat currScaled;
+        cv::Mat flowScaled;
+        cv::Mat flowROI;
+        FlowSettings settings{};
+    };
+
+    void updateSettings(double altitude);
+
+    void placeTiles(int x, int y, int len, cv::Size frameSize);
+
+    void calcTile(int index, const cv::Mat& grayFrame, int accountLen);
+
+    void extractROI(const cv::Mat& frame, const cv::Rect& roi, cv::Mat& out) const;
+
+    void calcKeyframe(int x, int y, int len, const cv::Mat& grayFrame);
+
+    void trackKeyframe();
+
+    void anchorKeyframe(int x, int y, int len, const cv::Mat& grayFrame, bool regionBuilt);
+
     Drone* m_drone;
+    const int m_maxLen;
+    const Mode m_mode;
     cv::Mat m_prevFrame;
     cv::Mat m_opticalFlow;
+    // Fixed-point rectification maps (CV_16SC2 + CV_16UC1), built once and
+    // only ever sampled over the flow ROI
+    cv::Mat m_rectifyMapXY;
+    cv::Mat m_rectifyMapFrac;
+    std::vector<TileBuffers> m_tileBuffers;
+    std::vector<Tile> m_tiles;
+    cv::Point2f m_fusedFlow;
+    double m_flowConfidence = 0.0;
+    ThreadPool m_pool;
+    FlowSettings m_settings{ s_bandScales[0], 3, s_bandWindowSizes[0], 3 };
+    FlowSettings m_activeSettings = m_settings;
+    int m_altitudeBand = 0;
+    int m_sheddingFrames = 0;
+    double m_recentMotion = 0.0;
+
+    // Keyframe mode. Both pyramids cover m_keyRegion: the current one is
+    // built per frame and swapped in when the keyframe is re-anchored in place
+    cv::Mat m_regionBuffer;
+    cv::Mat m_region;
+    cv::Rect m_keyRegion;
+    cv::Point2f m_keyCentre;
+    int m_keyLen = 0;
+    int m_keyLevels = 0;
+    std::vector<cv::Mat> m_keyPyramid;
+    std::vector<cv::Mat> m_currPyramid;
+    // Corners in keyframe region coordinates, and where the last calc() found them
+    std::vector<cv::Point2f> m_keyCorners;
+    std::vector<cv::Point2f> m_trackedCorners;
+    std::vector<unsigned char> m_cornerStatus;
+    std::vector<float> m_cornerErrors;
+    std::vector<float> m_cornerDx;
+    std::vector<float> m_cornerDy;
+    cv::Point2f m_keyDisplacement;
+    cv::Point2f m_prevKeyDisplacement;
+    double m_keyConfidence = 0.0;
+    bool m_hasKeyDisplacement = false;
+    bool m_reanchored = false;
+    std::uint64_t m_keyframeCount = 0;
 };
 
 #endif
@@ -0,0 +1,88 @@
+#ifndef CAMERAPROFILE_H
+#define CAMERAPROFILE_H
+
+#include <opencv2/opencv.hpp>
+
+#include "posHold/Drone.h"
+
+// Compile-time descriptions of the ideal pinhole cameras we fly. Kernels
+// instantiated for a profile see its intrinsics as constants, so projections
+// fold to a few multiply-adds and divisions by the focal length or the
+// diagonal disappear. Calibrated cameras with distortion never match a
+// profile and run the generic kernels.
+//
+// A profile provides:
+//   name                        for logs
+//   resolutionX, resolutionY    pixels
+//   focalLengthX, focalLengthY  pixels
+//   principalX, principalY      pixels
+//   maxRoiRadius                largest flow ROI half-size, in pixels
+
+// 60 degree horizontal field of view; focal lengths are
+// resolutionX / (2 tan(30 deg)), bit-identical to Drone::CameraInfo's
+struct Profile60Deg1280x720
+{
+    static constexpr const char* name = "60deg-1280x720";
+    static constexpr int resolutionX = 1280;
+    static constexpr int resolutionY = 720;
+    static constexpr double focalLengthX = 1108.5125168440816;
+    static constexpr double focalLengthY = focalLengthX;
+    static constexpr double principalX = resolutionX / 2.0;
+    static constexpr double principalY = resolutionY / 2.0;
+    static constexpr int maxRoiRadius = 80;
+};
+
+struct Profile60Deg640x480
+{
+    static constexpr const char* name = "60deg-640x480";
+    static constexpr int resolutionX = 640;
+    static constexpr int resolutionY = 480;
+    static constexpr double focalLengthX = 554.2562584220408;
+    static constexpr double focalLengthY = focalLengthX;
+    static constexpr double principalX = resolutionX / 2.0;
+    static constexpr double principalY = resolutionY / 2.0;
+    // Half the focal length of the 720p mode: the same ground footprint
+    static constexpr int maxRoiRadius = 40;
+};
+
+struct Profile60Deg1920x1080
+{
+    static constexpr const char* name = "60deg-1920x1080";
+    static constexpr int resolutionX = 1920;
+    static constexpr int resolutionY = 1080;
+    static constexpr double focalLengthX = 1662.7687752661222;
+    static constexpr double focalLengthY = focalLengthX;
+    static constexpr double principalX = resolutionX / 2.0;
+    static constexpr double principalY = resolutionY / 2.0;
+    // Capped by the Farneback pixel budget rather than the ground footprint
+    static constexpr int maxRoiRadius = 80;
+};
+
+// Per-camera kernels and constants, picked once when VecDown/VecMove are
+// constructed
+struct CameraKernels
+{
+    // Largest disc discMeanFlow() has an unrolled kernel for
+    static constexpr int s_maxDiscRadius = 80;
+
+    // Image point of the down vector given in body axes, clamped to the frame
+    using ProjectDown = cv::Point2f (*)(const cv::Vec3d& down, const Drone::CameraInfo& cameraInfo);
+
+    // Kernels of the compiled-in profile matching cameraInfo exactly,
+    // otherwise the generic ones reading cameraInfo at run time
+    [[nodiscard]] static CameraKernels select(const Drone::CameraInfo& cameraInfo);
+
+    // Mean of the CV_32FC2 flow over the disc of the given radius around
+    // centre, clipped to the flow image; zero if the disc misses it entirely.
+    // radius is clamped to [0, s_maxDiscRadius]
+    [[nodiscard]] static cv::Point2f discMeanFlow(const cv::Mat& flow, cv::Point centre, int radius);
+
+    const char* profile;
+    ProjectDown projectDown;
+    double inverseFocalLength;
+    // 1 / sqrt(resolutionX^2 + resolutionY^2)
+    double inverseDiagonal;
+    int maxRoiRadius;
+};
+
+#endif
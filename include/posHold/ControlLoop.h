@@ -0,0 +1,169 @@
+#ifndef CONTROLLOOP_H
+#define CONTROLLOOP_H
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+#include <opencv2/opencv.hpp>
+
+#include "pid/pid.hpp"
+#include "posHold/Drone.h"
+#include "posHold/StateEstimator.h"
+
+// Runs the position controller at telemetry rate on its own thread, so the
+// RC output no longer waits for the camera. Every tick reads the attitude
+// (and every few ticks the altitude), propagates the StateEstimator with it,
+// applies the flow vision submitted since the previous tick at the time its
+// frame was taken, and sends the controller's output for the predicted
+// position and velocity.
+//
+// The drone's telemetry is read from this thread while VecMove reads it from
+// the vision thread; msp::Msp serialises the two.
+//
+// The estimator predicts horizontal acceleration from the tilt alone. Wind
+// and other forces it does not model only enter as process noise, so in a
+// gust the prediction between frames drifts the wrong way and the controller
+// acts on it. With poshold_pid_sweep --camera-rate 30 --gust 1 the best gains
+// cost 14.6 through this loop against 13.2 holding the output between
+// frames, and no --accel-noise from 4 to 16 closes the gap; that needs the
+// wind estimated as a state of its own. Until the sweep shows this loop
+// ahead, rp4_pos_hold1 --hold holds the output between frames and flies this
+// loop only with --multi-rate.
+class ControlLoop
+{
+public:
+    struct Options
+    {
+        // Controller ticks per second; MSP telemetry sustains 100-250 Hz
+        double rate = 200.0;
+        // Read the altitude on every Nth tick only, sparing the serial link
+        int altitudeDivider = 4;
+    };
+
+    struct Status
+    {
+        cv::Point2f position;
+        cv::Point2f velocity;
+        simd::Vec2u rc{ 1500u, 1500u };
+        std::uint64_t ticks = 0;
+        // Flow and position measurements applied
+        std::uint64_t flowUpdates = 0;
+        // Ticks started late by more than a period; the missed ones are skipped
+        std::uint64_t overruns = 0;
+        // Ticks skipped because the telemetry could not be read
+        std::uint64_t failedTicks = 0;
+    };
+
+    // Sends roll and pitch PWM, e.g. through msp::Msp::setRawRc
+    using Output = std::function<void(simd::Vec2u rc)>;
+
+    // What one tick read, estimated and sent, for flight logs and telemetry
+    struct Tick
+    {
+        std::chrono::steady_clock::time_point time;
+        Drone::GyroData attitude;
+        // The altitude is only read on every altitudeDivider-th tick
+        bool altitudeRead;
+        Drone::AltitudeData altitude;
+        cv::Point2f position;
+        cv::Point2f velocity;
+        cv::Point2f setpoint;
+        double estimatedAltitude;
+        simd::Vec2u rc;
+        PidController::Terms terms;
+        // Wall time spent reading telemetry, in the estimator and in the
+        // controller and output
+        std::chrono::steady_clock::duration telemetryTime;
+        std::chrono::steady_clock::duration estimatorTime;
+        std::chrono::steady_clock::duration controlTime;
+    };
+
+    using TickListener = std::function<void(const Tick& tick)>;
+
+    ControlLoop(Drone& drone, const PidController& controller, Output output, const Options& options,
+                const StateEstimator& estimator = StateEstimator());
+
+    ControlLoop(const ControlLoop&) = delete;
+    ControlLoop& operator=(const ControlLoop&) = delete;
+
+    ~ControlLoop();
+
+    // Ticks on a new thread until stop() or destruction
+    void start();
+
+    void stop();
+
+    // From the vision thread after VecMove::calc(), with getVecMove(),
+    // getSampleInterval() and getSampleTimestamp(), unless getFlowConfidence()
+    // is zero. Flow that arrives twice before a tick is merged into one
+    // measurement.
+    void submitFlow(const cv::Point2f& displacement, double interval,
+                    std::chrono::steady_clock::time_point sampleTime);
+
+    // From the vision thread instead of submitFlow(), with
+    // VecMove::getAccumulatedPosition(): the estimator is corrected on the
+    // position rather than the velocity, so measurement noise does not
+    // random-walk into it. Of positions submitted between ticks, the newest
+    // is applied.
+    void submitPosition(const cv::Point2f& position, std::chrono::steady_clock::time_point sampleTime);
+
+    void setSetpoint(const cv::Point2f& setpoint);
+
+    // Called on the ticking thread after every tick's output; set it before
+    // start()
+    void setTickListener(TickListener listener);
+
+    // One tick at now; the thread started by start() calls it, offline
+    // drivers may call it directly instead. Throws what the drone's telemetry
+    // getters throw, before changing any state; the thread counts such ticks
+    // in Status::failedTicks and carries on
+    void step(std::chrono::steady_clock::time_point now);
+
+    [[nodiscard]] Status getStatus() const;
+
+private:
+    struct PendingFlow
+    {
+        cv::Point2f displacement;
+        double interval = 0.0;
+        std::chrono::steady_clock::time_point sampleTime;
+        bool valid = false;
+    };
+
+    struct PendingPosition
+    {
+        cv::Point2f position;
+        std::chrono::steady_clock::time_point sampleTime;
+        bool valid = false;
+    };
+
+    void run();
+
+    Drone* m_drone;
+    PidController m_controller;
+    const Output m_output;
+    const Options m_options;
+    TickListener m_tickListener;
+
+    // Tick state, owned by whoever calls step()
+    StateEstimator m_estimator;
+    std::chrono::steady_clock::time_point m_lastTick;
+    std::uint64_t m_ticks = 0;
+    std::uint64_t m_flowUpdates = 0;
+
+    mutable std::mutex m_mutex;
+    std::condition_variable m_wake;
+    PendingFlow m_pendingFlow;
+    PendingPosition m_pendingPosition;
+    cv::Point2f m_setpoint;
+    Status m_status;
+    bool m_stopping = false;
+
+    std::thread m_thread;
+};
+
+#endif
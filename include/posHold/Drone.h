@@ -2,6 +2,7 @@
 #define DRONE_H
 
 #include <array>
+#include <chrono>
 #include <cstdint>
 #include <opencv2/opencv.hpp>
 
@@ -12,19 +13,68 @@ class Drone
 public:
     struct CameraInfo
     {
+        // Ideal pinhole camera, principal point in the centre of the frame
         CameraInfo(
             const double fov,
             const int resolutionX,
             const int resolutionY,
             const double minDist,
             const double maxDist) :
-            fov{ fov },
+            CameraInfo(
+                resolutionX,
+                resolutionY,
+                minDist,
+                maxDist,
+                resolutionX / (std::tan(fov / 2) * 2),
+                resolutionX / (std::tan(fov / 2) * 2),
+                resolutionX / 2.0,
+                resolutionY / 2.0,
+                { 0.0, 0.0, 0.0, 0.0, 0.0 })
+        {
+        }
+
+        // Calibrated camera: intrinsics in pixels and OpenCV distortion
+        // coefficients (k1, k2, p1, p2, k3)
+        CameraInfo(
+            const int resolutionX,
+            const int resolutionY,
+            const double minDist,
+            const double maxDist,
+            const double focalLengthX,
+            const double focalLengthY,
+            const double principalX,
+            const double principalY,
+            const std::array<double, 5>& distortion) :
+            fov{ 2 * std::atan(resolutionX / (2 * focalLengthX)) },
             resolutionX{ resolutionX },
             resolutionY{ resolutionY },
             minDist{ minDist },
             maxDist{ maxDist },
-            focalLength{ resolutionX / (std::tan(fov / 2) * 2) }
+            focalLength{ focalLengthX },
+            focalLengthY{ focalLengthY },
+            principalX{ principalX },
+            principalY{ principalY },
+            distortion{ distortion }
+        {
+        }
+
+        [[nodiscard]] bool hasDistortion() const
+        {
+            for (const double coefficient : distortion)
+            {
+                if (coefficient != 0.0)
+                {
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        [[nodiscard]] cv::Matx33d cameraMatrix() const
         {
+            return { focalLength, 0.0, principalX,
+                     0.0, focalLengthY, principalY,
+                     0.0, 0.0, 1.0 };
         }
 
         const double fov;
@@ -33,6 +83,10 @@ public:
         const double minDist;
         const double maxDist;
         const double focalLength;
+        const double focalLengthY;
+        const double principalX;
+        const double principalY;
+        const std::array<double, 5> distortion;
     };
 
     struct GyroData
@@ -42,27 +96,74 @@ public:
         double yaw;
     };
 
-    const CameraInfo cameraInfo = CameraInfo(
-        60 * CV_PI / 180,
-        1280,
-        720,
-        0.01,
-        1000.0
-    );
+    struct AltitudeData
+    {
+        double altitude;
+        double vario;
+    };
+
+    // Camera mounted on the airframe
+    [[nodiscard]] static CameraInfo defaultCameraInfo()
+    {
+        return CameraInfo(
+            60 * CV_PI / 180,
+            1280,
+            720,
+            0.01,
+            1000.0
+        );
+    }
+
+    const CameraInfo cameraInfo = defaultCameraInfo();
 
     Drone();
 
     explicit Drone(msp::Msp& m_msp);
 
-    [[nodiscard]] cv::Mat getGrayscaleImage();
+    virtual ~Drone() = default;
+
+    // Returns the newest frame; frames that queued up while the caller was
+    // busy are dropped (see getSkippedFrames)
+    [[nodiscard]] virtual cv::Mat getGrayscaleImage();
+
+    // Frames dropped before the last getGrayscaleImage() result
+    [[nodiscard]] virtual int getSkippedFrames() const;
 
-    [[nodiscard]] GyroData getGyroData();
+    // Seconds between the last two frames returned by getGrayscaleImage()
+    [[nodiscard]] virtual double getFrameInterval() const;
+
+    [[nodiscard]] virtual std::chrono::steady_clock::time_point getFrameTimestamp() const;
+
+    [[nodiscard]] virtual GyroData getGyroData();
 
     [[nodiscard]] double getAltitude();
 
+    [[nodiscard]] virtual AltitudeData getAltitudeData();
+
+protected:
+    // For sources that replace the camera (RTSP) or both the camera and the
+    // flight controller (offline replay, simulation); no capture device is
+    // opened, and telemetry is read from msp if given
+    explicit Drone(const CameraInfo& cameraInfo, msp::Msp* msp = nullptr);
+
 private:
-    msp::Msp* m_msp;
+    // Treat the camera as backlogged once a read comes this many nominal
+    // frame periods after the previous one
+    static constexpr double s_backlogPeriods = 1.5;
+    // Deepest capture queue worth draining in one read
+    static constexpr int s_maxSkippedFrames = 4;
+    static constexpr double s_defaultFps = 30.0;
+
+    void initCamera();
+
+    msp::Msp* m_msp = nullptr;
     cv::VideoCapture m_camera;
+    cv::Mat m_captureFrame;
+    double m_framePeriod = 1.0 / s_defaultFps;
+    int m_skippedFrames = 0;
+    double m_frameInterval = 0.0;
+    double m_framePositionMs = 0.0;
+    std::chrono::steady_clock::time_point m_frameTimestamp;
 };
 
 #endif
@@ -0,0 +1,76 @@
+#ifndef FRAMEPOOL_H
+#define FRAMEPOOL_H
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include <opencv2/opencv.hpp>
+
+// cv::Mat allocator that recycles pixel buffers instead of returning them to
+// the heap. The per-frame path creates the same set of images every frame
+// (captured and converted frames, ROI copies, Farneback's pyramids and
+// polynomial expansions), so after the first few frames every allocation is
+// served from buffers the previous frame released: no malloc, no operator
+// new, no page faults.
+//
+// Buffers are binned by size class (powers of two split in quarters), so ROIs
+// that change size a little between frames share bins. Memory is bounded by
+// the peak number of live buffers per class and is never given back; the pool
+// lives for the rest of the process once installed.
+class FramePool final : public cv::MatAllocator
+{
+public:
+    struct Stats
+    {
+        // Buffers obtained from the heap; flat once the loop is warm
+        std::uint64_t heapAllocations;
+        // Allocations served from recycled buffers
+        std::uint64_t reused;
+        std::size_t reservedBytes;
+    };
+
+    // Makes the process-wide pool the default allocator of every cv::Mat
+    // created from now on; idempotent. Mats allocated before keep their
+    // allocator.
+    static FramePool& install();
+
+    [[nodiscard]] Stats getStats() const;
+
+    cv::UMatData* allocate(int dims, const int* sizes, int type, void* data, size_t* step,
+                           cv::AccessFlag flags, cv::UMatUsageFlags usageFlags) const override;
+
+    bool allocate(cv::UMatData* data, cv::AccessFlag accessFlags, cv::UMatUsageFlags usageFlags) const override;
+
+    void deallocate(cv::UMatData* data) const override;
+
+private:
+    struct Bin
+    {
+        std::vector<void*> free;
+        // Buffers of this class handed out or free; free never outgrows it,
+        // so returning a buffer never reallocates the vector
+        std::size_t total = 0;
+    };
+
+    FramePool() = default;
+
+    [[nodiscard]] static std::size_t sizeClass(std::size_t size);
+
+    [[nodiscard]] void* takeBuffer(std::size_t size) const;
+
+    void giveBuffer(void* buffer, std::size_t size) const;
+
+    [[nodiscard]] cv::UMatData* takeHeader() const;
+
+    void giveHeader(cv::UMatData* header) const;
+
+    mutable std::mutex m_mutex;
+    mutable std::unordered_map<std::size_t, Bin> m_bins;
+    mutable Bin m_headers;
+    mutable Stats m_stats{};
+};
+
+#endif
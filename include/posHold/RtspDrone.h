@@ -0,0 +1,107 @@
+#ifndef RTSPDRONE_H
+#define RTSPDRONE_H
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+#include <opencv2/opencv.hpp>
+
+#include "posHold/Drone.h"
+
+// Drone whose camera is an RTSP/H.264 stream, e.g. a Pi camera served by
+// mediamtx on the bench (rtsp://localhost:8554/stream).
+//
+// The stream goes through a GStreamer pipeline tuned for latency rather than
+// smoothness: no jitter buffer, no decoder frame threading (it holds back one
+// frame per thread), and an appsink that keeps only the newest frame. The
+// decoder's planar YUV output reaches us unconverted and the luma plane is
+// handed out as is, so no frame is ever converted to BGR and back to gray.
+// Without GStreamer support in OpenCV the FFmpeg backend is used with its
+// low-delay options instead, at the cost of a colour conversion per frame.
+//
+// Frame timestamps come from the stream's presentation timestamps, mapped onto
+// steady_clock through the smallest arrival delay seen so far: intervals and
+// dropped frames are those of the camera, not of network or decoder jitter.
+// Attitude and altitude are read over MSP when a link is given, as in Drone.
+class RtspDrone : public Drone
+{
+public:
+    struct Options
+    {
+        std::string url = "rtsp://localhost:8554/stream";
+        // rtspsrc transport: "udp" never waits for retransmissions, "tcp"
+        // survives lossy Wi-Fi at the cost of stalls
+        std::string protocols = "udp";
+        // GStreamer H.264 decoder and its properties; "v4l2h264dec" uses the
+        // Pi's hardware decoder
+        std::string decoder = "avdec_h264 max-threads=1";
+        // Encoder and network latency of the stream, seconds; subtracted from
+        // the timestamps when known (the PTS mapping cannot observe it)
+        double captureLatency = 0.0;
+        // Use the FFmpeg backend when the GStreamer pipeline cannot be opened
+        bool ffmpegFallback = true;
+    };
+
+    // Throws std::runtime_error if the stream cannot be opened
+    explicit RtspDrone(const Options& options, const CameraInfo& cameraInfo = defaultCameraInfo());
+
+    RtspDrone(const Options& options, msp::Msp& msp, const CameraInfo& cameraInfo = defaultCameraInfo());
+
+    // "gstreamer" or "ffmpeg"
+    [[nodiscard]] const char* getBackend() const;
+
+    // Newest decoded frame as a view of the decoder's luma plane; empty if
+    // the stream stalled or ended. Throws std::runtime_error if the stream
+    // resolution differs from cameraInfo
+    [[nodiscard]] cv::Mat getGrayscaleImage() override;
+
+    // Frames the stream carried between the last two returned ones, from
+    // their timestamps
+    [[nodiscard]] int getSkippedFrames() const override;
+
+    [[nodiscard]] double getFrameInterval() const override;
+
+    // Capture time of the last frame, from its presentation timestamp
+    [[nodiscard]] std::chrono::steady_clock::time_point getFrameTimestamp() const override;
+
+    // Seconds from the capture of the last frame to its return from
+    // getGrayscaleImage()
+    [[nodiscard]] double getFrameAge() const;
+
+private:
+    static constexpr double s_defaultFps = 30.0;
+    // A timestamp this far behind the previous one means the stream restarted
+    static constexpr double s_restartSeconds = 1.0;
+    // Largest rate difference between the sender's and our clock
+    static constexpr double s_clockDriftPpm = 100.0;
+    // Treat the FFmpeg capture as backlogged once a read comes this many
+    // frame periods after the previous one (GStreamer drops on its own)
+    static constexpr double s_backlogPeriods = 1.5;
+    static constexpr int s_maxSkippedFrames = 4;
+
+    [[nodiscard]] std::string pipeline() const;
+
+    void open();
+
+    // Skips frames the FFmpeg backend queued while the caller was busy
+    void drainBacklog();
+
+    void updateTimestamp(double positionMs, std::chrono::steady_clock::time_point arrival);
+
+    const Options m_options;
+    cv::VideoCapture m_capture;
+    bool m_gstreamer = false;
+    double m_framePeriod = 1.0 / s_defaultFps;
+    int m_skippedFrames = 0;
+    double m_frameInterval = 0.0;
+    double m_frameAge = 0.0;
+    // Presentation timestamp of the last frame, ms; negative before the first
+    double m_positionMs = -1.0;
+    // steady_clock time of PTS zero, by the fastest arrival seen
+    std::chrono::steady_clock::duration m_clockOffset{};
+    std::chrono::steady_clock::time_point m_frameTimestamp;
+    std::chrono::steady_clock::time_point m_lastRead;
+};
+
+#endif
@@ -0,0 +1,117 @@
+#ifndef STATEESTIMATOR_H
+#define STATEESTIMATOR_H
+
+#include <array>
+#include <chrono>
+
+#include <opencv2/opencv.hpp>
+#include "posHold/Drone.h"
+
+// Linear Kalman filter over [x, y, vx, vy, z, vz].
+// Horizontal axes are the image axes used by VecDown/VecMove (meters, m/s),
+// z is the barometric altitude. All matrices are fixed-size cv::Matx, so the
+// filter never touches the heap and the compiler can unroll every product.
+//
+// predict() is meant to run at telemetry rate (attitude drives the horizontal
+// acceleration), updateAltitude() whenever MSP_ALTITUDE arrives and
+// updateFlow() once per camera frame with the VecMove displacement. The timed
+// overloads let flow that lands after later predictions (vision lagging
+// telemetry) correct the state of its frame rather than the newest one.
+class StateEstimator
+{
+public:
+    StateEstimator();
+
+    // positionNoise applies to updatePosition(), e.g. with
+    // VecMove::getAccumulatedPosition() in keyframe flow mode
+    StateEstimator(double accelNoise, double flowNoise, double altitudeNoise, double varioNoise,
+                   double positionNoise = 0.05);
+
+    void predict(const Drone::GyroData& attitude, double dt);
+
+    // Same as predict(attitude, dt), and remembers the step taken at time so
+    // a late flow measurement can be applied where it belongs
+    void predict(const Drone::GyroData& attitude, double dt, std::chrono::steady_clock::time_point time);
+
+    void updateAltitude(const Drone::AltitudeData& altitudeData);
+
+    void updateFlow(const cv::Point2f& displacement, double dt);
+
+    // Flow of a frame taken at sampleTime: the horizontal state is rewound to
+    // the newest timed prediction at or before it, corrected there and
+    // propagated again through the steps recorded since. Applied to the
+    // current state when sampleTime is older than the recorded steps.
+    void updateFlow(const cv::Point2f& displacement, double dt, std::chrono::steady_clock::time_point sampleTime);
+
+    // Position measured against the same origin as the estimate
+    void updatePosition(const cv::Point2f& position);
+
+    // Same as updatePosition(position), applied at sampleTime like the timed
+    // updateFlow()
+    void updatePosition(const cv::Point2f& position, std::chrono::steady_clock::time_point sampleTime);
+
+    void resetPosition();
+
+    [[nodiscard]] cv::Point2f getPosition() const;
+
+    [[nodiscard]] cv::Point2f getVelocity() const;
+
+    [[nodiscard]] double getAltitude() const;
+
+    [[nodiscard]] double getVerticalSpeed() const;
+
+private:
+    static constexpr int s_stateSize = 6;
+    static constexpr float s_gravity = 9.80665f;
+    static constexpr float s_initialVariance = 100.0f;
+    // Timed predictions kept for late flow: a quarter second at 250 Hz
+    static constexpr int s_historySize = 64;
+
+    using State = cv::Matx<float, s_stateSize, 1>;
+    using Covariance = cv::Matx<float, s_stateSize, s_stateSize>;
+
+    // A timed prediction, with the state and covariance right after it and
+    // any flow applied at its time
+    struct Step
+    {
+        std::chrono::steady_clock::time_point time;
+        Drone::GyroData attitude;
+        float dt;
+        State state;
+        Covariance covariance;
+    };
+
+    void propagate(const Drone::GyroData& attitude, float t);
+
+    // Measurement matrix picking [x, y] (first = 0) or [vx, vy] (first = 2)
+    [[nodiscard]] static cv::Matx<float, 2, s_stateSize> horizontalRows(int first);
+
+    void updateHorizontalAt(std::chrono::steady_clock::time_point sampleTime,
+                            const cv::Matx<float, 2, s_stateSize>& H,
+                            const cv::Matx<float, 2, 1>& z,
+                            float variance);
+
+    // Stores the current state into the newest recorded step
+    void refreshNewestStep();
+
+    template <int M>
+    void update(const cv::Matx<float, M, s_stateSize>& H,
+                const cv::Matx<float, M, 1>& z,
+                const cv::Matx<float, M, M>& R);
+
+    const float m_accelVariance;
+    const float m_flowVariance;
+    const float m_altitudeVariance;
+    const float m_varioVariance;
+    const float m_positionVariance;
+
+    State m_state;
+    Covariance m_covariance;
+    bool m_hasAltitude = false;
+
+    std::array<Step, s_historySize> m_history;
+    int m_historyNewest = 0;
+    int m_historyCount = 0;
+};
+
+#endif
@@ -0,0 +1,64 @@
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <condition_variable>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fork-join pool for per-frame work. The threads are started once and sleep
+// between frames; run() hands out task indices to them and to the calling
+// thread, which also works, and returns when every task has finished. A
+// pool of one thread starts nothing and runs the tasks inline.
+class ThreadPool
+{
+public:
+    // threads counts the caller, so threads - 1 workers are started
+    explicit ThreadPool(int threads);
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    ~ThreadPool();
+
+    // Calls task(i) for every i in [0, count) and waits for all of them. The
+    // first exception a task throws is rethrown here once the rest are done.
+    // The task is passed by reference, never copied or wrapped in a
+    // std::function, so dispatching a frame does not allocate.
+    template <class Task>
+    void run(const int count, const Task& task)
+    {
+        dispatch(count, &task, [](const void* context, const int index)
+        {
+            (*static_cast<const Task*>(context))(index);
+        });
+    }
+
+    [[nodiscard]] int size() const;
+
+private:
+    using Invoke = void (*)(const void* context, int index);
+
+    void dispatch(int count, const void* context, Invoke invoke);
+
+    void work();
+
+    // Claims and runs tasks of the current run() until none is left; called
+    // with m_mutex held and returns with it held
+    void drain(std::unique_lock<std::mutex>& lock);
+
+    std::mutex m_mutex;
+    std::condition_variable m_start;
+    std::condition_variable m_done;
+    const void* m_context = nullptr;
+    Invoke m_invoke = nullptr;
+    int m_count = 0;
+    int m_next = 0;
+    int m_running = 0;
+    std::exception_ptr m_error;
+    bool m_stop = false;
+    std::vector<std::thread> m_threads;
+};
+
+#endif
@@ -1,6 +1,7 @@
 #ifndef VECDOWN_H
 #define VECDOWN_H
 
+#include "posHold/CameraProfile.h"
 #include "posHold/Drone.h"
 
 class VecDown
@@ -20,6 +21,8 @@ private:
     [[nodiscard]] cv::Point2f calcVecDownProjection();
 
     Drone* m_drone;
+    // Projection specialised for the drone's camera profile
+    CameraKernels m_kernels;
     cv::Point2f m_vecDown;
     cv::Point2f m_vecDownDisplacement;
     bool m_hasPrev = false;
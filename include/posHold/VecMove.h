@@ -1,6 +1,7 @@
 #ifndef VECMOVE_H
 #define VECMOVE_H
 
+#include "posHold/CameraProfile.h"
 #include "posHold/Drone.h"
 #include "posHold/VecDown.h"
 #include "posHold/CameraOpticalFlow.h"
@@ -8,20 +9,88 @@
 class VecMove
 {
 public:
-    explicit VecMove(Drone& drone);
+    // flowTiles optical-flow tiles are computed in parallel per frame and
+    // fused (see CameraOpticalFlow); more than one is opt-in, as each extra
+    // tile takes a core. In Keyframe flow mode the displacement comes from
+    // the position against the keyframe
+    explicit VecMove(Drone& drone, int flowTiles = 1,
+                     CameraOpticalFlow::Mode flowMode = CameraOpticalFlow::Mode::Consecutive);
 
     void calc();
 
     [[nodiscard]] cv::Point2f getVecMove() const;
 
+    // False until calc() has produced a displacement
+    [[nodiscard]] bool hasVecMove() const;
+
+    // Confidence in the optical flow behind the last getVecMove(), from 0 to
+    // 1 (CameraOpticalFlow::getFlowConfidence()). At zero the flow was not
+    // measured, e.g. the first frame, a down vector outside the frame or a
+    // lost keyframe: getVecMove() then holds at most the attitude change, and
+    // feeding it to the StateEstimator would read as hovering
+    [[nodiscard]] double getFlowConfidence() const;
+
+    // Projection of the down vector used by the last calc()
+    [[nodiscard]] cv::Point2f getVecDown() const;
+
+    // Optical flow (pixels) averaged around the down vector by the last
+    // calc(), fused over the flow tiles; zero when the down vector fell
+    // outside the frame
+    [[nodiscard]] cv::Point2f getMeanFlow() const;
+
+    // Flow tiles of the last calc(), with their weights and timings
+    [[nodiscard]] const std::vector<CameraOpticalFlow::Tile>& getFlowTiles() const;
+
+    // Sum of getVecMove() since the first calc(), meters. In Keyframe flow
+    // mode it is the keyframe's position plus the offset measured against
+    // it, so errors do not accumulate while a keyframe holds
+    [[nodiscard]] cv::Point2f getAccumulatedPosition() const;
+
+    // Keyframe flow mode: position relative to the current keyframe, meters
+    [[nodiscard]] cv::Point2f getKeyframeOffset() const;
+
+    // Keyframe flow mode: keyframes taken so far
+    [[nodiscard]] std::uint64_t getKeyframeCount() const;
+
+    // Seconds spanned by the last getVecMove() displacement, including any
+    // frames the camera dropped in between
+    [[nodiscard]] double getSampleInterval() const;
+
+    [[nodiscard]] std::chrono::steady_clock::time_point getSampleTimestamp() const;
+
 private:
-    static constexpr int s_accountFlowPixels = 10;
-    static constexpr int s_calcFlowPixels = 50;
+    // Lower bound of the Farneback ROI half-size; the upper bound is the
+    // camera profile's maxRoiRadius, which flow buffers are sized for once
+    static constexpr int s_minCalcFlowPixels = 10;
+    static constexpr int s_minAccountFlowPixels = 5;
+    // Ground radius (meters) the ROI keeps covering when flying low
+    static constexpr double s_minGroundRadius = 0.05;
+    // ROI half-size in multiples of the predicted per-frame pixel motion
+    static constexpr double s_motionMargin = 3.0;
+    // Pixels Farneback may process per frame at its working scale
+    static constexpr double s_flowPixelBudget = 96.0 * 96.0;
     static constexpr double s_noFlowBalanceVecMultiplier = 1.0f;
+
+    void updateFlowRadii(double altitude);
+
+    [[nodiscard]] cv::Point2f keyframeVecMove(const cv::Point2f& p, double altitude);
+
     Drone* m_drone;
+    const CameraKernels m_kernels;
     VecDown m_vecDown;
     CameraOpticalFlow m_cameraOpticalFlow;
     cv::Point2f m_vecMove;
+    cv::Point2f m_meanFlow;
+    double m_flowConfidence = 0.0;
+    cv::Point2f m_position;
+    // Position and down-vector projection when the current keyframe was taken
+    cv::Point2f m_keyframeOrigin;
+    cv::Point2f m_keyframeVecDown;
+    double m_sampleInterval = 0.0;
+    std::chrono::steady_clock::time_point m_sampleTimestamp;
+    int m_calcFlowPixels = s_minCalcFlowPixels;
+    int m_accountFlowPixels = s_minCalcFlowPixels;
+    double m_predictedMotion = 0.0;
     bool m_hasPrev = false;
 };
 
@@ -0,0 +1,91 @@
+#ifndef VIDEORECORDER_H
+#define VIDEORECORDER_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <opencv2/opencv.hpp>
+
+// Records frames on its own low-priority thread so encoding never stalls the
+// control loop. submit() only moves a cv::Mat header (reference counted, no
+// pixel copy) into a bounded queue; when the queue is full the frame is
+// dropped and counted instead of waiting for the encoder.
+//
+// A submitted frame shares its pixels with the caller, so the caller must not
+// write into that buffer afterwards (read each frame into a fresh cv::Mat).
+class VideoRecorder
+{
+public:
+    struct Options
+    {
+        std::string path = "output.mp4";
+        int fourcc = cv::VideoWriter::fourcc('m', 'p', '4', 'v');
+        double fps = 30.0;
+        // Size of the frames passed to submit()
+        cv::Size frameSize;
+        std::size_t queueDepth = 8;
+        // Record every Nth submitted frame
+        int frameStride = 1;
+        // Non-empty: record a grayscale window of this size around the point
+        // given to submit() instead of the whole frame; must fit in frameSize
+        cv::Size roiSize;
+        // Record whole frames converted to grayscale
+        bool grayscale = false;
+    };
+
+    explicit VideoRecorder(const Options& options);
+
+    VideoRecorder(const VideoRecorder&) = delete;
+    VideoRecorder& operator=(const VideoRecorder&) = delete;
+
+    // Encodes what is still queued, then closes the file
+    ~VideoRecorder();
+
+    [[nodiscard]] bool isOpened() const;
+
+    // Returns false if the frame was dropped because the encoder is behind.
+    // roiCenter is used only when Options::roiSize is set.
+    bool submit(const cv::Mat& frame, cv::Point roiCenter = {});
+
+    [[nodiscard]] std::uint64_t getRecordedFrames() const;
+
+    // Frames lost to a full queue or an encoder failure
+    [[nodiscard]] std::uint64_t getDroppedFrames() const;
+
+private:
+    struct Job
+    {
+        cv::Mat frame;
+        cv::Rect roi;
+    };
+
+    void run();
+
+    void encode(const Job& job);
+
+    const Options m_options;
+    cv::VideoWriter m_writer;
+    cv::Mat m_converted;
+
+    std::mutex m_mutex;
+    std::condition_variable m_ready;
+    std::vector<Job> m_queue;
+    std::size_t m_head = 0;
+    std::size_t m_size = 0;
+    bool m_stopping = false;
+
+    std::uint64_t m_submitted = 0;
+    std::atomic<std::uint64_t> m_recorded{ 0 };
+    std::atomic<std::uint64_t> m_dropped{ 0 };
+    std::atomic<bool> m_failed{ false };
+
+    std::thread m_thread;
+};
+
+#endif
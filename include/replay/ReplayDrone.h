@@ -0,0 +1,70 @@
+#ifndef REPLAYDRONE_H
+#define REPLAYDRONE_H
+
+#include <chrono>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include "posHold/Drone.h"
+
+// Drone backed by a recorded flight: a video readable by cv::VideoCapture and
+// a telemetry CSV with one row per video frame
+//
+//   timestamp_us,skipped,roll,pitch,yaw,altitude,vario
+//
+// timestamp_us is the steady_clock time the frame was captured at, skipped the
+// frames the live pipeline dropped before it, angles are in radians and
+// altitude/vario in meters and meters per second (the units of GyroData and
+// AltitudeData).
+//
+// Telemetry getters return the row of the frame the next getGrayscaleImage()
+// will decode, which matches the live order in VecMove::calc (attitude and
+// altitude are read first, then the frame). Frame getters describe the frame
+// returned last. Nothing here waits, so a log replays as fast as it decodes.
+class ReplayDrone : public Drone
+{
+public:
+    struct Sample
+    {
+        std::chrono::steady_clock::time_point timestamp;
+        int skippedFrames;
+        GyroData attitude;
+        AltitudeData altitude;
+    };
+
+    ReplayDrone(const std::string& videoPath,
+                const std::string& telemetryPath,
+                const CameraInfo& cameraInfo = defaultCameraInfo());
+
+    [[nodiscard]] bool hasNextFrame() const;
+
+    // Zero-based index of the frame returned by the last getGrayscaleImage()
+    [[nodiscard]] std::size_t getFrameIndex() const;
+
+    [[nodiscard]] cv::Mat getGrayscaleImage() override;
+
+    [[nodiscard]] int getSkippedFrames() const override;
+
+    [[nodiscard]] double getFrameInterval() const override;
+
+    [[nodiscard]] std::chrono::steady_clock::time_point getFrameTimestamp() const override;
+
+    [[nodiscard]] GyroData getGyroData() override;
+
+    [[nodiscard]] AltitudeData getAltitudeData() override;
+
+private:
+    [[nodiscard]] static std::vector<Sample> loadTelemetry(const std::string& path);
+
+    // Row of the next frame, or of the last one once the log is exhausted
+    [[nodiscard]] const Sample& upcoming() const;
+
+    cv::VideoCapture m_video;
+    std::vector<Sample> m_samples;
+    std::size_t m_next = 0;
+    cv::Mat m_frame;
+    double m_frameInterval = 0.0;
+};
+
+#endif
@@ -0,0 +1,128 @@
+#ifndef SYNTHETICDRONE_H
+#define SYNTHETICDRONE_H
+
+#include <chrono>
+#include <cstddef>
+
+#include <opencv2/opencv.hpp>
+
+#include "posHold/Drone.h"
+#include "sim/Trajectory.h"
+
+// Drone flying a scripted Trajectory over a procedurally textured ground plane
+//
+// Frames are rendered through the cameraInfo pinhole model (including its
+// distortion) at a fixed frame rate, so the same trajectory and options give
+// the same frames on every run. Telemetry is the exact trajectory pose plus
+// optional noise, and the ground truth of every frame is available for
+// scoring CameraOpticalFlow and VecMove against.
+//
+// The camera looks straight down the body -z axis with image x along body -x
+// and image y along body y, which is the model VecDown projects with. The
+// horizon must stay out of view (tilt below 90 degrees minus half the field of
+// view). The texture is mirrored beyond its edges, so the ground is unbounded.
+//
+// Like ReplayDrone, telemetry getters describe the frame the next
+// getGrayscaleImage() will render and frame getters the one returned last.
+class SyntheticDrone : public Drone
+{
+public:
+    struct Options
+    {
+        double fps = 30.0;
+        // Ground texture: textureSize x textureSize texels of texelSize meters
+        int textureSize = 4096;
+        double texelSize = 0.0025;
+        unsigned seed = 1;
+        // Gaussian sensor noise, in gray levels
+        double imageNoise = 0.0;
+        // Gaussian defocus blur, in pixels
+        double defocusSigma = 0.0;
+        // Shutter time centred on the frame time; above zero, motion blur is
+        // rendered from motionBlurSamples poses across it
+        double exposureTime = 0.0;
+        int motionBlurSamples = 4;
+        // Gaussian telemetry noise, in radians and meters
+        double attitudeNoise = 0.0;
+        double altitudeNoise = 0.0;
+    };
+
+    SyntheticDrone(Trajectory trajectory, const Options& options, const CameraInfo& cameraInfo = defaultCameraInfo());
+
+    [[nodiscard]] bool hasNextFrame() const;
+
+    // Zero-based index of the frame returned by the last getGrayscaleImage()
+    [[nodiscard]] std::size_t getFrameIndex() const;
+
+    [[nodiscard]] cv::Mat getGrayscaleImage() override;
+
+    [[nodiscard]] int getSkippedFrames() const override;
+
+    [[nodiscard]] double getFrameInterval() const override;
+
+    [[nodiscard]] std::chrono::steady_clock::time_point getFrameTimestamp() const override;
+
+    [[nodiscard]] GyroData getGyroData() override;
+
+    [[nodiscard]] AltitudeData getAltitudeData() override;
+
+    // Wall time the last getGrayscaleImage() spent rendering, for timing a
+    // pipeline around it
+    [[nodiscard]] double getRenderSeconds() const;
+
+    // Exact pose of the frame returned last
+    [[nodiscard]] Trajectory::Pose getTruePose() const;
+
+    // Ground-plane (x, y) and altitude change between the last two frames
+    [[nodiscard]] cv::Vec3d getTrueDisplacement() const;
+
+    // getTrueDisplacement() in the frame VecMove::getVecMove() reports in:
+    // the horizontal displacement rotated by the current yaw onto the image
+    // axes, in meters
+    [[nodiscard]] cv::Point2f getTrueVecMove() const;
+
+    // Where the ground seen at rectified pixel p of the previous frame moved
+    // to in the last frame, minus p: the flow CameraOpticalFlow should report
+    [[nodiscard]] cv::Point2f getTrueFlowAt(cv::Point2f p) const;
+
+private:
+    // Rotation from ground to body axes, as in VecDown::calcVecDown3d
+    [[nodiscard]] static cv::Matx33d bodyFromGround(const Trajectory::Pose& pose);
+
+    // Homography from rectified pixels to texels for a camera at pose
+    [[nodiscard]] cv::Matx33d texelsFromPixels(const Trajectory::Pose& pose) const;
+
+    [[nodiscard]] cv::Point2d groundPoint(const Trajectory::Pose& pose, cv::Point2d p) const;
+
+    [[nodiscard]] cv::Point2d project(const Trajectory::Pose& pose, cv::Point2d ground) const;
+
+    [[nodiscard]] double frameTime(std::size_t index) const;
+
+    // Procedural ground of size x size texels, shared by drones with the same seed
+    [[nodiscard]] static cv::Mat groundTexture(int size, unsigned seed);
+
+    void render(const Trajectory::Pose& pose, cv::Mat& out);
+
+    // Draws the telemetry noise of the frame getGrayscaleImage() renders next
+    void sampleTelemetry();
+
+    Trajectory m_trajectory;
+    Options m_options;
+    cv::RNG m_rng;
+    cv::Mat m_texture;
+    // Rectified coordinates of every sensor pixel, only for distorted cameras
+    cv::Mat m_rectifiedPixels;
+    cv::Mat m_texelMap;
+    cv::Mat m_render;
+    cv::Mat m_accumulator;
+    cv::Mat m_noise;
+    std::size_t m_next = 0;
+    std::size_t m_frameCount;
+    double m_renderSeconds = 0.0;
+    Trajectory::Pose m_pose{};
+    Trajectory::Pose m_prevPose{};
+    GyroData m_upcomingAttitude{};
+    AltitudeData m_upcomingAltitude{};
+};
+
+#endif
@@ -0,0 +1,53 @@
+#ifndef TRAJECTORY_H
+#define TRAJECTORY_H
+
+#include <string>
+#include <vector>
+
+// Scripted 6-DoF flight path: keyframes linearly interpolated in time
+//
+// x and y are ground-plane meters, altitude is meters above the ground and
+// roll/pitch/yaw are radians in the Drone::GyroData convention. exposure is a
+// gain applied to the rendered frame (1 = nominal), for scripting lighting
+// changes. Angles are interpolated as plain numbers, so a yaw script that
+// turns past pi keeps counting rather than wrapping.
+class Trajectory
+{
+public:
+    struct Pose
+    {
+        double x;
+        double y;
+        double altitude;
+        double roll;
+        double pitch;
+        double yaw;
+        double exposure;
+    };
+
+    struct Keyframe
+    {
+        double time;
+        Pose pose;
+    };
+
+    // Keyframes must be in increasing time order
+    explicit Trajectory(std::vector<Keyframe> keyframes);
+
+    // CSV with one keyframe per row; the exposure column may be omitted
+    //
+    //   time,x,y,altitude,roll,pitch,yaw[,exposure]
+    [[nodiscard]] static Trajectory load(const std::string& path);
+
+    // Pose at time t seconds; held at the first/last keyframe outside the script
+    [[nodiscard]] Pose at(double t) const;
+
+    [[nodiscard]] double startTime() const;
+
+    [[nodiscard]] double duration() const;
+
+private:
+    std::vector<Keyframe> m_keyframes;
+};
+
+#endif
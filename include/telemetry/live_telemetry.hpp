@@ -0,0 +1,202 @@
+/**
+ * @file live_telemetry.hpp
+ * @brief Live state of the control loop in a POSIX shared-memory segment
+ *
+ * Segment layout (version 1, little-endian): one Segment holding a header
+ * and the latest Snapshot, versioned by a seqlock. The single writer
+ * overwrites the snapshot in place; any number of readers in other processes
+ * copy it out whenever they like. Publishing is a handful of plain stores
+ * into a resident mapping: no syscall, lock or allocation in the control
+ * loop, and a slow or crashed reader cannot stall it.
+ *
+ * The seqlock counter is odd while a snapshot is being written. A reader
+ * copies the snapshot between two loads of the counter and retries when they
+ * differ or the first one is odd. The snapshot is stored as 64-bit atomic
+ * words so concurrent copies are well defined rather than data races.
+ */
+
+#ifndef LIVE_TELEMETRY_HPP
+#define LIVE_TELEMETRY_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <type_traits>
+
+namespace telemetry {
+
+static_assert(__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__,
+              "telemetry segments are little-endian");
+
+static constexpr char MAGIC[8] = {'P', 'H', 'L', 'I', 'V', 'E', '\0', '\0'};
+static constexpr std::uint32_t VERSION = 1;
+/// shm_open() name used by the tools when none is given.
+static constexpr char DEFAULT_SEGMENT[] = "/poshold_telemetry";
+
+/**
+ * @brief One control-loop iteration, in the units of the flight log records
+ * (radians, meters, meters per second, pixels, PWM microseconds).
+ */
+struct Snapshot {
+  std::uint64_t timestamp_us; ///< steady_clock time of the frame
+  std::uint32_t frame;
+  std::uint32_t skipped_frames;
+
+  // Telemetry from the flight controller
+  float roll;
+  float pitch;
+  float yaw;
+  float altitude;
+  float vario;
+
+  // Vision
+  float frame_interval; ///< Seconds since the previous frame
+  float flow_x;         ///< VecMove::getMeanFlow(), pixels
+  float flow_y;
+  float vec_down_x; ///< VecMove::getVecDown(), pixels
+  float vec_down_y;
+  float vec_move_x; ///< VecMove::getVecMove(), meters
+  float vec_move_y;
+
+  // Estimator and controller
+  float position_x;
+  float position_y;
+  float velocity_x;
+  float velocity_y;
+  float setpoint_x;
+  float setpoint_y;
+  float estimated_altitude;
+  float pid_p[2]; ///< PidController::Terms, roll and pitch
+  float pid_i[2];
+  float pid_d[2];
+
+  std::uint16_t rc[8]; ///< Channels sent, in msp::Channels order; 0 if unused
+
+  // Stage timings of this iteration, microseconds
+  std::uint32_t vision_us;
+  std::uint32_t estimator_us;
+  std::uint32_t control_us;
+  std::uint32_t loop_us;
+  std::uint32_t reserved;
+};
+
+static_assert(std::is_trivially_copyable<Snapshot>::value,
+              "snapshots are copied word by word");
+static_assert(sizeof(Snapshot) == 152, "Snapshot layout");
+static_assert(sizeof(Snapshot) % sizeof(std::uint64_t) == 0,
+              "Snapshot must be a whole number of words");
+
+static constexpr std::size_t SNAPSHOT_WORDS =
+    sizeof(Snapshot) / sizeof(std::uint64_t);
+
+struct Segment {
+  char magic[8];
+  std::uint32_t version;
+  std::uint32_t snapshot_size;
+  std::uint32_t writer_pid;
+  std::uint32_t reserved;
+  std::uint64_t start_time_us; ///< steady_clock time the segment was created
+  /// Seqlock: odd while a snapshot is being written, 2 * snapshots published
+  /// otherwise
+  std::atomic<std::uint64_t> sequence;
+  std::atomic<std::uint64_t> words[SNAPSHOT_WORDS]; ///< The latest Snapshot
+};
+
+static_assert(std::atomic<std::uint64_t>::is_always_lock_free,
+              "the seqlock is shared through the mapping");
+static_assert(sizeof(Segment) == 40 + sizeof(Snapshot), "Segment layout");
+
+/**
+ * @class LiveTelemetryWriter
+ * @brief Creates the segment and publishes snapshots into it.
+ *
+ * The segment is sized and mapped with MAP_POPULATE at construction, so
+ * publish() touches only resident pages. There must be a single writer per
+ * segment; a second writer on the same name would corrupt the seqlock.
+ */
+class LiveTelemetryWriter {
+public:
+  /**
+   * @brief Create (or take over) the shared-memory object @p name and map it.
+   *
+   * @param name shm_open() name, e.g. DEFAULT_SEGMENT; must start with '/'.
+   * @throws std::system_error with original errno if the object cannot be
+   * created, sized or mapped.
+   */
+  explicit LiveTelemetryWriter(const char *name = DEFAULT_SEGMENT);
+
+  LiveTelemetryWriter(const LiveTelemetryWriter &) = delete;
+  LiveTelemetryWriter &operator=(const LiveTelemetryWriter &) = delete;
+
+  /**
+   * @brief Unmap and unlink the segment; errors are ignored. Readers keep
+   * their mapping and see the last snapshot.
+   */
+  ~LiveTelemetryWriter() noexcept;
+
+  /**
+   * @brief Replace the published snapshot with @p snapshot.
+   */
+  void publish(const Snapshot &snapshot) noexcept;
+
+  /// Snapshots published so far.
+  [[nodiscard]] std::uint64_t count() const noexcept;
+
+private:
+  int fd_ = -1;
+  Segment *segment_ = nullptr;
+  std::string name_;
+};
+
+/**
+ * @class LiveTelemetryReader
+ * @brief Maps a segment read-only and copies out consistent snapshots.
+ *
+ * Reading never blocks the writer and issues no syscall, so a monitor may
+ * poll at any rate.
+ */
+class LiveTelemetryReader {
+public:
+  /**
+   * @brief Map the shared-memory object @p name and validate its header.
+   *
+   * @throws std::system_error with original errno if it cannot be opened or
+   * mapped (ENOENT: no writer has created it yet).
+   * @throws std::runtime_error if it is not a version 1 telemetry segment.
+   */
+  explicit LiveTelemetryReader(const char *name = DEFAULT_SEGMENT);
+
+  LiveTelemetryReader(const LiveTelemetryReader &) = delete;
+  LiveTelemetryReader &operator=(const LiveTelemetryReader &) = delete;
+
+  ~LiveTelemetryReader() noexcept;
+
+  /**
+   * @brief Copy the latest snapshot into @p out.
+   *
+   * @param count If not null, receives the number of snapshots published
+   * up to the one copied, so pollers can tell a new snapshot from a repeat.
+   * @param max_attempts Copies to try while the writer keeps overwriting it.
+   * @return false if nothing has been published yet or every attempt raced
+   * with the writer; @p out is then unspecified.
+   */
+  bool read(Snapshot *out, std::uint64_t *count = nullptr,
+            unsigned max_attempts = 64) const noexcept;
+
+  /// Snapshots published so far.
+  [[nodiscard]] std::uint64_t count() const noexcept;
+
+  /// Process id of the writer that created the segment.
+  [[nodiscard]] std::uint32_t writer_pid() const noexcept;
+
+  [[nodiscard]] std::uint64_t start_time_us() const noexcept;
+
+private:
+  int fd_ = -1;
+  const Segment *segment_ = nullptr;
+};
+
+} // namespace telemetry
+
+#endif // !LIVE_TELEMETRY_HPP
@@ -1,11 +1,25 @@
 #ifndef UTILS_HPP
 #define UTILS_HPP
 
+#include <chrono>
+#include <functional>
 #include <iostream>
 #include <sstream>
 
 namespace utils {
 
+/**
+ * @brief Time source for components that measure dt themselves.
+ *
+ * Defaults to std::chrono::steady_clock; offline replay injects the
+ * timestamps of the recorded samples instead.
+ */
+using Clock = std::function<std::chrono::steady_clock::time_point()>;
+
+inline std::chrono::steady_clock::time_point steady_now() {
+  return std::chrono::steady_clock::now();
+}
+
 template <class... T>
 [[noreturn]] inline void throw_errno(int e, T &&...parts) {
   std::ostringstream os;
@@ -1,8 +1,9 @@
 import json
+import sys
 import matplotlib.pyplot as plt
 
 def plot_data():
-    input_filename = "src/pid/path_data.json"
+    input_filename = sys.argv[1] if len(sys.argv) > 1 else "src/pid/path_data.json"
 
     try:
         with open(input_filename, 'r') as f:
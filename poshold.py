@@ -0,0 +1,193 @@
+import ctypes
+import os
+
+import numpy as np
+
+# Mirrors include/capi/poshold.h (ABI version 1). Arrays are handed to the
+# library in place: they must already have the documented dtype and be
+# C-contiguous, otherwise a ValueError is raised instead of copying.
+
+ABI_VERSION = 1
+LIBRARY_PATH = os.environ.get('POSHOLD_LIB', './build/libposhold.so')
+
+MSP_FRAME_OVERHEAD = 6
+MSP_SET_RAW_RC_FRAME_SIZE = MSP_FRAME_OVERHEAD + 16
+
+CAMERA_DTYPE = np.dtype([
+    ('resolution_x', '<i4'), ('resolution_y', '<i4'),
+    ('min_dist', '<f8'), ('max_dist', '<f8'),
+    ('focal_length_x', '<f8'), ('focal_length_y', '<f8'),
+    ('principal_x', '<f8'), ('principal_y', '<f8'),
+    ('distortion', '<f8', (5,)),
+])
+
+FRAME_INFO_DTYPE = np.dtype([
+    ('timestamp_us', '<i8'),
+    ('skipped_frames', '<i4'), ('reserved', '<i4'),
+    ('roll', '<f8'), ('pitch', '<f8'), ('yaw', '<f8'),
+    ('altitude', '<f8'), ('vario', '<f8'),
+])
+
+FLOW_RESULT_DTYPE = np.dtype([
+    ('vec_down_x', '<f4'), ('vec_down_y', '<f4'),
+    ('vec_move_x', '<f4'), ('vec_move_y', '<f4'),
+    ('valid', '<i4'), ('reserved', '<i4'),
+])
+
+MSP_FRAME_DTYPE = np.dtype([
+    ('direction', 'u1'), ('command_id', 'u1'), ('size', 'u1'), ('checksum_ok', 'u1'),
+    ('payload_offset', '<u4'),
+])
+
+
+class PosholdError(RuntimeError):
+    pass
+
+
+def _load():
+    lib = ctypes.CDLL(LIBRARY_PATH)
+    vp = ctypes.c_void_p
+    size = ctypes.c_size_t
+
+    lib.poshold_abi_version.restype = ctypes.c_int
+    lib.poshold_last_error.restype = ctypes.c_char_p
+
+    lib.poshold_pid_create.argtypes = [ctypes.c_float] * 4 + [ctypes.c_int64]
+    lib.poshold_pid_create.restype = vp
+    lib.poshold_pid_destroy.argtypes = [vp]
+    lib.poshold_pid_step_batch.argtypes = [vp, size, vp, vp, vp, vp, vp]
+    lib.poshold_pid_step_batch.restype = ctypes.c_int
+
+    lib.poshold_flow_create.argtypes = [vp]
+    lib.poshold_flow_create.restype = vp
+    lib.poshold_flow_destroy.argtypes = [vp]
+    lib.poshold_flow_camera.argtypes = [vp, vp]
+    lib.poshold_flow_process_batch.argtypes = [vp, size, vp, size, size, vp, vp]
+    lib.poshold_flow_process_batch.restype = ctypes.c_int
+
+    lib.poshold_msp_encode_set_raw_rc_batch.argtypes = [size, vp, vp]
+    lib.poshold_msp_encode_set_raw_rc_batch.restype = ctypes.c_int
+    lib.poshold_msp_decode_stream.argtypes = [vp, size, vp, size, ctypes.POINTER(ctypes.c_size_t)]
+    lib.poshold_msp_decode_stream.restype = ctypes.c_int
+
+    if lib.poshold_abi_version() != ABI_VERSION:
+        raise PosholdError(f"{LIBRARY_PATH}: ABI version {lib.poshold_abi_version()}, expected {ABI_VERSION}")
+    return lib
+
+
+_lib = None
+
+
+def library():
+    global _lib
+    if _lib is None:
+        _lib = _load()
+    return _lib
+
+
+def _ptr(array, dtype, shape=None, name='array'):
+    """Pointer to the data of array, which is used in place."""
+    if array is None:
+        return None
+    if array.dtype != dtype:
+        raise ValueError(f"{name} must have dtype {dtype}, got {array.dtype}")
+    if not array.flags['C_CONTIGUOUS']:
+        raise ValueError(f"{name} must be C-contiguous")
+    if shape is not None and array.shape != shape:
+        raise ValueError(f"{name} must have shape {shape}, got {array.shape}")
+    return array.ctypes.data
+
+
+def _check(result):
+    if result < 0:
+        raise PosholdError(library().poshold_last_error().decode())
+    return result
+
+
+class Pid:
+    """PidController whose clock is the timestamps given to step()."""
+
+    def __init__(self, k_p, k_i, k_d, k_df, start_time_us=0):
+        self._handle = library().poshold_pid_create(k_p, k_i, k_d, k_df, start_time_us)
+        if not self._handle:
+            raise MemoryError("poshold_pid_create failed")
+
+    def __del__(self):
+        if getattr(self, '_handle', None):
+            library().poshold_pid_destroy(self._handle)
+            self._handle = None
+
+    def step(self, positions, timestamps_us, velocities=None, desired=None, out=None):
+        """positions (N, 2) float32, timestamps_us (N,) int64 -> (N, 2) uint32 PWM."""
+        n = len(positions)
+        if out is None:
+            out = np.empty((n, 2), dtype=np.uint32)
+        _check(library().poshold_pid_step_batch(
+            self._handle, n,
+            _ptr(positions, np.float32, (n, 2), 'positions'),
+            _ptr(velocities, np.float32, (n, 2), 'velocities'),
+            _ptr(desired, np.float32, (n, 2), 'desired'),
+            _ptr(timestamps_us, np.int64, (n,), 'timestamps_us'),
+            _ptr(out, np.uint32, (n, 2), 'out')))
+        return out
+
+
+class Flow:
+    """VecDown/VecMove over grayscale frames held in numpy arrays."""
+
+    def __init__(self, camera=None):
+        camera_ptr = None
+        if camera is not None:
+            camera = np.asarray(camera, dtype=CAMERA_DTYPE).reshape(())
+            camera_ptr = camera.ctypes.data
+        self._handle = library().poshold_flow_create(camera_ptr)
+        if not self._handle:
+            raise PosholdError(library().poshold_last_error().decode())
+
+        self.camera = np.zeros((), dtype=CAMERA_DTYPE)
+        library().poshold_flow_camera(self._handle, self.camera.ctypes.data)
+
+    def __del__(self):
+        if getattr(self, '_handle', None):
+            library().poshold_flow_destroy(self._handle)
+            self._handle = None
+
+    def process(self, frames, info, out=None):
+        """frames (N, H, W) uint8 with row-contiguous frames, info (N,) FRAME_INFO_DTYPE."""
+        if frames.dtype != np.uint8 or frames.ndim != 3 or frames.strides[2] != 1:
+            raise ValueError("frames must be an (N, H, W) uint8 array with contiguous rows")
+        n, height, width = frames.shape
+        if (width, height) != (int(self.camera['resolution_x']), int(self.camera['resolution_y'])):
+            raise ValueError(f"frames must be {int(self.camera['resolution_x'])}x{int(self.camera['resolution_y'])}")
+        if out is None:
+            out = np.empty(n, dtype=FLOW_RESULT_DTYPE)
+        _check(library().poshold_flow_process_batch(
+            self._handle, n, frames.ctypes.data, frames.strides[1], frames.strides[0],
+            _ptr(info, FRAME_INFO_DTYPE, (n,), 'info'),
+            _ptr(out, FLOW_RESULT_DTYPE, (n,), 'out')))
+        return out
+
+
+def msp_encode_set_raw_rc(channels, out=None):
+    """channels (N, 8) uint16 -> (N, MSP_SET_RAW_RC_FRAME_SIZE) uint8 frames."""
+    n = len(channels)
+    if out is None:
+        out = np.empty((n, MSP_SET_RAW_RC_FRAME_SIZE), dtype=np.uint8)
+    _check(library().poshold_msp_encode_set_raw_rc_batch(
+        n, _ptr(channels, np.uint16, (n, 8), 'channels'),
+        _ptr(out, np.uint8, (n, MSP_SET_RAW_RC_FRAME_SIZE), 'out')))
+    return out
+
+
+def msp_decode_stream(data, max_frames=None):
+    """Split a uint8 byte stream into frames; returns (frames, bytes consumed).
+
+    Payload i is data[frames['payload_offset'][i]:][:frames['size'][i]].
+    """
+    if max_frames is None:
+        max_frames = len(data) // MSP_FRAME_OVERHEAD + 1
+    frames = np.empty(max_frames, dtype=MSP_FRAME_DTYPE)
+    consumed = ctypes.c_size_t(0)
+    found = _check(library().poshold_msp_decode_stream(
+        _ptr(data, np.uint8, None, 'data'), len(data), frames.ctypes.data, max_frames, ctypes.byref(consumed)))
+    return frames[:found], consumed.value
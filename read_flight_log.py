@@ -0,0 +1,99 @@
+import sys
+
+import numpy as np
+
+# Mirrors include/flightlog/flight_log.hpp (version 1)
+MAGIC = b'PHFLOG\x00\x00'
+VERSION = 1
+THUMBNAIL_SIDE = 64
+
+STREAMS = ['telemetry', 'flow', 'controller', 'rc', 'thumbnail']
+
+STREAM_INFO_DTYPE = np.dtype([
+    ('record_size', '<u4'),
+    ('reserved', '<u4'),
+    ('offset', '<u8'),
+    ('capacity', '<u8'),
+    ('count', '<u8'),
+    ('dropped', '<u8'),
+])
+
+HEADER_DTYPE = np.dtype([
+    ('magic', 'u1', (8,)),
+    ('version', '<u4'),
+    ('stream_count', '<u4'),
+    ('start_time_us', '<u8'),
+    ('streams', STREAM_INFO_DTYPE, (len(STREAMS),)),
+])
+
+RECORD_DTYPES = {
+    'telemetry': np.dtype([
+        ('timestamp_us', '<u8'),
+        ('roll', '<f4'), ('pitch', '<f4'), ('yaw', '<f4'),
+        ('altitude', '<f4'), ('vario', '<f4'),
+        ('reserved', '<u4'),
+    ]),
+    'flow': np.dtype([
+        ('timestamp_us', '<u8'),
+        ('frame', '<u4'), ('skipped_frames', '<u4'),
+        ('interval', '<f4'),
+        ('vec_down_x', '<f4'), ('vec_down_y', '<f4'),
+        ('vec_move_x', '<f4'), ('vec_move_y', '<f4'),
+        ('reserved', '<u4'),
+    ]),
+    'controller': np.dtype([
+        ('timestamp_us', '<u8'),
+        ('position_x', '<f4'), ('position_y', '<f4'),
+        ('velocity_x', '<f4'), ('velocity_y', '<f4'),
+        ('setpoint_x', '<f4'), ('setpoint_y', '<f4'),
+        ('altitude', '<f4'),
+        ('reserved', '<u4'),
+    ]),
+    'rc': np.dtype([
+        ('timestamp_us', '<u8'),
+        ('channels', '<u2', (8,)),
+    ]),
+    'thumbnail': np.dtype([
+        ('timestamp_us', '<u8'),
+        ('frame', '<u4'),
+        ('width', '<u2'), ('height', '<u2'),
+        ('pixels', 'u1', (THUMBNAIL_SIDE, THUMBNAIL_SIDE)),
+    ]),
+}
+
+
+def open_flight_log(path):
+    """Map every stream of a flight log as a read-only numpy array.
+
+    The arrays are views of the file (np.memmap), cut to the records written
+    when the header was read; nothing is copied.
+    """
+    header = np.fromfile(path, dtype=HEADER_DTYPE, count=1)[0]
+    if header['magic'].tobytes() != MAGIC:
+        raise ValueError(f"{path} is not a flight log")
+    if header['version'] != VERSION:
+        raise ValueError(f"{path}: unsupported version {header['version']}")
+
+    log = {'start_time_us': int(header['start_time_us'])}
+    for name, info in zip(STREAMS, header['streams']):
+        dtype = RECORD_DTYPES[name]
+        if info['record_size'] != dtype.itemsize:
+            raise ValueError(f"{path}: record size mismatch in stream {name}")
+
+        count = int(info['count'])
+        log[name] = (np.memmap(path, dtype=dtype, mode='r', offset=int(info['offset']), shape=(count,))
+                     if count > 0 else np.empty(0, dtype=dtype))
+        log[name + '_dropped'] = int(info['dropped'])
+    return log
+
+
+if __name__ == '__main__':
+    if len(sys.argv) < 2:
+        print(f"Usage: {sys.argv[0]} <flight log>")
+        sys.exit(2)
+
+    flight_log = open_flight_log(sys.argv[1])
+    for stream in STREAMS:
+        records = flight_log[stream]
+        span = (records['timestamp_us'][-1] - records['timestamp_us'][0]) / 1e6 if len(records) > 1 else 0.0
+        print(f"{stream}: {len(records)} records over {span:.2f} s, {flight_log[stream + '_dropped']} dropped")
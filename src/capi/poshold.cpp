@@ -0,0 +1,346 @@
+#include <chrono>
+#include <cstring>
+#include <exception>
+#include <new>
+#include <string>
+
+#include "capi/poshold.h"
+#include "msp/codec.hpp"
+#include "msp/msp.hpp"
+#include "pid/pid.hpp"
+#include "posHold/Drone.h"
+#include "posHold/VecMove.h"
+
+namespace {
+
+thread_local std::string lastError;
+
+// Runs f, turning any exception into -1 and a poshold_last_error() message
+template <class F>
+int guarded(F&& f)
+{
+    try
+    {
+        lastError.clear();
+        return f();
+    }
+    catch (const std::exception& e)
+    {
+        lastError = e.what();
+    }
+    catch (...)
+    {
+        lastError = "unknown error";
+    }
+    return -1;
+}
+
+std::chrono::steady_clock::time_point fromMicroseconds(const int64_t us)
+{
+    return std::chrono::steady_clock::time_point(std::chrono::microseconds(us));
+}
+
+// Drone fed frame by frame from caller memory
+class BufferDrone final : public Drone
+{
+public:
+    explicit BufferDrone(const CameraInfo& cameraInfo) :
+        Drone(cameraInfo)
+    {
+    }
+
+    void setFrame(const cv::Mat& frame, const poshold_frame_info& info)
+    {
+        const auto timestamp = fromMicroseconds(info.timestamp_us);
+        m_frameInterval = m_hasFrame
+            ? std::chrono::duration<double>(timestamp - m_frameTimestamp).count()
+            : 0.0;
+        m_frameTimestamp = timestamp;
+        m_hasFrame = true;
+        m_frame = frame;
+        m_info = info;
+    }
+
+    [[nodiscard]] cv::Mat getGrayscaleImage() override
+    {
+        return m_frame;
+    }
+
+    [[nodiscard]] int getSkippedFrames() const override
+    {
+        return m_info.skipped_frames;
+    }
+
+    [[nodiscard]] double getFrameInterval() const override
+    {
+        return m_frameInterval;
+    }
+
+    [[nodiscard]] std::chrono::steady_clock::time_point getFrameTimestamp() const override
+    {
+        return m_frameTimestamp;
+    }
+
+    [[nodiscard]] GyroData getGyroData() override
+    {
+        return { m_info.roll, m_info.pitch, m_info.yaw };
+    }
+
+    [[nodiscard]] AltitudeData getAltitudeData() override
+    {
+        return { m_info.altitude, m_info.vario };
+    }
+
+private:
+    cv::Mat m_frame;
+    poshold_frame_info m_info{};
+    std::chrono::steady_clock::time_point m_frameTimestamp;
+    double m_frameInterval = 0.0;
+    bool m_hasFrame = false;
+};
+
+Drone::CameraInfo toCameraInfo(const poshold_camera& camera)
+{
+    return Drone::CameraInfo(
+        camera.resolution_x,
+        camera.resolution_y,
+        camera.min_dist,
+        camera.max_dist,
+        camera.focal_length_x,
+        camera.focal_length_y,
+        camera.principal_x,
+        camera.principal_y,
+        { camera.distortion[0], camera.distortion[1], camera.distortion[2],
+          camera.distortion[3], camera.distortion[4] });
+}
+
+} // namespace
+
+struct poshold_pid
+{
+    poshold_pid(float k_p, float k_i, float k_d, float k_df, std::chrono::steady_clock::time_point start) :
+        now{ start },
+        controller(k_p, k_i, k_d, k_df, [this] { return now; })
+    {
+    }
+
+    std::chrono::steady_clock::time_point now;
+    PidController controller;
+};
+
+struct poshold_flow
+{
+    explicit poshold_flow(const Drone::CameraInfo& cameraInfo) :
+        drone(cameraInfo),
+        vecMove(drone)
+    {
+    }
+
+    BufferDrone drone;
+    VecMove vecMove;
+};
+
+extern "C" {
+
+int poshold_abi_version(void)
+{
+    return POSHOLD_ABI_VERSION;
+}
+
+const char* poshold_last_error(void)
+{
+    return lastError.c_str();
+}
+
+poshold_pid* poshold_pid_create(float k_p, float k_i, float k_d, float k_df, int64_t start_time_us)
+{
+    return new (std::nothrow) poshold_pid(k_p, k_i, k_d, k_df, fromMicroseconds(start_time_us));
+}
+
+void poshold_pid_destroy(poshold_pid* pid)
+{
+    delete pid;
+}
+
+int poshold_pid_step_batch(poshold_pid* pid, size_t count, const float* positions, const float* velocities,
+                           const float* desired, const int64_t* timestamps_us, uint32_t* rc_out)
+{
+    for (size_t i = 0; i < count; ++i)
+    {
+        const simd::Vec2f position{ positions[2 * i], positions[2 * i + 1] };
+        const simd::Vec2f target = desired != nullptr
+            ? simd::Vec2f{ desired[2 * i], desired[2 * i + 1] }
+            : simd::Vec2f{ 0.0f, 0.0f };
+
+        pid->now = fromMicroseconds(timestamps_us[i]);
+        const simd::Vec2u rc = velocities != nullptr
+            ? pid->controller.calculate_raw_rc(position, { velocities[2 * i], velocities[2 * i + 1] }, target)
+            : pid->controller.calculate_raw_rc(position, target);
+
+        rc_out[2 * i] = rc.x;
+        rc_out[2 * i + 1] = rc.y;
+    }
+    return 0;
+}
+
+void* create_pid(float k_p, float k_i, float k_d, float k_df)
+{
+    return new (std::nothrow) poshold_pid(k_p, k_i, k_d, k_df, std::chrono::steady_clock::now());
+}
+
+void calculate_pid(void* pid, const float* current_position, const float* desired_position, uint32_t* rc_out)
+{
+    auto* handle = static_cast<poshold_pid*>(pid);
+    handle->now = std::chrono::steady_clock::now();
+    const simd::Vec2u rc = handle->controller.calculate_raw_rc(
+        { current_position[0], current_position[1] }, { desired_position[0], desired_position[1] });
+    rc_out[0] = rc.x;
+    rc_out[1] = rc.y;
+}
+
+void destroy_pid(void* pid)
+{
+    delete static_cast<poshold_pid*>(pid);
+}
+
+poshold_flow* poshold_flow_create(const poshold_camera* camera)
+{
+    poshold_flow* flow = nullptr;
+    guarded([&]
+    {
+        flow = new poshold_flow(camera != nullptr ? toCameraInfo(*camera) : Drone::defaultCameraInfo());
+        return 0;
+    });
+    return flow;
+}
+
+void poshold_flow_destroy(poshold_flow* flow)
+{
+    delete flow;
+}
+
+void poshold_flow_camera(const poshold_flow* flow, poshold_camera* camera)
+{
+    const Drone::CameraInfo& info = flow->drone.cameraInfo;
+    camera->resolution_x = info.resolutionX;
+    camera->resolution_y = info.resolutionY;
+    camera->min_dist = info.minDist;
+    camera->max_dist = info.maxDist;
+    camera->focal_length_x = info.focalLength;
+    camera->focal_length_y = info.focalLengthY;
+    camera->principal_x = info.principalX;
+    camera->principal_y = info.principalY;
+    std::memcpy(camera->distortion, info.distortion.data(), sizeof(camera->distortion));
+}
+
+int poshold_flow_process_batch(poshold_flow* flow, size_t count, const uint8_t* frames, size_t row_stride,
+                               size_t frame_stride, const poshold_frame_info* info, poshold_flow_result* results)
+{
+    return guarded([&]
+    {
+        const Drone::CameraInfo& cameraInfo = flow->drone.cameraInfo;
+        for (size_t i = 0; i < count; ++i)
+        {
+            // Header over the caller's pixels; VecMove only reads them
+            const cv::Mat frame(cameraInfo.resolutionY, cameraInfo.resolutionX, CV_8UC1,
+                                const_cast<uint8_t*>(frames + i * frame_stride), row_stride);
+            flow->drone.setFrame(frame, info[i]);
+            flow->vecMove.calc();
+
+            poshold_flow_result& result = results[i];
+            const bool valid = flow->vecMove.hasVecMove();
+            const cv::Point2f vecDown = flow->vecMove.getVecDown();
+            const cv::Point2f vecMove = valid ? flow->vecMove.getVecMove() : cv::Point2f();
+            result.vec_down_x = vecDown.x;
+            result.vec_down_y = vecDown.y;
+            result.vec_move_x = vecMove.x;
+            result.vec_move_y = vecMove.y;
+            result.valid = valid ? 1 : 0;
+            result.reserved = 0;
+        }
+        return 0;
+    });
+}
+
+int poshold_msp_encode(uint8_t direction, uint8_t command_id, const uint8_t* payload, uint8_t size, uint8_t* out,
+                       size_t out_size)
+{
+    if (out_size < msp::FRAME_OVERHEAD + size)
+    {
+        lastError = "output buffer too small for MSP frame";
+        return -1;
+    }
+    return static_cast<int>(msp::encode_frame(static_cast<msp::CommandType>(direction), command_id, payload, size, out));
+}
+
+int poshold_msp_encode_set_raw_rc_batch(size_t count, const uint16_t* channels, uint8_t* out)
+{
+    std::uint8_t payload[msp::SET_RAW_RC_PAYLOAD_SIZE];
+    for (size_t i = 0; i < count; ++i)
+    {
+        const uint16_t* ch = channels + 8 * i;
+        msp::encode_set_raw_rc({ ch[0], ch[1], ch[2], ch[3], ch[4], ch[5], ch[6], ch[7] }, payload);
+        msp::encode_frame(msp::CommandType::Request, msp::MSP_SET_RAW_RC, payload, sizeof(payload),
+                          out + i * POSHOLD_MSP_SET_RAW_RC_FRAME_SIZE);
+    }
+    return 0;
+}
+
+int poshold_msp_decode_stream(const uint8_t* data, size_t size, poshold_msp_frame* frames, size_t max_frames,
+                              size_t* consumed)
+{
+    size_t offset = 0;
+    size_t found = 0;
+    while (offset < size && found < max_frames)
+    {
+        msp::FrameView view{};
+        size_t frameSize = 0;
+        const msp::DecodeStatus status = msp::decode_frame(data + offset, size - offset, &view, &frameSize);
+
+        if (status == msp::DecodeStatus::Incomplete)
+        {
+            break;
+        }
+        if (status == msp::DecodeStatus::BadHeader)
+        {
+            ++offset;
+            continue;
+        }
+
+        poshold_msp_frame& frame = frames[found++];
+        frame.direction = data[offset + 2];
+        frame.command_id = data[offset + 4];
+        frame.size = data[offset + 3];
+        frame.checksum_ok = status == msp::DecodeStatus::Ok ? 1 : 0;
+        frame.payload_offset = static_cast<uint32_t>(offset + 5);
+        offset += frameSize;
+    }
+
+    *consumed = offset;
+    return static_cast<int>(found);
+}
+
+int poshold_msp_decode_attitude(const uint8_t* payload, uint8_t size, double* out)
+{
+    return guarded([&]
+    {
+        const msp::AttitudeData data(size, const_cast<uint8_t*>(payload));
+        out[0] = data.roll_tenths * CV_PI / 1800;
+        out[1] = data.pitch_tenths * CV_PI / 1800;
+        out[2] = data.yaw_tenths * CV_PI / 1800;
+        return 0;
+    });
+}
+
+int poshold_msp_decode_altitude(const uint8_t* payload, uint8_t size, double* out)
+{
+    return guarded([&]
+    {
+        const msp::AltitudeData data(size, const_cast<uint8_t*>(payload));
+        out[0] = data.altitude / 100.0;
+        out[1] = data.vario / 100.0;
+        return 0;
+    });
+}
+
+} // extern "C"
@@ -0,0 +1,170 @@
+#include <cerrno>
+#include <cstring>
+#include <new>
+#include <stdexcept>
+#include <string>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "flightlog/flight_log.hpp"
+#include "utils.hpp"
+
+namespace flightlog {
+
+namespace {
+
+constexpr std::uint32_t RECORD_SIZES[STREAM_COUNT] = {
+		sizeof(TelemetryRecord), sizeof(FlowRecord), sizeof(ControllerRecord),
+		sizeof(RcRecord), sizeof(ThumbnailRecord)};
+
+std::uint64_t page_align(std::uint64_t bytes) {
+	return (bytes + PAGE_SIZE - 1) / PAGE_SIZE * PAGE_SIZE;
+}
+
+} // namespace
+
+FlightLogWriter::FlightLogWriter(const char *path, const Capacity &capacity) :
+		fd_(::open(path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644)) {
+	if (fd_ < 0) {
+		auto e = errno;
+		utils::throw_errno(e, "while trying to create flight log <", path, ">");
+	}
+
+	const std::uint64_t capacities[STREAM_COUNT] = {
+			capacity.telemetry, capacity.flow, capacity.controller, capacity.rc,
+			capacity.thumbnail};
+
+	std::uint64_t offsets[STREAM_COUNT];
+	std::uint64_t size = PAGE_SIZE;
+	for (std::uint32_t i = 0; i < STREAM_COUNT; ++i) {
+		offsets[i] = size;
+		size += page_align(capacities[i] * RECORD_SIZES[i]);
+	}
+	size_ = static_cast<std::size_t>(size);
+
+	// Reserve the blocks up front: a write fault on a sparse page of a full
+	// disk would raise SIGBUS in the middle of the control loop
+	if (const int e = ::posix_fallocate(fd_, 0, static_cast<off_t>(size_)); e != 0) {
+		::close(fd_);
+		utils::throw_errno(e, "Error allocating flight log with posix_fallocate");
+	}
+
+	void *mapping = ::mmap(nullptr, size_, PROT_READ | PROT_WRITE,
+												 MAP_SHARED | MAP_POPULATE, fd_, 0);
+	if (mapping == MAP_FAILED) {
+		const int e = errno;
+		::close(fd_);
+		utils::throw_errno(e, "Error mapping flight log with mmap");
+	}
+
+	base_ = static_cast<std::uint8_t *>(mapping);
+	header_ = new (base_) FileHeader{};
+	std::memcpy(header_->magic, MAGIC, sizeof(MAGIC));
+	header_->version = VERSION;
+	header_->stream_count = STREAM_COUNT;
+	header_->start_time_us = to_us(std::chrono::steady_clock::now());
+	for (std::uint32_t i = 0; i < STREAM_COUNT; ++i) {
+		StreamInfo &stream = header_->streams[i];
+		stream.record_size = RECORD_SIZES[i];
+		stream.offset = offsets[i];
+		stream.capacity = capacities[i];
+	}
+}
+
+FlightLogWriter::~FlightLogWriter() noexcept {
+	if (base_ != nullptr) {
+		::msync(base_, size_, MS_ASYNC);
+		::munmap(base_, size_);
+		base_ = nullptr;
+	}
+	if (fd_ >= 0) {
+		::close(fd_);
+		fd_ = -1;
+	}
+}
+
+std::uint64_t FlightLogWriter::count(StreamType stream) const noexcept {
+	return header_->streams[stream].count.load(std::memory_order_relaxed);
+}
+
+std::uint64_t FlightLogWriter::dropped(StreamType stream) const noexcept {
+	return header_->streams[stream].dropped.load(std::memory_order_relaxed);
+}
+
+FlightLogReader::FlightLogReader(const char *path) :
+		fd_(::open(path, O_RDONLY | O_CLOEXEC)) {
+	if (fd_ < 0) {
+		auto e = errno;
+		utils::throw_errno(e, "while trying to open flight log <", path, ">");
+	}
+
+	struct stat st;
+	if (::fstat(fd_, &st) != 0) {
+		const int e = errno;
+		::close(fd_);
+		utils::throw_errno(e, "Error reading flight log size with fstat");
+	}
+	size_ = static_cast<std::size_t>(st.st_size);
+
+	auto fail = [&](const std::string &msg) -> void {
+		::close(fd_);
+		throw std::runtime_error("flight log <" + std::string(path) + ">: " + msg);
+	};
+
+	if (size_ < PAGE_SIZE)
+		fail("shorter than its header");
+
+	void *mapping = ::mmap(nullptr, size_, PROT_READ, MAP_SHARED, fd_, 0);
+	if (mapping == MAP_FAILED) {
+		const int e = errno;
+		::close(fd_);
+		utils::throw_errno(e, "Error mapping flight log with mmap");
+	}
+	base_ = static_cast<const std::uint8_t *>(mapping);
+	header_ = reinterpret_cast<const FileHeader *>(base_);
+
+	auto fail_mapped = [&](const std::string &msg) -> void {
+		::munmap(const_cast<std::uint8_t *>(base_), size_);
+		fail(msg);
+	};
+
+	if (std::memcmp(header_->magic, MAGIC, sizeof(MAGIC)) != 0)
+		fail_mapped("not a flight log");
+	if (header_->version != VERSION)
+		fail_mapped("unsupported version " + std::to_string(header_->version));
+	if (header_->stream_count != STREAM_COUNT)
+		fail_mapped("unexpected stream count " +
+								std::to_string(header_->stream_count));
+
+	for (std::uint32_t i = 0; i < STREAM_COUNT; ++i) {
+		const StreamInfo &stream = header_->streams[i];
+		if (stream.record_size != RECORD_SIZES[i])
+			fail_mapped("record size mismatch in stream " + std::to_string(i));
+		if (stream.offset + stream.capacity * stream.record_size > size_)
+			fail_mapped("stream " + std::to_string(i) + " exceeds the file");
+	}
+}
+
+FlightLogReader::~FlightLogReader() noexcept {
+	if (base_ != nullptr) {
+		::munmap(const_cast<std::uint8_t *>(base_), size_);
+		base_ = nullptr;
+	}
+	if (fd_ >= 0) {
+		::close(fd_);
+		fd_ = -1;
+	}
+}
+
+std::uint64_t FlightLogReader::dropped(StreamType stream) const noexcept {
+	return header_->streams[stream].dropped.load(std::memory_order_relaxed);
+}
+
+std::uint64_t FlightLogReader::start_time_us() const noexcept {
+	return header_->start_time_us;
+}
+
+} // namespace flightlog
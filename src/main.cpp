@@ -1,8 +1,17 @@
+#include "msp/mode_monitor.hpp"
 #include "msp/msp.hpp"
+#include "msp/msp_proxy.hpp"
 
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
 #include <exception>
 #include <iostream>
 #include <iomanip>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
 #include <unistd.h>
 #include <chrono>
 
@@ -11,50 +20,521 @@
 #include <opencv2/imgcodecs.hpp>
 #include <opencv2/highgui.hpp>
 
+#include "flightlog/flight_log.hpp"
+#include "posHold/ControlLoop.h"
+#include "posHold/FramePool.h"
+#include "posHold/RtspDrone.h"
 #include "posHold/VecMove.h"
+#include "posHold/VideoRecorder.h"
 #include "pid/pid.hpp"
+#include "telemetry/live_telemetry.hpp"
 
 using namespace std;
 
+// The receiver's channels for everything position hold does not drive, so
+// enabling MSP override never moves throttle, yaw or the switches even if the
+// flight controller overrides more than roll and pitch. Refreshed from MSP_RC
+// on the vision thread, read by whichever thread sends RC.
+//
+// MSP_RC lists rcData (roll, pitch, yaw, throttle, aux1...) while
+// MSP_SET_RAW_RC takes raw channels through Betaflight's rcmap, which for the
+// default AETR1234 map is roll, pitch, throttle, yaw, aux1...
+class PassThroughRc
+{
+public:
+	// Channels MSP_RC must report; fewer cannot be passed through
+	static constexpr std::uint8_t s_channels = 8;
+
+	void update(const msp::RcData& live)
+	{
+		if (live.channel_count < s_channels)
+		{
+			throw std::runtime_error("MSP_RC reports " + std::to_string(live.channel_count) + " channels, "
+									 + std::to_string(s_channels) + " needed");
+		}
+		const std::uint16_t* c = live.channels;
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_channels = msp::Channels{ c[0], c[1], c[3], c[2], c[4], c[5], c[6], c[7] };
+		m_valid = true;
+	}
+
+	// Live channels with roll and pitch from rc; false before the first update()
+	[[nodiscard]] bool with(const simd::Vec2u rc, msp::Channels& channels) const
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		channels = m_channels;
+		channels.roll = static_cast<std::uint16_t>(rc.x);
+		channels.pitch = static_cast<std::uint16_t>(rc.y);
+		return m_valid;
+	}
+
+private:
+	mutable std::mutex m_mutex;
+	msp::Channels m_channels{};
+	bool m_valid = false;
+};
+
+// Result of the last VecMove::calc(), for the snapshots of the thread that
+// runs the controller
+struct VisionSample
+{
+	std::uint64_t timestamp_us = 0;
+	std::uint32_t frame = 0;
+	std::uint32_t skipped_frames = 0;
+	float interval = 0.0f;
+	cv::Point2f flow;
+	cv::Point2f vec_down;
+	cv::Point2f vec_move;
+	std::uint32_t vision_us = 0;
+};
+
+static std::uint32_t microseconds(const std::chrono::steady_clock::duration duration)
+{
+	return static_cast<std::uint32_t>(std::chrono::duration_cast<std::chrono::microseconds>(duration).count());
+}
+
+static void fillVision(telemetry::Snapshot& snapshot, const VisionSample& vision)
+{
+	snapshot.frame = vision.frame;
+	snapshot.skipped_frames = vision.skipped_frames;
+	snapshot.frame_interval = vision.interval;
+	snapshot.flow_x = vision.flow.x;
+	snapshot.flow_y = vision.flow.y;
+	snapshot.vec_down_x = vision.vec_down.x;
+	snapshot.vec_down_y = vision.vec_down.y;
+	snapshot.vec_move_x = vision.vec_move.x;
+	snapshot.vec_move_y = vision.vec_move.y;
+	snapshot.vision_us = vision.vision_us;
+}
+
+static void fillController(telemetry::Snapshot& snapshot, const PidController::Terms& terms, const msp::Channels& sent)
+{
+	snapshot.pid_p[0] = terms.p.x;
+	snapshot.pid_p[1] = terms.p.y;
+	snapshot.pid_i[0] = terms.i.x;
+	snapshot.pid_i[1] = terms.i.y;
+	snapshot.pid_d[0] = terms.d.x;
+	snapshot.pid_d[1] = terms.d.y;
+	const std::uint16_t channels[8] = { sent.roll, sent.pitch, sent.throttle, sent.yaw,
+										sent.aux1, sent.aux2, sent.aux3, sent.aux4 };
+	std::copy(std::begin(channels), std::end(channels), snapshot.rc);
+}
+
+// Position hold for 90 seconds instead of recording. By default the
+// controller runs once per measured frame on VecMove's position and its output
+// is resent until the next one. With multiRate a ControlLoop ticks at
+// telemetry rate on a prediction between frames instead; in a gust that does
+// worse (see ControlLoop.h), so it is opt-in. RC goes out only while the
+// flight controller is in MSP override mode and answering. Betaflight should
+// override just roll and pitch (msp_override_channels_mask = 3); the other
+// channels are sent as the receiver last reported them, so a wider mask
+// freezes them at the stick positions they had rather than centring them.
+//
+// Every frame, tick and RC packet is appended to the flight log at logPath
+// and published to the live telemetry segment. Flow records come from the
+// vision thread; telemetry, controller and RC records and the snapshots from
+// the thread that runs the controller, so each stream has a single writer.
+static int runPositionHold(Drone& drone, msp::Msp& msp, VecMove& vecMove, PidController& controller, const bool multiRate,
+						   const std::string& logPath, const std::string& segment)
+{
+	// MSP timeouts are not printed; a dead link is reported here, once
+	msp::ModeMonitor monitor(msp, {}, std::chrono::milliseconds(200), [](const msp::ModeMonitor::LinkEvent event)
+	{
+		cout << (event == msp::ModeMonitor::LinkEvent::Lost ? "FC link lost" : "FC link restored") << endl;
+	});
+
+	// Refuses to start without the receiver's channels to pass through
+	PassThroughRc pass_through;
+	pass_through.update(msp.rc());
+
+	flightlog::FlightLogWriter log(logPath.c_str());
+	cout << "Flight log: " << logPath << endl;
+
+	// A missing shared-memory mount only costs the live view
+	std::unique_ptr<telemetry::LiveTelemetryWriter> live;
+	try
+	{
+		live = std::make_unique<telemetry::LiveTelemetryWriter>(segment.c_str());
+		cout << "Live telemetry: " << segment << endl;
+	}
+	catch (const std::exception& e)
+	{
+		cerr << "Live telemetry disabled: " << e.what() << endl;
+	}
+
+	// Written and read only by the thread that sends RC
+	msp::Channels sent{};
+	const ControlLoop::Output output = [&msp, &monitor, &pass_through, &log, &sent](const simd::Vec2u rc)
+	{
+		msp::Channels channels;
+		if (monitor.link_lost() || !monitor.active(msp::BOXMSPOVERRIDE) || !pass_through.with(rc, channels))
+		{
+			return;
+		}
+		try
+		{
+			msp.setRawRc(msp::SetRawRcData(channels));
+		}
+		catch (const std::exception&)
+		{
+			// A lost link shows up in the monitor; the next tick tries again
+			return;
+		}
+		sent = channels;
+		log.append(flightlog::RcRecord{
+			flightlog::to_us(std::chrono::steady_clock::now()),
+			{ channels.roll, channels.pitch, channels.throttle, channels.yaw,
+			  channels.aux1, channels.aux2, channels.aux3, channels.aux4 } });
+	};
+
+	// Latest vision result, handed to the ticking thread with --multi-rate
+	std::mutex vision_mutex;
+	VisionSample vision;
+
+	std::unique_ptr<ControlLoop> loop;
+	if (multiRate)
+	{
+		loop = std::make_unique<ControlLoop>(drone, controller, output, ControlLoop::Options());
+		Drone::AltitudeData last_altitude{ 0.0, 0.0 };
+		loop->setTickListener([&log, &live, &sent, &vision_mutex, &vision, last_altitude](const ControlLoop::Tick& tick) mutable
+		{
+			if (tick.altitudeRead)
+			{
+				last_altitude = tick.altitude;
+			}
+			const std::uint64_t timestamp_us = flightlog::to_us(tick.time);
+			log.append(flightlog::TelemetryRecord{
+				timestamp_us,
+				static_cast<float>(tick.attitude.roll),
+				static_cast<float>(tick.attitude.pitch),
+				static_cast<float>(tick.attitude.yaw),
+				static_cast<float>(last_altitude.altitude),
+				static_cast<float>(last_altitude.vario),
+				0 });
+			log.append(flightlog::ControllerRecord{
+				timestamp_us,
+				tick.position.x, tick.position.y,
+				tick.velocity.x, tick.velocity.y,
+				tick.setpoint.x, tick.setpoint.y,
+				static_cast<float>(tick.estimatedAltitude),
+				0 });
+
+			if (live)
+			{
+				telemetry::Snapshot snapshot{};
+				{
+					std::lock_guard<std::mutex> lock(vision_mutex);
+					fillVision(snapshot, vision);
+				}
+				snapshot.timestamp_us = timestamp_us;
+				snapshot.roll = static_cast<float>(tick.attitude.roll);
+				snapshot.pitch = static_cast<float>(tick.attitude.pitch);
+				snapshot.yaw = static_cast<float>(tick.attitude.yaw);
+				snapshot.altitude = static_cast<float>(last_altitude.altitude);
+				snapshot.vario = static_cast<float>(last_altitude.vario);
+				snapshot.position_x = tick.position.x;
+				snapshot.position_y = tick.position.y;
+				snapshot.velocity_x = tick.velocity.x;
+				snapshot.velocity_y = tick.velocity.y;
+				snapshot.setpoint_x = tick.setpoint.x;
+				snapshot.setpoint_y = tick.setpoint.y;
+				snapshot.estimated_altitude = static_cast<float>(tick.estimatedAltitude);
+				fillController(snapshot, tick.terms, sent);
+				snapshot.estimator_us = microseconds(tick.estimatorTime);
+				snapshot.control_us = microseconds(tick.controlTime);
+				snapshot.loop_us = microseconds(tick.telemetryTime + tick.estimatorTime + tick.controlTime);
+				live->publish(snapshot);
+			}
+		});
+		loop->start();
+	}
+
+	cout << "Holding position for 90 seconds" << (multiRate ? " (multi-rate)" : "") << "..." << endl;
+	const auto start_time = std::chrono::steady_clock::now();
+	int last_progress_second = 0;
+	simd::Vec2u held_rc{ 1500u, 1500u };
+	cv::Point2f position;
+	std::uint32_t frame_index = 0;
+	std::uint64_t measured_frames = 0;
+	std::uint64_t failed_frames = 0;
+	while (true)
+	{
+		const auto elapsed = std::chrono::steady_clock::now() - start_time;
+		if (elapsed >= std::chrono::seconds(90))
+		{
+			break;
+		}
+
+		try
+		{
+			const auto frame_start = std::chrono::steady_clock::now();
+			pass_through.update(msp.rc());
+
+			// With the held output this thread runs the controller and logs
+			// the telemetry it saw; the ticking thread does both otherwise
+			Drone::GyroData attitude{ 0.0, 0.0, 0.0 };
+			Drone::AltitudeData altitude{ 0.0, 0.0 };
+			if (!loop)
+			{
+				attitude = drone.getGyroData();
+				altitude = drone.getAltitudeData();
+				log.append(flightlog::TelemetryRecord{
+					flightlog::to_us(std::chrono::steady_clock::now()),
+					static_cast<float>(attitude.roll),
+					static_cast<float>(attitude.pitch),
+					static_cast<float>(attitude.yaw),
+					static_cast<float>(altitude.altitude),
+					static_cast<float>(altitude.vario),
+					0 });
+			}
+
+			const auto vision_start = std::chrono::steady_clock::now();
+			vecMove.calc();
+			const auto vision_end = std::chrono::steady_clock::now();
+
+			frame_index += static_cast<std::uint32_t>(drone.getSkippedFrames()) + 1;
+			VisionSample sample;
+			sample.timestamp_us = flightlog::to_us(drone.getFrameTimestamp());
+			sample.frame = frame_index;
+			sample.skipped_frames = static_cast<std::uint32_t>(drone.getSkippedFrames());
+			sample.interval = static_cast<float>(drone.getFrameInterval());
+			sample.flow = vecMove.getMeanFlow();
+			sample.vec_down = vecMove.getVecDown();
+			sample.vec_move = vecMove.getVecMove();
+			sample.vision_us = microseconds(vision_end - vision_start);
+			log.append(flightlog::FlowRecord{
+				sample.timestamp_us,
+				sample.frame,
+				sample.skipped_frames,
+				sample.interval,
+				sample.vec_down.x, sample.vec_down.y,
+				sample.vec_move.x, sample.vec_move.y,
+				0 });
+			{
+				std::lock_guard<std::mutex> lock(vision_mutex);
+				vision = sample;
+			}
+
+			// Frames without measured flow (first frame, lost keyframe) would
+			// read as hovering
+			const bool measured = vecMove.getFlowConfidence() > 0.0;
+			if (measured)
+			{
+				position = vecMove.getAccumulatedPosition();
+				++measured_frames;
+				if (loop)
+				{
+					loop->submitPosition(position, vecMove.getSampleTimestamp());
+				}
+			}
+
+			// Velocity of the last measured frame, for the log only
+			const double interval = vecMove.getSampleInterval();
+			const cv::Point2f velocity = measured && interval > 0.0
+				? sample.vec_move * static_cast<float>(1.0 / interval) : cv::Point2f();
+			if (!loop && measured)
+			{
+				held_rc = controller.calculate_raw_rc({ position.x, position.y });
+				log.append(flightlog::ControllerRecord{
+					sample.timestamp_us,
+					position.x, position.y,
+					velocity.x, velocity.y,
+					0.0f, 0.0f,
+					static_cast<float>(altitude.altitude),
+					0 });
+			}
+			const auto control_start = std::chrono::steady_clock::now();
+			if (!loop)
+			{
+				output(held_rc);
+			}
+
+			if (!loop && live)
+			{
+				telemetry::Snapshot snapshot{};
+				fillVision(snapshot, sample);
+				snapshot.timestamp_us = sample.timestamp_us;
+				snapshot.roll = static_cast<float>(attitude.roll);
+				snapshot.pitch = static_cast<float>(attitude.pitch);
+				snapshot.yaw = static_cast<float>(attitude.yaw);
+				snapshot.altitude = static_cast<float>(altitude.altitude);
+				snapshot.vario = static_cast<float>(altitude.vario);
+				snapshot.position_x = position.x;
+				snapshot.position_y = position.y;
+				snapshot.velocity_x = velocity.x;
+				snapshot.velocity_y = velocity.y;
+				snapshot.estimated_altitude = static_cast<float>(altitude.altitude);
+				fillController(snapshot, controller.last_terms(), sent);
+				snapshot.control_us = microseconds(std::chrono::steady_clock::now() - control_start);
+				snapshot.loop_us = microseconds(std::chrono::steady_clock::now() - frame_start);
+				live->publish(snapshot);
+			}
+		}
+		catch (const std::runtime_error&)
+		{
+			// The frame's MSP telemetry timed out; the monitor reports the link
+			++failed_frames;
+		}
+
+		const int current_second = static_cast<int>(std::chrono::duration_cast<std::chrono::seconds>(elapsed).count());
+		if (current_second >= last_progress_second + 10)
+		{
+			cout << "Progress: " << current_second << "s / 90s";
+			if (loop)
+			{
+				const ControlLoop::Status status = loop->getStatus();
+				cout << " | Position: " << fixed << setprecision(2) << status.position.x << ", " << status.position.y << " m"
+					 << " | RC: " << status.rc.x << ", " << status.rc.y
+					 << " | Ticks: " << status.ticks << " (" << status.overruns << " late, " << status.failedTicks << " failed)";
+			}
+			else
+			{
+				cout << " | Position: " << fixed << setprecision(2) << position.x << ", " << position.y << " m"
+					 << " | RC: " << held_rc.x << ", " << held_rc.y;
+			}
+			cout << " | Frames failed: " << failed_frames
+				 << (monitor.link_lost() ? " | FC link lost" : "")
+				 << (monitor.active(msp::BOXMSPOVERRIDE) ? " | MSP override" : "")
+				 << endl;
+			last_progress_second = current_second;
+		}
+	}
+
+	cout << "Position hold done: " << measured_frames << " measured frames, " << failed_frames << " failed";
+	if (loop)
+	{
+		loop->stop();
+		const ControlLoop::Status status = loop->getStatus();
+		cout << ", " << status.ticks << " ticks, " << status.overruns << " late, " << status.failedTicks << " failed";
+	}
+	cout << endl;
+	cout << "Flight log records: " << log.count(flightlog::FLOW) << " flow, " << log.count(flightlog::CONTROLLER)
+		 << " controller, " << log.count(flightlog::RC) << " RC" << endl;
+	return 0;
+}
+
 int main(int argc, char* argv[])
 {
-	if (argc < 2)
+	// --msp-proxy SOCKET shares the FC link with MSP clients on a local socket,
+	// --hold flies position hold instead of recording, --multi-rate with the
+	// controller at telemetry rate, logging to --log PATH and publishing to
+	// --telemetry SEGMENT
+	std::string proxy_socket;
+	bool hold = false;
+	bool multi_rate = false;
+	std::string log_path = "flight.phlog";
+	std::string segment = telemetry::DEFAULT_SEGMENT;
+	bool hold_options = false;
+	int arg = 1;
+	while (arg < argc && std::strncmp(argv[arg], "--", 2) == 0)
+	{
+		if (std::strcmp(argv[arg], "--hold") == 0)
+		{
+			hold = true;
+			++arg;
+		}
+		else if (std::strcmp(argv[arg], "--multi-rate") == 0)
+		{
+			multi_rate = true;
+			hold_options = true;
+			++arg;
+		}
+		else if (std::strcmp(argv[arg], "--log") == 0 || std::strcmp(argv[arg], "--telemetry") == 0)
+		{
+			if (arg + 1 >= argc)
+			{
+				std::cerr << argv[arg] << " needs a value\n";
+				return 2;
+			}
+			(std::strcmp(argv[arg], "--log") == 0 ? log_path : segment) = argv[arg + 1];
+			hold_options = true;
+			arg += 2;
+		}
+		else if (std::strcmp(argv[arg], "--msp-proxy") == 0)
+		{
+			if (arg + 1 >= argc)
+			{
+				std::cerr << "--msp-proxy needs a socket path\n";
+				return 2;
+			}
+			proxy_socket = argv[arg + 1];
+			arg += 2;
+		}
+		else
+		{
+			std::cerr << "Unknown option " << argv[arg] << '\n';
+			return 2;
+		}
+	}
+
+	if (argc - arg < 1)
+	{
+		std::cerr << "Usage: " << argv[0] << " [--msp-proxy SOCKET] [--hold [--multi-rate] [--log PATH] [--telemetry SEGMENT]] /dev/ttyUSB0 [rtsp://localhost:8554/stream]\n";
+		return 2;
+	}
+
+	if (hold_options && !hold)
 	{
-		std::cerr << "Usage: " << argv[0] << " /dev/ttyUSB0\n";
+		std::cerr << "--multi-rate, --log and --telemetry need --hold\n";
 		return 2;
 	}
 
-	const char *port = argv[1];
+	const char *port = argv[arg];
+
+	// Every image of the frame loop is recycled from here once it is warm
+	FramePool::install();
 
 	try
 	{
-		Drone drone{"rtsp://localhost:8554/stream"};
+		// The FC link is only opened when something uses it, so recording
+		// works without a flight controller on the port. The proxy owns the
+		// serial port and gives our requests priority
+		std::unique_ptr<msp::MspProxy> proxy;
+		std::unique_ptr<msp::Msp> msp;
+		if (!proxy_socket.empty())
+		{
+			msp::ProxyOptions proxy_options;
+			proxy_options.socket_path = proxy_socket;
+			proxy = std::make_unique<msp::MspProxy>(port, msp::DEFAULT_BAUD_RATE, proxy_options);
+			msp = std::make_unique<msp::Msp>(*proxy);
+			cout << "Serving MSP clients on " << proxy_socket << endl;
+		}
+		else if (hold)
+		{
+			msp = std::make_unique<msp::Msp>(port);
+		}
+
+		RtspDrone::Options stream_options;
+		if (argc - arg > 1)
+		{
+			stream_options.url = argv[arg + 1];
+		}
+		const std::unique_ptr<RtspDrone> stream = msp ? std::make_unique<RtspDrone>(stream_options, *msp)
+		                                              : std::make_unique<RtspDrone>(stream_options);
+		RtspDrone& drone = *stream;
 
         VecMove vecMove(drone);
 
 		PidController controller(1.0f, 0.0f, 0.0f, 0.0f);
 
-        auto& camera = drone.getCamera();
+		if (hold)
+		{
+			return runPositionHold(drone, *msp, vecMove, controller, multi_rate, log_path, segment);
+		}
 
-        if (!camera.isOpened()) {
-            cerr << "Error: Could not open RTSP stream (rtsp://localhost:8554/stream)" << endl;
-            cerr << "Make sure the stream server is running." << endl;
-            return -1;
-        }
+        int frame_width = drone.cameraInfo.resolutionX;
+        int frame_height = drone.cameraInfo.resolutionY;
 
-        int frame_width = static_cast<int>(camera.get(cv::CAP_PROP_FRAME_WIDTH));
-        int frame_height = static_cast<int>(camera.get(cv::CAP_PROP_FRAME_HEIGHT));
+        cout << "Stream opened via " << drone.getBackend() << " (" << frame_width << "x" << frame_height << ")" << endl;
 
-        cout << "Camera opened successfully (" << frame_width << "x" << frame_height << ")" << endl;
+        VideoRecorder::Options recorder_options;
+        recorder_options.path = "output.mp4";
+        recorder_options.frameSize = cv::Size(frame_width, frame_height);
+        // Frames arrive as luma only
+        recorder_options.grayscale = true;
+        VideoRecorder recorder(recorder_options);
 
-        cv::VideoWriter writer(
-            "output.mp4",
-            cv::VideoWriter::fourcc('m','p','4','v'),  // MP4
-            30.0,
-            cv::Size(frame_width, frame_height)
-        );
-
-        if (!writer.isOpened()) {
+        if (!recorder.isOpened()) {
             cerr << "Error: Could not open output file (output.mp4) for writing" << endl;
             return -1;
         }
@@ -62,7 +542,6 @@ int main(int argc, char* argv[])
         cout << "Starting 90-second video recording to output.mp4..." << endl;
         cout << "---------------------------------------------------" << endl;
 
-        cv::Mat frame;
         int frame_count = 0;
         int last_progress_second = 0;
 
@@ -77,14 +556,15 @@ int main(int argc, char* argv[])
                 break;
             }
 
-            camera.read(frame);
+            // A fresh buffer every time, so the recorder may keep the last one
+            cv::Mat frame = drone.getGrayscaleImage();
 
             if (frame.empty()) {
                 cerr << "Warning: Empty frame received at " << elapsed.count() / 1000.0 << " seconds" << endl;
                 continue;
             }
 
-            writer.write(frame);
+            recorder.submit(frame);
             frame_count++;
 
             int current_second = elapsed.count() / 1000;
@@ -93,6 +573,8 @@ int main(int argc, char* argv[])
                 cout << "Progress: " << current_second << "s / 90s"
                      << " | Frames: " << frame_count
                      << " | FPS: " << fixed << setprecision(1) << actual_fps
+                     << " | Dropped: " << recorder.getDroppedFrames()
+                     << " | Frame age: " << setprecision(1) << 1e3 * drone.getFrameAge() << " ms"
                      << endl;
                 last_progress_second = current_second;
             }
@@ -102,12 +584,11 @@ int main(int argc, char* argv[])
         auto total_duration = std::chrono::duration_cast<std::chrono::milliseconds>(end_time - start_time);
         double actual_fps = frame_count / (total_duration.count() / 1000.0);
 
-        writer.release();
-
         cout << "---------------------------------------------------" << endl;
         cout << "Recording complete!" << endl;
         cout << "Duration: " << fixed << setprecision(2) << total_duration.count() / 1000.0 << " seconds" << endl;
         cout << "Total frames: " << frame_count << endl;
+        cout << "Dropped by recorder: " << recorder.getDroppedFrames() << endl;
         cout << "Average FPS: " << fixed << setprecision(2) << actual_fps << endl;
         cout << "Output saved to: output.mp4" << endl;
 	}
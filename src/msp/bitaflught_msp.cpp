@@ -1,78 +1,100 @@
+#include <algorithm>
+#include <chrono>
 #include <cstdint>
 #include <cstring>
 #include <iostream>
-#include <termios.h>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <thread>
 
 #include "msp/bitaflught_msp.hpp"
+#include "msp/codec.hpp"
+#include "msp/msp.hpp"
 #include "msp/serial_stream.hpp"
 
 namespace msp {
 
-BitaflughtMsp::BitaflughtMsp(const char *dev, speed_t baud_rate, cc_t timeout)
-		: stream_(dev, baud_rate, timeout) {}
+BitaflughtMsp::BitaflughtMsp(const char *dev, std::uint32_t baud_rate,
+						 std::uint8_t timeout)
+		: stream_(dev, baud_rate == AUTO_BAUD_RATE ? DEFAULT_BAUD_RATE : baud_rate,
+				  timeout),
+		  reply_timeout_ms_(100 * std::max<int>(timeout, 1)) {
+	if (baud_rate == AUTO_BAUD_RATE)
+		probe_link_speed();
+}
 
 BitaflughtMsp::~BitaflughtMsp() = default;
 
 void BitaflughtMsp::send(CommandType command_type, std::uint8_t command_id,
 						 const void *payload, std::uint8_t size) {
-	uint8_t frame[5 + 255 + 1];
-	frame[0] = '$';
-	frame[1] = 'M';
-	frame[2] = msp::to_underlying(command_type);
-	frame[3] = size;
-	frame[4] = command_id;
-
-	const uint8_t *p = static_cast<const uint8_t *>(payload);
-	uint8_t chk = static_cast<uint8_t>(size ^ command_id);
-
-	for (uint8_t i = 0; i < size; ++i) {
-		uint8_t b = p[i];
-		frame[5 + i] = b;
-		chk ^= b;
-	}
-
-	frame[5 + size] = chk;
-
-	const size_t total = 5 + size + 1;
+	uint8_t frame[MAX_FRAME_SIZE];
+	const size_t total = encode_frame(command_type, command_id, payload, size, frame);
 	stream_.write(frame, total);
 }
 
 bool BitaflughtMsp::recv(std::uint8_t *command_id, void *payload,
 						 std::uint8_t max_size, std::uint8_t *recv_size) {
+	return recv(command_id, payload, max_size, recv_size,
+				std::chrono::steady_clock::now() +
+						std::chrono::milliseconds(reply_timeout_ms_));
+}
+
+bool BitaflughtMsp::recv(std::uint8_t *command_id, void *payload,
+						 std::uint8_t max_size, std::uint8_t *recv_size,
+						 std::chrono::steady_clock::time_point deadline) {
 	uint8_t buffer[5 + 255 + 1];
-	uint8_t size_b = 0;
-	while (true) {
-		size_t a;
-		while (stream_.available() < 5) {
+	// A timeout is reported by the caller (ModeMonitor's link-lost event),
+	// not here: a dead link would otherwise flood stdout at the poll rate
+	if (!read_until(buffer, 5, deadline))
+		return false;
+
+	if (buffer[0] == '$' && buffer[1] == 'M' && buffer[2] == '>') {
+		*recv_size = buffer[3];
+		*command_id = buffer[4];
+		std::uint8_t checksumCalc = *recv_size ^ *command_id;
+		if (!read_until(buffer + 5, *recv_size + 1, deadline))
+			return false;
+
+		auto *payload_ptr = static_cast<uint8_t *>(payload);
+		for (int i = 0; i < *recv_size; i++) {
+			uint8_t b = buffer[i + 5];
+			checksumCalc ^= b;
+			if (i < max_size)
+				payload_ptr[i] = b;
 		}
-		size_b += stream_.read(buffer + size_b, 5);
-		if (buffer[0] == '$' && buffer[1] == 'M' && buffer[2] == '>') {
-			*recv_size = buffer[3];
-			*command_id = buffer[4];
-			std::uint8_t checksumCalc = *recv_size ^ *command_id;
-			auto *payload_ptr = static_cast<uint8_t *>(payload);
-			while (stream_.available() < *recv_size + 1) {
-			}
-			size_b += stream_.read(buffer + size_b, *recv_size + 1);
-			for (int i = 0; i < *recv_size; i++) {
-				uint8_t b = buffer[i + 5];
-				checksumCalc ^= b;
-				*(payload_ptr++) = b;
-			}
-			uint8_t checksum = buffer[5 + *recv_size];
-			for (std::uint8_t j = *recv_size + 6; j < max_size; ++j) {
-				*(payload_ptr++) = 0;
-			}
-			if (checksum == checksumCalc) {
-				return true;
-			}
-			std::cout << "Invalid checksum (calc): " << static_cast<int>(checksumCalc)
-								<< "; (received): " << static_cast<int>(checksum) << std::endl;
+		for (int j = *recv_size; j < max_size; ++j) {
+			payload_ptr[j] = 0;
+		}
+		uint8_t checksum = buffer[5 + *recv_size];
+		if (checksum == checksumCalc) {
+			return true;
 		}
-		std::cout << "Wrong header" << buffer[0] << buffer[1] << buffer[2]
-							<< std::endl;
+		std::cout << "Invalid checksum (calc): " << static_cast<int>(checksumCalc)
+							<< "; (received): " << static_cast<int>(checksum) << std::endl;
 		return false;
 	}
+	std::cout << "Wrong header" << buffer[0] << buffer[1] << buffer[2]
+						<< std::endl;
+	return false;
+}
+
+bool BitaflughtMsp::read_until(std::uint8_t *buffer, std::size_t count,
+							   std::chrono::steady_clock::time_point deadline) {
+	std::size_t size = 0;
+	while (size < count) {
+		const auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(
+				deadline - std::chrono::steady_clock::now())
+				.count();
+		if (remaining <= 0 || !stream_.wait_readable(static_cast<int>(remaining)))
+			return false;
+
+		std::size_t want = std::min(stream_.available(), count - size);
+		if (want == 0)
+			want = 1;
+		size += stream_.read(buffer + size, want);
+	}
+	return true;
 }
 
 bool BitaflughtMsp::request(std::uint8_t command_id, void *payload,
@@ -87,9 +109,13 @@ bool BitaflughtMsp::waitFor(std::uint8_t command_id, void *payload,
 							std::uint8_t max_size, std::uint8_t *recv_size) {
 	std::uint8_t rx_id = 0;
 	std::uint8_t out_len;
+	// One deadline for the reply, however many other frames come first
+	const auto deadline = std::chrono::steady_clock::now() +
+						  std::chrono::milliseconds(reply_timeout_ms_);
 
 	while (true) {
-		if (!recv(&rx_id, payload, max_size, (recv_size ? recv_size : &out_len))) {
+		if (!recv(&rx_id, payload, max_size, (recv_size ? recv_size : &out_len),
+				  deadline)) {
 			if (recv_size)
 				*recv_size = 0;
 			return false;
@@ -111,9 +137,112 @@ bool BitaflughtMsp::command(std::uint8_t command_id, void *payload,
 	return true;
 }
 bool BitaflughtMsp::getActiveModes(std::uint32_t *active_modes) {
-	(void)active_modes;
+	std::uint8_t payload[32];
+	std::uint8_t recv_size = 0;
+
+	if (!request(MSP_STATUS, payload, sizeof(payload), &recv_size) || recv_size < 10)
+		return false;
 
+	*active_modes = static_cast<std::uint32_t>(payload[6] | (payload[7] << 8) |
+											   (payload[8] << 16) | (payload[9] << 24));
 	return true;
 }
 
+bool BitaflughtMsp::wait_response(std::uint8_t command_id, int timeout_ms) {
+	using clock = std::chrono::steady_clock;
+	const auto deadline = clock::now() + std::chrono::milliseconds(timeout_ms);
+
+	std::uint8_t buffer[2 * MAX_FRAME_SIZE];
+	std::size_t size = 0;
+	while (true) {
+		// Drop whatever cannot start a frame, then frames for other commands
+		while (size > 0) {
+			FrameView frame;
+			std::size_t consumed = 0;
+			const DecodeStatus status = decode_frame(buffer, size, &frame, &consumed);
+			if (status == DecodeStatus::Incomplete)
+				break;
+			if (status == DecodeStatus::Ok &&
+				frame.command_type == CommandType::Response &&
+				frame.command_id == command_id)
+				return true;
+
+			if (consumed == 0)
+				consumed = 1;
+			std::memmove(buffer, buffer + consumed, size - consumed);
+			size -= consumed;
+		}
+
+		const auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(
+				deadline - clock::now())
+				.count();
+		if (remaining <= 0 || !stream_.wait_readable(static_cast<int>(remaining)))
+			return false;
+
+		std::size_t want = stream_.available();
+		if (want > sizeof(buffer) - size)
+			want = sizeof(buffer) - size;
+		if (want == 0)
+			want = 1;
+		size += stream_.read(buffer + size, want);
+	}
+}
+
+std::uint32_t BitaflughtMsp::probe_link_speed(const std::uint32_t *candidates,
+											  std::size_t count, unsigned attempts,
+											  int reply_timeout_ms,
+											  std::vector<LinkProbeResult> *report) {
+	using clock = std::chrono::steady_clock;
+	const std::uint8_t command_id = static_cast<std::uint8_t>(MSP_API_VERSION);
+
+	for (std::size_t i = 0; i < count; ++i) {
+		LinkProbeResult result = {candidates[i], 0, 0, 0, 0.0};
+		try {
+			stream_.set_baud_rate(candidates[i]);
+		} catch (const std::system_error &) {
+			// The driver cannot generate this rate
+			if (report)
+				report->push_back(result);
+			continue;
+		}
+		result.actual_rate = stream_.baud_rate();
+
+		// Let the line settle and drop bytes received while switching
+		std::this_thread::sleep_for(std::chrono::milliseconds(5));
+		stream_.discard_input();
+
+		double round_trip_sum_us = 0.0;
+		for (unsigned k = 0; k < attempts; ++k) {
+			++result.attempts;
+			const auto start = clock::now();
+			send(CommandType::Request, command_id, nullptr, 0);
+			if (!wait_response(command_id, reply_timeout_ms))
+				break;
+			round_trip_sum_us +=
+					std::chrono::duration<double, std::micro>(clock::now() - start).count();
+			++result.replies;
+		}
+		if (result.replies > 0)
+			result.mean_round_trip_us = round_trip_sum_us / result.replies;
+		if (report)
+			report->push_back(result);
+
+		if (result.replies == attempts)
+			return result.actual_rate;
+	}
+
+	throw std::runtime_error("No baud rate got " + std::to_string(attempts) +
+							 " MSP_API_VERSION replies from the flight controller");
+}
+
+std::uint32_t BitaflughtMsp::probe_link_speed(std::vector<LinkProbeResult> *report) {
+	return probe_link_speed(PROBE_BAUD_RATES,
+							sizeof(PROBE_BAUD_RATES) / sizeof(PROBE_BAUD_RATES[0]),
+							20, 50, report);
+}
+
+std::uint32_t BitaflughtMsp::baud_rate() const noexcept {
+	return stream_.baud_rate();
+}
+
 }
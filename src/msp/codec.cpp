@@ -0,0 +1,75 @@
+#include <cstring>
+
+#include "msp/codec.hpp"
+
+namespace msp {
+
+std::size_t encode_frame(CommandType command_type, std::uint8_t command_id,
+						 const void *payload, std::uint8_t size,
+						 std::uint8_t *out) noexcept {
+	out[0] = '$';
+	out[1] = 'M';
+	out[2] = msp::to_underlying(command_type);
+	out[3] = size;
+	out[4] = command_id;
+
+	const std::uint8_t *p = static_cast<const std::uint8_t *>(payload);
+	std::uint8_t chk = static_cast<std::uint8_t>(size ^ command_id);
+
+	for (std::uint8_t i = 0; i < size; ++i) {
+		std::uint8_t b = p[i];
+		out[5 + i] = b;
+		chk ^= b;
+	}
+
+	out[5 + size] = chk;
+
+	return FRAME_OVERHEAD + size;
+}
+
+DecodeStatus decode_frame(const std::uint8_t *data, std::size_t available,
+						  FrameView *frame, std::size_t *consumed) noexcept {
+	*consumed = 0;
+
+	if (available >= 1 && data[0] != '$')
+		return DecodeStatus::BadHeader;
+	if (available >= 2 && data[1] != 'M')
+		return DecodeStatus::BadHeader;
+	if (available >= 3 && data[2] != to_underlying(CommandType::Response) &&
+		data[2] != to_underlying(CommandType::Request) &&
+		data[2] != to_underlying(CommandType::Error))
+		return DecodeStatus::BadHeader;
+	if (available < FRAME_OVERHEAD - 1)
+		return DecodeStatus::Incomplete;
+
+	const std::uint8_t size = data[3];
+	if (available < FRAME_OVERHEAD + size)
+		return DecodeStatus::Incomplete;
+
+	std::uint8_t chk = static_cast<std::uint8_t>(size ^ data[4]);
+	for (std::uint8_t i = 0; i < size; ++i)
+		chk ^= data[5 + i];
+
+	*consumed = FRAME_OVERHEAD + size;
+	if (chk != data[5 + size])
+		return DecodeStatus::BadChecksum;
+
+	frame->command_type = static_cast<CommandType>(data[2]);
+	frame->command_id = data[4];
+	frame->size = size;
+	frame->payload = data + 5;
+	return DecodeStatus::Ok;
+}
+
+void encode_set_raw_rc(const Channels &channels, std::uint8_t *out) noexcept {
+	const std::uint16_t ch[8] = {channels.roll, channels.pitch,
+								 channels.throttle, channels.yaw,
+								 channels.aux1, channels.aux2,
+								 channels.aux3, channels.aux4};
+	for (std::uint8_t i = 0; i < 8; i++) {
+		out[i * 2] = ch[i] & 0xFF;
+		out[i * 2 + 1] = (ch[i] >> 8) & 0xFF;
+	}
+}
+
+} // namespace msp
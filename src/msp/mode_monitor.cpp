@@ -0,0 +1,74 @@
+#include <exception>
+#include <utility>
+
+#include "msp/mode_monitor.hpp"
+
+namespace msp {
+
+ModeMonitor::ModeMonitor(Msp &msp, Listener listener,
+						 std::chrono::milliseconds period,
+						 LinkListener link_listener, unsigned lost_after)
+		: msp_(msp), box_ids_(msp.boxIds()), listener_(std::move(listener)),
+		  period_(period), link_listener_(std::move(link_listener)),
+		  lost_after_(lost_after > 0 ? lost_after : 1) {
+	// Fail here rather than report a mode-less drone from the first poll
+	modes_.store(box_ids_.translate(msp_.status().mode_flags).bits,
+				 std::memory_order_relaxed);
+	updated_.store(std::chrono::steady_clock::now().time_since_epoch().count(),
+				   std::memory_order_relaxed);
+
+	thread_ = std::thread(&ModeMonitor::run, this);
+}
+
+ModeMonitor::~ModeMonitor() noexcept {
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		stop_ = true;
+	}
+	wake_.notify_all();
+	if (thread_.joinable())
+		thread_.join();
+}
+
+std::chrono::steady_clock::time_point ModeMonitor::updated() const noexcept {
+	return std::chrono::steady_clock::time_point(std::chrono::steady_clock::duration(
+			updated_.load(std::memory_order_relaxed)));
+}
+
+void ModeMonitor::run() {
+	std::unique_lock<std::mutex> lock(mutex_);
+	while (!wake_.wait_for(lock, period_, [this] { return stop_; })) {
+		lock.unlock();
+		poll();
+		lock.lock();
+	}
+}
+
+void ModeMonitor::poll() {
+	ActiveModes current;
+	try {
+		current = box_ids_.translate(msp_.status().mode_flags);
+	} catch (const std::exception &) {
+		failures_.fetch_add(1, std::memory_order_relaxed);
+		if (++consecutive_failures_ == lost_after_) {
+			link_lost_.store(true, std::memory_order_relaxed);
+			if (link_listener_)
+				link_listener_(LinkEvent::Lost);
+		}
+		return;
+	}
+
+	consecutive_failures_ = 0;
+	if (link_lost_.exchange(false, std::memory_order_relaxed) && link_listener_)
+		link_listener_(LinkEvent::Restored);
+
+	const ActiveModes previous{
+			modes_.exchange(current.bits, std::memory_order_relaxed)};
+	updated_.store(std::chrono::steady_clock::now().time_since_epoch().count(),
+				   std::memory_order_relaxed);
+
+	if (current != previous && listener_)
+		listener_(previous, current);
+}
+
+} // namespace msp
@@ -1,16 +1,41 @@
 #include "msp/msp.hpp"
+#include "msp/codec.hpp"
+#include "msp/msp_proxy.hpp"
 
 namespace msp {
 
-Msp::Msp(const char *dev, speed_t baud_rate, cc_t timeout)
-		: bitaflught_msp_(dev, baud_rate, timeout) {}
+Msp::Msp(const char *dev, std::uint32_t baud_rate, std::uint8_t timeout)
+		: bitaflught_msp_(std::make_unique<BitaflughtMsp>(dev, baud_rate, timeout)) {}
+
+Msp::Msp(MspProxy &proxy) : proxy_(&proxy) {}
+
+Msp::~Msp() = default;
+
+std::uint32_t Msp::baud_rate() const noexcept {
+	return proxy_ ? proxy_->baud_rate() : bitaflught_msp_->baud_rate();
+}
+
+bool Msp::request(std::uint8_t command_id, void *payload, std::uint8_t max_size,
+				  std::uint8_t *recv_size) {
+	if (proxy_)
+		return proxy_->request(command_id, nullptr, 0, payload, max_size, recv_size);
+	std::lock_guard<std::mutex> lock(mutex_);
+	return bitaflught_msp_->request(command_id, payload, max_size, recv_size);
+}
+
+bool Msp::command(std::uint8_t command_id, void *payload, std::uint8_t size) {
+	if (proxy_)
+		return proxy_->request(command_id, payload, size, nullptr, 0);
+	std::lock_guard<std::mutex> lock(mutex_);
+	return bitaflught_msp_->command(command_id, payload, size, true);
+}
 
 AttitudeData Msp::attitude() {
 	constexpr std::uint8_t EXPECTED_SIZE = 6;
 	std::uint8_t payload[EXPECTED_SIZE];
 	std::uint8_t recv_size = 0;
 
-	if (!bitaflught_msp_.request(MSP_ATTITUDE, payload, EXPECTED_SIZE,
+	if (!request(MSP_ATTITUDE, payload, EXPECTED_SIZE,
 															 &recv_size)) {
 		throw std::runtime_error("MSP_ATTITUDE request failed or timed out");
 	}
@@ -22,7 +47,7 @@ StatusData Msp::status() {
 	std::uint8_t payload[32];
 	std::uint8_t recv_size = 0;
 
-	if (!bitaflught_msp_.request(MSP_STATUS, payload, sizeof(payload),
+	if (!request(MSP_STATUS, payload, sizeof(payload),
 															 &recv_size)) {
 		throw std::runtime_error("MSP_STATUS request failed or timed out");
 	}
@@ -34,7 +59,7 @@ RcData Msp::rc() {
 	std::uint8_t payload[MAX_RC_CHANNELS * 2];
 	std::uint8_t recv_size = 0;
 
-	if (!bitaflught_msp_.request(MSP_RC, payload, sizeof(payload), &recv_size)) {
+	if (!request(MSP_RC, payload, sizeof(payload), &recv_size)) {
 		throw std::runtime_error("MSP_RC request failed or timed out");
 	}
 
@@ -46,7 +71,7 @@ AltitudeData Msp::altitude() {
 	std::uint8_t payload[EXPECTED_SIZE];
 	std::uint8_t recv_size = 0;
 
-	if (!bitaflught_msp_.request(MSP_ALTITUDE, payload, EXPECTED_SIZE,
+	if (!request(MSP_ALTITUDE, payload, EXPECTED_SIZE,
 															 &recv_size)) {
 		throw std::runtime_error("MSP_ALTITUDE request failed or timed out");
 	}
@@ -55,19 +80,37 @@ AltitudeData Msp::altitude() {
 }
 
 void Msp::setRawRc(const SetRawRcData &data) {
-	std::uint8_t payload[16];
-	std::uint8_t size = 16;
-
-	const std::uint16_t *ch =
-			reinterpret_cast<const std::uint16_t *>(&data.channels);
-	for (std::uint8_t i = 0; i < 8; i++) {
-		payload[i * 2] = ch[i] & 0xFF;
-		payload[i * 2 + 1] = (ch[i] >> 8) & 0xFF;
-	}
+	std::uint8_t payload[SET_RAW_RC_PAYLOAD_SIZE];
+	std::uint8_t size = SET_RAW_RC_PAYLOAD_SIZE;
 
-	if (!bitaflught_msp_.command(MSP_SET_RAW_RC, payload, size, true)) {
+	encode_set_raw_rc(data.channels, payload);
+
+	if (!command(MSP_SET_RAW_RC, payload, size)) {
 		throw std::runtime_error("MSP_SET_RAW_RC command failed");
 	}
 }
 
+const BoxIdMap &Msp::boxIds() {
+	std::lock_guard<std::mutex> lock(box_ids_mutex_);
+	if (!box_ids_loaded_) {
+		std::uint8_t payload[255];
+		std::uint8_t recv_size = 0;
+
+		// A throw leaves box_ids_loaded_ unset, so the next call asks again
+		if (!request(MSP_BOXIDS, payload, sizeof(payload), &recv_size)) {
+			throw std::runtime_error("MSP_BOXIDS request failed or timed out");
+		}
+
+		box_ids_ = BoxIdMap(payload, recv_size);
+		box_ids_loaded_ = true;
+	}
+
+	return box_ids_;
+}
+
+ActiveModes Msp::activeModes() {
+	const BoxIdMap &box_ids = boxIds();
+	return box_ids.translate(status().mode_flags);
+}
+
 }
@@ -0,0 +1,467 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "msp/codec.hpp"
+#include "msp/msp.hpp"
+#include "msp/msp_proxy.hpp"
+#include "utils.hpp"
+
+namespace msp {
+
+MspProxy::MspProxy(const char *dev, const std::uint32_t baud_rate, ProxyOptions options) :
+		options_(std::move(options)), link_(dev, baud_rate, 0, 1) {
+	wake_fd_ = ::eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+	if (wake_fd_ < 0)
+		utils::throw_errno(errno, "Error creating proxy wakeup with eventfd");
+
+	if (!options_.socket_path.empty()) {
+		auto fail = [&](auto &&...msg) -> void {
+			const int e = errno;
+			if (listen_fd_ >= 0)
+				::close(listen_fd_);
+			::close(wake_fd_);
+			utils::throw_errno(e, std::forward<decltype(msg)>(msg)...);
+		};
+
+		struct sockaddr_un address = {};
+		address.sun_family = AF_UNIX;
+		if (options_.socket_path.size() >= sizeof(address.sun_path)) {
+			errno = ENAMETOOLONG;
+			fail("while trying to bind proxy socket <", options_.socket_path, ">");
+		}
+		std::memcpy(address.sun_path, options_.socket_path.c_str(), options_.socket_path.size() + 1);
+
+		listen_fd_ = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0);
+		if (listen_fd_ < 0)
+			fail("Error creating proxy socket with socket");
+
+		// A socket file left by a previous run refuses bind()
+		::unlink(options_.socket_path.c_str());
+		if (::bind(listen_fd_, reinterpret_cast<const struct sockaddr *>(&address), sizeof(address)) != 0)
+			fail("while trying to bind proxy socket <", options_.socket_path, ">");
+		if (::listen(listen_fd_, static_cast<int>(options_.max_clients)) != 0)
+			fail("Error listening on proxy socket with listen");
+	}
+
+	link_rx_.reserve(2 * MAX_FRAME_SIZE);
+	clients_.reserve(options_.max_clients);
+	thread_ = std::thread(&MspProxy::run, this);
+}
+
+MspProxy::~MspProxy() noexcept {
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		stop_ = true;
+	}
+	wake();
+	if (thread_.joinable())
+		thread_.join();
+
+	for (Client &client : clients_)
+		::close(client.fd);
+	clients_.clear();
+
+	if (listen_fd_ >= 0) {
+		::close(listen_fd_);
+		::unlink(options_.socket_path.c_str());
+		listen_fd_ = -1;
+	}
+	if (wake_fd_ >= 0) {
+		::close(wake_fd_);
+		wake_fd_ = -1;
+	}
+}
+
+bool MspProxy::request(const std::uint8_t command_id, const void *payload, const std::uint8_t size,
+					   void *response, const std::uint8_t max_size, std::uint8_t *recv_size,
+					   const int timeout_ms) {
+	ControlRequest request;
+	request.command_id = command_id;
+	request.size = size;
+	if (size > 0)
+		std::memcpy(request.payload, payload, size);
+	request.waiting = true;
+	request.timeout_ms = timeout_ms;
+
+	std::unique_lock<std::mutex> lock(mutex_);
+	if (stop_ || control_count_ == MAX_CONTROL_QUEUE)
+		return false;
+	control_queue_[control_count_++] = &request;
+	wake();
+	done_.wait(lock, [&] { return request.done; });
+
+	if (recv_size)
+		*recv_size = request.response_size;
+	if (request.ok && max_size > 0)
+		std::memcpy(response, request.response, std::min(max_size, request.response_size));
+	return request.ok;
+}
+
+void MspProxy::post(const std::uint8_t command_id, const void *payload, const std::uint8_t size) {
+	std::lock_guard<std::mutex> lock(mutex_);
+
+	ControlRequest *slot = nullptr;
+	for (ControlRequest &post : posts_) {
+		if (post.queued && post.command_id == command_id) {
+			// Still waiting for the link: replace it with the newer one
+			post.size = size;
+			if (size > 0)
+				std::memcpy(post.payload, payload, size);
+			return;
+		}
+		if (!post.queued && slot == nullptr)
+			slot = &post;
+	}
+
+	if (slot == nullptr || control_count_ == MAX_CONTROL_QUEUE) {
+		++stats_.posts_dropped;
+		return;
+	}
+
+	slot->command_id = command_id;
+	slot->size = size;
+	if (size > 0)
+		std::memcpy(slot->payload, payload, size);
+	slot->waiting = false;
+	slot->queued = true;
+	control_queue_[control_count_++] = slot;
+	wake();
+}
+
+std::uint32_t MspProxy::baud_rate() const noexcept { return link_.baud_rate(); }
+
+ProxyStats MspProxy::stats() const {
+	std::lock_guard<std::mutex> lock(mutex_);
+	return stats_;
+}
+
+void MspProxy::wake() noexcept {
+	const std::uint64_t one = 1;
+	// EAGAIN only when the counter is already pending, which wakes it anyway
+	(void)!::write(wake_fd_, &one, sizeof(one));
+}
+
+void MspProxy::run() {
+	std::vector<struct pollfd> fds;
+	fds.reserve(3 + options_.max_clients);
+
+	while (true) {
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			if (stop_)
+				break;
+		}
+
+		if (owner_ == Owner::None)
+			start_next();
+
+		fds.clear();
+		fds.push_back({wake_fd_, POLLIN, 0});
+		fds.push_back({link_.native_handle(), POLLIN, 0});
+		fds.push_back({clients_.size() < options_.max_clients ? listen_fd_ : -1, POLLIN, 0});
+		for (const Client &client : clients_) {
+			// Backpressure: a client with a full queue is not read
+			const short events = client.pending.size() < options_.max_client_pending ? POLLIN : 0;
+			fds.push_back({client.fd, events, 0});
+		}
+
+		int timeout = -1;
+		if (owner_ != Owner::None) {
+			const auto remaining = std::chrono::ceil<std::chrono::milliseconds>(
+					deadline_ - std::chrono::steady_clock::now());
+			timeout = static_cast<int>(std::max<std::chrono::milliseconds::rep>(remaining.count(), 0));
+		}
+
+		if (::poll(fds.data(), fds.size(), timeout) < 0) {
+			if (errno == EINTR)
+				continue;
+			// Nothing sensible left to do on this thread; fail every caller
+			break;
+		}
+
+		if (fds[0].revents & POLLIN) {
+			std::uint64_t count;
+			(void)!::read(wake_fd_, &count, sizeof(count));
+		}
+
+		if (fds[1].revents & POLLIN)
+			read_link();
+
+		if (owner_ != Owner::None && std::chrono::steady_clock::now() >= deadline_) {
+			complete(nullptr);
+			// A late reply must not be taken for the answer to the next request
+			link_.discard_input();
+			link_rx_.clear();
+		}
+
+		if (fds[2].revents & POLLIN)
+			accept_clients();
+
+		// Clients were added behind the polled ones, and closing shifts them
+		const std::size_t polled = fds.size() - 3;
+		for (std::size_t i = polled; i-- > 0;) {
+			const short revents = fds[3 + i].revents;
+			if (revents == 0 || i >= clients_.size() || clients_[i].fd != fds[3 + i].fd)
+				continue;
+			if ((revents & (POLLERR | POLLHUP | POLLNVAL)) && !(revents & POLLIN)) {
+				close_client(i);
+				continue;
+			}
+			if ((revents & POLLIN) && !read_client(clients_[i]))
+				close_client(i);
+		}
+
+		for (std::size_t i = clients_.size(); i-- > 0;) {
+			if (clients_[i].broken)
+				close_client(i);
+		}
+	}
+
+	// Release every control caller still waiting, and refuse later ones
+	std::lock_guard<std::mutex> lock(mutex_);
+	stop_ = true;
+	if (in_flight_control_ != nullptr) {
+		in_flight_control_->done = true;
+		in_flight_control_ = nullptr;
+	}
+	for (std::size_t i = 0; i < control_count_; ++i) {
+		control_queue_[i]->queued = false;
+		control_queue_[i]->done = true;
+	}
+	control_count_ = 0;
+	done_.notify_all();
+}
+
+void MspProxy::accept_clients() {
+	while (clients_.size() < options_.max_clients) {
+		const int fd = ::accept4(listen_fd_, nullptr, nullptr, SOCK_CLOEXEC | SOCK_NONBLOCK);
+		if (fd < 0)
+			return;
+
+		Client client;
+		client.fd = fd;
+		client.rx.reserve(2 * MAX_FRAME_SIZE);
+		clients_.push_back(std::move(client));
+	}
+}
+
+bool MspProxy::read_client(Client &client) {
+	std::uint8_t buffer[512];
+	const ssize_t n = ::recv(client.fd, buffer, sizeof(buffer), MSG_DONTWAIT);
+	if (n == 0)
+		return false;
+	if (n < 0)
+		return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+	client.rx.insert(client.rx.end(), buffer, buffer + n);
+
+	std::size_t offset = 0;
+	while (client.pending.size() < options_.max_client_pending && !client.broken) {
+		FrameView frame;
+		std::size_t consumed = 0;
+		const DecodeStatus status =
+				decode_frame(client.rx.data() + offset, client.rx.size() - offset, &frame, &consumed);
+		if (status == DecodeStatus::Incomplete)
+			break;
+		if (status == DecodeStatus::BadHeader) {
+			++offset;
+			continue;
+		}
+
+		if (status == DecodeStatus::Ok && frame.command_type == CommandType::Request) {
+			if (options_.reject_client_rc && frame.command_id == MSP_SET_RAW_RC) {
+				{
+					std::lock_guard<std::mutex> lock(mutex_);
+					++stats_.rejected;
+				}
+				reply_to_client(client.fd, CommandType::Error, frame.command_id, nullptr, 0);
+			} else {
+				const std::uint8_t *begin = client.rx.data() + offset;
+				client.pending.emplace_back(begin, begin + consumed);
+			}
+		}
+		offset += consumed;
+	}
+	client.rx.erase(client.rx.begin(), client.rx.begin() + offset);
+
+	return true;
+}
+
+void MspProxy::reply_to_client(const int fd, const CommandType command_type, const std::uint8_t command_id,
+							   const std::uint8_t *payload, const std::uint8_t size) {
+	std::uint8_t frame[MAX_FRAME_SIZE];
+	const std::size_t length = encode_frame(command_type, command_id, payload, size, frame);
+
+	const ssize_t sent = ::send(fd, frame, length, MSG_DONTWAIT | MSG_NOSIGNAL);
+	if (sent == static_cast<ssize_t>(length))
+		return;
+
+	// The client stopped reading or went away; never block the link on it.
+	// It is closed after the current pass over the clients
+	for (Client &client : clients_) {
+		if (client.fd == fd && !client.broken) {
+			client.broken = true;
+			std::lock_guard<std::mutex> lock(mutex_);
+			++stats_.clients_dropped;
+		}
+	}
+}
+
+void MspProxy::start_next() {
+	std::uint8_t frame[MAX_FRAME_SIZE];
+	std::size_t length = 0;
+	int timeout_ms = options_.client_timeout_ms;
+
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		if (control_count_ > 0) {
+			ControlRequest *request = control_queue_[0];
+			std::copy(control_queue_ + 1, control_queue_ + control_count_, control_queue_);
+			--control_count_;
+
+			length = encode_frame(CommandType::Request, request->command_id, request->payload,
+								  request->size, frame);
+			owner_ = Owner::Control;
+			in_flight_command_ = request->command_id;
+			if (request->waiting) {
+				in_flight_control_ = request;
+				timeout_ms = request->timeout_ms;
+			} else {
+				// The post slot may be refilled as soon as its frame is encoded
+				request->queued = false;
+				in_flight_control_ = nullptr;
+			}
+		}
+	}
+
+	if (length == 0) {
+		for (std::size_t k = 0; k < clients_.size(); ++k) {
+			const std::size_t i = (next_client_ + k) % clients_.size();
+			Client &client = clients_[i];
+			if (client.pending.empty())
+				continue;
+
+			const std::vector<std::uint8_t> &request = client.pending.front();
+			length = request.size();
+			std::memcpy(frame, request.data(), length);
+			in_flight_command_ = request[4];
+			client.pending.pop_front();
+
+			owner_ = Owner::Client;
+			in_flight_client_fd_ = client.fd;
+			next_client_ = i + 1;
+			break;
+		}
+	}
+
+	if (owner_ == Owner::None)
+		return;
+
+	try {
+		link_.write(frame, length);
+	} catch (const std::system_error &) {
+		complete(nullptr);
+		return;
+	}
+	deadline_ = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+}
+
+void MspProxy::read_link() {
+	std::uint8_t buffer[512];
+	std::size_t available = 0;
+	try {
+		available = std::min(link_.available(), sizeof(buffer));
+		if (available == 0)
+			return;
+		available = link_.read(buffer, available);
+	} catch (const std::system_error &) {
+		return;
+	}
+	link_rx_.insert(link_rx_.end(), buffer, buffer + available);
+
+	std::size_t offset = 0;
+	while (offset < link_rx_.size()) {
+		FrameView frame;
+		std::size_t consumed = 0;
+		const DecodeStatus status =
+				decode_frame(link_rx_.data() + offset, link_rx_.size() - offset, &frame, &consumed);
+		if (status == DecodeStatus::Incomplete)
+			break;
+		if (status == DecodeStatus::BadHeader) {
+			++offset;
+			continue;
+		}
+
+		if (status == DecodeStatus::Ok) {
+			if (owner_ != Owner::None && frame.command_id == in_flight_command_ &&
+				frame.command_type != CommandType::Request) {
+				complete(&frame);
+			} else {
+				std::lock_guard<std::mutex> lock(mutex_);
+				++stats_.unsolicited;
+			}
+		}
+		offset += consumed;
+	}
+	link_rx_.erase(link_rx_.begin(), link_rx_.begin() + offset);
+}
+
+void MspProxy::complete(const FrameView *reply) {
+	const bool ok = reply != nullptr && reply->command_type == CommandType::Response;
+
+	if (owner_ == Owner::Control) {
+		std::lock_guard<std::mutex> lock(mutex_);
+		if (reply == nullptr)
+			++stats_.timeouts;
+		else
+			++stats_.control_transactions;
+
+		if (in_flight_control_ != nullptr) {
+			in_flight_control_->ok = ok;
+			in_flight_control_->response_size = ok ? reply->size : 0;
+			if (ok && reply->size > 0)
+				std::memcpy(in_flight_control_->response, reply->payload, reply->size);
+			in_flight_control_->done = true;
+			done_.notify_all();
+		}
+	} else if (owner_ == Owner::Client) {
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			if (reply == nullptr)
+				++stats_.timeouts;
+			else
+				++stats_.client_transactions;
+		}
+
+		const int fd = in_flight_client_fd_;
+		owner_ = Owner::None;
+		in_flight_client_fd_ = -1;
+		// An unanswered request still gets an error frame, so the client
+		// does not wait for its own timeout
+		if (fd >= 0 && reply != nullptr)
+			reply_to_client(fd, reply->command_type, in_flight_command_, reply->payload, reply->size);
+		else if (fd >= 0)
+			reply_to_client(fd, CommandType::Error, in_flight_command_, nullptr, 0);
+	}
+
+	owner_ = Owner::None;
+	in_flight_control_ = nullptr;
+	in_flight_client_fd_ = -1;
+}
+
+void MspProxy::close_client(const std::size_t index) {
+	if (clients_[index].fd == in_flight_client_fd_)
+		in_flight_client_fd_ = -1; // its reply is read and dropped
+	::close(clients_[index].fd);
+	clients_.erase(clients_.begin() + static_cast<std::ptrdiff_t>(index));
+	if (next_client_ > index)
+		--next_client_;
+}
+
+} // namespace msp
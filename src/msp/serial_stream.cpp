@@ -1,21 +1,39 @@
 #include <cerrno>
+#include <chrono>
 #include <cstddef>
 #include <cstring>
 
 #include <fcntl.h>
-#include <iostream>
-#include <ostream>
+#include <poll.h>
 #include <sys/ioctl.h>
-#include <sys/termios.h>
-#include <termios.h>
 #include <unistd.h>
+// termios2 and BOTHER; <termios.h> must not be included alongside
+#include <asm/termbits.h>
+#include <linux/serial.h>
 
 #include "msp/serial_stream.hpp"
 #include "utils.hpp"
 
 namespace msp {
 
-SerialStream::SerialStream(const char *dev, const speed_t baud_rate, const cc_t timeout) :
+namespace {
+
+void apply_baud_rate(struct termios2 &tty, const std::uint32_t baud_rate) {
+	tty.c_cflag &= ~CBAUD;
+	tty.c_cflag |= BOTHER;
+	tty.c_ispeed = baud_rate;
+	tty.c_ospeed = baud_rate;
+#ifdef IBSHIFT
+	// Input rate follows c_ispeed rather than the output rate
+	tty.c_cflag &= ~(CBAUD << IBSHIFT);
+	tty.c_cflag |= BOTHER << IBSHIFT;
+#endif
+}
+
+} // namespace
+
+SerialStream::SerialStream(const char *dev, const std::uint32_t baud_rate, const std::uint8_t timeout,
+						   const std::uint8_t min_bytes) :
 		serial_fd_(::open(dev, O_RDWR | O_NOCTTY | O_CLOEXEC)) {
 	if (serial_fd_ < 0) {
 		auto e = errno;
@@ -27,13 +45,13 @@ SerialStream::SerialStream(const char *dev, const speed_t baud_rate, const cc_t
 		if (serial_fd_ >= 0) {
 			::close(serial_fd_);
 		}
-		
+
 		utils::throw_errno(e, std::forward<decltype(msg)>(msg)...);
 	};
 
-	struct termios tty;
-	if (::tcgetattr(serial_fd_, &tty) != 0)
-		fail("Error calling tcgetattr");
+	struct termios2 tty;
+	if (::ioctl(serial_fd_, TCGETS2, &tty) != 0)
+		fail("Error reading attributes with TCGETS2");
 
 	tty.c_iflag &= ~(IXON | IXOFF | IXANY);
 	tty.c_iflag &= ~(IGNBRK | BRKINT | PARMRK | ISTRIP | INLCR | IGNCR | ICRNL);
@@ -60,23 +78,33 @@ SerialStream::SerialStream(const char *dev, const speed_t baud_rate, const cc_t
 
 	tty.c_cc[VTIME] = timeout;
 
-	tty.c_cc[VMIN] = 1;
+	tty.c_cc[VMIN] = min_bytes;
+
+	apply_baud_rate(tty, baud_rate);
 
-	if (::cfsetispeed(&tty, baud_rate) != 0)
-		fail("Error setting input baud rate with cfsetispeed");
-	if (::cfsetospeed(&tty, baud_rate) != 0)
-		fail("Error setting output baud rate with cfsetospeed");
+	if (::ioctl(serial_fd_, TCSETS2, &tty) != 0)
+		fail("Error setting attributes with TCSETS2 at", baud_rate, "baud");
 
-	if (::tcsetattr(serial_fd_, TCSANOW, &tty) != 0)
-		fail("Error setting attributes with tcsetattr");
+	// The driver may round the rate to what its clock can divide down to
+	if (::ioctl(serial_fd_, TCGETS2, &tty) != 0)
+		fail("Error reading attributes with TCGETS2");
+	baud_rate_ = tty.c_ospeed;
 
-	if (::tcflush(serial_fd_, TCIOFLUSH))
-		fail("Error error flushing input and output with tcflush");
+	// Best effort: only drivers implementing the serial ioctls (USB adapters,
+	// 8250) know the flag
+	struct serial_struct serial;
+	if (::ioctl(serial_fd_, TIOCGSERIAL, &serial) == 0) {
+		serial.flags |= ASYNC_LOW_LATENCY;
+		low_latency_ = ::ioctl(serial_fd_, TIOCSSERIAL, &serial) == 0;
+	}
+
+	if (::ioctl(serial_fd_, TCFLSH, TCIOFLUSH) != 0)
+		fail("Error error flushing input and output with TCFLSH");
 }
 
 SerialStream::~SerialStream() noexcept {
 	if (serial_fd_ >= 0) {
-		::tcdrain(serial_fd_);
+		::ioctl(serial_fd_, TCSBRK, 1);
 		::close(serial_fd_);
 
 		serial_fd_ = -1;
@@ -84,24 +112,29 @@ SerialStream::~SerialStream() noexcept {
 }
 
 size_t SerialStream::read(std::uint8_t *buffer, size_t size) {
-	ssize_t n = 0;
-	for (;;) {
-		n += ::read(serial_fd_, buffer+n, size-n);
-
-		const int e = errno;
+	size_t n = 0;
+	while (n < size) {
+		const ssize_t result = ::read(serial_fd_, buffer + n, size - n);
 
-		if (n >= size)
-			return static_cast<std::size_t>(n);
+		if (result > 0) {
+			n += static_cast<size_t>(result);
+			continue;
+		}
+		if (result == 0)
+			return n; // VTIME expired
 
+		const int e = errno;
 		switch (e) {
 		case EINTR:
 			continue;
 		case EAGAIN:
-			return 0;
+			return n;
 		default:
 			utils::throw_errno(e, "Error reading serial input with read");
 		}
 	}
+
+	return n;
 }
 
 size_t SerialStream::write(std::uint8_t *data, size_t size) {
@@ -127,8 +160,9 @@ size_t SerialStream::write(std::uint8_t *data, size_t size) {
 }
 
 void SerialStream::flush() {
-	if (::tcdrain(serial_fd_) != 0)
-		utils::throw_errno(errno, "tcdrain failed");
+	// tcdrain()
+	if (::ioctl(serial_fd_, TCSBRK, 1) != 0)
+		utils::throw_errno(errno, "Error draining output with TCSBRK");
 }
 
 size_t SerialStream::available() {
@@ -140,4 +174,67 @@ size_t SerialStream::available() {
 	return static_cast<size_t>(n);
 }
 
+bool SerialStream::wait_readable(const int timeout_ms) {
+	const auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+	struct pollfd pfd = {serial_fd_, POLLIN, 0};
+
+	for (int remaining = timeout_ms;;) {
+		const int result = ::poll(&pfd, 1, remaining);
+		if (result >= 0)
+			return result > 0;
+
+		const int e = errno;
+		if (e != EINTR)
+			utils::throw_errno(e, "Error waiting for serial input with poll");
+
+		remaining = static_cast<int>(std::chrono::duration_cast<std::chrono::milliseconds>(
+										 deadline - std::chrono::steady_clock::now())
+										 .count());
+		if (remaining < 0)
+			remaining = 0;
+	}
+}
+
+void SerialStream::discard_input() {
+	if (::ioctl(serial_fd_, TCFLSH, TCIFLUSH) != 0)
+		utils::throw_errno(errno, "Error discarding input with TCFLSH");
+}
+
+void SerialStream::set_baud_rate(const std::uint32_t baud_rate) {
+	flush();
+
+	struct termios2 tty;
+	if (::ioctl(serial_fd_, TCGETS2, &tty) != 0)
+		utils::throw_errno(errno, "Error reading attributes with TCGETS2");
+
+	apply_baud_rate(tty, baud_rate);
+
+	if (::ioctl(serial_fd_, TCSETS2, &tty) != 0)
+		utils::throw_errno(errno, "Error setting", baud_rate, "baud with TCSETS2");
+
+	if (::ioctl(serial_fd_, TCGETS2, &tty) != 0)
+		utils::throw_errno(errno, "Error reading attributes with TCGETS2");
+	baud_rate_ = tty.c_ospeed;
+
+	discard_input();
+}
+
+std::uint32_t SerialStream::baud_rate() const noexcept { return baud_rate_; }
+
+void SerialStream::set_read_timing(const std::uint8_t min_bytes, const std::uint8_t timeout) {
+	struct termios2 tty;
+	if (::ioctl(serial_fd_, TCGETS2, &tty) != 0)
+		utils::throw_errno(errno, "Error reading attributes with TCGETS2");
+
+	tty.c_cc[VMIN] = min_bytes;
+	tty.c_cc[VTIME] = timeout;
+
+	if (::ioctl(serial_fd_, TCSETS2, &tty) != 0)
+		utils::throw_errno(errno, "Error setting VMIN/VTIME with TCSETS2");
+}
+
+bool SerialStream::low_latency() const noexcept { return low_latency_; }
+
+int SerialStream::native_handle() const noexcept { return serial_fd_; }
+
 }
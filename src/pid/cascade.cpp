@@ -0,0 +1,131 @@
+#include "pid/cascade.hpp"
+#include <utility>
+
+CascadeController::CascadeController(const CascadeStageConfig &position_stage,
+									 const CascadeStageConfig &velocity_stage,
+									 float outer_period, float k_ff,
+									 utils::Clock clock)
+		: outer_period_(outer_period), k_ff_(k_ff), clock_(std::move(clock)) {
+	const CascadeStageConfig &o = position_stage;
+	const CascadeStageConfig &i = velocity_stage;
+
+	k_p_ = simd::load(simd::Vec4f{{o.k_p, o.k_p, i.k_p, i.k_p}});
+	k_i_ = simd::load(simd::Vec4f{{o.k_i, o.k_i, i.k_i, i.k_i}});
+	k_d_ = simd::load(simd::Vec4f{{o.k_d, o.k_d, i.k_d, i.k_d}});
+	k_df_ = simd::load(simd::Vec4f{{o.k_df, o.k_df, i.k_df, i.k_df}});
+	integral_max_ = simd::load(simd::Vec4f{
+			{o.integral_limit, o.integral_limit, i.integral_limit, i.integral_limit}});
+	integral_min_ = simd::neg(integral_max_);
+	output_max_ = simd::load(simd::Vec4f{
+			{o.output_limit, o.output_limit, i.output_limit, i.output_limit}});
+	output_min_ = simd::neg(output_max_);
+
+	reset();
+}
+
+simd::Vec2u CascadeController::calculate_raw_rc(
+		simd::Vec2f current_position, simd::Vec2f current_velocity,
+		const CascadeSetpoint &setpoint) {
+	return calculate_raw_rc(current_position, current_velocity, setpoint,
+							clock_());
+}
+
+simd::Vec2u CascadeController::calculate_raw_rc(
+		simd::Vec2f current_position, simd::Vec2f current_velocity,
+		const CascadeSetpoint &setpoint,
+		std::chrono::steady_clock::time_point sample_time) {
+	auto current_us = std::chrono::duration_cast<std::chrono::microseconds>(
+			sample_time.time_since_epoch());
+
+	float dt_inner = (current_us - last_inner_time).count() / 1000000.0f;
+	last_inner_time = current_us;
+	if (dt_inner < 0.0f)
+		dt_inner = 0.0f;
+
+	float dt_outer = (current_us - last_outer_time).count() / 1000000.0f;
+	if (dt_outer > 0.0f && dt_outer >= outer_period_) {
+		last_outer_time = current_us;
+	} else {
+		dt_outer = 0.0f;
+	}
+
+	// Lanes with dt == 0 are not due and keep their state below
+	const simd::f32x4 zero = simd::dup4(0.0f);
+	const simd::f32x4 dt =
+			simd::load(simd::Vec4f{{dt_outer, dt_outer, dt_inner, dt_inner}});
+	const float inv_dt_inner = dt_inner > 0.0f ? 1.0f / dt_inner : 0.0f;
+	const simd::f32x4 inv_dt = simd::load(
+			simd::Vec4f{{0.0f, 0.0f, inv_dt_inner, inv_dt_inner}});
+
+	// Inner setpoint: held outer output plus velocity feed-forward
+	const simd::Vec4f held = simd::store(output_);
+	const simd::f32x4 desired = simd::load(simd::Vec4f{
+			{setpoint.position.x, setpoint.position.y,
+			 held.v[OUTER_X] + setpoint.velocity.x,
+			 held.v[OUTER_Y] + setpoint.velocity.y}});
+	const simd::f32x4 state = simd::load(simd::Vec4f{
+			{current_position.x, current_position.y, current_velocity.x,
+			 current_velocity.y}});
+
+	simd::f32x4 error = simd::sub(desired, state);
+
+	// derivative on measurement: outer lanes take -velocity, inner lanes
+	// difference consecutive velocities
+	simd::f32x4 derivative_raw = simd::mla(
+			simd::load(simd::Vec4f{
+					{-current_velocity.x, -current_velocity.y, 0.0f, 0.0f}}),
+			simd::sub(last_value_, state), inv_dt);
+
+	simd::f32x4 first_part = simd::mla(filtered_derivative_,
+									   filtered_derivative_, simd::neg(k_df_));
+	simd::f32x4 filtered = simd::mla(first_part, derivative_raw, k_df_);
+	filtered_derivative_ =
+			simd::blend_gt(dt, zero, filtered, filtered_derivative_);
+	last_value_ = simd::blend_gt(dt, zero, state, last_value_);
+
+	integral_ = simd::mla(integral_, error, dt);
+
+	integral_ = simd::min(simd::max(integral_, integral_min_), integral_max_);
+
+	simd::f32x4 i_term = simd::mul(integral_, k_i_);
+
+	simd::f32x4 d_term = simd::mul(filtered_derivative_, k_d_);
+
+	simd::f32x4 p_term = simd::mul(error, k_p_);
+
+	simd::f32x4 ff_term = simd::load(simd::Vec4f{
+			{0.0f, 0.0f, k_ff_ * setpoint.acceleration.x,
+			 k_ff_ * setpoint.acceleration.y}});
+
+	simd::f32x4 output =
+			simd::add(simd::add(simd::add(i_term, p_term), d_term), ff_term);
+	output = simd::min(simd::max(output, output_min_), output_max_);
+	output_ = simd::blend_gt(dt, zero, output, output_);
+
+	// the inner limit may exceed the RC range, so clamp the PWM like
+	// PidController before converting
+	const float BASE_SPEED = 1500.0f;
+	const float MAX_VALUE = 2000.0f;
+	const float MIN_VALUE = 1000.0f;
+	simd::f32x4 pwm_f = simd::add(output_, simd::dup4(BASE_SPEED));
+	pwm_f = simd::min(pwm_f, simd::dup4(MAX_VALUE));
+	pwm_f = simd::max(pwm_f, simd::dup4(MIN_VALUE));
+	const simd::Vec4u pwm = simd::store(simd::to_u32(pwm_f));
+
+	return {pwm.v[INNER_X], pwm.v[INNER_Y]};
+}
+
+simd::Vec2f CascadeController::velocity_setpoint() const {
+	const simd::Vec4f output = simd::store(output_);
+	return {output.v[OUTER_X], output.v[OUTER_Y]};
+}
+
+void CascadeController::reset() {
+	filtered_derivative_ = simd::dup4(0.0f);
+	integral_ = simd::dup4(0.0f);
+	output_ = simd::dup4(0.0f);
+
+	last_inner_time = std::chrono::duration_cast<std::chrono::microseconds>(
+			clock_().time_since_epoch());
+	last_outer_time = last_inner_time;
+}
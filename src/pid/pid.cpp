@@ -1,73 +1,121 @@
 #include "pid/pid.hpp"
 #include <algorithm>
-#include <arm_neon.h>
+#include <cstdio>
 #include <iostream>
+#include <utility>
 
-PidController::PidController(float k_p, float k_i, float k_d, float k_df)
-		: k_p_(k_p), k_i_(k_i), k_d_(k_d), k_df_(k_df) {
+PidController::PidController(float k_p, float k_i, float k_d, float k_df,
+							 utils::Clock clock)
+		: k_p_(k_p), k_i_(k_i), k_d_(k_d), k_df_(k_df), clock_(std::move(clock)) {
 	last_time = std::chrono::duration_cast<std::chrono::microseconds>(
-			std::chrono::steady_clock::now().time_since_epoch());
+			clock_().time_since_epoch());
 }
 
-uint32x2_t PidController::calculate_raw_rc(float32x2_t current_position,
-										   float32x2_t desired_position) {
-	auto current_time = std::chrono::duration_cast<std::chrono::microseconds>(
-			std::chrono::steady_clock::now().time_since_epoch());
-	float32x2_t error = vsub_f32(desired_position, current_position);
-	float dt_sec = (current_time - last_time).count() / 1000000.0f;
-	last_time = current_time;
+float PidController::elapsed_seconds(
+		std::chrono::steady_clock::time_point current_time) {
+	auto current_us = std::chrono::duration_cast<std::chrono::microseconds>(
+			current_time.time_since_epoch());
+	float dt_sec = (current_us - last_time).count() / 1000000.0f;
+	last_time = current_us;
+	return dt_sec;
+}
+
+simd::Vec2u PidController::calculate_raw_rc(simd::Vec2f current_position,
+											simd::Vec2f desired_position) {
+	float dt_sec = elapsed_seconds(clock_());
+	simd::f32x2 position = simd::load(current_position);
+	simd::f32x2 error = simd::sub(simd::load(desired_position), position);
+
+	simd::f32x2 derivative_raw = simd::dup(0.0f);
+	if (dt_sec > 0.0f) {
+		derivative_raw =
+				simd::mul_n(simd::sub(last_value_, position), 1.0f / dt_sec);
+	}
+	last_value_ = position;
+
+	return compute_output(error, derivative_raw, dt_sec);
+}
+
+simd::Vec2u PidController::calculate_raw_rc(simd::Vec2f current_position,
+											simd::Vec2f current_velocity,
+											simd::Vec2f desired_position) {
+	return calculate_raw_rc(current_position, current_velocity,
+							desired_position, clock_());
+}
+
+simd::Vec2u PidController::calculate_raw_rc(
+		simd::Vec2f current_position, simd::Vec2f current_velocity,
+		simd::Vec2f desired_position,
+		std::chrono::steady_clock::time_point sample_time) {
+	float dt_sec = elapsed_seconds(sample_time);
+	simd::f32x2 position = simd::load(current_position);
+	simd::f32x2 error = simd::sub(simd::load(desired_position), position);
+	last_value_ = position;
+
+	// derivative on measurement: d(-position)/dt
+	return compute_output(error, simd::neg(simd::load(current_velocity)),
+						  dt_sec);
+}
 
+simd::Vec2u PidController::compute_output(simd::f32x2 error,
+										  simd::f32x2 derivative_raw,
+										  float dt_sec) {
 	if (dt_sec <= 0.0f) {
 
-		filtered_derivative_ = vdup_n_f32(0.0f);
+		filtered_derivative_ = simd::dup(0.0f);
 	} else {
-		float32x2_t derivative_raw =
-				vmul_n_f32(vsub_f32(last_value_, current_position), 1.0f / dt_sec);
-
-		float32x2_t first_part =
-				vfma_n_f32(filtered_derivative_, filtered_derivative_, -k_df_);
-		filtered_derivative_ = vfma_n_f32(first_part, derivative_raw, k_df_);
+		simd::f32x2 first_part =
+				simd::mla_n(filtered_derivative_, filtered_derivative_, -k_df_);
+		filtered_derivative_ = simd::mla_n(first_part, derivative_raw, k_df_);
 	}
 
-	integral_ = vfma_n_f32(integral_, error, dt_sec);
+	integral_ = simd::mla_n(integral_, error, dt_sec);
 
-	integral_ = vmin_f32(vmax_f32(integral_, integral_min_), integral_max_);
+	integral_ = simd::min(simd::max(integral_, integral_min_), integral_max_);
 
-	float32x2_t i_term = vmul_n_f32(integral_, k_i_);
+	simd::f32x2 i_term = simd::mul_n(integral_, k_i_);
 
-	float32x2_t d_term = vmul_n_f32(filtered_derivative_, k_d_);
+	simd::f32x2 d_term = simd::mul_n(filtered_derivative_, k_d_);
 
-	float32x2_t p_term = vmul_n_f32(error, k_p_);
+	simd::f32x2 p_term = simd::mul_n(error, k_p_);
 
-	float32x2_t temp = vadd_f32(i_term, p_term);
-	float32x2_t output = vadd_f32(temp, d_term);
+	p_term_ = p_term;
+	i_term_ = i_term;
+	d_term_ = d_term;
+
+	simd::f32x2 temp = simd::add(i_term, p_term);
+	simd::f32x2 output = simd::add(temp, d_term);
 
 	const float MAX_PWM_OFFSET = 500.0f;
-	float32x2_t offset = vdup_n_f32(MAX_PWM_OFFSET);
-	output = vmin_f32(output, offset);
-	offset = vneg_f32(offset);
-	output = vmax_f32(output, offset);
+	simd::f32x2 offset = simd::dup(MAX_PWM_OFFSET);
+	output = simd::min(output, offset);
+	offset = simd::neg(offset);
+	output = simd::max(output, offset);
 
 
 	const float BASE_SPEED = 1500.0f;
-	float32x2_t base_speed = vdup_n_f32(BASE_SPEED);
-	output = vadd_f32(output, base_speed);
-	uint32x2_t int_output = vcvt_u32_f32(output);
+	simd::f32x2 base_speed = simd::dup(BASE_SPEED);
+	output = simd::add(output, base_speed);
+	simd::u32x2 int_output = simd::to_u32(output);
 
 	const uint32_t MAX_VALUE = 2000u;
 	const uint32_t MIN_VALUE = 1000u;
-	uint32x2_t max_value = vdup_n_u32(MAX_VALUE);
-	uint32x2_t min_value = vdup_n_u32(MIN_VALUE);
-	int_output = vmin_u32(int_output, max_value);
-	int_output = vmax_u32(int_output, min_value);
+	simd::u32x2 max_value = simd::dup_u32(MAX_VALUE);
+	simd::u32x2 min_value = simd::dup_u32(MIN_VALUE);
+	int_output = simd::min_u32(int_output, max_value);
+	int_output = simd::max_u32(int_output, min_value);
+
 
+	simd::Vec2u my_values = simd::store(int_output);
 
-	uint32_t my_values[2];
-	vst1_u32(my_values, int_output);
+#ifndef NDEBUG
+	printf("PID Output PWM: x=%d, y=%d\n", my_values.x, my_values.y);
+#endif
 
-	printf("PID Output PWM: x=%d, y=%d\n", my_values[0], my_values[1]);
-	last_value_ = current_position;
 
+	return my_values;
+}
 
-	return int_output;
+PidController::Terms PidController::last_terms() const {
+	return {simd::store(p_term_), simd::store(i_term_), simd::store(d_term_)};
 }
@@ -0,0 +1,141 @@
+#include "pid/pid4.hpp"
+#include <utility>
+
+PidController4::PidController4(const std::array<PidAxisConfig, AXIS_COUNT> &axes,
+							   const std::array<std::uint16_t, 4> &aux,
+							   utils::Clock clock)
+		: aux_(aux), clock_(std::move(clock)) {
+	simd::Vec4f k_p, k_i, k_d, k_df, integral_max, center, output_min,
+			output_max, wrap;
+
+	// AoS configuration -> one vector per parameter
+	for (int i = 0; i < AXIS_COUNT; ++i) {
+		k_p.v[i] = axes[i].k_p;
+		k_i.v[i] = axes[i].k_i;
+		k_d.v[i] = axes[i].k_d;
+		k_df.v[i] = axes[i].k_df;
+		integral_max.v[i] = axes[i].integral_limit;
+		center.v[i] = axes[i].center;
+		output_min.v[i] = axes[i].output_min;
+		output_max.v[i] = axes[i].output_max;
+		wrap.v[i] = axes[i].wrap;
+	}
+
+	k_p_ = simd::load(k_p);
+	k_i_ = simd::load(k_i);
+	k_d_ = simd::load(k_d);
+	k_df_ = simd::load(k_df);
+	integral_max_ = simd::load(integral_max);
+	integral_min_ = simd::neg(integral_max_);
+	center_ = simd::load(center);
+	output_min_ = simd::load(output_min);
+	output_max_ = simd::load(output_max);
+	wrap_ = simd::load(wrap);
+	half_wrap_ = simd::mul_n(wrap_, 0.5f);
+
+	last_time = std::chrono::duration_cast<std::chrono::microseconds>(
+			clock_().time_since_epoch());
+}
+
+msp::Channels PidController4::calculate_raw_rc(simd::Vec4f current_state,
+											   simd::Vec4f desired_state) {
+	return calculate_raw_rc(current_state, desired_state, clock_());
+}
+
+msp::Channels PidController4::calculate_raw_rc(
+		simd::Vec4f current_state, simd::Vec4f desired_state,
+		std::chrono::steady_clock::time_point sample_time) {
+	float dt_sec = elapsed_seconds(sample_time);
+	simd::f32x4 state = simd::load(current_state);
+	simd::f32x4 error = wrapped(simd::sub(simd::load(desired_state), state));
+
+	simd::f32x4 derivative_raw = simd::dup4(0.0f);
+	if (dt_sec > 0.0f) {
+		derivative_raw =
+				simd::mul_n(wrapped(simd::sub(last_value_, state)), 1.0f / dt_sec);
+	}
+	last_value_ = state;
+
+	return compute_output(error, derivative_raw, dt_sec);
+}
+
+msp::Channels PidController4::calculate_raw_rc(simd::Vec4f current_state,
+											   simd::Vec4f current_rate,
+											   simd::Vec4f desired_state) {
+	return calculate_raw_rc(current_state, current_rate, desired_state,
+							clock_());
+}
+
+msp::Channels PidController4::calculate_raw_rc(
+		simd::Vec4f current_state, simd::Vec4f current_rate,
+		simd::Vec4f desired_state,
+		std::chrono::steady_clock::time_point sample_time) {
+	float dt_sec = elapsed_seconds(sample_time);
+	simd::f32x4 state = simd::load(current_state);
+	simd::f32x4 error = wrapped(simd::sub(simd::load(desired_state), state));
+	last_value_ = state;
+
+	// derivative on measurement: d(-state)/dt
+	return compute_output(error, simd::neg(simd::load(current_rate)), dt_sec);
+}
+
+void PidController4::reset() {
+	integral_ = simd::dup4(0.0f);
+	filtered_derivative_ = simd::dup4(0.0f);
+	last_time = std::chrono::duration_cast<std::chrono::microseconds>(
+			clock_().time_since_epoch());
+}
+
+float PidController4::elapsed_seconds(
+		std::chrono::steady_clock::time_point current_time) {
+	auto current_us = std::chrono::duration_cast<std::chrono::microseconds>(
+			current_time.time_since_epoch());
+	float dt_sec = (current_us - last_time).count() / 1000000.0f;
+	last_time = current_us;
+	return dt_sec;
+}
+
+simd::f32x4 PidController4::wrapped(simd::f32x4 value) const {
+	// lanes with wrap == 0 compare against 0 but only ever add/subtract 0
+	value = simd::sub(value, simd::select_gt(value, half_wrap_, wrap_));
+	return simd::add(value,
+					 simd::select_gt(simd::neg(half_wrap_), value, wrap_));
+}
+
+msp::Channels PidController4::compute_output(simd::f32x4 error,
+											 simd::f32x4 derivative_raw,
+											 float dt_sec) {
+	if (dt_sec <= 0.0f) {
+		filtered_derivative_ = simd::dup4(0.0f);
+	} else {
+		simd::f32x4 first_part = simd::mla(filtered_derivative_,
+										   filtered_derivative_, simd::neg(k_df_));
+		filtered_derivative_ = simd::mla(first_part, derivative_raw, k_df_);
+	}
+
+	integral_ = simd::mla_n(integral_, error, dt_sec);
+
+	integral_ = simd::min(simd::max(integral_, integral_min_), integral_max_);
+
+	simd::f32x4 i_term = simd::mul(integral_, k_i_);
+
+	simd::f32x4 d_term = simd::mul(filtered_derivative_, k_d_);
+
+	simd::f32x4 p_term = simd::mul(error, k_p_);
+
+	simd::f32x4 output = simd::add(simd::add(i_term, p_term), d_term);
+
+	output = simd::add(output, center_);
+	output = simd::min(simd::max(output, output_min_), output_max_);
+
+	simd::Vec4u pwm = simd::store(simd::to_u32(output));
+
+	return {static_cast<std::uint16_t>(pwm.v[ROLL]),
+			static_cast<std::uint16_t>(pwm.v[PITCH]),
+			static_cast<std::uint16_t>(pwm.v[THROTTLE]),
+			static_cast<std::uint16_t>(pwm.v[YAW]),
+			aux_[0],
+			aux_[1],
+			aux_[2],
+			aux_[3]};
+}
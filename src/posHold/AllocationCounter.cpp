@@ -0,0 +1,80 @@
+#include "posHold/AllocationCounter.h"
+
+#ifdef POSHOLD_COUNT_ALLOCATIONS
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+namespace
+{
+
+std::atomic<std::uint64_t> s_allocations{ 0 };
+
+void* countedAllocate(const std::size_t size)
+{
+    s_allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void* p = std::malloc(size == 0 ? 1 : size))
+    {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+} // namespace
+
+// Linked into any program that calls AllocationCounter::count(), replacing
+// the allocation functions of the whole process
+void* operator new(std::size_t size)
+{
+    return countedAllocate(size);
+}
+
+void* operator new[](std::size_t size)
+{
+    return countedAllocate(size);
+}
+
+void operator delete(void* p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete[](void* p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept
+{
+    std::free(p);
+}
+
+void operator delete[](void* p, std::size_t) noexcept
+{
+    std::free(p);
+}
+
+bool AllocationCounter::enabled()
+{
+    return true;
+}
+
+std::uint64_t AllocationCounter::count()
+{
+    return s_allocations.load(std::memory_order_relaxed);
+}
+
+#else
+
+bool AllocationCounter::enabled()
+{
+    return false;
+}
+
+std::uint64_t AllocationCounter::count()
+{
+    return 0;
+}
+
+#endif
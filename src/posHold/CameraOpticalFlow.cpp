@@ -1,62 +1,596 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iterator>
+
 #include <opencv2/opencv.hpp>
 
 #include "posHold/CameraOpticalFlow.h"
+#include "posHold/CameraProfile.h"
+
+namespace
+{
+
+// Tile positions in steps of one tile side: the centre, then its neighbours
+// in opposite pairs. The first 1, 3, 5 or 9 of them are symmetric about both
+// axes, so the ring does not pull the fused flow towards one side
+constexpr int s_tileOffsets[CameraOpticalFlow::s_maxTiles][2] = {
+    { 0, 0 },
+    { -1, 0 }, { 1, 0 },
+    { 0, -1 }, { 0, 1 },
+    { -1, -1 }, { 1, 1 }, { 1, -1 }, { -1, 1 },
+};
 
-CameraOpticalFlow::CameraOpticalFlow(Drone& drone) :
-    m_drone{ &drone }
+// Largest balanced tile count not above the requested one
+int balancedTileCount(const int tiles)
+{
+    if (tiles >= CameraOpticalFlow::s_maxTiles)
+    {
+        return CameraOpticalFlow::s_maxTiles;
+    }
+    if (tiles >= 5)
+    {
+        return 5;
+    }
+    return tiles >= 3 ? 3 : 1;
+}
+
+} // namespace
+
+CameraOpticalFlow::TileBuffers::TileBuffers(const int maxLen) :
+    prevROIBuffer(2 * maxLen + 1, 2 * maxLen + 1, CV_8UC1),
+    currROIBuffer(2 * maxLen + 1, 2 * maxLen + 1, CV_8UC1),
+    prevScaledBuffer(2 * maxLen + 1, 2 * maxLen + 1, CV_8UC1),
+    currScaledBuffer(2 * maxLen + 1, 2 * maxLen + 1, CV_8UC1),
+    flowScaledBuffer(2 * maxLen + 1, 2 * maxLen + 1, CV_32FC2),
+    flowROIBuffer(2 * maxLen + 1, 2 * maxLen + 1, CV_32FC2),
+    gradXBuffer(2 * maxLen + 1, 2 * maxLen + 1, CV_32FC1),
+    gradYBuffer(2 * maxLen + 1, 2 * maxLen + 1, CV_32FC1)
 {
 }
 
-void CameraOpticalFlow::calc(const int x, const int y, const int len)
+CameraOpticalFlow::CameraOpticalFlow(Drone& drone, const int maxLen, const int tiles, const Mode mode) :
+    m_drone{ &drone },
+    m_maxLen{ maxLen },
+    m_mode{ mode },
+    m_tiles(mode == Mode::Keyframe ? 1 : balancedTileCount(tiles)),
+    m_pool(static_cast<int>(m_tiles.size()))
 {
+    if (m_mode == Mode::Keyframe)
+    {
+        const int regionSide = 2 * s_keyframeRegionLens * maxLen + 1;
+        m_regionBuffer.create(regionSide, regionSide, CV_8UC1);
+        m_keyCorners.reserve(s_keyframeMaxCorners);
+        m_trackedCorners.reserve(s_keyframeMaxCorners);
+        m_cornerStatus.reserve(s_keyframeMaxCorners);
+        m_cornerErrors.reserve(s_keyframeMaxCorners);
+        m_cornerDx.reserve(s_keyframeMaxCorners);
+        m_cornerDy.reserve(s_keyframeMaxCorners);
+    }
+
+    m_tileBuffers.reserve(m_tiles.size());
+    for (std::size_t i = 0; i < m_tiles.size(); ++i)
+    {
+        m_tileBuffers.emplace_back(maxLen);
+        m_tileBuffers.back().settings = m_activeSettings;
+    }
+
+    const Drone::CameraInfo& cameraInfo = m_drone->cameraInfo;
+
+    if (cameraInfo.hasDistortion())
+    {
+        const cv::Mat cameraMatrix(cameraInfo.cameraMatrix());
+        cv::initUndistortRectifyMap(
+            cameraMatrix,
+            cameraInfo.distortion,
+            cv::noArray(),
+            cameraMatrix,
+            cv::Size(cameraInfo.resolutionX, cameraInfo.resolutionY),
+            CV_16SC2,
+            m_rectifyMapXY,
+            m_rectifyMapFrac
+        );
+    }
+}
+
+void CameraOpticalFlow::calc(const int x, const int y, int len, const double altitude, int accountLen)
+{
+    len = std::min(len, m_maxLen);
+    if (accountLen < 0)
+    {
+        accountLen = len;
+    }
+
     cv::Mat grayFrame = m_drone->getGrayscaleImage();
 
+    if (m_mode == Mode::Keyframe)
+    {
+        calcKeyframe(x, y, len, grayFrame);
+        return;
+    }
+
     if (m_prevFrame.empty())
     {
-        m_prevFrame = grayFrame.clone();
+        m_flowConfidence = 0.0;
+        grayFrame.copyTo(m_prevFrame);
         m_opticalFlow = cv::Mat::zeros(grayFrame.size(), CV_32FC2);
         return;
     }
 
-    int x0 = std::max(x - len, 0);
-    int y0 = std::max(y - len, 0);
-    int x1 = std::min(x + len, grayFrame.cols - 1);
-    int y1 = std::min(y + len, grayFrame.rows - 1);
-    cv::Rect roi(x0, y0, x1 - x0 + 1, y1 - y0 + 1);
+    // Only the tiles write m_opticalFlow: clear what they wrote last frame,
+    // so nothing outside this frame's tiles is left over when they move
+    if (m_opticalFlow.size() == grayFrame.size())
+    {
+        for (const Tile& tile : m_tiles)
+        {
+            if (tile.valid)
+            {
+                m_opticalFlow(tile.roi).setTo(cv::Scalar::all(0));
+            }
+        }
+    }
 
-    cv::Mat prevROI = m_prevFrame(roi);
-    cv::Mat currROI = grayFrame(roi);
+    placeTiles(x, y, len, grayFrame.size());
 
-    cv::Mat flowROI;
-    cv::calcOpticalFlowFarneback(
-        prevROI, currROI, flowROI,
-        0.5,   // pyramid scale
-        3,     // levels
-        15,    // window size
-        3,     // iterations
-        5,     // poly_n
-        1.2,   // poly_sigma
-        0      // flags
-    );
+    // A frame gap means the vision stage fell behind: run cheaper settings
+    // for a while so it catches up instead of spiralling
+    const int frameGap = m_drone->getSkippedFrames() + 1;
+    if (frameGap > 1)
+    {
+        m_sheddingFrames = s_sheddingFrames;
+    }
+
+    updateSettings(altitude);
+
+    m_activeSettings = m_settings;
+    if (m_sheddingFrames > 0)
+    {
+        --m_sheddingFrames;
+        m_activeSettings.scale = std::max(0.5 * m_activeSettings.scale, s_bandScales[std::size(s_bandScales) - 1]);
+        m_activeSettings.iterations = 1;
+    }
 
     if (m_opticalFlow.empty() || m_opticalFlow.size() != grayFrame.size())
     {
         m_opticalFlow = cv::Mat::zeros(grayFrame.size(), CV_32FC2);
     }
 
+    // Tiles do not overlap, so each writes its own part of m_opticalFlow
+    m_pool.run(static_cast<int>(m_tiles.size()), [this, &grayFrame, accountLen](const int index)
+    {
+        calcTile(index, grayFrame, accountLen);
+    });
+
+    // Texture-weighted fusion; with no texture anywhere every tile counts
+    // the same
+    double textureSum = 0.0;
+    int validTiles = 0;
+    for (const Tile& tile : m_tiles)
+    {
+        if (tile.valid)
+        {
+            textureSum += tile.texture;
+            ++validTiles;
+        }
+    }
+    double fusedX = 0.0;
+    double fusedY = 0.0;
+    for (Tile& tile : m_tiles)
+    {
+        if (!tile.valid)
+        {
+            tile.weight = 0.0;
+            continue;
+        }
+        tile.weight = textureSum > 0.0 ? tile.texture / textureSum : 1.0 / validTiles;
+        fusedX += tile.weight * tile.meanFlow.x;
+        fusedY += tile.weight * tile.meanFlow.y;
+    }
+    m_fusedFlow = cv::Point2f(static_cast<float>(fusedX), static_cast<float>(fusedY));
+    m_flowConfidence = validTiles > 0 ? 1.0 : 0.0;
+
+    // Flow spans the whole frame gap; the motion estimate stays per frame
+    m_recentMotion = std::max(std::hypot(fusedX, fusedY) / frameGap, m_recentMotion * s_motionDecay);
+
+#ifndef NDEBUG
+    // Full-frame norm and a flushed line per frame: debug builds only
     double diff = cv::norm(m_prevFrame, grayFrame, cv::NORM_L2);
     std::cout << "Frame difference: " << diff << std::endl;
+#endif
 
-    flowROI.copyTo(m_opticalFlow(roi));
+    // Copied into the same buffer every frame: the caller may reuse its own
+    grayFrame.copyTo(m_prevFrame);
+}
+
+void CameraOpticalFlow::placeTiles(const int x, const int y, const int len, const cv::Size frameSize)
+{
+    const int side = 2 * len + 1;
+    const cv::Rect frame(cv::Point(0, 0), frameSize);
+
+    for (std::size_t i = 0; i < m_tiles.size(); ++i)
+    {
+        Tile& tile = m_tiles[i];
+        const cv::Point centre(x + s_tileOffsets[i][0] * side, y + s_tileOffsets[i][1] * side);
+
+        tile.roi = cv::Rect(centre.x - len, centre.y - len, side, side) & frame;
+        tile.meanFlow = cv::Point2f(0.0f, 0.0f);
+        tile.texture = 0.0;
+        tile.seconds = 0.0;
+
+        if (i == 0)
+        {
+            // The centre tile is always computed and averaged around the
+            // requested point, as a single ROI would be
+            tile.centre = centre;
+            tile.valid = !tile.roi.empty();
+            continue;
+        }
+
+        // A ring tile cut by the frame edge is averaged around what is left
+        tile.centre = (tile.roi.tl() + tile.roi.br()) / 2;
+        tile.valid = std::min(tile.roi.width, tile.roi.height) >= s_minTileFraction * side;
+    }
+}
+
+void CameraOpticalFlow::calcTile(const int index, const cv::Mat& grayFrame, const int accountLen)
+{
+    Tile& tile = m_tiles[index];
+    if (!tile.valid)
+    {
+        return;
+    }
+
+    const auto start = std::chrono::steady_clock::now();
+    TileBuffers& b = m_tileBuffers[index];
+    const cv::Rect& roi = tile.roi;
+
+    const cv::Rect roiView(cv::Point(0, 0), roi.size());
+    b.prevROI = b.prevROIBuffer(roiView);
+    b.currROI = b.currROIBuffer(roiView);
+    b.flowROI = b.flowROIBuffer(roiView);
+
+    extractROI(m_prevFrame, roi, b.prevROI);
+    extractROI(grayFrame, roi, b.currROI);
+
+    // The pyramid needs at least one window at its coarsest level, so small
+    // ROIs keep a finer scale and fewer levels than the altitude would allow
+    FlowSettings& settings = b.settings;
+    settings = m_activeSettings;
+    const int roiSide = std::min(roi.width, roi.height);
+    settings.scale = std::min(1.0, std::max(settings.scale,
+        static_cast<double>(settings.windowSize) / roiSide));
+    while (settings.levels > 1
+        && roiSide * settings.scale / (1 << (settings.levels - 1)) < settings.windowSize)
+    {
+        --settings.levels;
+    }
+
+    const double scale = settings.scale;
+    const bool downscale = scale < 1.0;
+    if (downscale)
+    {
+        const cv::Rect scaledView(0, 0,
+                                  std::max(1, cvRound(roi.width * scale)),
+                                  std::max(1, cvRound(roi.height * scale)));
+        b.prevScaled = b.prevScaledBuffer(scaledView);
+        b.currScaled = b.currScaledBuffer(scaledView);
+        b.flowScaled = b.flowScaledBuffer(scaledView);
+
+        cv::resize(b.prevROI, b.prevScaled, b.prevScaled.size(), 0, 0, cv::INTER_AREA);
+        cv::resize(b.currROI, b.currScaled, b.currScaled.size(), 0, 0, cv::INTER_AREA);
+    }
+
+    const cv::Mat& working = downscale ? b.currScaled : b.currROI;
+
+    cv::calcOpticalFlowFarneback(
+        downscale ? b.prevScaled : b.prevROI,
+        working,
+        downscale ? b.flowScaled : b.flowROI,
+        0.5,                            // pyramid scale
+        settings.levels,                // levels
+        settings.windowSize,            // window size
+        settings.iterations,            // iterations
+        5,                              // poly_n
+        1.2,                            // poly_sigma
+        0                               // flags
+    );
+
+    if (downscale)
+    {
+        cv::resize(b.flowScaled, b.flowROI, b.flowROI.size(), 0, 0, cv::INTER_LINEAR);
+        cv::multiply(b.flowROI,
+                     cv::Scalar(static_cast<double>(roi.width) / b.flowScaled.cols,
+                                static_cast<double>(roi.height) / b.flowScaled.rows),
+                     b.flowROI);
+    }
+
+    // Structure tensor of the image Farneback worked on: its smaller
+    // eigenvalue is large only where the ground has texture in both
+    // directions, i.e. where translation is observable
+    const cv::Rect workingView(cv::Point(0, 0), working.size());
+    cv::Mat gradX = b.gradXBuffer(workingView);
+    cv::Mat gradY = b.gradYBuffer(workingView);
+    cv::Sobel(working, gradX, CV_32F, 1, 0, 3);
+    cv::Sobel(working, gradY, CV_32F, 0, 1, 3);
+    const double xx = gradX.dot(gradX);
+    const double yy = gradY.dot(gradY);
+    const double xy = gradX.dot(gradY);
+    const double halfTrace = 0.5 * (xx + yy);
+    const double radius = std::hypot(0.5 * (xx - yy), xy);
+    tile.texture = std::max(halfTrace - radius, 0.0) / working.total();
+
+    tile.meanFlow = CameraKernels::discMeanFlow(b.flowROI, tile.centre - roi.tl(), accountLen);
+
+    b.flowROI.copyTo(m_opticalFlow(roi));
+
+    tile.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+void CameraOpticalFlow::calcKeyframe(const int x, const int y, const int len, const cv::Mat& grayFrame)
+{
+    m_hasKeyDisplacement = false;
+    m_reanchored = false;
+
+    bool regionBuilt = false;
+    if (!m_keyCorners.empty())
+    {
+        m_region = m_regionBuffer(cv::Rect(cv::Point(0, 0), m_keyRegion.size()));
+        extractROI(grayFrame, m_keyRegion, m_region);
+        cv::buildOpticalFlowPyramid(m_region, m_currPyramid,
+                                    cv::Size(s_keyframeWindowSize, s_keyframeWindowSize), m_keyLevels);
+        regionBuilt = true;
+        trackKeyframe();
+    }
 
-    m_prevFrame = grayFrame.clone();
+    // A dropped frame needs no special care: the displacement is measured
+    // against the keyframe, however many frames ago it was taken. Without
+    // one (first frame, track lost) this frame's motion is unknown; the
+    // zero flow is flagged by a zero confidence so it does not read as
+    // hovering
+    m_fusedFlow = m_hasKeyDisplacement ? m_keyDisplacement - m_prevKeyDisplacement : cv::Point2f(0.0f, 0.0f);
+    m_flowConfidence = m_hasKeyDisplacement ? m_keyConfidence : 0.0;
+    m_prevKeyDisplacement = m_keyDisplacement;
+
+    const double maxTravel = s_keyframeMaxTravel * m_keyLen;
+    const bool reanchor = !m_hasKeyDisplacement
+        || m_keyConfidence < s_keyframeMinConfidence
+        || cv::norm(m_keyDisplacement) > maxTravel
+        || cv::norm(cv::Point2f(static_cast<float>(x), static_cast<float>(y)) - m_keyCentre) > maxTravel;
+    if (reanchor)
+    {
+        anchorKeyframe(x, y, len, grayFrame, regionBuilt);
+    }
+}
+
+void CameraOpticalFlow::trackKeyframe()
+{
+    // Start each corner where the last frame's displacement puts it
+    m_trackedCorners.resize(m_keyCorners.size());
+    for (std::size_t i = 0; i < m_keyCorners.size(); ++i)
+    {
+        m_trackedCorners[i] = m_keyCorners[i] + m_prevKeyDisplacement;
+    }
+
+    cv::calcOpticalFlowPyrLK(m_keyPyramid, m_currPyramid, m_keyCorners, m_trackedCorners,
+                             m_cornerStatus, m_cornerErrors,
+                             cv::Size(s_keyframeWindowSize, s_keyframeWindowSize), m_keyLevels,
+                             cv::TermCriteria(cv::TermCriteria::COUNT | cv::TermCriteria::EPS, 30, 0.01),
+                             cv::OPTFLOW_USE_INITIAL_FLOW);
+
+    m_cornerDx.clear();
+    m_cornerDy.clear();
+    for (std::size_t i = 0; i < m_keyCorners.size(); ++i)
+    {
+        if (m_cornerStatus[i])
+        {
+            m_cornerDx.push_back(m_trackedCorners[i].x - m_keyCorners[i].x);
+            m_cornerDy.push_back(m_trackedCorners[i].y - m_keyCorners[i].y);
+        }
+    }
+    if (static_cast<int>(m_cornerDx.size()) < s_keyframeMinCorners)
+    {
+        m_keyConfidence = static_cast<double>(m_cornerDx.size()) / m_keyCorners.size();
+        return;
+    }
+
+    // Median displacement, then the mean of the corners that agree with it:
+    // corners on moving objects or lost in blur do not pull the estimate
+    const auto median = [](std::vector<float>& values)
+    {
+        const auto middle = values.begin() + values.size() / 2;
+        std::nth_element(values.begin(), middle, values.end());
+        return *middle;
+    };
+    const cv::Point2f medianDisplacement(median(m_cornerDx), median(m_cornerDy));
+
+    cv::Point2f sum(0.0f, 0.0f);
+    int inliers = 0;
+    for (std::size_t i = 0; i < m_keyCorners.size(); ++i)
+    {
+        const cv::Point2f displacement = m_trackedCorners[i] - m_keyCorners[i];
+        if (m_cornerStatus[i] && cv::norm(displacement - medianDisplacement) <= s_keyframeInlierPixels)
+        {
+            sum += displacement;
+            ++inliers;
+        }
+    }
+
+    m_keyConfidence = static_cast<double>(inliers) / m_keyCorners.size();
+    m_hasKeyDisplacement = inliers >= s_keyframeMinCorners;
+    if (m_hasKeyDisplacement)
+    {
+        m_keyDisplacement = sum / static_cast<float>(inliers);
+    }
+}
+
+void CameraOpticalFlow::anchorKeyframe(const int x, const int y, const int len, const cv::Mat& grayFrame,
+                                       const bool regionBuilt)
+{
+    const cv::Rect frame(cv::Point(0, 0), grayFrame.size());
+    const int half = s_keyframeRegionLens * len;
+    const cv::Rect region = cv::Rect(x - half, y - half, 2 * half + 1, 2 * half + 1) & frame;
+    const cv::Rect inner = cv::Rect(x - len, y - len, 2 * len + 1, 2 * len + 1) & frame;
+
+    // m_keyDisplacement keeps this frame's measurement against the old
+    // keyframe for the caller; tracking restarts from zero
+    m_keyCorners.clear();
+    m_prevKeyDisplacement = cv::Point2f(0.0f, 0.0f);
+    if (inner.empty())
+    {
+        return;
+    }
+
+    if (regionBuilt && region == m_keyRegion)
+    {
+        // Same window as the old keyframe: this frame's pyramid is already
+        // built, so the new keyframe costs no second one
+        std::swap(m_keyPyramid, m_currPyramid);
+    }
+    else
+    {
+        m_region = m_regionBuffer(cv::Rect(cv::Point(0, 0), region.size()));
+        extractROI(grayFrame, region, m_region);
+        m_keyLevels = cv::buildOpticalFlowPyramid(m_region, m_keyPyramid,
+                                                  cv::Size(s_keyframeWindowSize, s_keyframeWindowSize),
+                                                  s_keyframeLevels);
+    }
+
+    const cv::Rect innerView(inner.tl() - region.tl(), inner.size());
+    cv::goodFeaturesToTrack(m_region(innerView), m_keyCorners, s_keyframeMaxCorners,
+                            s_keyframeCornerQuality, s_keyframeCornerDistance);
+    for (cv::Point2f& corner : m_keyCorners)
+    {
+        corner += cv::Point2f(innerView.tl());
+    }
+
+    m_keyRegion = region;
+    m_keyCentre = cv::Point2f(static_cast<float>(x), static_cast<float>(y));
+    m_keyLen = len;
+    m_reanchored = true;
+    ++m_keyframeCount;
+}
+
+cv::Point2f CameraOpticalFlow::getFusedFlow() const
+{
+    return m_fusedFlow;
+}
+
+double CameraOpticalFlow::getFlowConfidence() const
+{
+    return m_flowConfidence;
+}
+
+CameraOpticalFlow::Mode CameraOpticalFlow::getMode() const
+{
+    return m_mode;
+}
+
+cv::Point2f CameraOpticalFlow::getKeyframeDisplacement() const
+{
+    return m_keyDisplacement;
+}
+
+bool CameraOpticalFlow::hasKeyframeDisplacement() const
+{
+    return m_hasKeyDisplacement;
+}
+
+bool CameraOpticalFlow::hasReanchored() const
+{
+    return m_reanchored;
+}
+
+double CameraOpticalFlow::getKeyframeConfidence() const
+{
+    return m_keyConfidence;
+}
+
+std::uint64_t CameraOpticalFlow::getKeyframeCount() const
+{
+    return m_keyframeCount;
+}
+
+const std::vector<CameraOpticalFlow::Tile>& CameraOpticalFlow::getTiles() const
+{
+    return m_tiles;
+}
+
+CameraOpticalFlow::FlowSettings CameraOpticalFlow::getSettings() const
+{
+    return m_tileBuffers.front().settings;
+}
+
+void CameraOpticalFlow::updateSettings(const double altitude)
+{
+    constexpr int lastBand = static_cast<int>(std::size(s_bandScales)) - 1;
+
+    while (m_altitudeBand < lastBand
+        && altitude > s_altitudeBands[m_altitudeBand] + s_altitudeHysteresis)
+    {
+        ++m_altitudeBand;
+    }
+    while (m_altitudeBand > 0
+        && altitude < s_altitudeBands[m_altitudeBand - 1] - s_altitudeHysteresis)
+    {
+        --m_altitudeBand;
+    }
+
+    m_settings.scale = s_bandScales[m_altitudeBand];
+    m_settings.windowSize = s_bandWindowSizes[m_altitudeBand];
+
+    // Displacement (in working-resolution pixels) a pyramid of the given
+    // depth can follow: half a window at the coarsest level
+    const double motion = m_recentMotion * m_settings.scale;
+    const auto reach = [this](const int levels)
+    {
+        return 0.5 * m_settings.windowSize * (1 << (levels - 1));
+    };
+
+    while (m_settings.levels < s_maxLevels && motion > reach(m_settings.levels))
+    {
+        ++m_settings.levels;
+    }
+    while (m_settings.levels > 1 && motion < s_levelHysteresis * reach(m_settings.levels - 1))
+    {
+        --m_settings.levels;
+    }
+}
+
+void CameraOpticalFlow::extractROI(const cv::Mat& frame, const cv::Rect& roi, cv::Mat& out) const
+{
+    if (m_rectifyMapXY.empty())
+    {
+        out = frame(roi);
+        return;
+    }
+
+    // The maps hold absolute source coordinates, so remapping through their
+    // ROI rectifies just this window of the frame
+    cv::remap(frame, out, m_rectifyMapXY(roi), m_rectifyMapFrac(roi), cv::INTER_LINEAR);
 }
 
 cv::Point2f CameraOpticalFlow::getOpticalFlowAt(const int x, const int y) const
 {
+    if (m_mode == Mode::Keyframe)
+    {
+        throw std::runtime_error("CameraOpticalFlow::getOpticalFlowAt has no dense flow in Keyframe mode");
+    }
     if (m_opticalFlow.empty())
     {
         throw std::runtime_error("CameraOpticalFlow::getOpticalFlowAt called before calling CameraOpticalFlow::calc");
     }
     return m_opticalFlow.at<cv::Point2f>(y, x);
 }
+
+const cv::Mat& CameraOpticalFlow::getOpticalFlow() const
+{
+    if (m_mode == Mode::Keyframe)
+    {
+        throw std::runtime_error("CameraOpticalFlow::getOpticalFlow has no dense flow in Keyframe mode");
+    }
+    if (m_opticalFlow.empty())
+    {
+        throw std::runtime_error("CameraOpticalFlow::getOpticalFlow called before calling CameraOpticalFlow::calc");
+    }
+    return m_opticalFlow;
+}
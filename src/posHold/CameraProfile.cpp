@@ -0,0 +1,209 @@
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <utility>
+
+#include "posHold/CameraProfile.h"
+
+namespace
+{
+
+constexpr double constexprSqrt(const double x)
+{
+    // Newton's method from above; ends within an ulp of std::sqrt for the
+    // magnitudes of a sensor diagonal
+    double r = x > 1.0 ? x : 1.0;
+    for (int i = 0; i < 64; ++i)
+    {
+        r = 0.5 * (r + x / r);
+    }
+    return r;
+}
+
+constexpr int integerSqrt(const int n)
+{
+    int r = 0;
+    while ((r + 1) * (r + 1) <= n)
+    {
+        ++r;
+    }
+    return r;
+}
+
+inline cv::Point2f projectDownWith(
+    const cv::Vec3d& down,
+    const double focalLengthX,
+    const double focalLengthY,
+    const double principalX,
+    const double principalY,
+    const int resolutionX,
+    const int resolutionY)
+{
+    const double depth = -down[2];
+
+    if (depth <= 0.0)
+    {
+        return { 0.0, 0.0 };
+    }
+
+    // Projection into the rectified (distortion-free) image, which is the
+    // coordinate frame CameraOpticalFlow reports flow in
+    const double xScreen = -focalLengthX * (down[0] / depth);
+    const double yScreen = focalLengthY * (down[1] / depth);
+
+    const float u = principalX + xScreen;
+    const float v = principalY + yScreen;
+
+    return {
+        std::max(std::min(u, static_cast<float>(resolutionX)), 0.0f),
+        std::max(std::min(v, static_cast<float>(resolutionY)), 0.0f)
+    };
+}
+
+cv::Point2f projectDownGeneric(const cv::Vec3d& down, const Drone::CameraInfo& cameraInfo)
+{
+    return projectDownWith(down, cameraInfo.focalLength, cameraInfo.focalLengthY,
+                           cameraInfo.principalX, cameraInfo.principalY,
+                           cameraInfo.resolutionX, cameraInfo.resolutionY);
+}
+
+template <class Profile>
+cv::Point2f projectDown(const cv::Vec3d& down, const Drone::CameraInfo&)
+{
+    return projectDownWith(down, Profile::focalLengthX, Profile::focalLengthY,
+                           Profile::principalX, Profile::principalY,
+                           Profile::resolutionX, Profile::resolutionY);
+}
+
+template <class Profile>
+bool matches(const Drone::CameraInfo& cameraInfo)
+{
+    auto same = [](const double a, const double b) { return std::abs(a - b) <= 1e-9 * std::abs(b); };
+    return !cameraInfo.hasDistortion()
+        && cameraInfo.resolutionX == Profile::resolutionX
+        && cameraInfo.resolutionY == Profile::resolutionY
+        && same(cameraInfo.focalLength, Profile::focalLengthX)
+        && same(cameraInfo.focalLengthY, Profile::focalLengthY)
+        && same(cameraInfo.principalX, Profile::principalX)
+        && same(cameraInfo.principalY, Profile::principalY);
+}
+
+template <class Profile>
+constexpr CameraKernels kernelsFor()
+{
+    static_assert(Profile::maxRoiRadius <= CameraKernels::s_maxDiscRadius,
+                  "profile ROI larger than the disc kernels");
+    return {
+        Profile::name,
+        &projectDown<Profile>,
+        1.0 / Profile::focalLengthX,
+        1.0 / constexprSqrt(static_cast<double>(Profile::resolutionX) * Profile::resolutionX
+            + static_cast<double>(Profile::resolutionY) * Profile::resolutionY),
+        Profile::maxRoiRadius,
+    };
+}
+
+struct ProfileEntry
+{
+    bool (*matches)(const Drone::CameraInfo& cameraInfo);
+    CameraKernels kernels;
+};
+
+// Runtime dispatch table of the compiled-in profiles
+const ProfileEntry s_profiles[] = {
+    { &matches<Profile60Deg1280x720>, kernelsFor<Profile60Deg1280x720>() },
+    { &matches<Profile60Deg640x480>, kernelsFor<Profile60Deg640x480>() },
+    { &matches<Profile60Deg1920x1080>, kernelsFor<Profile60Deg1920x1080>() },
+};
+
+// Half-widths of the rows of a filled disc, top to bottom
+template <int Radius>
+constexpr std::array<int, 2 * Radius + 1> discSpans()
+{
+    std::array<int, 2 * Radius + 1> spans{};
+    for (int dy = -Radius; dy <= Radius; ++dy)
+    {
+        spans[dy + Radius] = integerSqrt(Radius * Radius - dy * dy);
+    }
+    return spans;
+}
+
+template <int Radius>
+cv::Point2f discMean(const cv::Mat& flow, const cv::Point centre)
+{
+    static constexpr std::array<int, 2 * Radius + 1> spans = discSpans<Radius>();
+
+    const int dyMin = std::max(-Radius, -centre.y);
+    const int dyMax = std::min(Radius, flow.rows - 1 - centre.y);
+
+    double sumX = 0.0;
+    double sumY = 0.0;
+    int count = 0;
+    for (int dy = dyMin; dy <= dyMax; ++dy)
+    {
+        const int span = spans[dy + Radius];
+        const int xMin = std::max(centre.x - span, 0);
+        const int xMax = std::min(centre.x + span, flow.cols - 1);
+        if (xMin > xMax)
+        {
+            continue;
+        }
+
+        const cv::Point2f* row = flow.ptr<cv::Point2f>(centre.y + dy);
+        float rowX = 0.0f;
+        float rowY = 0.0f;
+        for (int x = xMin; x <= xMax; ++x)
+        {
+            rowX += row[x].x;
+            rowY += row[x].y;
+        }
+        sumX += rowX;
+        sumY += rowY;
+        count += xMax - xMin + 1;
+    }
+
+    if (count == 0)
+    {
+        return { 0.0f, 0.0f };
+    }
+    return { static_cast<float>(sumX / count), static_cast<float>(sumY / count) };
+}
+
+using DiscMean = cv::Point2f (*)(const cv::Mat& flow, cv::Point centre);
+
+template <int... Radii>
+constexpr std::array<DiscMean, sizeof...(Radii)> discMeanTable(std::integer_sequence<int, Radii...>)
+{
+    return { &discMean<Radii>... };
+}
+
+// One unrolled kernel per radius, indexed by radius
+constexpr auto s_discMeans = discMeanTable(std::make_integer_sequence<int, CameraKernels::s_maxDiscRadius + 1>{});
+
+} // namespace
+
+CameraKernels CameraKernels::select(const Drone::CameraInfo& cameraInfo)
+{
+    for (const ProfileEntry& entry : s_profiles)
+    {
+        if (entry.matches(cameraInfo))
+        {
+            return entry.kernels;
+        }
+    }
+
+    return {
+        "generic",
+        &projectDownGeneric,
+        1.0 / cameraInfo.focalLength,
+        1.0 / std::sqrt(static_cast<double>(cameraInfo.resolutionX) * cameraInfo.resolutionX
+            + static_cast<double>(cameraInfo.resolutionY) * cameraInfo.resolutionY),
+        s_maxDiscRadius,
+    };
+}
+
+cv::Point2f CameraKernels::discMeanFlow(const cv::Mat& flow, const cv::Point centre, const int radius)
+{
+    CV_Assert(flow.type() == CV_32FC2);
+    return s_discMeans[std::clamp(radius, 0, s_maxDiscRadius)](flow, centre);
+}
@@ -0,0 +1,209 @@
+#include <algorithm>
+#include <stdexcept>
+#include <utility>
+
+#include "posHold/ControlLoop.h"
+
+ControlLoop::ControlLoop(Drone& drone, const PidController& controller, Output output, const Options& options,
+                         const StateEstimator& estimator) :
+    m_drone{ &drone },
+    m_controller{ controller },
+    m_output{ std::move(output) },
+    m_options{ options },
+    m_estimator{ estimator }
+{
+    if (m_options.rate <= 0.0)
+    {
+        throw std::invalid_argument("ControlLoop rate must be positive");
+    }
+}
+
+ControlLoop::~ControlLoop()
+{
+    stop();
+}
+
+void ControlLoop::start()
+{
+    if (m_thread.joinable())
+    {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stopping = false;
+    }
+    m_thread = std::thread(&ControlLoop::run, this);
+}
+
+void ControlLoop::stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stopping = true;
+    }
+    m_wake.notify_one();
+
+    if (m_thread.joinable())
+    {
+        m_thread.join();
+    }
+}
+
+void ControlLoop::submitFlow(const cv::Point2f& displacement, const double interval,
+                             const std::chrono::steady_clock::time_point sampleTime)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_pendingFlow.valid)
+    {
+        // Consecutive frames: their displacements add up over both intervals
+        m_pendingFlow.displacement += displacement;
+        m_pendingFlow.interval += interval;
+    }
+    else
+    {
+        m_pendingFlow.displacement = displacement;
+        m_pendingFlow.interval = interval;
+        m_pendingFlow.valid = true;
+    }
+    m_pendingFlow.sampleTime = sampleTime;
+}
+
+void ControlLoop::submitPosition(const cv::Point2f& position, const std::chrono::steady_clock::time_point sampleTime)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_pendingPosition.position = position;
+    m_pendingPosition.sampleTime = sampleTime;
+    m_pendingPosition.valid = true;
+}
+
+void ControlLoop::setSetpoint(const cv::Point2f& setpoint)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_setpoint = setpoint;
+}
+
+void ControlLoop::setTickListener(TickListener listener)
+{
+    m_tickListener = std::move(listener);
+}
+
+void ControlLoop::step(const std::chrono::steady_clock::time_point now)
+{
+    const auto tickStart = std::chrono::steady_clock::now();
+
+    // Telemetry first: if it cannot be read the tick leaves no trace and the
+    // next one predicts over both periods
+    const Drone::GyroData attitude = m_drone->getGyroData();
+    const bool altitudeDue =
+        m_ticks % static_cast<std::uint64_t>(std::max(m_options.altitudeDivider, 1)) == 0;
+    const Drone::AltitudeData altitude = altitudeDue ? m_drone->getAltitudeData() : Drone::AltitudeData{};
+
+    const auto telemetryEnd = std::chrono::steady_clock::now();
+
+    const double dt = m_ticks > 0 ? std::chrono::duration<double>(now - m_lastTick).count() : 0.0;
+    m_lastTick = now;
+
+    m_estimator.predict(attitude, dt, now);
+    if (altitudeDue)
+    {
+        m_estimator.updateAltitude(altitude);
+    }
+
+    PendingFlow flow;
+    PendingPosition position;
+    cv::Point2f setpoint;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        flow = m_pendingFlow;
+        m_pendingFlow.valid = false;
+        position = m_pendingPosition;
+        m_pendingPosition.valid = false;
+        setpoint = m_setpoint;
+    }
+
+    // The frame was taken before this tick's prediction: the estimator
+    // corrects the state of that time and carries the correction forward
+    if (flow.valid)
+    {
+        m_estimator.updateFlow(flow.displacement, flow.interval, flow.sampleTime);
+        ++m_flowUpdates;
+    }
+    if (position.valid)
+    {
+        m_estimator.updatePosition(position.position, position.sampleTime);
+        ++m_flowUpdates;
+    }
+
+    const cv::Point2f estimate = m_estimator.getPosition();
+    const cv::Point2f velocity = m_estimator.getVelocity();
+    const auto estimatorEnd = std::chrono::steady_clock::now();
+    const simd::Vec2u rc = m_controller.calculate_raw_rc(
+        { estimate.x, estimate.y }, { velocity.x, velocity.y }, { setpoint.x, setpoint.y }, now);
+
+    if (m_output)
+    {
+        m_output(rc);
+    }
+    ++m_ticks;
+
+    if (m_tickListener)
+    {
+        const auto controlEnd = std::chrono::steady_clock::now();
+        m_tickListener(Tick{ now, attitude, altitudeDue, altitude, estimate, velocity, setpoint,
+                             m_estimator.getAltitude(), rc, m_controller.last_terms(),
+                             telemetryEnd - tickStart, estimatorEnd - telemetryEnd, controlEnd - estimatorEnd });
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_status.position = estimate;
+    m_status.velocity = velocity;
+    m_status.rc = rc;
+    m_status.ticks = m_ticks;
+    m_status.flowUpdates = m_flowUpdates;
+}
+
+ControlLoop::Status ControlLoop::getStatus() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_status;
+}
+
+void ControlLoop::run()
+{
+    const auto period = std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+        std::chrono::duration<double>(1.0 / m_options.rate));
+
+    auto next = std::chrono::steady_clock::now();
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (!m_stopping)
+    {
+        lock.unlock();
+        bool failed = false;
+        try
+        {
+            step(std::chrono::steady_clock::now());
+        }
+        catch (const std::runtime_error&)
+        {
+            // MSP telemetry timed out; ModeMonitor reports a dead link
+            failed = true;
+        }
+        lock.lock();
+        if (failed)
+        {
+            ++m_status.failedTicks;
+        }
+
+        // A late tick (slow MSP reply, preemption) restarts the schedule
+        // instead of firing the missed ticks back to back
+        next += period;
+        const auto now = std::chrono::steady_clock::now();
+        if (now > next + period)
+        {
+            ++m_status.overruns;
+            next = now;
+        }
+        m_wake.wait_until(lock, next, [this] { return m_stopping; });
+    }
+}
@@ -1,26 +1,86 @@
+#include <algorithm>
+
 #include "posHold/Drone.h"
 
 Drone::Drone() :
     m_camera(0)
 {
-    m_camera.set(cv::CAP_PROP_FRAME_WIDTH, cameraInfo.resolutionX);
-    m_camera.set(cv::CAP_PROP_FRAME_HEIGHT, cameraInfo.resolutionY);
+    initCamera();
 }
 
 Drone::Drone(msp::Msp& msp) :
     m_msp{ &msp },
     m_camera(0)
+{
+    initCamera();
+}
+
+Drone::Drone(const CameraInfo& cameraInfo, msp::Msp* msp) :
+    cameraInfo{ cameraInfo },
+    m_msp{ msp }
+{
+}
+
+void Drone::initCamera()
 {
     m_camera.set(cv::CAP_PROP_FRAME_WIDTH, cameraInfo.resolutionX);
     m_camera.set(cv::CAP_PROP_FRAME_HEIGHT, cameraInfo.resolutionY);
+    // Not every backend honours this, hence the frame dropping below
+    m_camera.set(cv::CAP_PROP_BUFFERSIZE, 1);
+
+    const double fps = m_camera.get(cv::CAP_PROP_FPS);
+    m_framePeriod = 1.0 / (fps > 0.0 ? fps : s_defaultFps);
+    m_frameTimestamp = std::chrono::steady_clock::now();
 }
 
 [[nodiscard]] cv::Mat Drone::getGrayscaleImage()
 {
-    cv::Mat frame;
-    m_camera >> frame;
-    cv::cvtColor(frame, frame, cv::COLOR_BGR2GRAY);
-    return frame;
+    const auto previousTimestamp = m_frameTimestamp;
+    const double sinceLastRead = std::chrono::duration<double>(
+        std::chrono::steady_clock::now() - previousTimestamp).count();
+
+    // Frames captured while the caller was busy are stale; grab() skips them
+    // without decoding so the pipeline always works on the newest image
+    m_skippedFrames = 0;
+    if (sinceLastRead > s_backlogPeriods * m_framePeriod)
+    {
+        const int queued = std::min(static_cast<int>(sinceLastRead / m_framePeriod) - 1, s_maxSkippedFrames);
+        for (; m_skippedFrames < queued && m_camera.grab(); ++m_skippedFrames)
+        {
+        }
+    }
+
+    // The capture buffer is reused; only the gray frame handed out is new
+    // (and recycled by FramePool once the caller drops it)
+    m_camera >> m_captureFrame;
+
+    m_frameTimestamp = std::chrono::steady_clock::now();
+
+    // Prefer the capture timestamps of the backend over the time we read at
+    const double positionMs = m_camera.get(cv::CAP_PROP_POS_MSEC);
+    m_frameInterval = positionMs > m_framePositionMs
+        ? (positionMs - m_framePositionMs) / 1000.0
+        : std::chrono::duration<double>(m_frameTimestamp - previousTimestamp).count();
+    m_framePositionMs = positionMs;
+
+    cv::Mat gray;
+    cv::cvtColor(m_captureFrame, gray, cv::COLOR_BGR2GRAY);
+    return gray;
+}
+
+int Drone::getSkippedFrames() const
+{
+    return m_skippedFrames;
+}
+
+double Drone::getFrameInterval() const
+{
+    return m_frameInterval;
+}
+
+std::chrono::steady_clock::time_point Drone::getFrameTimestamp() const
+{
+    return m_frameTimestamp;
 }
 
 [[nodiscard]] Drone::GyroData Drone::getGyroData()
@@ -29,7 +89,10 @@ Drone::Drone(msp::Msp& msp) :
     // gyroData.pitch - absolute rotation angle (not velocity) around left-right world axis
     // gyroData.yaw - absolute rotation angle (not velocity) around vertical world axis
 
-    return { 0.0, 0.0, 0.0 };
+    if (m_msp == nullptr)
+    {
+        return { 0.0, 0.0, 0.0 };
+    }
 
     msp::AttitudeData data = m_msp->attitude();
     return {
@@ -41,6 +104,22 @@ Drone::Drone(msp::Msp& msp) :
 
 [[nodiscard]] double Drone::getAltitude()
 {
-    return 1.0;
-    return m_msp->altitude().altitude / 100.0;
+    return getAltitudeData().altitude;
+}
+
+[[nodiscard]] Drone::AltitudeData Drone::getAltitudeData()
+{
+    // altitudeData.altitude - barometric altitude above the arming point, in meters
+    // altitudeData.vario - vertical velocity, in meters per second (positive when ascending)
+
+    if (m_msp == nullptr)
+    {
+        return { 1.0, 0.0 };
+    }
+
+    msp::AltitudeData data = m_msp->altitude();
+    return {
+        data.altitude / 100.0,
+        data.vario / 100.0
+    };
 }
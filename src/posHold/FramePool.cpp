@@ -0,0 +1,141 @@
+#include <new>
+
+#include "posHold/FramePool.h"
+
+FramePool& FramePool::install()
+{
+    // Never destroyed: Mats released during static destruction still return
+    // their buffers here
+    static FramePool* const pool = new FramePool();
+    cv::Mat::setDefaultAllocator(pool);
+    return *pool;
+}
+
+FramePool::Stats FramePool::getStats() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_stats;
+}
+
+cv::UMatData* FramePool::allocate(const int dims, const int* sizes, const int type, void* data, size_t* step,
+                                  cv::AccessFlag, cv::UMatUsageFlags) const
+{
+    // Same layout rules as OpenCV's standard allocator
+    size_t total = CV_ELEM_SIZE(type);
+    for (int i = dims - 1; i >= 0; --i)
+    {
+        if (step != nullptr)
+        {
+            if (data != nullptr && step[i] != CV_AUTOSTEP)
+            {
+                CV_Assert(total <= step[i]);
+                total = step[i];
+            }
+            else
+            {
+                step[i] = total;
+            }
+        }
+        total *= sizes[i];
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    cv::UMatData* u = takeHeader();
+    if (data != nullptr)
+    {
+        u->data = u->origdata = static_cast<uchar*>(data);
+        u->flags |= cv::UMatData::USER_ALLOCATED;
+    }
+    else
+    {
+        u->data = u->origdata = static_cast<uchar*>(takeBuffer(total));
+    }
+    u->size = total;
+    return u;
+}
+
+bool FramePool::allocate(cv::UMatData* data, cv::AccessFlag, cv::UMatUsageFlags) const
+{
+    return data != nullptr;
+}
+
+void FramePool::deallocate(cv::UMatData* data) const
+{
+    if (data == nullptr)
+    {
+        return;
+    }
+
+    CV_Assert(data->urefcount == 0 && data->refcount == 0);
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (!(data->flags & cv::UMatData::USER_ALLOCATED))
+    {
+        giveBuffer(data->origdata, data->size);
+        data->origdata = nullptr;
+    }
+    giveHeader(data);
+}
+
+std::size_t FramePool::sizeClass(const std::size_t size)
+{
+    constexpr std::size_t minClass = 64;
+    if (size <= minClass)
+    {
+        return minClass;
+    }
+
+    // Quarter steps of the largest power of two not above size: at most 25%
+    // of a buffer is slack
+    std::size_t power = minClass;
+    while (power <= size / 2)
+    {
+        power *= 2;
+    }
+    const std::size_t quarter = power / 4;
+    return (size + quarter - 1) / quarter * quarter;
+}
+
+void* FramePool::takeBuffer(const std::size_t size) const
+{
+    const std::size_t capacity = sizeClass(size);
+    Bin& bin = m_bins[capacity];
+    if (!bin.free.empty())
+    {
+        void* buffer = bin.free.back();
+        bin.free.pop_back();
+        ++m_stats.reused;
+        return buffer;
+    }
+
+    bin.free.reserve(++bin.total);
+    ++m_stats.heapAllocations;
+    m_stats.reservedBytes += capacity;
+    return cv::fastMalloc(capacity);
+}
+
+void FramePool::giveBuffer(void* buffer, const std::size_t size) const
+{
+    m_bins[sizeClass(size)].free.push_back(buffer);
+}
+
+cv::UMatData* FramePool::takeHeader() const
+{
+    void* storage;
+    if (!m_headers.free.empty())
+    {
+        storage = m_headers.free.back();
+        m_headers.free.pop_back();
+    }
+    else
+    {
+        m_headers.free.reserve(++m_headers.total);
+        storage = ::operator new(sizeof(cv::UMatData));
+    }
+    return new (storage) cv::UMatData(this);
+}
+
+void FramePool::giveHeader(cv::UMatData* header) const
+{
+    header->~UMatData();
+    m_headers.free.push_back(header);
+}
@@ -0,0 +1,191 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <stdexcept>
+
+#include "posHold/RtspDrone.h"
+
+RtspDrone::RtspDrone(const Options& options, const CameraInfo& cameraInfo) :
+    Drone(cameraInfo),
+    m_options{ options }
+{
+    open();
+}
+
+RtspDrone::RtspDrone(const Options& options, msp::Msp& msp, const CameraInfo& cameraInfo) :
+    Drone(cameraInfo, &msp),
+    m_options{ options }
+{
+    open();
+}
+
+std::string RtspDrone::pipeline() const
+{
+    // latency=0 and buffer-mode=none disable the jitter buffer; appsink keeps
+    // one frame and drops older ones instead of queueing behind the caller;
+    // the caps keep the decoder's planar output, whose first plane is luma
+    return "rtspsrc location=" + m_options.url
+        + " latency=0 buffer-mode=none drop-on-latency=true protocols=" + m_options.protocols
+        + " ! rtph264depay ! h264parse ! " + m_options.decoder
+        + " ! video/x-raw,format=(string){I420,NV12}"
+        + " ! appsink max-buffers=1 drop=true sync=false";
+}
+
+void RtspDrone::open()
+{
+    m_gstreamer = m_capture.open(pipeline(), cv::CAP_GSTREAMER);
+    if (m_gstreamer)
+    {
+        // Without this the backend converts the planar frames to BGR
+        m_capture.set(cv::CAP_PROP_CONVERT_RGB, 0);
+    }
+    else if (m_options.ffmpegFallback)
+    {
+        // Read by the FFmpeg backend when a capture is opened; a value set in
+        // the environment takes precedence
+        ::setenv("OPENCV_FFMPEG_CAPTURE_OPTIONS",
+                 ("rtsp_transport;" + m_options.protocols
+                     + "|fflags;nobuffer|flags;low_delay|max_delay;0|reorder_queue_size;0").c_str(),
+                 0);
+        m_capture.open(m_options.url, cv::CAP_FFMPEG);
+        m_capture.set(cv::CAP_PROP_BUFFERSIZE, 1);
+    }
+
+    if (!m_capture.isOpened())
+    {
+        throw std::runtime_error("RtspDrone: cannot open stream " + m_options.url);
+    }
+
+    const double fps = m_capture.get(cv::CAP_PROP_FPS);
+    m_framePeriod = 1.0 / (fps > 0.0 ? fps : s_defaultFps);
+    m_lastRead = std::chrono::steady_clock::now();
+    m_frameTimestamp = m_lastRead;
+}
+
+const char* RtspDrone::getBackend() const
+{
+    return m_gstreamer ? "gstreamer" : "ffmpeg";
+}
+
+cv::Mat RtspDrone::getGrayscaleImage()
+{
+    if (!m_gstreamer)
+    {
+        drainBacklog();
+    }
+
+    // Fresh buffer every time: the caller may still hold the last frame
+    cv::Mat frame;
+    if (!m_capture.read(frame) || frame.empty())
+    {
+        return {};
+    }
+
+    const auto arrival = std::chrono::steady_clock::now();
+    m_lastRead = arrival;
+    updateTimestamp(m_capture.get(cv::CAP_PROP_POS_MSEC), arrival);
+
+    cv::Mat gray;
+    if (frame.type() == CV_8UC1 && frame.cols == cameraInfo.resolutionX
+        && frame.rows == cameraInfo.resolutionY * 3 / 2)
+    {
+        // I420 or NV12: the luma plane is the top rows
+        gray = frame.rowRange(0, cameraInfo.resolutionY);
+    }
+    else if (frame.type() == CV_8UC1)
+    {
+        gray = frame;
+    }
+    else
+    {
+        cv::cvtColor(frame, gray, cv::COLOR_BGR2GRAY);
+    }
+
+    if (gray.cols != cameraInfo.resolutionX || gray.rows != cameraInfo.resolutionY)
+    {
+        throw std::runtime_error("RtspDrone: stream is " + std::to_string(gray.cols) + "x"
+            + std::to_string(gray.rows) + ", camera info expects " + std::to_string(cameraInfo.resolutionX)
+            + "x" + std::to_string(cameraInfo.resolutionY));
+    }
+
+    m_frameAge = std::chrono::duration<double>(std::chrono::steady_clock::now() - m_frameTimestamp).count();
+    return gray;
+}
+
+void RtspDrone::drainBacklog()
+{
+    const double sinceLastRead = std::chrono::duration<double>(
+        std::chrono::steady_clock::now() - m_lastRead).count();
+    if (sinceLastRead <= s_backlogPeriods * m_framePeriod)
+    {
+        return;
+    }
+
+    // grab() skips the queued frames without converting them; the skipped
+    // count itself comes from the timestamps
+    const int queued = std::min(static_cast<int>(sinceLastRead / m_framePeriod) - 1, s_maxSkippedFrames);
+    for (int i = 0; i < queued && m_capture.grab(); ++i)
+    {
+    }
+}
+
+void RtspDrone::updateTimestamp(const double positionMs, const std::chrono::steady_clock::time_point arrival)
+{
+    const auto pts = std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+        std::chrono::duration<double, std::milli>(positionMs));
+    const auto offset = arrival - std::chrono::steady_clock::time_point(pts);
+
+    const bool first = m_positionMs < 0.0;
+    const bool restarted = !first && positionMs < m_positionMs - 1e3 * s_restartSeconds;
+    if (positionMs <= 0.0 && !first)
+    {
+        // Backend without timestamps: fall back to arrival times
+        m_frameInterval = std::chrono::duration<double>(arrival - m_frameTimestamp).count();
+        m_skippedFrames = std::max(0, static_cast<int>(std::lround(m_frameInterval / m_framePeriod)) - 1);
+        m_frameTimestamp = arrival;
+        return;
+    }
+
+    if (first || restarted)
+    {
+        m_clockOffset = offset;
+        m_frameInterval = 0.0;
+        m_skippedFrames = 0;
+    }
+    else
+    {
+        // The least delayed frame so far is the best estimate of when PTS
+        // zero was captured; the estimate creeps later by the largest clock
+        // drift expected, so it follows a sender clock running slow
+        m_frameInterval = std::max(0.0, (positionMs - m_positionMs) / 1000.0);
+        m_clockOffset += std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+            std::chrono::duration<double>(1e-6 * s_clockDriftPpm * m_frameInterval));
+        m_clockOffset = std::min(m_clockOffset, offset);
+        m_skippedFrames = std::max(0, static_cast<int>(std::lround(m_frameInterval / m_framePeriod)) - 1);
+    }
+    m_positionMs = positionMs;
+
+    const auto latency = std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+        std::chrono::duration<double>(m_options.captureLatency));
+    m_frameTimestamp = std::chrono::steady_clock::time_point(pts) + m_clockOffset - latency;
+}
+
+int RtspDrone::getSkippedFrames() const
+{
+    return m_skippedFrames;
+}
+
+double RtspDrone::getFrameInterval() const
+{
+    return m_frameInterval;
+}
+
+std::chrono::steady_clock::time_point RtspDrone::getFrameTimestamp() const
+{
+    return m_frameTimestamp;
+}
+
+double RtspDrone::getFrameAge() const
+{
+    return m_frameAge;
+}
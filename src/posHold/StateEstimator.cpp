@@ -0,0 +1,287 @@
+#include <algorithm>
+#include <cmath>
+
+#include "posHold/StateEstimator.h"
+
+StateEstimator::StateEstimator() :
+    StateEstimator(2.0, 0.2, 0.5, 0.3)
+{
+}
+
+StateEstimator::StateEstimator(
+    const double accelNoise,
+    const double flowNoise,
+    const double altitudeNoise,
+    const double varioNoise,
+    const double positionNoise) :
+    m_accelVariance{ static_cast<float>(accelNoise * accelNoise) },
+    m_flowVariance{ static_cast<float>(flowNoise * flowNoise) },
+    m_altitudeVariance{ static_cast<float>(altitudeNoise * altitudeNoise) },
+    m_varioVariance{ static_cast<float>(varioNoise * varioNoise) },
+    m_positionVariance{ static_cast<float>(positionNoise * positionNoise) },
+    m_state{ State::zeros() },
+    m_covariance{ Covariance::diag(State(0.0f, 0.0f,
+                                         s_initialVariance, s_initialVariance,
+                                         s_initialVariance, s_initialVariance)) }
+{
+}
+
+void StateEstimator::predict(const Drone::GyroData& attitude, const double dt)
+{
+    if (dt <= 0.0)
+    {
+        return;
+    }
+
+    propagate(attitude, static_cast<float>(dt));
+}
+
+void StateEstimator::predict(const Drone::GyroData& attitude, const double dt,
+                             const std::chrono::steady_clock::time_point time)
+{
+    if (dt <= 0.0)
+    {
+        return;
+    }
+
+    propagate(attitude, static_cast<float>(dt));
+
+    m_historyNewest = (m_historyNewest + 1) % s_historySize;
+    m_historyCount = std::min(m_historyCount + 1, s_historySize);
+    Step& step = m_history[m_historyNewest];
+    step.time = time;
+    step.attitude = attitude;
+    step.dt = static_cast<float>(dt);
+    step.state = m_state;
+    step.covariance = m_covariance;
+}
+
+void StateEstimator::propagate(const Drone::GyroData& attitude, const float t)
+{
+    Covariance F = Covariance::eye();
+    F(0, 2) = t;
+    F(1, 3) = t;
+    F(4, 5) = t;
+
+    // Thrust tilts toward the point where the true down vector lands on the
+    // image, so the horizontal acceleration follows VecDown's projection.
+    const float ax = -s_gravity * static_cast<float>(std::tan(attitude.pitch));
+    const float ay = -s_gravity * static_cast<float>(std::tan(attitude.roll));
+
+    m_state = F * m_state;
+    m_state(0) += 0.5f * ax * t * t;
+    m_state(1) += 0.5f * ay * t * t;
+    m_state(2) += ax * t;
+    m_state(3) += ay * t;
+
+    // Piecewise-constant white acceleration on every [position, velocity] pair
+    const float q11 = 0.25f * t * t * t * t * m_accelVariance;
+    const float q12 = 0.5f * t * t * t * m_accelVariance;
+    const float q22 = t * t * m_accelVariance;
+
+    static constexpr int axisPairs[3][2] = { { 0, 2 }, { 1, 3 }, { 4, 5 } };
+
+    Covariance Q = Covariance::zeros();
+    for (const auto& pair : axisPairs)
+    {
+        const int p = pair[0];
+        const int v = pair[1];
+        Q(p, p) = q11;
+        Q(p, v) = q12;
+        Q(v, p) = q12;
+        Q(v, v) = q22;
+    }
+
+    m_covariance = F * m_covariance * F.t() + Q;
+}
+
+void StateEstimator::updateAltitude(const Drone::AltitudeData& altitudeData)
+{
+    if (!m_hasAltitude)
+    {
+        m_state(4) = static_cast<float>(altitudeData.altitude);
+        m_state(5) = static_cast<float>(altitudeData.vario);
+        m_covariance(4, 4) = m_altitudeVariance;
+        m_covariance(5, 5) = m_varioVariance;
+        m_hasAltitude = true;
+        return;
+    }
+
+    cv::Matx<float, 2, s_stateSize> H = cv::Matx<float, 2, s_stateSize>::zeros();
+    H(0, 4) = 1.0f;
+    H(1, 5) = 1.0f;
+
+    update<2>(H,
+              cv::Matx<float, 2, 1>(static_cast<float>(altitudeData.altitude),
+                                    static_cast<float>(altitudeData.vario)),
+              cv::Matx<float, 2, 2>(m_altitudeVariance, 0.0f,
+                                    0.0f, m_varioVariance));
+}
+
+void StateEstimator::updateFlow(const cv::Point2f& displacement, const double dt)
+{
+    if (dt <= 0.0)
+    {
+        return;
+    }
+
+    const float invDt = static_cast<float>(1.0 / dt);
+    update<2>(horizontalRows(2),
+              cv::Matx<float, 2, 1>(displacement.x * invDt, displacement.y * invDt),
+              cv::Matx<float, 2, 2>(m_flowVariance, 0.0f,
+                                    0.0f, m_flowVariance));
+    refreshNewestStep();
+}
+
+void StateEstimator::updateFlow(const cv::Point2f& displacement, const double dt,
+                                const std::chrono::steady_clock::time_point sampleTime)
+{
+    if (dt <= 0.0)
+    {
+        return;
+    }
+
+    const float invDt = static_cast<float>(1.0 / dt);
+    updateHorizontalAt(sampleTime, horizontalRows(2),
+                       cv::Matx<float, 2, 1>(displacement.x * invDt, displacement.y * invDt),
+                       m_flowVariance);
+}
+
+void StateEstimator::updatePosition(const cv::Point2f& position)
+{
+    update<2>(horizontalRows(0),
+              cv::Matx<float, 2, 1>(position.x, position.y),
+              cv::Matx<float, 2, 2>(m_positionVariance, 0.0f,
+                                    0.0f, m_positionVariance));
+    refreshNewestStep();
+}
+
+void StateEstimator::updatePosition(const cv::Point2f& position,
+                                    const std::chrono::steady_clock::time_point sampleTime)
+{
+    updateHorizontalAt(sampleTime, horizontalRows(0), cv::Matx<float, 2, 1>(position.x, position.y),
+                       m_positionVariance);
+}
+
+cv::Matx<float, 2, StateEstimator::s_stateSize> StateEstimator::horizontalRows(const int first)
+{
+    cv::Matx<float, 2, s_stateSize> H = cv::Matx<float, 2, s_stateSize>::zeros();
+    H(0, first) = 1.0f;
+    H(1, first + 1) = 1.0f;
+    return H;
+}
+
+void StateEstimator::updateHorizontalAt(
+    const std::chrono::steady_clock::time_point sampleTime,
+    const cv::Matx<float, 2, s_stateSize>& H,
+    const cv::Matx<float, 2, 1>& z,
+    const float variance)
+{
+    const cv::Matx<float, 2, 2> R(variance, 0.0f,
+                                  0.0f, variance);
+
+    // Steps back from the newest recorded prediction to the one the
+    // measurement belongs to
+    int age = 0;
+    while (age < m_historyCount
+        && m_history[(m_historyNewest - age + s_historySize) % s_historySize].time > sampleTime)
+    {
+        ++age;
+    }
+    if (age == 0 || age == m_historyCount)
+    {
+        update<2>(H, z, R);
+        refreshNewestStep();
+        return;
+    }
+
+    const State live = m_state;
+    const Covariance liveCovariance = m_covariance;
+
+    Step& base = m_history[(m_historyNewest - age + s_historySize) % s_historySize];
+    m_state = base.state;
+    m_covariance = base.covariance;
+    update<2>(H, z, R);
+    base.state = m_state;
+    base.covariance = m_covariance;
+
+    for (int i = age - 1; i >= 0; --i)
+    {
+        Step& step = m_history[(m_historyNewest - i + s_historySize) % s_historySize];
+        propagate(step.attitude, step.dt);
+        step.state = m_state;
+        step.covariance = m_covariance;
+    }
+
+    // Altitude never couples with the horizontal axes (F, Q and every H are
+    // block-diagonal), so the live vertical state, with the altitude
+    // updates the recorded steps lack, is kept as is
+    for (int i = 4; i < s_stateSize; ++i)
+    {
+        m_state(i) = live(i);
+        for (int j = 0; j < s_stateSize; ++j)
+        {
+            m_covariance(i, j) = liveCovariance(i, j);
+            m_covariance(j, i) = liveCovariance(j, i);
+        }
+    }
+}
+
+void StateEstimator::refreshNewestStep()
+{
+    if (m_historyCount > 0)
+    {
+        m_history[m_historyNewest].state = m_state;
+        m_history[m_historyNewest].covariance = m_covariance;
+    }
+}
+
+void StateEstimator::resetPosition()
+{
+    m_state(0) = 0.0f;
+    m_state(1) = 0.0f;
+
+    for (int i = 0; i < s_stateSize; ++i)
+    {
+        m_covariance(0, i) = m_covariance(i, 0) = 0.0f;
+        m_covariance(1, i) = m_covariance(i, 1) = 0.0f;
+    }
+
+    // Recorded steps hold positions from before the reset
+    m_historyCount = 0;
+}
+
+cv::Point2f StateEstimator::getPosition() const
+{
+    return { m_state(0), m_state(1) };
+}
+
+cv::Point2f StateEstimator::getVelocity() const
+{
+    return { m_state(2), m_state(3) };
+}
+
+double StateEstimator::getAltitude() const
+{
+    return m_state(4);
+}
+
+double StateEstimator::getVerticalSpeed() const
+{
+    return m_state(5);
+}
+
+template <int M>
+void StateEstimator::update(
+    const cv::Matx<float, M, s_stateSize>& H,
+    const cv::Matx<float, M, 1>& z,
+    const cv::Matx<float, M, M>& R)
+{
+    const cv::Matx<float, s_stateSize, M> Ht = H.t();
+    const cv::Matx<float, M, 1> innovation = z - H * m_state;
+    const cv::Matx<float, M, M> S = H * m_covariance * Ht + R;
+    const cv::Matx<float, s_stateSize, M> K = m_covariance * Ht * S.inv();
+
+    m_state += K * innovation;
+    m_covariance = (Covariance::eye() - K * H) * m_covariance;
+}
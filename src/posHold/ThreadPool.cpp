@@ -0,0 +1,101 @@
+#include <utility>
+
+#include "posHold/ThreadPool.h"
+
+ThreadPool::ThreadPool(const int threads)
+{
+    for (int i = 1; i < threads; ++i)
+    {
+        m_threads.emplace_back(&ThreadPool::work, this);
+    }
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_start.notify_all();
+    for (std::thread& thread : m_threads)
+    {
+        thread.join();
+    }
+}
+
+void ThreadPool::dispatch(const int count, const void* context, const Invoke invoke)
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_context = context;
+    m_invoke = invoke;
+    m_count = count;
+    m_next = 0;
+    m_error = nullptr;
+    if (count > 1)
+    {
+        m_start.notify_all();
+    }
+
+    drain(lock);
+    // The caller ran out of tasks; wait for those still on other threads
+    m_done.wait(lock, [this] { return m_running == 0; });
+
+    m_context = nullptr;
+    m_invoke = nullptr;
+    m_count = 0;
+    m_next = 0;
+    if (m_error)
+    {
+        std::rethrow_exception(std::exchange(m_error, nullptr));
+    }
+}
+
+int ThreadPool::size() const
+{
+    return static_cast<int>(m_threads.size()) + 1;
+}
+
+void ThreadPool::work()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (true)
+    {
+        m_start.wait(lock, [this] { return m_stop || m_next < m_count; });
+        if (m_stop)
+        {
+            return;
+        }
+        drain(lock);
+        if (m_running == 0)
+        {
+            m_done.notify_all();
+        }
+    }
+}
+
+void ThreadPool::drain(std::unique_lock<std::mutex>& lock)
+{
+    while (m_next < m_count)
+    {
+        const int index = m_next++;
+        ++m_running;
+        lock.unlock();
+
+        std::exception_ptr error;
+        try
+        {
+            m_invoke(m_context, index);
+        }
+        catch (...)
+        {
+            error = std::current_exception();
+        }
+
+        lock.lock();
+        --m_running;
+        if (error && !m_error)
+        {
+            m_error = error;
+        }
+    }
+}
@@ -1,7 +1,8 @@
 #include "posHold/VecDown.h"
 
 VecDown::VecDown(Drone& drone) :
-    m_drone{ &drone }
+    m_drone{ &drone },
+    m_kernels{ CameraKernels::select(drone.cameraInfo) }
 {
 }
 
@@ -63,23 +64,5 @@ cv::Vec3d VecDown::calcVecDown3d()
 
 cv::Point2f VecDown::calcVecDownProjection()
 {
-    cv::Vec3d v = calcVecDown3d();
-
-    const double depth = -v[2];
-
-    if (depth <= 0.0)
-    {
-        return { 0.0, 0.0 };
-    }
-
-    double x_screen = -m_drone->cameraInfo.focalLength * (v[0] / depth);
-    double y_screen = m_drone->cameraInfo.focalLength * (v[1] / depth);
-
-    float u = m_drone->cameraInfo.resolutionX / 2.0 + x_screen;
-    float v_scr = m_drone->cameraInfo.resolutionY / 2.0 + y_screen;
-
-    return {
-        std::max(std::min(u, static_cast<float>(m_drone->cameraInfo.resolutionX)), 0.0f),
-        std::max(std::min(v_scr, static_cast<float>(m_drone->cameraInfo.resolutionY)), 0.0f)
-    };
+    return m_kernels.projectDown(calcVecDown3d(), m_drone->cameraInfo);
 }
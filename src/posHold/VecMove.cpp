@@ -1,9 +1,13 @@
+#include <algorithm>
+#include <cmath>
+
 #include "posHold/VecMove.h"
 
-VecMove::VecMove(Drone& drone) :
+VecMove::VecMove(Drone& drone, const int flowTiles, const CameraOpticalFlow::Mode flowMode) :
     m_drone{ &drone },
+    m_kernels{ CameraKernels::select(drone.cameraInfo) },
     m_vecDown(drone),
-    m_cameraOpticalFlow(drone)
+    m_cameraOpticalFlow(drone, m_kernels.maxRoiRadius, flowTiles, flowMode)
 {
 }
 
@@ -12,46 +16,95 @@ void VecMove::calc()
     m_vecDown.calc();
 
     const cv::Point2f p = m_vecDown.getVecDown();
+    const double altitude = m_drone->getAltitude();
+
+    updateFlowRadii(altitude);
 
-    m_cameraOpticalFlow.calc(static_cast<int>(p.x), static_cast<int>(p.y), s_accountFlowPixels);
+    m_cameraOpticalFlow.calc(cvRound(p.x), cvRound(p.y), m_calcFlowPixels, altitude, m_accountFlowPixels);
+
+    m_sampleInterval = m_drone->getFrameInterval();
+    m_sampleTimestamp = m_drone->getFrameTimestamp();
 
     if (p.x < 0 || static_cast<int>(p.x) >= m_drone->cameraInfo.resolutionX
         || p.y < 0 || static_cast<int>(p.y) >= m_drone->cameraInfo.resolutionY)
     {
-        m_vecMove = p * s_noFlowBalanceVecMultiplier
-            / std::sqrt((m_drone->cameraInfo.resolutionX * m_drone->cameraInfo.resolutionX
-                + m_drone->cameraInfo.resolutionY * m_drone->cameraInfo.resolutionY
-            ));
+        m_vecMove = p * (s_noFlowBalanceVecMultiplier * m_kernels.inverseDiagonal);
+        m_meanFlow = cv::Point2f(0.0f, 0.0f);
+        m_flowConfidence = 0.0;
+        return;
+    }
+
+    if (m_cameraOpticalFlow.getMode() == CameraOpticalFlow::Mode::Keyframe)
+    {
+        m_vecMove = keyframeVecMove(p, altitude);
+        m_meanFlow = m_cameraOpticalFlow.getFusedFlow();
+        m_flowConfidence = m_cameraOpticalFlow.getFlowConfidence();
+        m_predictedMotion = (cv::norm(m_meanFlow) + cv::norm(m_vecDown.getVecDownDisplacement()))
+            / (m_drone->getSkippedFrames() + 1);
+        m_hasPrev = true;
         return;
     }
 
-    cv::Point2f meanOpticalFlow{ 0.0f, 0.0f };
+    // Averaging discs around the pixel nearest to p and the ring tiles,
+    // weighted by how much texture each tile has
+    const cv::Point2f meanOpticalFlow = m_cameraOpticalFlow.getFusedFlow();
+
+    m_meanFlow = meanOpticalFlow;
+    m_flowConfidence = m_cameraOpticalFlow.getFlowConfidence();
 
-    const int xMin = std::max(static_cast<int>(p.x) - s_accountFlowPixels, 0);
-    const int xMax = std::min(static_cast<int>(p.x) + s_accountFlowPixels, m_drone->cameraInfo.resolutionX - 1);
-    const int yMin = std::max(static_cast<int>(p.y) - s_accountFlowPixels, 0);
-    const int yMax = std::min(static_cast<int>(p.y) + s_accountFlowPixels, m_drone->cameraInfo.resolutionY - 1);
+    const cv::Point2f vecDownDisplacement = m_vecDown.getVecDownDisplacement();
 
-    int counter = 0;
-    for (int x = xMin; x <= xMax; ++x)
+    m_vecMove = (altitude * m_kernels.inverseFocalLength) * (vecDownDisplacement - meanOpticalFlow);
+    m_position += m_vecMove;
+
+    // Per-frame motion, even when the flow spans a gap of dropped frames
+    m_predictedMotion = (cv::norm(meanOpticalFlow) + cv::norm(vecDownDisplacement))
+        / (m_drone->getSkippedFrames() + 1);
+
+    m_hasPrev = true;
+}
+
+cv::Point2f VecMove::keyframeVecMove(const cv::Point2f& p, const double altitude)
+{
+    const double metersPerPixel = altitude * m_kernels.inverseFocalLength;
+    const cv::Point2f previous = m_position;
+
+    if (m_cameraOpticalFlow.hasKeyframeDisplacement())
     {
-        for (int y = yMin; y <= yMax; ++y)
-        {
-            if (static_cast<long long>(p.x - x) * (p.x - x)
-                + static_cast<long long>(p.y - y) * (p.y - y)
-                <= static_cast<long long>(s_accountFlowPixels) * s_accountFlowPixels)
-            {
-                meanOpticalFlow += m_cameraOpticalFlow.getOpticalFlowAt(x, y);
-                ++counter;
-            }
-        }
+        // The per-frame formula summed since the keyframe: the down vector's
+        // travel minus the ground's, both measured from the keyframe
+        m_position = m_keyframeOrigin
+            + metersPerPixel * ((p - m_keyframeVecDown) - m_cameraOpticalFlow.getKeyframeDisplacement());
+    }
+    else
+    {
+        // No keyframe to measure against (first frame or tracking lost):
+        // only the attitude change is known until the next one is taken
+        m_position = previous + metersPerPixel * m_vecDown.getVecDownDisplacement();
     }
 
-    meanOpticalFlow /= counter;
+    if (m_cameraOpticalFlow.hasReanchored())
+    {
+        m_keyframeOrigin = m_position;
+        m_keyframeVecDown = p;
+    }
 
-    m_vecMove = (m_drone->getAltitude() / m_drone->cameraInfo.focalLength) * (m_vecDown.getVecDownDisplacement() - meanOpticalFlow);
+    return m_position - previous;
+}
 
-    m_hasPrev = true;
+cv::Point2f VecMove::getAccumulatedPosition() const
+{
+    return m_position;
+}
+
+cv::Point2f VecMove::getKeyframeOffset() const
+{
+    return m_position - m_keyframeOrigin;
+}
+
+std::uint64_t VecMove::getKeyframeCount() const
+{
+    return m_cameraOpticalFlow.getKeyframeCount();
 }
 
 cv::Point2f VecMove::getVecMove() const
@@ -62,3 +115,68 @@ cv::Point2f VecMove::getVecMove() const
     }
     return m_vecMove;
 }
+
+bool VecMove::hasVecMove() const
+{
+    return m_hasPrev;
+}
+
+double VecMove::getFlowConfidence() const
+{
+    return m_flowConfidence;
+}
+
+cv::Point2f VecMove::getVecDown() const
+{
+    return m_vecDown.getVecDown();
+}
+
+cv::Point2f VecMove::getMeanFlow() const
+{
+    return m_meanFlow;
+}
+
+const std::vector<CameraOpticalFlow::Tile>& VecMove::getFlowTiles() const
+{
+    return m_cameraOpticalFlow.getTiles();
+}
+
+double VecMove::getSampleInterval() const
+{
+    if (!m_hasPrev)
+    {
+        throw std::runtime_error("VecMove::getSampleInterval called before calling VecMove::calc");
+    }
+    return m_sampleInterval;
+}
+
+std::chrono::steady_clock::time_point VecMove::getSampleTimestamp() const
+{
+    if (!m_hasPrev)
+    {
+        throw std::runtime_error("VecMove::getSampleTimestamp called before calling VecMove::calc");
+    }
+    return m_sampleTimestamp;
+}
+
+void VecMove::updateFlowRadii(const double altitude)
+{
+    const Drone::CameraInfo& cameraInfo = m_drone->cameraInfo;
+
+    // Low altitude needs more pixels for the same patch of ground, fast motion
+    // needs room for features to stay inside the ROI, and the compute budget
+    // caps both at the flow stage's current working scale
+    const double groundRadius = s_minGroundRadius * cameraInfo.focalLength
+        / std::max(altitude, cameraInfo.minDist);
+    const double motionRadius = s_motionMargin * m_predictedMotion;
+    const double budgetRadius = std::sqrt(s_flowPixelBudget)
+        / (2.0 * m_cameraOpticalFlow.getSettings().scale);
+
+    const double radius = std::min(std::max(groundRadius, motionRadius), budgetRadius);
+    m_calcFlowPixels = std::clamp(static_cast<int>(std::ceil(radius)), s_minCalcFlowPixels, m_kernels.maxRoiRadius);
+
+    // Flow within one frame's motion of the ROI border tracks features that
+    // left the window, so the averaging disc stays clear of it
+    m_accountFlowPixels = std::clamp(m_calcFlowPixels - static_cast<int>(std::ceil(m_predictedMotion)),
+                                     s_minAccountFlowPixels, m_calcFlowPixels);
+}
@@ -0,0 +1,160 @@
+#include <algorithm>
+#include <iostream>
+
+#include <pthread.h>
+#include <sched.h>
+
+#include "posHold/VideoRecorder.h"
+
+VideoRecorder::VideoRecorder(const Options& options) :
+    m_options{ options },
+    m_queue(std::max<std::size_t>(options.queueDepth, 1))
+{
+    const bool roiOnly = !m_options.roiSize.empty();
+    m_writer.open(m_options.path,
+                  m_options.fourcc,
+                  m_options.fps,
+                  roiOnly ? m_options.roiSize : m_options.frameSize,
+                  !(roiOnly || m_options.grayscale));
+
+    if (m_writer.isOpened())
+    {
+        m_thread = std::thread(&VideoRecorder::run, this);
+    }
+}
+
+VideoRecorder::~VideoRecorder()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stopping = true;
+    }
+    m_ready.notify_one();
+
+    if (m_thread.joinable())
+    {
+        m_thread.join();
+    }
+    m_writer.release();
+}
+
+bool VideoRecorder::isOpened() const
+{
+    return m_writer.isOpened();
+}
+
+bool VideoRecorder::submit(const cv::Mat& frame, const cv::Point roiCenter)
+{
+    if (m_submitted++ % std::max(m_options.frameStride, 1) != 0)
+    {
+        return true;
+    }
+
+    if (!m_thread.joinable() || m_failed.load(std::memory_order_relaxed) || frame.empty())
+    {
+        m_dropped.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+
+    cv::Rect roi;
+    if (!m_options.roiSize.empty())
+    {
+        // Keep the window its full size by sliding it inside the frame
+        const cv::Size size(std::min(m_options.roiSize.width, frame.cols),
+                            std::min(m_options.roiSize.height, frame.rows));
+        roi = cv::Rect(std::clamp(roiCenter.x - size.width / 2, 0, frame.cols - size.width),
+                       std::clamp(roiCenter.y - size.height / 2, 0, frame.rows - size.height),
+                       size.width,
+                       size.height);
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_size == m_queue.size())
+        {
+            m_dropped.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+
+        Job& job = m_queue[(m_head + m_size) % m_queue.size()];
+        job.frame = frame;
+        job.roi = roi;
+        ++m_size;
+    }
+    m_ready.notify_one();
+    return true;
+}
+
+std::uint64_t VideoRecorder::getRecordedFrames() const
+{
+    return m_recorded.load(std::memory_order_relaxed);
+}
+
+std::uint64_t VideoRecorder::getDroppedFrames() const
+{
+    return m_dropped.load(std::memory_order_relaxed);
+}
+
+void VideoRecorder::run()
+{
+    // Only runs when no other thread wants the core; failing to lower the
+    // priority is not worth stopping the recording for
+    sched_param param{};
+    param.sched_priority = 0;
+    pthread_setschedparam(pthread_self(), SCHED_IDLE, &param);
+
+    for (;;)
+    {
+        Job job;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_ready.wait(lock, [this] { return m_size > 0 || m_stopping; });
+            if (m_size == 0)
+            {
+                return;
+            }
+
+            // Take the handle out so the caller's buffer is released as soon
+            // as this frame is encoded
+            job.frame = std::move(m_queue[m_head].frame);
+            job.roi = m_queue[m_head].roi;
+            m_head = (m_head + 1) % m_queue.size();
+            --m_size;
+        }
+
+        if (m_failed.load(std::memory_order_relaxed))
+        {
+            m_dropped.fetch_add(1, std::memory_order_relaxed);
+            continue;
+        }
+
+        try
+        {
+            encode(job);
+            m_recorded.fetch_add(1, std::memory_order_relaxed);
+        }
+        catch (const cv::Exception& e)
+        {
+            // Recording must never take the flight down with it
+            std::cerr << "VideoRecorder: stopping after encoder error: " << e.what() << std::endl;
+            m_failed.store(true, std::memory_order_relaxed);
+            m_dropped.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+}
+
+void VideoRecorder::encode(const Job& job)
+{
+    const bool roiOnly = !m_options.roiSize.empty();
+    const bool grayscale = roiOnly || m_options.grayscale;
+    const cv::Mat source = roiOnly ? job.frame(job.roi) : job.frame;
+
+    if (grayscale == (source.channels() == 1))
+    {
+        m_writer.write(source);
+        return;
+    }
+
+    cv::cvtColor(source, m_converted, grayscale ? cv::COLOR_BGR2GRAY : cv::COLOR_GRAY2BGR);
+    m_writer.write(m_converted);
+}
@@ -0,0 +1,132 @@
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+#include "replay/ReplayDrone.h"
+
+ReplayDrone::ReplayDrone(
+    const std::string& videoPath,
+    const std::string& telemetryPath,
+    const CameraInfo& cameraInfo) :
+    Drone(cameraInfo),
+    m_video(videoPath),
+    m_samples{ loadTelemetry(telemetryPath) }
+{
+    if (!m_video.isOpened())
+    {
+        throw std::runtime_error("ReplayDrone: cannot open video " + videoPath);
+    }
+    if (m_samples.empty())
+    {
+        throw std::runtime_error("ReplayDrone: no telemetry rows in " + telemetryPath);
+    }
+}
+
+bool ReplayDrone::hasNextFrame() const
+{
+    return m_next < m_samples.size();
+}
+
+std::size_t ReplayDrone::getFrameIndex() const
+{
+    return m_next - 1;
+}
+
+cv::Mat ReplayDrone::getGrayscaleImage()
+{
+    if (!hasNextFrame())
+    {
+        throw std::runtime_error("ReplayDrone::getGrayscaleImage called past the end of the log");
+    }
+
+    if (!m_video.read(m_frame))
+    {
+        throw std::runtime_error("ReplayDrone: video ended at frame " + std::to_string(m_next)
+            + " of " + std::to_string(m_samples.size()) + " telemetry rows");
+    }
+
+    m_frameInterval = m_next > 0
+        ? std::chrono::duration<double>(m_samples[m_next].timestamp - m_samples[m_next - 1].timestamp).count()
+        : 0.0;
+    ++m_next;
+
+    cv::Mat gray;
+    if (m_frame.channels() == 1)
+    {
+        gray = m_frame.clone();
+    }
+    else
+    {
+        cv::cvtColor(m_frame, gray, cv::COLOR_BGR2GRAY);
+    }
+    return gray;
+}
+
+int ReplayDrone::getSkippedFrames() const
+{
+    return m_next > 0 ? m_samples[m_next - 1].skippedFrames : 0;
+}
+
+double ReplayDrone::getFrameInterval() const
+{
+    return m_frameInterval;
+}
+
+std::chrono::steady_clock::time_point ReplayDrone::getFrameTimestamp() const
+{
+    return m_next > 0 ? m_samples[m_next - 1].timestamp : m_samples.front().timestamp;
+}
+
+Drone::GyroData ReplayDrone::getGyroData()
+{
+    return upcoming().attitude;
+}
+
+Drone::AltitudeData ReplayDrone::getAltitudeData()
+{
+    return upcoming().altitude;
+}
+
+const ReplayDrone::Sample& ReplayDrone::upcoming() const
+{
+    return m_samples[std::min(m_next, m_samples.size() - 1)];
+}
+
+std::vector<ReplayDrone::Sample> ReplayDrone::loadTelemetry(const std::string& path)
+{
+    std::ifstream file(path);
+    if (!file)
+    {
+        throw std::runtime_error("ReplayDrone: cannot open telemetry " + path);
+    }
+
+    std::vector<Sample> samples;
+    std::string line;
+    std::size_t lineNumber = 0;
+    while (std::getline(file, line))
+    {
+        ++lineNumber;
+        if (line.empty() || line.rfind("timestamp_us", 0) == 0)
+        {
+            continue;
+        }
+
+        std::istringstream row(line);
+        long long timestampUs = 0;
+        Sample sample{};
+        char comma = 0;
+        row >> timestampUs >> comma >> sample.skippedFrames
+            >> comma >> sample.attitude.roll >> comma >> sample.attitude.pitch >> comma >> sample.attitude.yaw
+            >> comma >> sample.altitude.altitude >> comma >> sample.altitude.vario;
+        if (!row)
+        {
+            throw std::runtime_error("ReplayDrone: malformed telemetry row " + std::to_string(lineNumber)
+                + " in " + path);
+        }
+
+        sample.timestamp = std::chrono::steady_clock::time_point(std::chrono::microseconds(timestampUs));
+        samples.push_back(sample);
+    }
+    return samples;
+}
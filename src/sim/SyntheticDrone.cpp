@@ -0,0 +1,302 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <stdexcept>
+#include <utility>
+
+#include "sim/SyntheticDrone.h"
+
+SyntheticDrone::SyntheticDrone(Trajectory trajectory, const Options& options, const CameraInfo& cameraInfo) :
+    Drone(cameraInfo),
+    m_trajectory{ std::move(trajectory) },
+    m_options{ options },
+    m_rng(options.seed),
+    m_frameCount{ static_cast<std::size_t>(std::floor(m_trajectory.duration() * options.fps + 1e-9)) + 1 }
+{
+    if (options.fps <= 0.0 || options.textureSize < 2 || options.texelSize <= 0.0 || options.motionBlurSamples < 1)
+    {
+        throw std::runtime_error("SyntheticDrone: invalid options");
+    }
+
+    m_texture = groundTexture(options.textureSize, options.seed);
+
+    if (cameraInfo.hasDistortion())
+    {
+        // The sensor sees the distorted image, so every sensor pixel samples
+        // the ground along the ray of its rectified position
+        cv::Mat pixels(cameraInfo.resolutionY, cameraInfo.resolutionX, CV_32FC2);
+        for (int y = 0; y < pixels.rows; ++y)
+        {
+            auto* row = pixels.ptr<cv::Vec2f>(y);
+            for (int x = 0; x < pixels.cols; ++x)
+            {
+                row[x] = cv::Vec2f(static_cast<float>(x), static_cast<float>(y));
+            }
+        }
+        const cv::Mat cameraMatrix(cameraInfo.cameraMatrix());
+        cv::undistortPoints(pixels.reshape(2, 1), m_rectifiedPixels, cameraMatrix, cameraInfo.distortion,
+                            cv::noArray(), cameraMatrix);
+        m_rectifiedPixels = m_rectifiedPixels.reshape(2, cameraInfo.resolutionY);
+    }
+
+    m_pose = m_trajectory.at(frameTime(0));
+    m_prevPose = m_pose;
+    sampleTelemetry();
+}
+
+bool SyntheticDrone::hasNextFrame() const
+{
+    return m_next < m_frameCount;
+}
+
+std::size_t SyntheticDrone::getFrameIndex() const
+{
+    return m_next - 1;
+}
+
+cv::Mat SyntheticDrone::getGrayscaleImage()
+{
+    if (!hasNextFrame())
+    {
+        throw std::runtime_error("SyntheticDrone::getGrayscaleImage called past the end of the trajectory");
+    }
+
+    const auto renderStart = std::chrono::steady_clock::now();
+    const double t = frameTime(m_next);
+    m_prevPose = m_next > 0 ? m_pose : m_trajectory.at(t);
+    m_pose = m_trajectory.at(t);
+
+    cv::Mat frame;
+    const int samples = m_options.exposureTime > 0.0 ? m_options.motionBlurSamples : 1;
+    if (samples > 1)
+    {
+        m_accumulator.create(cameraInfo.resolutionY, cameraInfo.resolutionX, CV_32FC1);
+        m_accumulator.setTo(0);
+        for (int i = 0; i < samples; ++i)
+        {
+            const double offset = m_options.exposureTime * ((i + 0.5) / samples - 0.5);
+            render(m_trajectory.at(t + offset), m_render);
+            cv::accumulate(m_render, m_accumulator);
+        }
+        m_accumulator.convertTo(frame, CV_8U, m_pose.exposure / samples);
+    }
+    else
+    {
+        render(m_pose, m_render);
+        m_render.convertTo(frame, CV_8U, m_pose.exposure);
+    }
+
+    if (m_options.defocusSigma > 0.0)
+    {
+        cv::GaussianBlur(frame, frame, cv::Size(0, 0), m_options.defocusSigma);
+    }
+
+    if (m_options.imageNoise > 0.0)
+    {
+        m_noise.create(frame.size(), CV_16SC1);
+        m_rng.fill(m_noise, cv::RNG::NORMAL, 0.0, m_options.imageNoise);
+        cv::add(frame, m_noise, frame, cv::noArray(), CV_8U);
+    }
+
+    ++m_next;
+    sampleTelemetry();
+    m_renderSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - renderStart).count();
+    return frame;
+}
+
+int SyntheticDrone::getSkippedFrames() const
+{
+    return 0;
+}
+
+double SyntheticDrone::getFrameInterval() const
+{
+    return m_next > 1 ? 1.0 / m_options.fps : 0.0;
+}
+
+std::chrono::steady_clock::time_point SyntheticDrone::getFrameTimestamp() const
+{
+    const double t = frameTime(m_next > 0 ? m_next - 1 : 0);
+    return std::chrono::steady_clock::time_point(
+        std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(t)));
+}
+
+Drone::GyroData SyntheticDrone::getGyroData()
+{
+    return m_upcomingAttitude;
+}
+
+Drone::AltitudeData SyntheticDrone::getAltitudeData()
+{
+    return m_upcomingAltitude;
+}
+
+double SyntheticDrone::getRenderSeconds() const
+{
+    return m_renderSeconds;
+}
+
+Trajectory::Pose SyntheticDrone::getTruePose() const
+{
+    return m_pose;
+}
+
+cv::Vec3d SyntheticDrone::getTrueDisplacement() const
+{
+    return { m_pose.x - m_prevPose.x, m_pose.y - m_prevPose.y, m_pose.altitude - m_prevPose.altitude };
+}
+
+cv::Point2f SyntheticDrone::getTrueVecMove() const
+{
+    const double dx = m_pose.x - m_prevPose.x;
+    const double dy = m_pose.y - m_prevPose.y;
+    const double bodyX = std::cos(m_pose.yaw) * dx + std::sin(m_pose.yaw) * dy;
+    const double bodyY = -std::sin(m_pose.yaw) * dx + std::cos(m_pose.yaw) * dy;
+    // Image x runs along body -x, image y along body y
+    return { static_cast<float>(-bodyX), static_cast<float>(bodyY) };
+}
+
+cv::Point2f SyntheticDrone::getTrueFlowAt(const cv::Point2f p) const
+{
+    const cv::Point2d moved = project(m_pose, groundPoint(m_prevPose, p));
+    return { static_cast<float>(moved.x - p.x), static_cast<float>(moved.y - p.y) };
+}
+
+cv::Matx33d SyntheticDrone::bodyFromGround(const Trajectory::Pose& pose)
+{
+    const cv::Matx33d Rx(1, 0, 0,
+                         0, std::cos(-pose.roll), -std::sin(-pose.roll),
+                         0, std::sin(-pose.roll), std::cos(-pose.roll));
+
+    const cv::Matx33d Ry(std::cos(-pose.pitch), 0, std::sin(-pose.pitch),
+                         0, 1, 0,
+                         -std::sin(-pose.pitch), 0, std::cos(-pose.pitch));
+
+    const cv::Matx33d Rz(std::cos(-pose.yaw), -std::sin(-pose.yaw), 0,
+                         std::sin(-pose.yaw), std::cos(-pose.yaw), 0,
+                         0, 0, 1);
+
+    return Rz * Ry * Rx;
+}
+
+cv::Matx33d SyntheticDrone::texelsFromPixels(const Trajectory::Pose& pose) const
+{
+    // Rectified pixel to body ray with unit depth
+    const cv::Matx33d rayFromPixel(-1.0 / cameraInfo.focalLength, 0.0, cameraInfo.principalX / cameraInfo.focalLength,
+                                   0.0, 1.0 / cameraInfo.focalLengthY, -cameraInfo.principalY / cameraInfo.focalLengthY,
+                                   0.0, 0.0, -1.0);
+    // Ground ray to the homogeneous point where it meets the ground plane
+    const cv::Matx33d groundFromRay(pose.altitude, 0.0, -pose.x,
+                                    0.0, pose.altitude, -pose.y,
+                                    0.0, 0.0, -1.0);
+    // Ground meters to texels, ground origin in the middle of the texture
+    const double centre = m_options.textureSize / 2.0;
+    const cv::Matx33d texelsFromGround(1.0 / m_options.texelSize, 0.0, centre,
+                                       0.0, 1.0 / m_options.texelSize, centre,
+                                       0.0, 0.0, 1.0);
+
+    return texelsFromGround * groundFromRay * bodyFromGround(pose).t() * rayFromPixel;
+}
+
+cv::Point2d SyntheticDrone::groundPoint(const Trajectory::Pose& pose, const cv::Point2d p) const
+{
+    const cv::Vec3d bodyRay(-(p.x - cameraInfo.principalX) / cameraInfo.focalLength,
+                            (p.y - cameraInfo.principalY) / cameraInfo.focalLengthY,
+                            -1.0);
+    const cv::Vec3d groundRay = bodyFromGround(pose).t() * bodyRay;
+    if (groundRay[2] >= 0.0)
+    {
+        throw std::runtime_error("SyntheticDrone: pixel looks above the horizon");
+    }
+
+    const double t = pose.altitude / -groundRay[2];
+    return { pose.x + t * groundRay[0], pose.y + t * groundRay[1] };
+}
+
+cv::Point2d SyntheticDrone::project(const Trajectory::Pose& pose, const cv::Point2d ground) const
+{
+    const cv::Vec3d p = bodyFromGround(pose) * cv::Vec3d(ground.x - pose.x, ground.y - pose.y, -pose.altitude);
+    const double depth = -p[2];
+    return {
+        cameraInfo.principalX - cameraInfo.focalLength * (p[0] / depth),
+        cameraInfo.principalY + cameraInfo.focalLengthY * (p[1] / depth)
+    };
+}
+
+double SyntheticDrone::frameTime(const std::size_t index) const
+{
+    return m_trajectory.startTime() + index / m_options.fps;
+}
+
+cv::Mat SyntheticDrone::groundTexture(const int size, const unsigned seed)
+{
+    // Textures are large and slow to build, and every drone flying the same
+    // seed sees the same read-only ground
+    static std::mutex mutex;
+    static std::map<std::pair<int, unsigned>, cv::Mat> cache;
+
+    const std::lock_guard<std::mutex> lock(mutex);
+    cv::Mat& texture = cache[{ size, seed }];
+    if (!texture.empty())
+    {
+        return texture;
+    }
+
+    // Value noise summed over octaves from ~0.6 m blobs down to 2-texel grain,
+    // coarse octaves weighted up, then equalised to the full gray range so
+    // every altitude sees texture at the scales Farneback tracks
+    cv::RNG rng(~static_cast<std::uint64_t>(seed));
+    cv::Mat sum = cv::Mat::zeros(size, size, CV_32FC1);
+    cv::Mat octave;
+    for (int cell = 256; cell >= 2; cell /= 2)
+    {
+        const int gridSize = std::max(2, size / cell);
+        cv::Mat grid(gridSize, gridSize, CV_32FC1);
+        rng.fill(grid, cv::RNG::UNIFORM, -1.0, 1.0);
+        cv::resize(grid, octave, sum.size(), 0, 0, cv::INTER_CUBIC);
+        cv::scaleAdd(octave, std::sqrt(static_cast<double>(cell)), sum, sum);
+    }
+
+    cv::normalize(sum, texture, 0, 255, cv::NORM_MINMAX, CV_8U);
+    cv::equalizeHist(texture, texture);
+    return texture;
+}
+
+void SyntheticDrone::render(const Trajectory::Pose& pose, cv::Mat& out)
+{
+    const cv::Matx33d texels = texelsFromPixels(pose);
+    const cv::Size size(cameraInfo.resolutionX, cameraInfo.resolutionY);
+
+    if (m_rectifiedPixels.empty())
+    {
+        cv::warpPerspective(m_texture, out, cv::Mat(texels), size,
+                            cv::INTER_LINEAR | cv::WARP_INVERSE_MAP, cv::BORDER_REFLECT_101);
+        return;
+    }
+
+    cv::perspectiveTransform(m_rectifiedPixels, m_texelMap, cv::Mat(texels));
+    cv::remap(m_texture, out, m_texelMap, cv::noArray(), cv::INTER_LINEAR, cv::BORDER_REFLECT_101);
+}
+
+void SyntheticDrone::sampleTelemetry()
+{
+    const double t = frameTime(std::min(m_next, m_frameCount - 1));
+    const Trajectory::Pose pose = m_trajectory.at(t);
+
+    auto noise = [this](const double sigma) { return sigma > 0.0 ? m_rng.gaussian(sigma) : 0.0; };
+
+    m_upcomingAttitude = {
+        pose.roll + noise(m_options.attitudeNoise),
+        pose.pitch + noise(m_options.attitudeNoise),
+        pose.yaw + noise(m_options.attitudeNoise)
+    };
+
+    // Central difference over one frame period
+    const double h = 0.5 / m_options.fps;
+    m_upcomingAltitude = {
+        pose.altitude + noise(m_options.altitudeNoise),
+        (m_trajectory.at(t + h).altitude - m_trajectory.at(t - h).altitude) / (2.0 * h)
+    };
+}
@@ -0,0 +1,100 @@
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <utility>
+
+#include "sim/Trajectory.h"
+
+Trajectory::Trajectory(std::vector<Keyframe> keyframes) :
+    m_keyframes{ std::move(keyframes) }
+{
+    if (m_keyframes.empty())
+    {
+        throw std::runtime_error("Trajectory: no keyframes");
+    }
+    for (std::size_t i = 1; i < m_keyframes.size(); ++i)
+    {
+        if (m_keyframes[i].time <= m_keyframes[i - 1].time)
+        {
+            throw std::runtime_error("Trajectory: keyframe " + std::to_string(i) + " is not later than the previous one");
+        }
+    }
+}
+
+Trajectory Trajectory::load(const std::string& path)
+{
+    std::ifstream file(path);
+    if (!file)
+    {
+        throw std::runtime_error("Trajectory: cannot open " + path);
+    }
+
+    std::vector<Keyframe> keyframes;
+    std::string line;
+    std::size_t lineNumber = 0;
+    while (std::getline(file, line))
+    {
+        ++lineNumber;
+        if (line.empty() || line.rfind("time", 0) == 0)
+        {
+            continue;
+        }
+
+        std::istringstream row(line);
+        Keyframe keyframe{};
+        char comma = 0;
+        row >> keyframe.time
+            >> comma >> keyframe.pose.x >> comma >> keyframe.pose.y >> comma >> keyframe.pose.altitude
+            >> comma >> keyframe.pose.roll >> comma >> keyframe.pose.pitch >> comma >> keyframe.pose.yaw;
+        if (!row)
+        {
+            throw std::runtime_error("Trajectory: malformed row " + std::to_string(lineNumber) + " in " + path);
+        }
+        if (!(row >> comma >> keyframe.pose.exposure))
+        {
+            keyframe.pose.exposure = 1.0;
+        }
+        keyframes.push_back(keyframe);
+    }
+    return Trajectory(std::move(keyframes));
+}
+
+Trajectory::Pose Trajectory::at(const double t) const
+{
+    if (t <= m_keyframes.front().time)
+    {
+        return m_keyframes.front().pose;
+    }
+    if (t >= m_keyframes.back().time)
+    {
+        return m_keyframes.back().pose;
+    }
+
+    const auto next = std::upper_bound(m_keyframes.begin(), m_keyframes.end(), t,
+        [](const double time, const Keyframe& keyframe) { return time < keyframe.time; });
+    const Keyframe& a = *(next - 1);
+    const Keyframe& b = *next;
+    const double w = (t - a.time) / (b.time - a.time);
+
+    auto lerp = [w](const double from, const double to) { return from + w * (to - from); };
+    return {
+        lerp(a.pose.x, b.pose.x),
+        lerp(a.pose.y, b.pose.y),
+        lerp(a.pose.altitude, b.pose.altitude),
+        lerp(a.pose.roll, b.pose.roll),
+        lerp(a.pose.pitch, b.pose.pitch),
+        lerp(a.pose.yaw, b.pose.yaw),
+        lerp(a.pose.exposure, b.pose.exposure),
+    };
+}
+
+double Trajectory::startTime() const
+{
+    return m_keyframes.front().time;
+}
+
+double Trajectory::duration() const
+{
+    return m_keyframes.back().time - m_keyframes.front().time;
+}
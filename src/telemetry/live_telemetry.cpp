@@ -0,0 +1,202 @@
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <new>
+#include <stdexcept>
+#include <string>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "telemetry/live_telemetry.hpp"
+#include "utils.hpp"
+
+namespace telemetry {
+
+namespace {
+
+std::uint64_t steady_now_us() {
+	return static_cast<std::uint64_t>(
+			std::chrono::duration_cast<std::chrono::microseconds>(
+					std::chrono::steady_clock::now().time_since_epoch())
+					.count());
+}
+
+inline void cpu_relax() {
+#if defined(__aarch64__) || defined(__arm__)
+	asm volatile("yield");
+#elif defined(__x86_64__) || defined(__i386__)
+	__builtin_ia32_pause();
+#endif
+}
+
+} // namespace
+
+LiveTelemetryWriter::LiveTelemetryWriter(const char *name) :
+		fd_(::shm_open(name, O_RDWR | O_CREAT | O_CLOEXEC, 0644)) {
+	if (fd_ < 0) {
+		auto e = errno;
+		utils::throw_errno(e, "while trying to create telemetry segment <", name, ">");
+	}
+
+	if (::ftruncate(fd_, sizeof(Segment)) != 0) {
+		const int e = errno;
+		::close(fd_);
+		utils::throw_errno(e, "Error sizing telemetry segment with ftruncate");
+	}
+
+	void *mapping = ::mmap(nullptr, sizeof(Segment), PROT_READ | PROT_WRITE,
+												 MAP_SHARED | MAP_POPULATE, fd_, 0);
+	if (mapping == MAP_FAILED) {
+		const int e = errno;
+		::close(fd_);
+		utils::throw_errno(e, "Error mapping telemetry segment with mmap");
+	}
+
+	name_ = name;
+
+	// A segment left behind by a crashed writer is taken over: the sequence
+	// restarts from 0 and the magic is written last, so a reader opening it
+	// meanwhile rejects it instead of trusting a half-written header
+	segment_ = new (mapping) Segment{};
+	segment_->version = VERSION;
+	segment_->snapshot_size = sizeof(Snapshot);
+	segment_->writer_pid = static_cast<std::uint32_t>(::getpid());
+	segment_->start_time_us = steady_now_us();
+	std::atomic_thread_fence(std::memory_order_release);
+	std::memcpy(segment_->magic, MAGIC, sizeof(MAGIC));
+}
+
+LiveTelemetryWriter::~LiveTelemetryWriter() noexcept {
+	if (segment_ != nullptr) {
+		::munmap(segment_, sizeof(Segment));
+		segment_ = nullptr;
+		::shm_unlink(name_.c_str());
+	}
+	if (fd_ >= 0) {
+		::close(fd_);
+		fd_ = -1;
+	}
+}
+
+void LiveTelemetryWriter::publish(const Snapshot &snapshot) noexcept {
+	std::uint64_t words[SNAPSHOT_WORDS];
+	std::memcpy(words, &snapshot, sizeof(Snapshot));
+
+	const std::uint64_t sequence =
+			segment_->sequence.load(std::memory_order_relaxed);
+	segment_->sequence.store(sequence + 1, std::memory_order_relaxed);
+	// Keep the word stores below the odd counter
+	std::atomic_thread_fence(std::memory_order_release);
+
+	for (std::size_t i = 0; i < SNAPSHOT_WORDS; ++i)
+		segment_->words[i].store(words[i], std::memory_order_relaxed);
+
+	segment_->sequence.store(sequence + 2, std::memory_order_release);
+}
+
+std::uint64_t LiveTelemetryWriter::count() const noexcept {
+	return segment_->sequence.load(std::memory_order_relaxed) / 2;
+}
+
+LiveTelemetryReader::LiveTelemetryReader(const char *name) :
+		fd_(::shm_open(name, O_RDONLY | O_CLOEXEC, 0)) {
+	if (fd_ < 0) {
+		auto e = errno;
+		utils::throw_errno(e, "while trying to open telemetry segment <", name, ">");
+	}
+
+	struct stat st;
+	if (::fstat(fd_, &st) != 0) {
+		const int e = errno;
+		::close(fd_);
+		utils::throw_errno(e, "Error reading telemetry segment size with fstat");
+	}
+
+	auto fail = [&](const std::string &msg) -> void {
+		::close(fd_);
+		throw std::runtime_error("telemetry segment <" + std::string(name) + ">: " + msg);
+	};
+
+	if (static_cast<std::size_t>(st.st_size) < sizeof(Segment))
+		fail("shorter than a version " + std::to_string(VERSION) + " segment");
+
+	void *mapping = ::mmap(nullptr, sizeof(Segment), PROT_READ, MAP_SHARED, fd_, 0);
+	if (mapping == MAP_FAILED) {
+		const int e = errno;
+		::close(fd_);
+		utils::throw_errno(e, "Error mapping telemetry segment with mmap");
+	}
+	segment_ = static_cast<const Segment *>(mapping);
+
+	auto fail_mapped = [&](const std::string &msg) -> void {
+		::munmap(const_cast<Segment *>(segment_), sizeof(Segment));
+		fail(msg);
+	};
+
+	if (std::memcmp(segment_->magic, MAGIC, sizeof(MAGIC)) != 0)
+		fail_mapped("not a telemetry segment");
+	std::atomic_thread_fence(std::memory_order_acquire);
+	if (segment_->version != VERSION)
+		fail_mapped("unsupported version " + std::to_string(segment_->version));
+	if (segment_->snapshot_size != sizeof(Snapshot))
+		fail_mapped("snapshot size mismatch");
+}
+
+LiveTelemetryReader::~LiveTelemetryReader() noexcept {
+	if (segment_ != nullptr) {
+		::munmap(const_cast<Segment *>(segment_), sizeof(Segment));
+		segment_ = nullptr;
+	}
+	if (fd_ >= 0) {
+		::close(fd_);
+		fd_ = -1;
+	}
+}
+
+bool LiveTelemetryReader::read(Snapshot *out, std::uint64_t *count,
+															 unsigned max_attempts) const noexcept {
+	std::uint64_t words[SNAPSHOT_WORDS];
+
+	for (unsigned attempt = 0; attempt < max_attempts; ++attempt) {
+		const std::uint64_t before =
+				segment_->sequence.load(std::memory_order_acquire);
+		if (before == 0)
+			return false;
+		if (before & 1) {
+			cpu_relax();
+			continue;
+		}
+
+		for (std::size_t i = 0; i < SNAPSHOT_WORDS; ++i)
+			words[i] = segment_->words[i].load(std::memory_order_relaxed);
+
+		// Keep the word loads above the second counter load
+		std::atomic_thread_fence(std::memory_order_acquire);
+		if (segment_->sequence.load(std::memory_order_relaxed) != before)
+			continue;
+
+		std::memcpy(out, words, sizeof(Snapshot));
+		if (count)
+			*count = before / 2;
+		return true;
+	}
+
+	return false;
+}
+
+std::uint64_t LiveTelemetryReader::count() const noexcept {
+	return segment_->sequence.load(std::memory_order_acquire) / 2;
+}
+
+std::uint32_t LiveTelemetryReader::writer_pid() const noexcept {
+	return segment_->writer_pid;
+}
+
+std::uint64_t LiveTelemetryReader::start_time_us() const noexcept {
+	return segment_->start_time_us;
+}
+
+} // namespace telemetry
@@ -1,5 +1,6 @@
 import ctypes
 import json
+import os
 
 DRONE_MASS = 1.0
 DELTA_TIME = 0.05
@@ -12,11 +13,13 @@ DRAG_FACTOR = 0.1
 START_POSITION = [-100.0, 50.0]
 TARGET_POSITION = [0.0, 0.0]
 
+LIBRARY_PATH = os.environ.get('POSHOLD_LIB', './build/libposhold.so')
+
 try:
-    pid_lib = ctypes.CDLL('./obj/pid.so')
+    pid_lib = ctypes.CDLL(LIBRARY_PATH)
 except OSError as e:
     print(f"Error loading library: {e}")
-    print("Make sure './obj/pid.so' exists and your C++ code compiled.")
+    print(f"Make sure '{LIBRARY_PATH}' exists (build the 'poshold' target) or set POSHOLD_LIB.")
     exit()
 
 
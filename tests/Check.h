@@ -0,0 +1,36 @@
+// Minimal assertions for the test executables: a failing CHECK prints the
+// expression and where it is, keeps going, and checkResult() turns the
+// number of failures into main()'s exit code.
+
+#ifndef CHECK_H
+#define CHECK_H
+
+#include <cstdio>
+
+inline int& checkFailures()
+{
+    static int failures = 0;
+    return failures;
+}
+
+#define CHECK(condition)                                                                  \
+    do                                                                                    \
+    {                                                                                     \
+        if (!(condition))                                                                 \
+        {                                                                                 \
+            std::fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #condition); \
+            ++checkFailures();                                                            \
+        }                                                                                 \
+    } while (false)
+
+inline int checkResult()
+{
+    if (checkFailures() != 0)
+    {
+        std::fprintf(stderr, "%d check(s) failed\n", checkFailures());
+        return 1;
+    }
+    return 0;
+}
+
+#endif
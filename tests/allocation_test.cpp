@@ -0,0 +1,184 @@
+// The frame loop does not touch the heap once warm.
+//
+// A SyntheticDrone flight (forward flight with a wobble and a slow yaw, so the
+// ROI size and the tile layout change from frame to frame) is rendered up
+// front and replayed from memory, so only the live loop's own work is
+// counted: vision (VecMove, one tile and three tiles), fusion
+// (StateEstimator) and control (PidController). Every global operator new is
+// counted (this executable is built with POSHOLD_COUNT_ALLOCATIONS) and any
+// allocation after FrameAllocationCheck's warm-up fails the test.
+
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+#include <opencv2/opencv.hpp>
+
+#include "pid/pid.hpp"
+#include "posHold/AllocationCounter.h"
+#include "posHold/FramePool.h"
+#include "posHold/StateEstimator.h"
+#include "posHold/VecMove.h"
+#include "sim/SyntheticDrone.h"
+#include "sim/Trajectory.h"
+
+#include "Check.h"
+
+namespace {
+
+constexpr double s_duration = 4.0;
+constexpr int s_warmupFrames = 30;
+
+struct RecordedFrame
+{
+    cv::Mat image;
+    int skippedFrames;
+    double interval;
+    std::chrono::steady_clock::time_point timestamp;
+    // Telemetry read before the frame, as in the live loop
+    Drone::GyroData gyro;
+    Drone::AltitudeData altitude;
+};
+
+Trajectory wobblingFlight()
+{
+    std::vector<Trajectory::Keyframe> keyframes;
+    for (int i = 0; i * 0.25 <= s_duration; ++i)
+    {
+        const double t = i * 0.25;
+        const double phase = CV_PI / 2 * i;
+        keyframes.push_back({ t, { 0.5 * t, 0.1 * t, 1.0 + 0.25 * std::sin(phase), 0.05 * std::sin(phase),
+                                   0.05 * std::cos(phase), 0.2 * t, 1.0 } });
+    }
+    return Trajectory(std::move(keyframes));
+}
+
+std::vector<RecordedFrame> record()
+{
+    SyntheticDrone drone(wobblingFlight(), SyntheticDrone::Options());
+    std::vector<RecordedFrame> frames;
+    while (drone.hasNextFrame())
+    {
+        RecordedFrame frame;
+        frame.gyro = drone.getGyroData();
+        frame.altitude = drone.getAltitudeData();
+        frame.image = drone.getGrayscaleImage().clone();
+        frame.skippedFrames = drone.getSkippedFrames();
+        frame.interval = drone.getFrameInterval();
+        frame.timestamp = drone.getFrameTimestamp();
+        frames.push_back(frame);
+    }
+    return frames;
+}
+
+// Serves recorded frames without rendering; like SyntheticDrone, telemetry
+// getters describe the frame the next getGrayscaleImage() returns
+class RecordedDrone : public Drone
+{
+public:
+    explicit RecordedDrone(const std::vector<RecordedFrame>& frames) :
+        Drone(defaultCameraInfo()),
+        m_frames(&frames)
+    {
+    }
+
+    [[nodiscard]] bool hasNextFrame() const
+    {
+        return m_next < m_frames->size();
+    }
+
+    [[nodiscard]] cv::Mat getGrayscaleImage() override
+    {
+        m_last = m_next++;
+        return (*m_frames)[m_last].image;
+    }
+
+    [[nodiscard]] int getSkippedFrames() const override
+    {
+        return (*m_frames)[m_last].skippedFrames;
+    }
+
+    [[nodiscard]] double getFrameInterval() const override
+    {
+        return (*m_frames)[m_last].interval;
+    }
+
+    [[nodiscard]] std::chrono::steady_clock::time_point getFrameTimestamp() const override
+    {
+        return (*m_frames)[m_last].timestamp;
+    }
+
+    [[nodiscard]] GyroData getGyroData() override
+    {
+        return (*m_frames)[m_next].gyro;
+    }
+
+    [[nodiscard]] AltitudeData getAltitudeData() override
+    {
+        return (*m_frames)[m_next].altitude;
+    }
+
+private:
+    const std::vector<RecordedFrame>* m_frames;
+    std::size_t m_next = 0;
+    std::size_t m_last = 0;
+};
+
+void testSteadyStateFrames(const std::vector<RecordedFrame>& frames, const int flowTiles)
+{
+    RecordedDrone drone(frames);
+    VecMove vecMove(drone, flowTiles);
+    StateEstimator estimator;
+    PidController controller(1.0f, 0.1f, 0.05f, 0.5f, [&drone] { return drone.getFrameTimestamp(); });
+
+    FrameAllocationCheck allocationCheck(s_warmupFrames);
+    while (drone.hasNextFrame())
+    {
+        allocationCheck.beginFrame();
+        const Drone::GyroData attitude = drone.getGyroData();
+        const Drone::AltitudeData altitude = drone.getAltitudeData();
+
+        vecMove.calc();
+
+        estimator.predict(attitude, drone.getFrameInterval());
+        estimator.updateAltitude(altitude);
+        if (vecMove.hasVecMove() && vecMove.getFlowConfidence() > 0.0)
+        {
+            estimator.updateFlow(vecMove.getVecMove(), vecMove.getSampleInterval());
+            const cv::Point2f position = estimator.getPosition();
+            const cv::Point2f velocity = estimator.getVelocity();
+            (void)controller.calculate_raw_rc({ position.x, position.y }, { velocity.x, velocity.y }, { 0.0f, 0.0f });
+        }
+
+        const std::uint64_t allocations = allocationCheck.endFrame();
+        if (allocationCheck.getFrames() > s_warmupFrames && allocations > 0)
+        {
+            std::fprintf(stderr, "tiles=%d: frame %d allocated %llu times\n", flowTiles,
+                         allocationCheck.getFrames() - 1, static_cast<unsigned long long>(allocations));
+        }
+    }
+
+    CHECK(allocationCheck.getFrames() > 2 * s_warmupFrames);
+    CHECK(allocationCheck.passed());
+}
+
+} // namespace
+
+int main()
+{
+    CHECK(AllocationCounter::enabled());
+    if (!AllocationCounter::enabled())
+    {
+        return checkResult();
+    }
+
+    FramePool::install();
+    const std::vector<RecordedFrame> frames = record();
+
+    testSteadyStateFrames(frames, 1);
+    testSteadyStateFrames(frames, 3);
+    return checkResult();
+}
@@ -0,0 +1,228 @@
+// CascadeController on an injected clock.
+//
+// The inner loop is called every 10 ms and the outer one is due every
+// 50 ms. Between outer updates the outer lanes (velocity setpoint, integral
+// and filtered derivative) have to hold, the inner loop has to track the held
+// setpoint, both feed-forward terms have to reach the output and every
+// per-stage limit and the RC range have to clamp. Gains and inputs are powers
+// of two or quarter units, so the expected values are exact.
+
+#include <chrono>
+
+#include "pid/cascade.hpp"
+
+#include "Check.h"
+
+namespace {
+
+constexpr std::chrono::microseconds s_innerPeriod(10000);
+constexpr float s_outerPeriod = 0.05f;
+constexpr int s_innerPerOuter = 5;
+
+struct TestClock
+{
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::time_point(std::chrono::seconds(1));
+
+    utils::Clock clock()
+    {
+        return [this] { return now; };
+    }
+};
+
+bool equal(const simd::Vec2f a, const simd::Vec2f b)
+{
+    return a.x == b.x && a.y == b.y;
+}
+
+// Outer P only: the velocity setpoint follows the position error at the
+// outer steps and holds in between, while the position keeps moving; the
+// inner loop sees each new setpoint one call later
+void testOuterHoldsBetweenUpdates()
+{
+    TestClock t;
+    CascadeStageConfig outer;
+    outer.k_p = 2.0f;
+    CascadeStageConfig inner;
+    inner.k_p = 10.0f;
+    CascadeController cascade(outer, inner, s_outerPeriod, 0.0f, t.clock());
+
+    simd::Vec2f held{ 0.0f, 0.0f };
+    for (int k = 1; k <= 4 * s_innerPerOuter; ++k)
+    {
+        t.now += s_innerPeriod;
+        const simd::Vec2f position{ -0.125f * k, 0.25f * k };
+        const simd::Vec2u rc = cascade.calculate_raw_rc(position, { 0.0f, 0.0f });
+
+        // inner P on the setpoint held before this call
+        CHECK(rc.x == static_cast<unsigned>(1500.0f + 10.0f * held.x));
+        CHECK(rc.y == static_cast<unsigned>(1500.0f + 10.0f * held.y));
+
+        if (k % s_innerPerOuter == 0)
+        {
+            held = { 0.25f * k, -0.5f * k };
+        }
+        CHECK(equal(cascade.velocity_setpoint(), held));
+    }
+}
+
+// Outer I only: the integral grows by error * outer period per outer step,
+// not per call
+void testOuterIntegralHolds()
+{
+    TestClock t;
+    CascadeStageConfig outer;
+    outer.k_i = 1.0f;
+    CascadeController cascade(outer, {}, s_outerPeriod, 0.0f, t.clock());
+
+    float integral = 0.0f;
+    for (int k = 1; k <= 4 * s_innerPerOuter; ++k)
+    {
+        t.now += s_innerPeriod;
+        cascade.calculate_raw_rc({ -1.0f, 0.5f }, { 0.0f, 0.0f });
+        if (k % s_innerPerOuter == 0)
+        {
+            integral += s_outerPeriod;
+        }
+        CHECK(equal(cascade.velocity_setpoint(), { integral, -0.5f * integral }));
+    }
+}
+
+// Outer D only, k_df = 0.5: the filtered derivative approaches the measured
+// -velocity by half the remaining distance per outer step
+void testOuterDerivativeHolds()
+{
+    TestClock t;
+    CascadeStageConfig outer;
+    outer.k_d = 1.0f;
+    outer.k_df = 0.5f;
+    CascadeController cascade(outer, {}, s_outerPeriod, 0.0f, t.clock());
+
+    float filtered = 0.0f;
+    for (int k = 1; k <= 4 * s_innerPerOuter; ++k)
+    {
+        t.now += s_innerPeriod;
+        cascade.calculate_raw_rc({ 0.0f, 0.0f }, { -1.0f, 2.0f });
+        if (k % s_innerPerOuter == 0)
+        {
+            filtered += 0.5f * (1.0f - filtered);
+        }
+        CHECK(equal(cascade.velocity_setpoint(), { filtered, -2.0f * filtered }));
+    }
+}
+
+// Velocity feed-forward shifts the inner setpoint, acceleration feed-forward
+// adds k_ff * acceleration to the PWM
+void testFeedForward()
+{
+    TestClock t;
+    CascadeStageConfig inner;
+    inner.k_p = 100.0f;
+    CascadeController cascade({}, inner, s_outerPeriod, 50.0f, t.clock());
+
+    CascadeSetpoint setpoint;
+    setpoint.velocity = { 0.5f, -0.25f };
+    t.now += s_innerPeriod;
+    simd::Vec2u rc = cascade.calculate_raw_rc({ 0.0f, 0.0f }, { 0.25f, 0.0f }, setpoint);
+    CHECK(rc.x == 1525 && rc.y == 1475);
+
+    setpoint.velocity = { 0.0f, 0.0f };
+    setpoint.acceleration = { 2.0f, -1.0f };
+    t.now += s_innerPeriod;
+    rc = cascade.calculate_raw_rc({ 0.0f, 0.0f }, { 0.0f, 0.0f }, setpoint);
+    CHECK(rc.x == 1600 && rc.y == 1450);
+
+    // an explicit sample time instead of the clock
+    rc = cascade.calculate_raw_rc({ 0.0f, 0.0f }, { 0.0f, 0.0f }, setpoint, t.now + s_innerPeriod);
+    CHECK(rc.x == 1600 && rc.y == 1450);
+}
+
+// Every stage clamps to its own output and integral limits
+void testStageLimits()
+{
+    TestClock t;
+    CascadeStageConfig outer;
+    outer.k_p = 10.0f;
+    outer.output_limit = 0.75f;
+    CascadeStageConfig inner;
+    inner.k_p = 1000.0f;
+    inner.output_limit = 200.0f;
+    CascadeController cascade(outer, inner, 0.0f, 0.0f, t.clock());
+
+    // outer output saturates at +-0.75 m/s
+    t.now += s_innerPeriod;
+    cascade.calculate_raw_rc({ -5.0f, 5.0f }, { 0.0f, 0.0f });
+    CHECK(equal(cascade.velocity_setpoint(), { 0.75f, -0.75f }));
+
+    // inner error 0.75 m/s * 1000 saturates at +-200 PWM
+    t.now += s_innerPeriod;
+    simd::Vec2u rc = cascade.calculate_raw_rc({ -5.0f, 5.0f }, { 0.0f, 0.0f });
+    CHECK(rc.x == 1700 && rc.y == 1300);
+
+    // integral limits: I only, a long constant error winds up to the bound
+    CascadeStageConfig outerI;
+    outerI.k_i = 2.0f;
+    outerI.integral_limit = 0.25f;
+    CascadeStageConfig innerI;
+    innerI.k_i = 100.0f;
+    innerI.integral_limit = 0.5f;
+    CascadeController windup(outerI, innerI, 0.0f, 0.0f, t.clock());
+    for (int k = 0; k < 500; ++k)
+    {
+        t.now += s_innerPeriod;
+        rc = windup.calculate_raw_rc({ -4.0f, 4.0f }, { -8.0f, 8.0f });
+    }
+    CHECK(equal(windup.velocity_setpoint(), { 0.5f, -0.5f }));
+    CHECK(rc.x == 1550 && rc.y == 1450);
+}
+
+// An inner limit above 500 still keeps the PWM inside the RC range
+void testPwmClampedToRcRange()
+{
+    TestClock t;
+    CascadeStageConfig outer;
+    outer.k_p = 1.0f;
+    outer.output_limit = 10.0f;
+    CascadeStageConfig inner;
+    inner.k_p = 1000.0f;
+    inner.output_limit = 2000.0f;
+    CascadeController cascade(outer, inner, 0.0f, 0.0f, t.clock());
+
+    t.now += s_innerPeriod;
+    cascade.calculate_raw_rc({ -10.0f, 10.0f }, { 0.0f, 0.0f });
+    t.now += s_innerPeriod;
+    const simd::Vec2u rc = cascade.calculate_raw_rc({ -10.0f, 10.0f }, { 0.0f, 0.0f });
+    CHECK(rc.x == 2000 && rc.y == 1000);
+}
+
+// reset() restarts both periods from the injected clock
+void testResetUsesClock()
+{
+    TestClock t;
+    CascadeStageConfig outer;
+    outer.k_p = 1.0f;
+    CascadeController cascade(outer, {}, s_outerPeriod, 0.0f, t.clock());
+
+    t.now += std::chrono::seconds(3);
+    cascade.reset();
+    t.now += s_innerPeriod;
+    cascade.calculate_raw_rc({ -1.0f, -1.0f }, { 0.0f, 0.0f });
+    CHECK(equal(cascade.velocity_setpoint(), { 0.0f, 0.0f }));
+
+    t.now += s_innerPeriod * (s_innerPerOuter - 1);
+    cascade.calculate_raw_rc({ -1.0f, -1.0f }, { 0.0f, 0.0f });
+    CHECK(equal(cascade.velocity_setpoint(), { 1.0f, 1.0f }));
+}
+
+} // namespace
+
+int main()
+{
+    testOuterHoldsBetweenUpdates();
+    testOuterIntegralHolds();
+    testOuterDerivativeHolds();
+    testFeedForward();
+    testStageLimits();
+    testPwmClampedToRcRange();
+    testResetUsesClock();
+    return checkResult();
+}
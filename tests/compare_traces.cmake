@@ -0,0 +1,30 @@
+# Runs two trace executables and fails unless they print the same lines.
+#
+#   cmake -DEXPECTED=<exe> -DACTUAL=<exe> -DWORK_DIR=<dir> -P compare_traces.cmake
+#
+# Lines starting with '#' (e.g. the backend name) are not compared.
+
+foreach(side EXPECTED ACTUAL)
+  execute_process(COMMAND ${${side}}
+    OUTPUT_FILE ${WORK_DIR}/${side}.trace
+    RESULT_VARIABLE result)
+  if(NOT result EQUAL 0)
+    message(FATAL_ERROR "${${side}} exited with ${result}")
+  endif()
+  file(STRINGS ${WORK_DIR}/${side}.trace ${side}_lines REGEX "^[^#]")
+endforeach()
+
+if("${EXPECTED_lines}" STREQUAL "${ACTUAL_lines}")
+  list(LENGTH EXPECTED_lines count)
+  message(STATUS "${count} trace lines identical")
+  return()
+endif()
+
+# Show where they part; walking the lists in CMake is quadratic
+find_program(DIFF_PROGRAM diff)
+if(DIFF_PROGRAM)
+  execute_process(COMMAND ${DIFF_PROGRAM} ${WORK_DIR}/EXPECTED.trace ${WORK_DIR}/ACTUAL.trace
+    OUTPUT_VARIABLE difference)
+  string(SUBSTRING "${difference}" 0 2000 difference)
+endif()
+message(FATAL_ERROR "traces differ (${WORK_DIR}/EXPECTED.trace vs ACTUAL.trace):\n${difference}")
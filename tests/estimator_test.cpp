@@ -0,0 +1,174 @@
+// StateEstimator with measurements that arrive late.
+//
+// Two estimators see the same timed predictions (200 Hz, changing attitude)
+// and the same camera measurements (30 Hz). One applies each measurement
+// right after the prediction of its frame, the other a few predictions later
+// with the frame's sampleTime, as ControlLoop does when vision lags
+// telemetry. Once the late one has caught up, both must hold the same state.
+
+#include <chrono>
+#include <cmath>
+#include <vector>
+
+#include "posHold/StateEstimator.h"
+
+#include "Check.h"
+
+namespace {
+
+constexpr double s_dt = 0.005;
+constexpr int s_steps = 600;
+constexpr int s_frameSteps = 7;
+constexpr float s_tolerance = 1e-4f;
+
+using Clock = std::chrono::steady_clock;
+
+Clock::time_point timeOf(const int step)
+{
+    return Clock::time_point(std::chrono::microseconds(5000 * step));
+}
+
+Drone::GyroData attitudeAt(const int step)
+{
+    const double t = step * s_dt;
+    return { 0.1 * std::sin(3.0 * t), 0.08 * std::cos(2.0 * t), 0.0 };
+}
+
+// Measurement of the frame taken at step: a displacement over the frame
+// interval, or a position
+cv::Point2f measurementAt(const int step)
+{
+    const double t = step * s_dt;
+    return cv::Point2f(static_cast<float>(0.05 * std::cos(1.5 * t)), static_cast<float>(-0.04 * std::sin(t)));
+}
+
+bool near(const cv::Point2f a, const cv::Point2f b)
+{
+    return std::abs(a.x - b.x) <= s_tolerance * (1.0f + std::abs(a.x))
+        && std::abs(a.y - b.y) <= s_tolerance * (1.0f + std::abs(a.y));
+}
+
+bool sameState(const StateEstimator& a, const StateEstimator& b)
+{
+    return near(a.getPosition(), b.getPosition()) && near(a.getVelocity(), b.getVelocity())
+        && a.getAltitude() == b.getAltitude() && a.getVerticalSpeed() == b.getVerticalSpeed();
+}
+
+enum class Measurement
+{
+    Flow,
+    Position
+};
+
+void apply(StateEstimator& estimator, const Measurement kind, const int frameStep, const bool timed)
+{
+    const cv::Point2f z = measurementAt(frameStep);
+    if (kind == Measurement::Flow)
+    {
+        if (timed)
+        {
+            estimator.updateFlow(z, s_frameSteps * s_dt, timeOf(frameStep));
+        }
+        else
+        {
+            estimator.updateFlow(z, s_frameSteps * s_dt);
+        }
+        return;
+    }
+    if (timed)
+    {
+        estimator.updatePosition(z, timeOf(frameStep));
+    }
+    else
+    {
+        estimator.updatePosition(z);
+    }
+}
+
+// Each frame is applied lateSteps predictions after its own; with more than
+// a frame of lag several frames are in flight at once
+void testLateMatchesOnTime(const Measurement kind, const int lateSteps)
+{
+    StateEstimator onTime;
+    StateEstimator late;
+    std::vector<int> pending;
+    int comparisons = 0;
+    int mismatches = 0;
+
+    for (int step = 1; step <= s_steps; ++step)
+    {
+        onTime.predict(attitudeAt(step), s_dt, timeOf(step));
+        late.predict(attitudeAt(step), s_dt, timeOf(step));
+        if (step % 4 == 0)
+        {
+            // Altitude arrives live on both and must not be rewound
+            const Drone::AltitudeData altitude{ 1.0 + 0.01 * step * s_dt, 0.01 };
+            onTime.updateAltitude(altitude);
+            late.updateAltitude(altitude);
+        }
+
+        if (step % s_frameSteps == 0)
+        {
+            apply(onTime, kind, step, true);
+            pending.push_back(step);
+        }
+        if (!pending.empty() && step - pending.front() == lateSteps)
+        {
+            apply(late, kind, pending.front(), true);
+            pending.erase(pending.begin());
+            // Caught up: every frame so far is applied on both
+            if (pending.empty())
+            {
+                ++comparisons;
+                mismatches += !sameState(onTime, late);
+            }
+        }
+    }
+
+    // Frames still in flight at the end land now
+    for (const int frameStep : pending)
+    {
+        apply(late, kind, frameStep, true);
+    }
+    CHECK(sameState(onTime, late));
+
+    // Late by less than a frame, the two catch up after every frame
+    CHECK(lateSteps >= s_frameSteps || comparisons > 50);
+    CHECK(mismatches == 0);
+}
+
+// A measurement older than the recorded predictions corrects the current
+// state, like the untimed overload
+void testOlderThanHistory()
+{
+    StateEstimator timed;
+    StateEstimator untimed;
+    for (int step = 1; step <= 200; ++step)
+    {
+        timed.predict(attitudeAt(step), s_dt, timeOf(step));
+        untimed.predict(attitudeAt(step), s_dt, timeOf(step));
+    }
+
+    apply(timed, Measurement::Flow, 10, true);
+    apply(untimed, Measurement::Flow, 10, false);
+    CHECK(sameState(timed, untimed));
+
+    // and a late one still differs from applying it to the current state
+    StateEstimator late = timed;
+    StateEstimator current = timed;
+    late.updateFlow(cv::Point2f(0.2f, -0.1f), s_frameSteps * s_dt, timeOf(190));
+    current.updateFlow(cv::Point2f(0.2f, -0.1f), s_frameSteps * s_dt);
+    CHECK(!near(late.getPosition(), current.getPosition()));
+}
+
+} // namespace
+
+int main()
+{
+    testLateMatchesOnTime(Measurement::Flow, 1);
+    testLateMatchesOnTime(Measurement::Flow, 4);
+    testLateMatchesOnTime(Measurement::Flow, 20);
+    testLateMatchesOnTime(Measurement::Position, 6);
+    testOlderThanHistory();
+    return checkResult();
+}
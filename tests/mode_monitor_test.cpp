@@ -0,0 +1,216 @@
+// Msp and ModeMonitor against a flight controller that stops answering.
+//
+// The flight controller is played on the master side of a pty. A first
+// MSP_BOXIDS goes unanswered: boxIds() has to throw within the reply
+// timeout and fetch the layout on the next call. ModeMonitor then polls
+// MSP_STATUS; when the flight controller falls silent every poll has to
+// time out instead of hanging, the link has to be reported lost after three
+// failed polls, and restored, with the mode change, once it answers again.
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "msp/codec.hpp"
+#include "msp/mode_monitor.hpp"
+#include "msp/msp.hpp"
+
+#include "Check.h"
+
+namespace {
+
+// Answers MSP_BOXIDS and MSP_STATUS on the pty master while m_answering
+class FakeFlightController
+{
+public:
+    explicit FakeFlightController(const int fd) : m_fd(fd), m_thread(&FakeFlightController::run, this) {}
+
+    ~FakeFlightController()
+    {
+        m_stop = true;
+        m_thread.join();
+    }
+
+    std::atomic<bool> answering{ true };
+    std::atomic<std::uint32_t> modeFlags{ 0 };
+    std::atomic<int> requests{ 0 };
+
+private:
+    void run()
+    {
+        std::vector<std::uint8_t> rx;
+        while (!m_stop)
+        {
+            struct pollfd fd = { m_fd, POLLIN, 0 };
+            if (::poll(&fd, 1, 10) <= 0)
+            {
+                continue;
+            }
+            std::uint8_t buffer[256];
+            const ssize_t n = ::read(m_fd, buffer, sizeof(buffer));
+            if (n <= 0)
+            {
+                continue;
+            }
+            rx.insert(rx.end(), buffer, buffer + n);
+
+            while (!rx.empty())
+            {
+                msp::FrameView frame;
+                std::size_t consumed = 0;
+                const msp::DecodeStatus status = msp::decode_frame(rx.data(), rx.size(), &frame, &consumed);
+                if (status == msp::DecodeStatus::Incomplete)
+                {
+                    break;
+                }
+                if (status == msp::DecodeStatus::Ok)
+                {
+                    ++requests;
+                    if (answering)
+                    {
+                        answer(frame.command_id);
+                    }
+                }
+                rx.erase(rx.begin(), rx.begin() + static_cast<std::ptrdiff_t>(consumed > 0 ? consumed : 1));
+            }
+        }
+    }
+
+    void answer(const std::uint8_t commandId)
+    {
+        std::vector<std::uint8_t> payload;
+        if (commandId == msp::MSP_BOXIDS)
+        {
+            payload = { 0, 1, 50 }; // ARM, ANGLE, MSP OVERRIDE
+        }
+        else if (commandId == msp::MSP_STATUS)
+        {
+            payload.assign(13, 0);
+            const std::uint32_t flags = modeFlags;
+            for (int i = 0; i < 4; ++i)
+            {
+                payload[6 + i] = static_cast<std::uint8_t>(flags >> (8 * i));
+            }
+        }
+        else
+        {
+            return;
+        }
+
+        std::uint8_t frame[msp::MAX_FRAME_SIZE];
+        const std::size_t length = msp::encode_frame(msp::CommandType::Response, commandId, payload.data(),
+                                                     static_cast<std::uint8_t>(payload.size()), frame);
+        (void)!::write(m_fd, frame, length);
+    }
+
+    int m_fd;
+    std::atomic<bool> m_stop{ false };
+    std::thread m_thread;
+};
+
+template <class Predicate>
+bool waitFor(Predicate predicate, const std::chrono::milliseconds timeout)
+{
+    const auto deadline = std::chrono::steady_clock::now() + timeout;
+    while (!predicate())
+    {
+        if (std::chrono::steady_clock::now() > deadline)
+        {
+            return false;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+    return true;
+}
+
+void testLinkLoss(const char* device, const int master)
+{
+    FakeFlightController fc(master);
+    // timeout 1: replies are due within 100 ms
+    msp::Msp msp(device, msp::DEFAULT_BAUD_RATE, 1);
+
+    // A failed MSP_BOXIDS is not cached
+    fc.answering = false;
+    const auto start = std::chrono::steady_clock::now();
+    bool threw = false;
+    try
+    {
+        (void)msp.boxIds();
+    }
+    catch (const std::runtime_error&)
+    {
+        threw = true;
+    }
+    CHECK(threw);
+    CHECK(std::chrono::steady_clock::now() - start < std::chrono::seconds(1));
+
+    fc.answering = true;
+    fc.modeFlags = 1u << 0; // armed
+    CHECK(msp.boxIds().supported().has(msp::BOXMSPOVERRIDE));
+
+    std::mutex mutex;
+    std::vector<msp::ModeMonitor::LinkEvent> events;
+    int modeChanges = 0;
+    msp::ModeMonitor monitor(
+        msp,
+        [&](msp::ActiveModes, msp::ActiveModes) {
+            std::lock_guard<std::mutex> lock(mutex);
+            ++modeChanges;
+        },
+        std::chrono::milliseconds(20),
+        [&](const msp::ModeMonitor::LinkEvent event) {
+            std::lock_guard<std::mutex> lock(mutex);
+            events.push_back(event);
+        });
+    CHECK(monitor.active(msp::BOXARM));
+    CHECK(!monitor.link_lost());
+
+    // Silent flight controller: polls time out and the link is lost once
+    fc.answering = false;
+    CHECK(waitFor([&] { return monitor.link_lost(); }, std::chrono::seconds(3)));
+    CHECK(waitFor([&] { return monitor.failures() >= 5; }, std::chrono::seconds(3)));
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        CHECK(events.size() == 1 && events[0] == msp::ModeMonitor::LinkEvent::Lost);
+    }
+    CHECK(monitor.active(msp::BOXARM)); // last known modes are kept
+
+    // Back with different modes
+    fc.modeFlags = (1u << 0) | (1u << 2); // armed, MSP override
+    fc.answering = true;
+    CHECK(waitFor([&] { return !monitor.link_lost(); }, std::chrono::seconds(3)));
+    CHECK(waitFor([&] { return monitor.active(msp::BOXMSPOVERRIDE); }, std::chrono::seconds(3)));
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        CHECK(events.size() == 2 && events[1] == msp::ModeMonitor::LinkEvent::Restored);
+        CHECK(modeChanges == 1);
+    }
+}
+
+} // namespace
+
+int main()
+{
+    const int master = ::posix_openpt(O_RDWR | O_NOCTTY | O_CLOEXEC);
+    if (master < 0 || ::grantpt(master) != 0 || ::unlockpt(master) != 0)
+    {
+        std::perror("posix_openpt");
+        return 1;
+    }
+    const std::string device = ::ptsname(master);
+
+    testLinkLoss(device.c_str(), master);
+
+    ::close(master);
+    return checkResult();
+}
@@ -0,0 +1,196 @@
+// MspProxy priority on a pseudo-terminal.
+//
+// The test plays the flight controller on the master side of a pty and a
+// configurator on the proxy's UNIX socket. The client queues four requests
+// at once; while the first is on the wire the control loop calls request().
+// The next frame the flight controller sees has to be the control request,
+// ahead of the three client requests still queued, and every reply has to
+// reach whoever asked.
+
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "msp/codec.hpp"
+#include "msp/msp.hpp"
+#include "msp/msp_proxy.hpp"
+
+#include "Check.h"
+
+namespace {
+
+constexpr int s_timeoutMs = 2000;
+
+struct Frame
+{
+    msp::CommandType type = msp::CommandType::Request;
+    std::uint8_t id = 0;
+    std::vector<std::uint8_t> payload;
+};
+
+// Reads MSP frames from a file descriptor with a deadline
+class FrameReader
+{
+public:
+    explicit FrameReader(const int fd) : m_fd(fd) {}
+
+    bool next(Frame& frame, const int timeoutMs = s_timeoutMs)
+    {
+        const auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeoutMs);
+        while (true)
+        {
+            msp::FrameView view;
+            std::size_t consumed = 0;
+            const msp::DecodeStatus status = msp::decode_frame(m_rx.data(), m_rx.size(), &view, &consumed);
+            if (status == msp::DecodeStatus::Ok)
+            {
+                frame.type = view.command_type;
+                frame.id = view.command_id;
+                frame.payload.assign(view.payload, view.payload + view.size);
+                m_rx.erase(m_rx.begin(), m_rx.begin() + static_cast<std::ptrdiff_t>(consumed));
+                return true;
+            }
+            if (status == msp::DecodeStatus::BadHeader)
+            {
+                m_rx.erase(m_rx.begin());
+                continue;
+            }
+
+            const auto remaining =
+                std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now());
+            struct pollfd fd = { m_fd, POLLIN, 0 };
+            if (remaining.count() <= 0 || ::poll(&fd, 1, static_cast<int>(remaining.count())) <= 0)
+            {
+                return false;
+            }
+            std::uint8_t buffer[512];
+            const ssize_t n = ::read(m_fd, buffer, sizeof(buffer));
+            if (n <= 0)
+            {
+                return false;
+            }
+            m_rx.insert(m_rx.end(), buffer, buffer + n);
+        }
+    }
+
+private:
+    int m_fd;
+    std::vector<std::uint8_t> m_rx;
+};
+
+void writeFrame(const int fd, const msp::CommandType type, const std::uint8_t id, const std::vector<std::uint8_t>& payload)
+{
+    std::uint8_t frame[msp::MAX_FRAME_SIZE];
+    const std::size_t length =
+        msp::encode_frame(type, id, payload.data(), static_cast<std::uint8_t>(payload.size()), frame);
+    CHECK(::write(fd, frame, length) == static_cast<ssize_t>(length));
+}
+
+int connectTo(const std::string& path)
+{
+    const int fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    struct sockaddr_un address = {};
+    address.sun_family = AF_UNIX;
+    std::strncpy(address.sun_path, path.c_str(), sizeof(address.sun_path) - 1);
+    if (fd < 0 || ::connect(fd, reinterpret_cast<const struct sockaddr*>(&address), sizeof(address)) != 0)
+    {
+        return -1;
+    }
+    return fd;
+}
+
+void testControlRequestGoesFirst(const char* device, const int fc)
+{
+    msp::ProxyOptions options;
+    options.socket_path = "/tmp/poshold_msp_proxy_test." + std::to_string(::getpid()) + ".sock";
+    options.client_timeout_ms = s_timeoutMs;
+    msp::MspProxy proxy(device, msp::DEFAULT_BAUD_RATE, options);
+
+    const int client = connectTo(options.socket_path);
+    CHECK(client >= 0);
+    if (client < 0)
+    {
+        return;
+    }
+
+    // Four client requests in one write, so all of them are queued at once
+    const std::uint8_t clientIds[] = { msp::MSP_API_VERSION, msp::MSP_STATUS, msp::MSP_RC, msp::MSP_ALTITUDE };
+    std::vector<std::uint8_t> burst;
+    for (const std::uint8_t id : clientIds)
+    {
+        std::uint8_t frame[msp::MAX_FRAME_SIZE];
+        const std::size_t length = msp::encode_frame(msp::CommandType::Request, id, nullptr, 0, frame);
+        burst.insert(burst.end(), frame, frame + length);
+    }
+    CHECK(::write(client, burst.data(), burst.size()) == static_cast<ssize_t>(burst.size()));
+
+    FrameReader wire(fc);
+    Frame frame;
+    CHECK(wire.next(frame) && frame.id == msp::MSP_API_VERSION);
+
+    // The control loop asks while the first client request is in flight
+    bool controlOk = false;
+    std::uint8_t attitude[6] = {};
+    std::uint8_t attitudeSize = 0;
+    std::thread control([&] {
+        controlOk = proxy.request(msp::MSP_ATTITUDE, nullptr, 0, attitude, sizeof(attitude), &attitudeSize, s_timeoutMs);
+    });
+    // request() has no observable queued state; give it time to queue
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+
+    writeFrame(fc, msp::CommandType::Response, msp::MSP_API_VERSION, { 0, 1, 46 });
+
+    CHECK(wire.next(frame) && frame.id == msp::MSP_ATTITUDE);
+    writeFrame(fc, msp::CommandType::Response, msp::MSP_ATTITUDE, { 0x10, 0x00, 0xf0, 0xff, 0x08, 0x07 });
+    control.join();
+    CHECK(controlOk);
+    CHECK(attitudeSize == 6 && attitude[0] == 0x10 && attitude[5] == 0x07);
+
+    // The rest of the client's queue follows in order
+    for (int i = 1; i < 4; ++i)
+    {
+        CHECK(wire.next(frame) && frame.id == clientIds[i]);
+        writeFrame(fc, msp::CommandType::Response, clientIds[i], { static_cast<std::uint8_t>(i) });
+    }
+
+    // and the client gets every reply to its own requests only
+    FrameReader replies(client);
+    for (int i = 0; i < 4; ++i)
+    {
+        CHECK(replies.next(frame) && frame.type == msp::CommandType::Response && frame.id == clientIds[i]);
+    }
+
+    const msp::ProxyStats stats = proxy.stats();
+    CHECK(stats.control_transactions == 1);
+    CHECK(stats.client_transactions == 4);
+    CHECK(stats.timeouts == 0);
+    ::close(client);
+}
+
+} // namespace
+
+int main()
+{
+    const int fc = ::posix_openpt(O_RDWR | O_NOCTTY | O_CLOEXEC);
+    if (fc < 0 || ::grantpt(fc) != 0 || ::unlockpt(fc) != 0)
+    {
+        std::perror("posix_openpt");
+        return 1;
+    }
+    const std::string device = ::ptsname(fc);
+
+    testControlRequestGoesFirst(device.c_str(), fc);
+
+    ::close(fc);
+    return checkResult();
+}
@@ -0,0 +1,244 @@
+// PidController4 against four independent PidControllers.
+//
+// Every lane of PidController4 has to produce the PWM of a PidController
+// with the same gains fed that axis alone, on the same injected clock. The
+// yaw lane wraps at 360 degrees while its reference controller sees the
+// unwrapped heading; headings are multiples of a quarter degree so the
+// wrapped and unwrapped differences are exact and the outputs must match bit
+// for bit.
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <random>
+
+#include "pid/pid.hpp"
+#include "pid/pid4.hpp"
+
+#include "Check.h"
+
+namespace {
+
+constexpr int s_steps = 3000;
+
+const std::array<PidAxisConfig, PidController4::AXIS_COUNT>& axisConfigs()
+{
+    static const std::array<PidAxisConfig, PidController4::AXIS_COUNT> axes = [] {
+        std::array<PidAxisConfig, PidController4::AXIS_COUNT> a{};
+        a[PidController4::ROLL] = { 120.0f, 5.0f, 40.0f, 0.5f };
+        a[PidController4::PITCH] = { 90.0f, 12.0f, 30.0f, 0.3f };
+        a[PidController4::THROTTLE] = { 200.0f, 40.0f, 10.0f, 0.8f };
+        a[PidController4::YAW] = { 4.0f, 0.5f, 0.2f, 0.6f };
+        a[PidController4::YAW].wrap = 360.0f;
+        return a;
+    }();
+    return axes;
+}
+
+std::array<PidController, PidController4::AXIS_COUNT> referenceControllers(const utils::Clock& clock)
+{
+    std::array<PidController, PidController4::AXIS_COUNT> pids;
+    for (int i = 0; i < PidController4::AXIS_COUNT; ++i)
+    {
+        const PidAxisConfig& c = axisConfigs()[i];
+        pids[i] = PidController(c.k_p, c.k_i, c.k_d, c.k_df, clock);
+    }
+    return pids;
+}
+
+// Heading in [-180, 180) for an unwrapped one
+float wrapHeading(float heading)
+{
+    while (heading >= 180.0f)
+    {
+        heading -= 360.0f;
+    }
+    while (heading < -180.0f)
+    {
+        heading += 360.0f;
+    }
+    return heading;
+}
+
+struct Sample
+{
+    float state[4];
+    float rate[4];
+    float desired[4];
+    float unwrappedYaw;
+    float unwrappedDesiredYaw;
+};
+
+// Random flight on a quarter-degree / quarter-unit grid; the heading turns
+// through +-180 several times and the yaw setpoint is kept within 90 degrees
+class Flight
+{
+public:
+    explicit Flight(const unsigned seed) : m_rng(seed) {}
+
+    Sample next()
+    {
+        Sample s{};
+        for (int i = 0; i < 3; ++i)
+        {
+            m_position[i] += step(8);
+            s.state[i] = m_position[i];
+            s.rate[i] = step(16);
+            s.desired[i] = step(4);
+        }
+        m_yaw += 1.5f + step(8);
+        s.unwrappedYaw = m_yaw;
+        s.unwrappedDesiredYaw = m_yaw + step(360);
+        s.state[3] = wrapHeading(s.unwrappedYaw);
+        s.rate[3] = step(40);
+        s.desired[3] = wrapHeading(s.unwrappedDesiredYaw);
+        return s;
+    }
+
+private:
+    // Multiple of 0.25 in [-range / 4, range / 4]
+    float step(const int range)
+    {
+        return static_cast<int>(m_rng() % (2 * range + 1) - range) * 0.25f;
+    }
+
+    std::mt19937 m_rng;
+    float m_position[3] = { 0.0f, 0.0f, 0.0f };
+    float m_yaw = 170.0f;
+};
+
+simd::Vec4f vec4(const float* v)
+{
+    return { { v[0], v[1], v[2], v[3] } };
+}
+
+std::uint16_t channel(const msp::Channels& channels, const int axis)
+{
+    switch (axis)
+    {
+    case PidController4::ROLL:
+        return channels.roll;
+    case PidController4::PITCH:
+        return channels.pitch;
+    case PidController4::THROTTLE:
+        return channels.throttle;
+    default:
+        return channels.yaw;
+    }
+}
+
+// Reference lane i: the PidController sees axis i as x, with y held at zero
+simd::Vec2f referenceState(const Sample& s, const int axis)
+{
+    return { axis == PidController4::YAW ? s.unwrappedYaw : s.state[axis], 0.0f };
+}
+
+simd::Vec2f referenceDesired(const Sample& s, const int axis)
+{
+    return { axis == PidController4::YAW ? s.unwrappedDesiredYaw : s.desired[axis], 0.0f };
+}
+
+void testPositionDerivative()
+{
+    std::chrono::steady_clock::time_point now{};
+    const utils::Clock clock = [&now] { return now; };
+    PidController4 pid4(axisConfigs(), { 1000, 1100, 1200, 1300 }, clock);
+    std::array<PidController, PidController4::AXIS_COUNT> pids = referenceControllers(clock);
+
+    Flight flight(4);
+    std::mt19937 timing(5);
+    int mismatches = 0;
+    for (int step = 0; step < s_steps; ++step)
+    {
+        now += std::chrono::microseconds(2000 + timing() % 40000);
+        const Sample s = flight.next();
+        const msp::Channels out = pid4.calculate_raw_rc(vec4(s.state), vec4(s.desired));
+        for (int axis = 0; axis < PidController4::AXIS_COUNT; ++axis)
+        {
+            const simd::Vec2u expected = pids[axis].calculate_raw_rc(referenceState(s, axis), referenceDesired(s, axis));
+            mismatches += channel(out, axis) != expected.x;
+        }
+        CHECK(out.aux1 == 1000 && out.aux2 == 1100 && out.aux3 == 1200 && out.aux4 == 1300);
+    }
+    CHECK(mismatches == 0);
+}
+
+void testRateDerivative()
+{
+    std::chrono::steady_clock::time_point now{};
+    const utils::Clock clock = [&now] { return now; };
+    PidController4 pid4(axisConfigs(), { 1000, 1000, 1000, 1000 }, clock);
+    std::array<PidController, PidController4::AXIS_COUNT> pids = referenceControllers(clock);
+
+    Flight flight(6);
+    int mismatches = 0;
+    for (int step = 0; step < s_steps; ++step)
+    {
+        // sample times run ahead of the clock, as with Drone::getFrameTimestamp()
+        now += std::chrono::microseconds(5000);
+        const std::chrono::steady_clock::time_point sampleTime = now + std::chrono::microseconds(step % 7 * 100);
+        const Sample s = flight.next();
+        const msp::Channels out = pid4.calculate_raw_rc(vec4(s.state), vec4(s.rate), vec4(s.desired), sampleTime);
+        for (int axis = 0; axis < PidController4::AXIS_COUNT; ++axis)
+        {
+            const simd::Vec2u expected = pids[axis].calculate_raw_rc(referenceState(s, axis), { s.rate[axis], 0.0f },
+                                                                     referenceDesired(s, axis), sampleTime);
+            mismatches += channel(out, axis) != expected.x;
+        }
+    }
+    CHECK(mismatches == 0);
+}
+
+// The short way around: 170 -> -170 is +20 degrees, not -340
+void testYawWrap()
+{
+    std::chrono::steady_clock::time_point now{};
+    std::array<PidAxisConfig, PidController4::AXIS_COUNT> axes{};
+    axes[PidController4::YAW] = { 10.0f, 0.0f, 0.0f, 0.0f };
+    axes[PidController4::YAW].wrap = 360.0f;
+    PidController4 pid4(axes, { 1000, 1000, 1000, 1000 }, [&now] { return now; });
+
+    now += std::chrono::milliseconds(10);
+    CHECK(pid4.calculate_raw_rc({ { 0.0f, 0.0f, 0.0f, 170.0f } }, { { 0.0f, 0.0f, 0.0f, -170.0f } }).yaw == 1700);
+    now += std::chrono::milliseconds(10);
+    CHECK(pid4.calculate_raw_rc({ { 0.0f, 0.0f, 0.0f, -170.0f } }, { { 0.0f, 0.0f, 0.0f, 170.0f } }).yaw == 1300);
+}
+
+// reset() restarts dt from the injected clock, like a new controller
+void testResetUsesClock()
+{
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::time_point(std::chrono::seconds(100));
+    const utils::Clock clock = [&now] { return now; };
+    PidController4 used(axisConfigs(), { 1000, 1000, 1000, 1000 }, clock);
+
+    Flight flight(7);
+    for (int step = 0; step < 50; ++step)
+    {
+        now += std::chrono::milliseconds(20);
+        const Sample s = flight.next();
+        used.calculate_raw_rc(vec4(s.state), vec4(s.desired));
+    }
+
+    now += std::chrono::milliseconds(500);
+    used.reset();
+    PidController4 fresh(axisConfigs(), { 1000, 1000, 1000, 1000 }, clock);
+
+    now += std::chrono::milliseconds(20);
+    const simd::Vec4f state{ { 0.5f, -0.25f, 1.0f, 20.0f } };
+    const simd::Vec4f rate{ { 0.25f, 0.5f, -0.25f, 3.0f } };
+    const simd::Vec4f desired{ { 0.0f, 0.0f, 1.5f, 0.0f } };
+    const msp::Channels a = used.calculate_raw_rc(state, rate, desired);
+    const msp::Channels b = fresh.calculate_raw_rc(state, rate, desired);
+    CHECK(a.roll == b.roll && a.pitch == b.pitch && a.throttle == b.throttle && a.yaw == b.yaw);
+}
+
+} // namespace
+
+int main()
+{
+    testPositionDerivative();
+    testRateDerivative();
+    testYawWrap();
+    testResetUsesClock();
+    return checkResult();
+}
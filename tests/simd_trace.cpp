@@ -0,0 +1,248 @@
+// Bit-exactness trace of the simd.hpp backends.
+//
+// Runs fixed edge cases and seeded random vectors through every simd
+// operation and through the controllers built on them, and prints each
+// result as raw hex words. CMake builds this file twice, once for the native
+// backend (NEON on ARM, SSE2 on x86) and once with POSHOLD_SIMD_SCALAR, and
+// compare_traces.cmake fails the test when the traces differ.
+//
+// Inputs are finite and normal; min()/max() are also fed signed zeros, where
+// the backends must agree on which operand is returned.
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <vector>
+
+#include "pid/pid.hpp"
+#include "pid/pid4.hpp"
+#include "pid/simd.hpp"
+
+namespace {
+
+constexpr int s_randomCases = 2000;
+
+std::uint32_t bits(const float value)
+{
+    std::uint32_t word;
+    std::memcpy(&word, &value, sizeof(word));
+    return word;
+}
+
+void print(const char* name, const simd::Vec2f v)
+{
+    std::printf("%s %08x %08x\n", name, bits(v.x), bits(v.y));
+}
+
+void print(const char* name, const simd::Vec2u v)
+{
+    std::printf("%s %08x %08x\n", name, v.x, v.y);
+}
+
+void print(const char* name, const simd::Vec4f v)
+{
+    std::printf("%s %08x %08x %08x %08x\n", name, bits(v.v[0]), bits(v.v[1]), bits(v.v[2]), bits(v.v[3]));
+}
+
+void print(const char* name, const simd::Vec4u v)
+{
+    std::printf("%s %08x %08x %08x %08x\n", name, v.v[0], v.v[1], v.v[2], v.v[3]);
+}
+
+// Values every backend has to get exactly right: signed zeros, PWM-range
+// numbers, the to_u32() saturation and sign boundaries
+const std::vector<float>& edgeCases()
+{
+    static const std::vector<float> values = {
+        0.0f, -0.0f, 1.0f, -1.0f, 0.5f, -0.5f, 1500.0f, 1500.5f, -1500.0f, 499.99997f, 500.0f, 2000.0f,
+        1e-30f, -1e-30f, 3.4e38f, -3.4e38f, 2147483520.0f, 2147483648.0f, 4294967040.0f, 4294967296.0f,
+        8589934592.0f, -2147483648.0f
+    };
+    return values;
+}
+
+// Random normal float with a power-of-two magnitude between 2^-10 and 2^33,
+// i.e. from well below a PWM step to beyond the uint32 range
+float randomFloat(std::mt19937& rng)
+{
+    const std::uint32_t mantissa = rng() >> 9;
+    const std::uint32_t exponent = 127 - 10 + rng() % 44;
+    const std::uint32_t sign = rng() & 0x80000000u;
+    const std::uint32_t word = sign | (exponent << 23) | mantissa;
+    float value;
+    std::memcpy(&value, &word, sizeof(value));
+    return value;
+}
+
+std::uint32_t randomU32(std::mt19937& rng)
+{
+    return static_cast<std::uint32_t>(rng());
+}
+
+void traceOps2(const float a0, const float a1, const float b0, const float b1, const float s, const std::uint32_t ua,
+               const std::uint32_t ub)
+{
+    const simd::f32x2 a = simd::load(simd::Vec2f{ a0, a1 });
+    const simd::f32x2 b = simd::load(simd::Vec2f{ b0, b1 });
+    const simd::u32x2 ua2 = simd::dup_u32(ua);
+    const simd::u32x2 ub2 = simd::dup_u32(ub);
+
+    print("load2", simd::store(a));
+    print("dup2", simd::store(simd::dup(s)));
+    print("add2", simd::store(simd::add(a, b)));
+    print("sub2", simd::store(simd::sub(a, b)));
+    print("mul_n2", simd::store(simd::mul_n(a, s)));
+    print("mla_n2", simd::store(simd::mla_n(a, b, s)));
+    print("neg2", simd::store(simd::neg(a)));
+    print("min2", simd::store(simd::min(a, b)));
+    print("max2", simd::store(simd::max(a, b)));
+    print("to_u32_2", simd::store(simd::to_u32(a)));
+    print("dup_u32_2", simd::store(ub2));
+    print("min_u32_2", simd::store(simd::min_u32(ua2, ub2)));
+    print("max_u32_2", simd::store(simd::max_u32(ua2, ub2)));
+}
+
+void traceOps4(const simd::Vec4f& av, const simd::Vec4f& bv, const simd::Vec4f& cv, const simd::Vec4f& dv,
+               const float s)
+{
+    const simd::f32x4 a = simd::load(av);
+    const simd::f32x4 b = simd::load(bv);
+    const simd::f32x4 c = simd::load(cv);
+    const simd::f32x4 d = simd::load(dv);
+
+    print("load4", simd::store(a));
+    print("dup4", simd::store(simd::dup4(s)));
+    print("add4", simd::store(simd::add(a, b)));
+    print("sub4", simd::store(simd::sub(a, b)));
+    print("mul4", simd::store(simd::mul(a, b)));
+    print("mul_n4", simd::store(simd::mul_n(a, s)));
+    print("mla4", simd::store(simd::mla(a, b, c)));
+    print("mla_n4", simd::store(simd::mla_n(a, b, s)));
+    print("neg4", simd::store(simd::neg(a)));
+    print("min4", simd::store(simd::min(a, b)));
+    print("max4", simd::store(simd::max(a, b)));
+    print("select_gt4", simd::store(simd::select_gt(a, b, c)));
+    print("blend_gt4", simd::store(simd::blend_gt(a, b, c, d)));
+    print("to_u32_4", simd::store(simd::to_u32(a)));
+}
+
+void traceOps()
+{
+    const std::vector<float>& edges = edgeCases();
+    const std::size_t n = edges.size();
+
+    // every ordered pair of edge cases, including a == b
+    for (std::size_t i = 0; i < n; ++i)
+    {
+        for (std::size_t j = 0; j < n; ++j)
+        {
+            const float a = edges[i];
+            const float b = edges[j];
+            traceOps2(a, b, b, a, edges[(i + j) % n], bits(a), bits(b));
+            traceOps4({ { a, b, -a, -b } }, { { b, a, b, -a } }, { { edges[(i + 1) % n], a, b, 1.0f } },
+                      { { -b, edges[(j + 1) % n], a, 0.0f } }, b);
+        }
+    }
+
+    std::mt19937 rng(31);
+    for (int i = 0; i < s_randomCases; ++i)
+    {
+        const float a0 = randomFloat(rng);
+        const float a1 = randomFloat(rng);
+        const float b0 = randomFloat(rng);
+        const float b1 = randomFloat(rng);
+        const float s = randomFloat(rng);
+        traceOps2(a0, a1, b0, b1, s, randomU32(rng), randomU32(rng));
+
+        simd::Vec4f v[4];
+        for (simd::Vec4f& vec : v)
+        {
+            for (float& lane : vec.v)
+            {
+                lane = randomFloat(rng);
+            }
+        }
+        // make the comparisons of select_gt/blend_gt meet equal lanes too
+        v[1].v[i % 4] = v[0].v[i % 4];
+        traceOps4(v[0], v[1], v[2], v[3], randomFloat(rng));
+    }
+}
+
+// PidController on a random walk, through both the clock-driven position
+// overload and the sample-time velocity overload
+void tracePid()
+{
+    std::mt19937 rng(32);
+
+    std::chrono::steady_clock::time_point now{};
+    PidController position(120.0f, 5.0f, 40.0f, 0.5f, [&now] { return now; });
+    PidController velocity(80.0f, 30.0f, 25.0f, 0.3f, [&now] { return now; });
+
+    simd::Vec2f state{ 0.0f, 0.0f };
+    for (int i = 0; i < s_randomCases; ++i)
+    {
+        now += std::chrono::microseconds(1000 + rng() % 39000);
+        const simd::Vec2f rate{ (static_cast<int>(rng() % 4001) - 2000) / 1000.0f,
+                                (static_cast<int>(rng() % 4001) - 2000) / 1000.0f };
+        state.x += rate.x * 0.01f;
+        state.y += rate.y * 0.01f;
+        const simd::Vec2f desired{ (rng() % 5) * 0.25f, (rng() % 5) * -0.25f };
+
+        print("pid_position", position.calculate_raw_rc(state, desired));
+        const PidController::Terms terms = position.last_terms();
+        print("pid_position_p", terms.p);
+        print("pid_position_i", terms.i);
+        print("pid_position_d", terms.d);
+
+        print("pid_velocity", velocity.calculate_raw_rc(state, rate, desired, now));
+        print("pid_velocity_i", velocity.last_terms().i);
+        print("pid_velocity_d", velocity.last_terms().d);
+    }
+}
+
+// PidController4 with a wrapped yaw lane on the same kind of random walk
+void tracePid4()
+{
+    std::mt19937 rng(33);
+
+    std::chrono::steady_clock::time_point now{};
+    std::array<PidAxisConfig, PidController4::AXIS_COUNT> axes{};
+    axes[PidController4::ROLL] = { 120.0f, 5.0f, 40.0f, 0.5f };
+    axes[PidController4::PITCH] = { 90.0f, 12.0f, 30.0f, 0.3f };
+    axes[PidController4::THROTTLE] = { 200.0f, 40.0f, 10.0f, 0.8f };
+    axes[PidController4::YAW] = { 4.0f, 0.5f, 0.2f, 0.6f };
+    axes[PidController4::YAW].wrap = 360.0f;
+    PidController4 pid(axes, { 1000, 1000, 1000, 1000 }, [&now] { return now; });
+
+    simd::Vec4f state{ { 0.0f, 0.0f, 1.0f, 0.0f } };
+    for (int i = 0; i < s_randomCases; ++i)
+    {
+        now += std::chrono::microseconds(1000 + rng() % 39000);
+        simd::Vec4f rate;
+        for (int lane = 0; lane < 4; ++lane)
+        {
+            rate.v[lane] = (static_cast<int>(rng() % 4001) - 2000) / 1000.0f;
+            state.v[lane] += rate.v[lane] * 0.01f;
+        }
+        state.v[3] = state.v[3] > 180.0f ? state.v[3] - 360.0f : state.v[3];
+        const simd::Vec4f desired{ { 0.0f, 0.0f, 1.5f, (static_cast<int>(rng() % 361) - 180) * 1.0f } };
+
+        const msp::Channels rc = i % 2 ? pid.calculate_raw_rc(state, desired)
+                                       : pid.calculate_raw_rc(state, rate, desired);
+        print("pid4", simd::Vec4u{ { rc.roll, rc.pitch, rc.throttle, rc.yaw } });
+    }
+}
+
+} // namespace
+
+int main()
+{
+    std::printf("# simd backend %s\n", simd::BACKEND_NAME);
+    traceOps();
+    tracePid();
+    tracePid4();
+    return 0;
+}
@@ -0,0 +1,611 @@
+// Benchmarks of the vision and control kernels on deterministic synthetic
+// input.
+//
+// Every benchmark reports ns/op, ops/s (frames/s for the per-frame kernels),
+// heap allocations per op (counted by the operator new replacement below) and,
+// where perf_event_open is permitted, cycles, instructions and cache misses per
+// op. --format json|csv gives machine-readable output for regression checks.
+// Images come from FramePool as in flight; --system-allocator measures them
+// on the heap instead.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <new>
+#include <string>
+#include <vector>
+
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <opencv2/opencv.hpp>
+
+#include "msp/codec.hpp"
+#include "msp/msp.hpp"
+#include "pid/cascade.hpp"
+#include "pid/pid.hpp"
+#include "posHold/AllocationCounter.h"
+#include "posHold/CameraOpticalFlow.h"
+#include "posHold/CameraProfile.h"
+#include "posHold/Drone.h"
+#include "posHold/FramePool.h"
+#include "posHold/VecDown.h"
+#include "posHold/VecMove.h"
+
+namespace {
+
+#ifdef POSHOLD_COUNT_ALLOCATIONS
+
+// poshold_core already replaces operator new (see AllocationCounter.h)
+std::uint64_t allocationCount()
+{
+    return AllocationCounter::count();
+}
+
+} // namespace
+
+#else
+
+std::atomic<std::uint64_t> allocations{ 0 };
+
+std::uint64_t allocationCount()
+{
+    return allocations.load(std::memory_order_relaxed);
+}
+
+} // namespace
+
+// Counts every heap allocation of the process
+void* operator new(std::size_t size)
+{
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void* p = std::malloc(size == 0 ? 1 : size))
+    {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept
+{
+    std::free(p);
+}
+
+#endif
+
+namespace {
+
+// Hardware counters of the calling thread; every counter the kernel refuses
+// (no PMU in a VM, perf_event_paranoid) simply reads as unavailable
+class PerfCounters
+{
+public:
+    enum Counter
+    {
+        CYCLES,
+        INSTRUCTIONS,
+        CACHE_MISSES,
+        COUNTER_COUNT
+    };
+
+    PerfCounters()
+    {
+        static constexpr std::uint64_t configs[COUNTER_COUNT] = {
+            PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS, PERF_COUNT_HW_CACHE_MISSES
+        };
+        for (int i = 0; i < COUNTER_COUNT; ++i)
+        {
+            perf_event_attr attr{};
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.size = sizeof(attr);
+            attr.config = configs[i];
+            attr.disabled = 1;
+            attr.exclude_kernel = 1;
+            attr.exclude_hv = 1;
+            m_fds[i] = static_cast<int>(::syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+        }
+    }
+
+    ~PerfCounters()
+    {
+        for (const int fd : m_fds)
+        {
+            if (fd >= 0)
+            {
+                ::close(fd);
+            }
+        }
+    }
+
+    PerfCounters(const PerfCounters&) = delete;
+    PerfCounters& operator=(const PerfCounters&) = delete;
+
+    void start()
+    {
+        for (const int fd : m_fds)
+        {
+            if (fd >= 0)
+            {
+                ::ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+                ::ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+            }
+        }
+    }
+
+    // Counts since start(), -1 where unavailable
+    void stop(long long (&counts)[COUNTER_COUNT])
+    {
+        for (int i = 0; i < COUNTER_COUNT; ++i)
+        {
+            counts[i] = -1;
+            if (m_fds[i] < 0)
+            {
+                continue;
+            }
+            ::ioctl(m_fds[i], PERF_EVENT_IOC_DISABLE, 0);
+            long long value = 0;
+            if (::read(m_fds[i], &value, sizeof(value)) == sizeof(value))
+            {
+                counts[i] = value;
+            }
+        }
+    }
+
+private:
+    int m_fds[COUNTER_COUNT];
+};
+
+// Drone serving a fixed ring of textured frames that drift a few pixels per
+// frame, with constant telemetry
+class BenchDrone final : public Drone
+{
+public:
+    static constexpr int s_frameCount = 8;
+
+    explicit BenchDrone(const double altitude) :
+        Drone(defaultCameraInfo()),
+        m_altitude{ altitude }
+    {
+        cv::RNG rng(0x5eed);
+        cv::Mat texture(cameraInfo.resolutionY + 4 * s_frameCount, cameraInfo.resolutionX + 4 * s_frameCount, CV_8UC1);
+        rng.fill(texture, cv::RNG::UNIFORM, 0, 256);
+        cv::GaussianBlur(texture, texture, cv::Size(0, 0), 2.0);
+
+        for (int i = 0; i < s_frameCount; ++i)
+        {
+            const cv::Rect window(3 * i, 2 * i, cameraInfo.resolutionX, cameraInfo.resolutionY);
+            m_frames.push_back(texture(window).clone());
+        }
+    }
+
+    [[nodiscard]] cv::Mat getGrayscaleImage() override
+    {
+        m_timestamp += std::chrono::microseconds(33333);
+        return m_frames[m_next++ % s_frameCount];
+    }
+
+    [[nodiscard]] int getSkippedFrames() const override
+    {
+        return 0;
+    }
+
+    [[nodiscard]] double getFrameInterval() const override
+    {
+        return 1.0 / 30.0;
+    }
+
+    [[nodiscard]] std::chrono::steady_clock::time_point getFrameTimestamp() const override
+    {
+        return m_timestamp;
+    }
+
+    [[nodiscard]] GyroData getGyroData() override
+    {
+        return { 0.02, -0.03, 0.1 };
+    }
+
+    [[nodiscard]] AltitudeData getAltitudeData() override
+    {
+        return { m_altitude, 0.0 };
+    }
+
+private:
+    std::vector<cv::Mat> m_frames;
+    std::size_t m_next = 0;
+    double m_altitude;
+    std::chrono::steady_clock::time_point m_timestamp;
+};
+
+struct Result
+{
+    std::string name;
+    std::uint64_t iterations;
+    double nsPerOp;
+    double opsPerSecond;
+    double allocationsPerOp;
+    double cyclesPerOp;
+    double instructionsPerOp;
+    double cacheMissesPerOp;
+};
+
+struct Benchmark
+{
+    std::string name;
+    // Builds the state once and returns the operation to time
+    std::function<std::function<void()>()> setup;
+};
+
+Result measure(const Benchmark& benchmark, const double minSeconds, PerfCounters& counters)
+{
+    const std::function<void()> op = benchmark.setup();
+
+    // Warm caches, lazily allocated buffers and the branch predictors
+    for (int i = 0; i < 3; ++i)
+    {
+        op();
+    }
+
+    std::uint64_t iterations = 1;
+    for (;;)
+    {
+        const std::uint64_t allocationsBefore = allocationCount();
+        counters.start();
+        const auto start = std::chrono::steady_clock::now();
+        for (std::uint64_t i = 0; i < iterations; ++i)
+        {
+            op();
+        }
+        const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        long long counts[PerfCounters::COUNTER_COUNT];
+        counters.stop(counts);
+        const std::uint64_t allocated = allocationCount() - allocationsBefore;
+
+        if (seconds >= minSeconds || iterations >= (1ull << 40))
+        {
+            const double n = static_cast<double>(iterations);
+            auto perOp = [n](const long long count) { return count < 0 ? -1.0 : count / n; };
+            return {
+                benchmark.name,
+                iterations,
+                seconds * 1e9 / n,
+                n / seconds,
+                allocated / n,
+                perOp(counts[PerfCounters::CYCLES]),
+                perOp(counts[PerfCounters::INSTRUCTIONS]),
+                perOp(counts[PerfCounters::CACHE_MISSES]),
+            };
+        }
+
+        // Aim a little past minSeconds with the next attempt
+        const double scale = seconds > 0.0 ? 1.4 * minSeconds / seconds : 100.0;
+        iterations = std::max(iterations + 1, static_cast<std::uint64_t>(iterations * std::min(scale, 100.0)));
+    }
+}
+
+template <class T>
+void doNotOptimize(const T& value)
+{
+    asm volatile("" : : "g"(&value) : "memory");
+}
+
+std::vector<Benchmark> benchmarks()
+{
+    std::vector<Benchmark> list;
+
+    list.push_back({ "drone/bgr2gray", []
+    {
+        // The conversion getGrayscaleImage() applies to every captured frame
+        const Drone::CameraInfo cameraInfo = Drone::defaultCameraInfo();
+        auto frame = std::make_shared<cv::Mat>(cameraInfo.resolutionY, cameraInfo.resolutionX, CV_8UC3);
+        cv::RNG(1).fill(*frame, cv::RNG::UNIFORM, 0, 256);
+        auto gray = std::make_shared<cv::Mat>();
+        return std::function<void()>([frame, gray] { cv::cvtColor(*frame, *gray, cv::COLOR_BGR2GRAY); });
+    } });
+
+    for (const double altitude : { 1.0, 4.0 })
+    {
+        for (const int len : { 10, 20, 40, 80 })
+        {
+            char name[64];
+            std::snprintf(name, sizeof(name), "flow/calc/len=%d/alt=%.0f", len, altitude);
+            list.push_back({ name, [len, altitude]
+            {
+                auto drone = std::make_shared<BenchDrone>(altitude);
+                auto flow = std::make_shared<CameraOpticalFlow>(*drone, 80);
+                const int x = drone->cameraInfo.resolutionX / 2;
+                const int y = drone->cameraInfo.resolutionY / 2;
+                return std::function<void()>([drone, flow, x, y, len, altitude] { flow->calc(x, y, len, altitude); });
+            } });
+        }
+    }
+
+    for (const int tiles : { 1, 5 })
+    {
+        // Wall time of the flow stage with tiles on as many threads
+        char name[64];
+        std::snprintf(name, sizeof(name), "flow/tiles=%d/len=40/alt=1", tiles);
+        list.push_back({ name, [tiles]
+        {
+            auto drone = std::make_shared<BenchDrone>(1.0);
+            auto flow = std::make_shared<CameraOpticalFlow>(*drone, 80, tiles);
+            const int x = drone->cameraInfo.resolutionX / 2;
+            const int y = drone->cameraInfo.resolutionY / 2;
+            return std::function<void()>([drone, flow, x, y]
+            {
+                flow->calc(x, y, 40, 1.0);
+                doNotOptimize(flow->getFusedFlow());
+            });
+        } });
+    }
+
+    for (const double altitude : { 1.0, 4.0 })
+    {
+        char name[64];
+        std::snprintf(name, sizeof(name), "vecmove/calc/alt=%.0f", altitude);
+        list.push_back({ name, [altitude]
+        {
+            auto drone = std::make_shared<BenchDrone>(altitude);
+            auto vecMove = std::make_shared<VecMove>(*drone, 1);
+            return std::function<void()>([drone, vecMove]
+            {
+                vecMove->calc();
+                doNotOptimize(vecMove->getVecMove());
+            });
+        } });
+    }
+
+    for (const int radius : { 5, 20, 80 })
+    {
+        char name[64];
+        std::snprintf(name, sizeof(name), "vecmove/disc_mean/r=%d", radius);
+        list.push_back({ name, [radius]
+        {
+            const Drone::CameraInfo cameraInfo = Drone::defaultCameraInfo();
+            auto flow = std::make_shared<cv::Mat>(cameraInfo.resolutionY, cameraInfo.resolutionX, CV_32FC2);
+            cv::RNG(2).fill(*flow, cv::RNG::UNIFORM, -4.0, 4.0);
+            const cv::Point centre(cameraInfo.resolutionX / 2, cameraInfo.resolutionY / 2);
+            return std::function<void()>([flow, centre, radius]
+            {
+                doNotOptimize(CameraKernels::discMeanFlow(*flow, centre, radius));
+            });
+        } });
+    }
+
+    list.push_back({ "vecdown/calc", []
+    {
+        auto drone = std::make_shared<BenchDrone>(1.0);
+        auto vecDown = std::make_shared<VecDown>(*drone);
+        return std::function<void()>([drone, vecDown]
+        {
+            vecDown->calc();
+            doNotOptimize(vecDown->getVecDown());
+        });
+    } });
+
+    list.push_back({ "pid/calculate_raw_rc/position", []
+    {
+        auto now = std::make_shared<std::chrono::steady_clock::time_point>();
+        auto pid = std::make_shared<PidController>(120.0f, 5.0f, 40.0f, 0.5f, [now] { return *now; });
+        return std::function<void()>([now, pid]
+        {
+            *now += std::chrono::microseconds(10000);
+            doNotOptimize(pid->calculate_raw_rc({ 0.3f, -0.2f }, { 0.0f, 0.0f }));
+        });
+    } });
+
+    list.push_back({ "pid/calculate_raw_rc/velocity", []
+    {
+        auto now = std::make_shared<std::chrono::steady_clock::time_point>();
+        auto pid = std::make_shared<PidController>(120.0f, 5.0f, 40.0f, 0.5f);
+        return std::function<void()>([now, pid]
+        {
+            *now += std::chrono::microseconds(10000);
+            doNotOptimize(pid->calculate_raw_rc({ 0.3f, -0.2f }, { 0.1f, 0.05f }, { 0.0f, 0.0f }, *now));
+        });
+    } });
+
+    // Both stages in one 4-lane pass; compare with pid/calculate_raw_rc/velocity
+    for (const int innerPerOuter : { 1, 4 })
+    {
+        char name[64];
+        std::snprintf(name, sizeof(name), "pid/cascade/inner_per_outer=%d", innerPerOuter);
+        list.push_back({ name, [innerPerOuter]
+        {
+            auto now = std::make_shared<std::chrono::steady_clock::time_point>();
+            const CascadeStageConfig position{ 1.5f, 0.2f, 0.0f, 0.0f, 2.0f, 1.0f };
+            const CascadeStageConfig velocity{ 120.0f, 5.0f, 40.0f, 0.5f, 100.0f, 500.0f };
+            auto cascade = std::make_shared<CascadeController>(position, velocity, 0.01f * innerPerOuter - 0.001f,
+                                                               10.0f, [now] { return *now; });
+            // a varying velocity keeps the inner D filter out of denormals
+            auto step = std::make_shared<unsigned>(0);
+            return std::function<void()>([now, cascade, step]
+            {
+                *now += std::chrono::microseconds(10000);
+                const float v = 0.01f * static_cast<float>(++*step % 8);
+                doNotOptimize(cascade->calculate_raw_rc({ 0.3f, -0.2f }, { v, 0.05f - v }));
+            });
+        } });
+    }
+
+    list.push_back({ "msp/encode/set_raw_rc", []
+    {
+        auto frame = std::make_shared<std::vector<std::uint8_t>>(msp::MAX_FRAME_SIZE);
+        return std::function<void()>([frame]
+        {
+            std::uint8_t payload[msp::SET_RAW_RC_PAYLOAD_SIZE];
+            msp::encode_set_raw_rc({ 1500, 1480, 1000, 1500, 1000, 1000, 1000, 1000 }, payload);
+            doNotOptimize(msp::encode_frame(msp::CommandType::Request, msp::MSP_SET_RAW_RC, payload,
+                                            sizeof(payload), frame->data()));
+        });
+    } });
+
+    list.push_back({ "msp/decode/attitude", []
+    {
+        const std::uint8_t payload[6] = { 0x10, 0x00, 0xf0, 0xff, 0x08, 0x07 };
+        auto frame = std::make_shared<std::vector<std::uint8_t>>(msp::MAX_FRAME_SIZE);
+        frame->resize(msp::encode_frame(msp::CommandType::Response, msp::MSP_ATTITUDE, payload, sizeof(payload),
+                                        frame->data()));
+        return std::function<void()>([frame]
+        {
+            msp::FrameView view{};
+            std::size_t consumed = 0;
+            msp::decode_frame(frame->data(), frame->size(), &view, &consumed);
+            const msp::AttitudeData attitude(view.size, const_cast<std::uint8_t*>(view.payload));
+            doNotOptimize(attitude.roll_tenths);
+        });
+    } });
+
+    return list;
+}
+
+// Hardware counter per op, or missing when the counter was unavailable
+std::string formatCounter(const double value, const char* format, const char* missing)
+{
+    if (value < 0.0)
+    {
+        return missing;
+    }
+    char text[32];
+    std::snprintf(text, sizeof(text), format, value);
+    return text;
+}
+
+void printText(const std::vector<Result>& results)
+{
+    std::printf("%-32s %12s %14s %10s %12s %12s %12s\n",
+                "benchmark", "ns/op", "ops/s", "allocs/op", "cycles/op", "instr/op", "misses/op");
+    auto counter = [](const double value) { return formatCounter(value, "%.1f", "n/a"); };
+    for (const Result& r : results)
+    {
+        std::printf("%-32s %12.1f %14.1f %10.2f %12s %12s %12s\n",
+                    r.name.c_str(), r.nsPerOp, r.opsPerSecond, r.allocationsPerOp,
+                    counter(r.cyclesPerOp).c_str(), counter(r.instructionsPerOp).c_str(),
+                    counter(r.cacheMissesPerOp).c_str());
+    }
+}
+
+void printCsv(const std::vector<Result>& results)
+{
+    std::printf("benchmark,iterations,ns_per_op,ops_per_s,allocs_per_op,cycles_per_op,instructions_per_op,"
+                "cache_misses_per_op\n");
+    for (const Result& r : results)
+    {
+        std::printf("%s,%llu,%.9g,%.9g,%.9g,%.9g,%.9g,%.9g\n",
+                    r.name.c_str(), static_cast<unsigned long long>(r.iterations), r.nsPerOp, r.opsPerSecond,
+                    r.allocationsPerOp, r.cyclesPerOp, r.instructionsPerOp, r.cacheMissesPerOp);
+    }
+}
+
+void printJson(const std::vector<Result>& results)
+{
+    // Unavailable hardware counters are null
+    auto counter = [](const double value) { return formatCounter(value, "%.9g", "null"); };
+    std::printf("[\n");
+    for (std::size_t i = 0; i < results.size(); ++i)
+    {
+        const Result& r = results[i];
+        std::printf("  {\"benchmark\": \"%s\", \"iterations\": %llu, \"ns_per_op\": %.9g, \"ops_per_s\": %.9g, "
+                    "\"allocs_per_op\": %.9g, \"cycles_per_op\": %s, \"instructions_per_op\": %s, "
+                    "\"cache_misses_per_op\": %s}%s\n",
+                    r.name.c_str(), static_cast<unsigned long long>(r.iterations), r.nsPerOp, r.opsPerSecond,
+                    r.allocationsPerOp, counter(r.cyclesPerOp).c_str(), counter(r.instructionsPerOp).c_str(),
+                    counter(r.cacheMissesPerOp).c_str(), i + 1 < results.size() ? "," : "");
+    }
+    std::printf("]\n");
+}
+
+} // namespace
+
+int main(int argc, char* argv[])
+{
+    std::string format = "text";
+    std::string filter;
+    double minSeconds = 0.5;
+    bool framePool = true;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        const std::string option = argv[i];
+        if (option == "--format" && i + 1 < argc)
+        {
+            format = argv[++i];
+        }
+        else if (option == "--filter" && i + 1 < argc)
+        {
+            filter = argv[++i];
+        }
+        else if (option == "--min-time" && i + 1 < argc)
+        {
+            minSeconds = std::atof(argv[++i]);
+        }
+        else if (option == "--system-allocator")
+        {
+            framePool = false;
+        }
+        else
+        {
+            std::cerr << "Usage: " << argv[0]
+                      << " [--format text|json|csv] [--filter SUBSTRING] [--min-time S] [--system-allocator]\n";
+            return 2;
+        }
+    }
+
+    if (format != "text" && format != "json" && format != "csv")
+    {
+        std::cerr << "Unknown format " << format << '\n';
+        return 2;
+    }
+
+    // Single-threaded numbers are the ones comparable between runs and boards
+    cv::setNumThreads(1);
+
+    // Images come from the same pool as in flight unless comparing against
+    // the heap
+    if (framePool)
+    {
+        FramePool::install();
+    }
+
+    PerfCounters counters;
+    std::vector<Result> results;
+    for (const Benchmark& benchmark : benchmarks())
+    {
+        if (!filter.empty() && benchmark.name.find(filter) == std::string::npos)
+        {
+            continue;
+        }
+        results.push_back(measure(benchmark, minSeconds, counters));
+        if (format == "text")
+        {
+            std::cerr << "." << std::flush;
+        }
+    }
+    if (format == "text")
+    {
+        std::cerr << '\n';
+        printText(results);
+    }
+    else if (format == "csv")
+    {
+        printCsv(results);
+    }
+    else
+    {
+        printJson(results);
+    }
+    return 0;
+}
@@ -0,0 +1,290 @@
+// Accuracy and cost of the vision stages on synthetic flights.
+//
+// Every (altitude, speed) scenario flies a straight line along x, optionally
+// yawing and rocking in roll/pitch, through SyntheticDrone. The stages are
+// scored against the ground truth of each frame:
+//
+//   vecmove     VecMove::calc end to end, error of getVecMove() in meters
+//   position    error of VecMove::getAccumulatedPosition() against the true
+//               distance flown so far, i.e. the drift, in meters
+//   flow/len=N  CameraOpticalFlow::calc on an N-pixel half-size ROI at the
+//               frame centre, end-point error of the centre flow in pixels
+//               (with --tiles, of the fused flow of the tiles around it;
+//               with --flow-mode keyframe, of the keyframe displacement change)
+//
+// Rendering time is excluded from ms/frame. Output is CSV on stdout, one row
+// per scenario and stage, for plotting accuracy against cost.
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <opencv2/opencv.hpp>
+
+#include "posHold/CameraOpticalFlow.h"
+#include "posHold/FramePool.h"
+#include "posHold/VecMove.h"
+#include "sim/SyntheticDrone.h"
+#include "sim/Trajectory.h"
+
+namespace {
+
+struct Scenario
+{
+    double duration = 3.0;      // s
+    double yawRate = 0.0;       // degrees/s
+    double wobble = 0.0;        // roll/pitch amplitude, degrees
+    double wobblePeriod = 1.0;  // s
+};
+
+struct Score
+{
+    int frames = 0;
+    double errorSum = 0.0;
+    double squaredErrorSum = 0.0;
+    double truthSum = 0.0;
+    double seconds = 0.0;
+
+    void add(const cv::Point2f estimate, const cv::Point2f truth, const double elapsed)
+    {
+        const double error = cv::norm(estimate - truth);
+        ++frames;
+        errorSum += error;
+        squaredErrorSum += error * error;
+        truthSum += cv::norm(truth);
+        seconds += elapsed;
+    }
+};
+
+Trajectory straightLine(const Scenario& scenario, const double altitude, const double speed)
+{
+    // Keyframes every quarter wobble period so the rocking is piecewise linear
+    // rather than a single ramp
+    const double step = scenario.wobble > 0.0 ? scenario.wobblePeriod / 4 : scenario.duration;
+    const double amplitude = scenario.wobble * CV_PI / 180;
+    std::vector<Trajectory::Keyframe> keyframes;
+    for (int i = 0; i * step <= scenario.duration + 1e-9; ++i)
+    {
+        const double t = i * step;
+        const double phase = 2 * CV_PI * t / scenario.wobblePeriod;
+        keyframes.push_back({ t, {
+            speed * t,
+            0.0,
+            altitude,
+            amplitude * std::sin(phase),
+            amplitude * std::cos(phase),
+            scenario.yawRate * CV_PI / 180 * t,
+            1.0
+        } });
+    }
+    return Trajectory(std::move(keyframes));
+}
+
+double elapsedSince(const std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+struct VecMoveScores
+{
+    Score move;
+    Score position;
+};
+
+VecMoveScores scoreVecMove(const Trajectory& trajectory, const SyntheticDrone::Options& options, const int tiles,
+                           const CameraOpticalFlow::Mode mode)
+{
+    SyntheticDrone drone(trajectory, options);
+    VecMove vecMove(drone, tiles, mode);
+    VecMoveScores scores;
+    cv::Point2f truePosition(0.0f, 0.0f);
+    while (drone.hasNextFrame())
+    {
+        const auto start = std::chrono::steady_clock::now();
+        vecMove.calc();
+        const double elapsed = elapsedSince(start) - drone.getRenderSeconds();
+        if (drone.getFrameIndex() > 0)
+        {
+            truePosition += drone.getTrueVecMove();
+            scores.move.add(vecMove.getVecMove(), drone.getTrueVecMove(), elapsed);
+            scores.position.add(vecMove.getAccumulatedPosition(), truePosition, elapsed);
+        }
+    }
+    return scores;
+}
+
+Score scoreFlow(const Trajectory& trajectory, const SyntheticDrone::Options& options, const int len,
+                const int tiles, const CameraOpticalFlow::Mode mode)
+{
+    SyntheticDrone drone(trajectory, options);
+    CameraOpticalFlow flow(drone, len, tiles, mode);
+    const int x = drone.cameraInfo.resolutionX / 2;
+    const int y = drone.cameraInfo.resolutionY / 2;
+    Score score;
+    while (drone.hasNextFrame())
+    {
+        const double altitude = drone.getAltitude();
+        const auto start = std::chrono::steady_clock::now();
+        flow.calc(x, y, len, altitude);
+        const double elapsed = elapsedSince(start) - drone.getRenderSeconds();
+        if (drone.getFrameIndex() > 0)
+        {
+            const cv::Point2f centre(static_cast<float>(x), static_cast<float>(y));
+            const cv::Point2f estimate = tiles > 1 || mode == CameraOpticalFlow::Mode::Keyframe
+                ? flow.getFusedFlow() : flow.getOpticalFlowAt(x, y);
+            score.add(estimate, drone.getTrueFlowAt(centre), elapsed);
+        }
+    }
+    return score;
+}
+
+void printRow(const std::string& stage, const double altitude, const double speed, const Score& score)
+{
+    const double n = std::max(score.frames, 1);
+    std::printf("%s,%.3f,%.3f,%d,%.6g,%.6g,%.6g,%.4f\n",
+                stage.c_str(), altitude, speed, score.frames,
+                score.errorSum / n,
+                std::sqrt(score.squaredErrorSum / n),
+                score.truthSum > 0.0 ? score.errorSum / score.truthSum : 0.0,
+                1e3 * score.seconds / n);
+}
+
+std::vector<double> parseList(const std::string& text)
+{
+    std::vector<double> values;
+    std::size_t begin = 0;
+    while (begin <= text.size())
+    {
+        const std::size_t end = std::min(text.find(',', begin), text.size());
+        values.push_back(std::atof(text.substr(begin, end - begin).c_str()));
+        begin = end + 1;
+    }
+    return values;
+}
+
+void usage(const char* program)
+{
+    std::cerr << "Usage: " << program << " [options]\n"
+              << "  --altitudes A,B,...    meters (default 0.5,1,2,4)\n"
+              << "  --speeds A,B,...       meters per second (default 0.25,0.5,1,2)\n"
+              << "  --lens A,B,...         flow ROI half-sizes (default 10,20,40,80)\n"
+              << "  --duration S           seconds per scenario (default 3)\n"
+              << "  --tiles N              flow tiles computed in parallel (default 1)\n"
+              << "  --flow-mode MODE       consecutive or keyframe (default consecutive)\n"
+              << "  --yaw-rate DEG         yaw rate, degrees per second\n"
+              << "  --wobble DEG           roll/pitch rocking amplitude, degrees\n"
+              << "  --trajectory CSV       fly this script instead of the grid\n"
+              << "  --noise SIGMA          image noise, gray levels\n"
+              << "  --defocus SIGMA        defocus blur, pixels\n"
+              << "  --exposure S           shutter time for motion blur, seconds\n"
+              << "  --attitude-noise RAD   gyro noise\n"
+              << "  --altitude-noise M     altitude noise\n"
+              << "  --seed N               texture and noise seed\n";
+}
+
+} // namespace
+
+int main(int argc, char* argv[])
+{
+    std::vector<double> altitudes{ 0.5, 1.0, 2.0, 4.0 };
+    std::vector<double> speeds{ 0.25, 0.5, 1.0, 2.0 };
+    std::vector<double> lens{ 10, 20, 40, 80 };
+    std::string trajectoryPath;
+    Scenario scenario;
+    SyntheticDrone::Options options;
+    int tiles = 1;
+    CameraOpticalFlow::Mode mode = CameraOpticalFlow::Mode::Consecutive;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        const std::string option = argv[i];
+        if (i + 1 >= argc)
+        {
+            usage(argv[0]);
+            return 2;
+        }
+        const std::string value = argv[++i];
+        if (option == "--altitudes") altitudes = parseList(value);
+        else if (option == "--speeds") speeds = parseList(value);
+        else if (option == "--lens") lens = parseList(value);
+        else if (option == "--duration") scenario.duration = std::atof(value.c_str());
+        else if (option == "--tiles") tiles = std::max(1, std::atoi(value.c_str()));
+        else if (option == "--flow-mode" && (value == "consecutive" || value == "keyframe"))
+        {
+            mode = value == "keyframe" ? CameraOpticalFlow::Mode::Keyframe : CameraOpticalFlow::Mode::Consecutive;
+        }
+        else if (option == "--yaw-rate") scenario.yawRate = std::atof(value.c_str());
+        else if (option == "--wobble") scenario.wobble = std::atof(value.c_str());
+        else if (option == "--trajectory") trajectoryPath = value;
+        else if (option == "--noise") options.imageNoise = std::atof(value.c_str());
+        else if (option == "--defocus") options.defocusSigma = std::atof(value.c_str());
+        else if (option == "--exposure") options.exposureTime = std::atof(value.c_str());
+        else if (option == "--attitude-noise") options.attitudeNoise = std::atof(value.c_str());
+        else if (option == "--altitude-noise") options.altitudeNoise = std::atof(value.c_str());
+        else if (option == "--seed") options.seed = static_cast<unsigned>(std::atoi(value.c_str()));
+        else
+        {
+            usage(argv[0]);
+            return 2;
+        }
+    }
+
+    if (scenario.duration <= 0.0 || scenario.wobblePeriod <= 0.0)
+    {
+        usage(argv[0]);
+        return 2;
+    }
+
+    // Timings comparable with the single-threaded Pi pipeline
+    cv::setNumThreads(1);
+    FramePool::install();
+
+    std::printf("stage,altitude,speed,frames,mean_error,rms_error,relative_error,ms_per_frame\n");
+
+    auto run = [&](const Trajectory& trajectory, const double altitude, const double speed)
+    {
+        const VecMoveScores scores = scoreVecMove(trajectory, options, tiles, mode);
+        printRow("vecmove", altitude, speed, scores.move);
+        printRow("position", altitude, speed, scores.position);
+        for (const double len : lens)
+        {
+            printRow("flow/len=" + std::to_string(static_cast<int>(len)), altitude, speed,
+                     scoreFlow(trajectory, options, static_cast<int>(len), tiles, mode));
+        }
+        std::fflush(stdout);
+    };
+
+    try
+    {
+        if (!trajectoryPath.empty())
+        {
+            const Trajectory trajectory = Trajectory::load(trajectoryPath);
+            const Trajectory::Pose start = trajectory.at(trajectory.startTime());
+            const Trajectory::Pose end = trajectory.at(trajectory.startTime() + trajectory.duration());
+            const double distance = std::hypot(end.x - start.x, end.y - start.y);
+            run(trajectory, start.altitude, trajectory.duration() > 0.0 ? distance / trajectory.duration() : 0.0);
+            return 0;
+        }
+
+        for (const double altitude : altitudes)
+        {
+            for (const double speed : speeds)
+            {
+                run(straightLine(scenario, altitude, speed), altitude, speed);
+            }
+        }
+    }
+    catch (const std::exception& e)
+    {
+        std::cerr << e.what() << '\n';
+        return 1;
+    }
+    return 0;
+}
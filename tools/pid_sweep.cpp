@@ -0,0 +1,571 @@
+// PID gain sweep on a simulated airframe.
+//
+// Every (k_p, k_i, k_d, k_df) combination of the requested grid flies the same
+// scenario: a point mass starting at --start is driven to the origin through
+// PidController. Roll/pitch PWM becomes a commanded tilt, the attitude follows
+// it with a first-order lag and the tilted thrust accelerates the mass against
+// linear drag. The controller sees the position through Gaussian noise and a
+// measurement delay, and its clock is the simulated time.
+//
+// With --camera-rate the position is only measured that many times a second,
+// like VecMove, and the controller runs on each new measurement, holding its
+// output in between. --multi-rate flies a ControlLoop instead, ticked with
+// step() every period on the simulated clock: its StateEstimator propagates
+// position and velocity from the simulated attitude, and each frame's
+// measurement corrects the state of the time the frame was taken. Frames are
+// submitted as positions (VecMove::getAccumulatedPosition()), or with --flow
+// as the displacement since the previous frame (VecMove::getVecMove()). --gust adds a wind that reverses every half
+// --gust-period, for comparing disturbance rejection.
+//
+// Runs are scheduled on all cores with range-splitting work stealing, scored
+// by settling time, overshoot and RMS error, and printed as a ranked table.
+// The best trajectories are written in the JSON format plot_path.py reads.
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "pid/pid.hpp"
+#include "posHold/ControlLoop.h"
+#include "posHold/Drone.h"
+#include "posHold/StateEstimator.h"
+
+namespace {
+
+constexpr double s_gravity = 9.80665;
+
+struct Model
+{
+    double dt = 0.01;             // controller period, s
+    double duration = 10.0;       // s
+    double maxAngle = 25.0;       // tilt at PWM 1000/2000, degrees
+    double attitudeTau = 0.1;     // attitude response time constant, s
+    double drag = 0.3;            // linear drag, 1/s
+    double gust = 0.0;            // wind acceleration along x, m/s^2
+    double gustPeriod = 2.0;      // the wind reverses every half period, s
+    double noise = 0.02;          // position measurement noise (1 sigma), m
+    double latency = 0.05;        // measurement delay, s
+    double cameraRate = 0.0;      // measurements per second, 0 = every period
+    bool multiRate = false;       // controller every period on a prediction
+    bool flow = false;            // multi-rate frames as displacements, not positions
+    double accelNoise = 4.0;      // estimator process noise; covers the drag and wind it does not model, m/s^2
+    double startX = -2.0;         // m
+    double startY = 1.0;          // m
+    double settleBand = 0.05;     // m
+    unsigned seed = 1;
+};
+
+struct Range
+{
+    double min;
+    double max;
+    int steps;
+
+    [[nodiscard]] double at(const int i) const
+    {
+        return steps > 1 ? min + (max - min) * i / (steps - 1) : min;
+    }
+};
+
+struct Gains
+{
+    float kp;
+    float ki;
+    float kd;
+    float kdf;
+};
+
+struct Score
+{
+    Gains gains;
+    double settlingTime;
+    double overshoot;
+    double rmsError;
+    bool diverged;
+    double cost;
+};
+
+struct Trajectory
+{
+    std::vector<double> x;
+    std::vector<double> y;
+};
+
+// Telemetry of the simulated airframe, as ControlLoop reads it from MSP
+class SimulatedDrone : public Drone
+{
+public:
+    SimulatedDrone() :
+        Drone(defaultCameraInfo())
+    {
+    }
+
+    [[nodiscard]] GyroData getGyroData() override
+    {
+        return attitude;
+    }
+
+    [[nodiscard]] AltitudeData getAltitudeData() override
+    {
+        return { 1.0, 0.0 };
+    }
+
+    GyroData attitude{ 0.0, 0.0, 0.0 };
+};
+
+// Simulates one gain set; fills trajectory when it is not null
+Score simulate(const Model& model, const Gains& gains, Trajectory* trajectory)
+{
+    auto now = std::chrono::steady_clock::time_point{};
+    const auto step = std::chrono::microseconds(static_cast<long long>(model.dt * 1e6));
+    PidController controller(gains.kp, gains.ki, gains.kd, gains.kdf, [&now] { return now; });
+
+    // Same noise realisation for every gain set, so scores are comparable
+    std::mt19937 rng(model.seed);
+    std::normal_distribution<double> noise(0.0, model.noise);
+
+    const int steps = static_cast<int>(std::lround(model.duration / model.dt));
+    const int delay = static_cast<int>(std::lround(model.latency / model.dt));
+    const double maxAngle = model.maxAngle * M_PI / 180.0;
+    const double attitudeGain = std::min(1.0, model.dt / model.attitudeTau);
+
+    const double startDistance = std::hypot(model.startX, model.startY);
+    // Unit vector from the start towards the target (the origin)
+    const double towardX = -model.startX / startDistance;
+    const double towardY = -model.startY / startDistance;
+
+    double x = model.startX;
+    double y = model.startY;
+    double vx = 0.0;
+    double vy = 0.0;
+    double roll = 0.0;
+    double pitch = 0.0;
+
+    std::deque<simd::Vec2f> measurements(delay + 1,
+        simd::Vec2f{ static_cast<float>(x), static_cast<float>(y) });
+
+    const int cameraSteps = model.cameraRate > 0.0
+        ? std::max(1, static_cast<int>(std::lround(1.0 / (model.cameraRate * model.dt))))
+        : 1;
+    simd::Vec2u rc{ 1500u, 1500u };
+
+    SimulatedDrone drone;
+    std::unique_ptr<ControlLoop> loop;
+    // Vision measures from where the airframe starts
+    const simd::Vec2f startMeasured = measurements.front();
+    simd::Vec2f lastFrame = startMeasured;
+    if (model.multiRate)
+    {
+        // Flow differences two noisy positions over a frame interval
+        const double positionNoise = std::max(model.noise, 1e-3);
+        const double flowNoise = std::sqrt(2.0) * positionNoise / (cameraSteps * model.dt);
+        ControlLoop::Options options;
+        options.rate = 1.0 / model.dt;
+        loop = std::make_unique<ControlLoop>(drone, controller, [&rc](const simd::Vec2u output) { rc = output; },
+                                             options,
+                                             StateEstimator(model.accelNoise, flowNoise, 0.5, 0.3, positionNoise));
+        // Vision measures from where it started, so the estimate starts at
+        // zero there and the target is the origin seen from the start
+        loop->setSetpoint(cv::Point2f(static_cast<float>(-model.startX), static_cast<float>(-model.startY)));
+    }
+
+    double squaredError = 0.0;
+    double overshoot = 0.0;
+    int lastOutsideBand = -1;
+    bool diverged = false;
+
+    if (trajectory != nullptr)
+    {
+        trajectory->x.reserve(steps + 1);
+        trajectory->y.reserve(steps + 1);
+    }
+
+    for (int i = 0; i < steps; ++i)
+    {
+        if (trajectory != nullptr)
+        {
+            trajectory->x.push_back(x);
+            trajectory->y.push_back(y);
+        }
+
+        measurements.push_back({ static_cast<float>(x + noise(rng)), static_cast<float>(y + noise(rng)) });
+        const simd::Vec2f measured = measurements.front();
+        measurements.pop_front();
+
+        now += step;
+        const bool frame = i % cameraSteps == 0;
+        if (loop)
+        {
+            // Roll tilts the simulated thrust along x and pitch along y; the
+            // estimator's image axes take them as -pitch and -roll
+            drone.attitude = Drone::GyroData{ -pitch, -roll, 0.0 };
+            // The frame left the airframe delay + 1 periods ago
+            const auto sampleTime = now - step * (delay + 1);
+            if (frame && !model.flow)
+            {
+                loop->submitPosition(cv::Point2f(measured.x - startMeasured.x, measured.y - startMeasured.y),
+                                     sampleTime);
+            }
+            else if (frame && i > 0)
+            {
+                loop->submitFlow(cv::Point2f(measured.x - lastFrame.x, measured.y - lastFrame.y),
+                                 cameraSteps * model.dt, sampleTime);
+            }
+            if (frame)
+            {
+                lastFrame = measured;
+            }
+            loop->step(now);
+        }
+        else if (frame)
+        {
+            rc = controller.calculate_raw_rc(measured);
+        }
+
+        const double rollCommand = (static_cast<double>(rc.x) - 1500.0) / 500.0 * maxAngle;
+        const double pitchCommand = (static_cast<double>(rc.y) - 1500.0) / 500.0 * maxAngle;
+        roll += (rollCommand - roll) * attitudeGain;
+        pitch += (pitchCommand - pitch) * attitudeGain;
+
+        const bool gustForward = std::fmod(i * model.dt, model.gustPeriod) < 0.5 * model.gustPeriod;
+        const double wind = gustForward ? model.gust : -model.gust;
+        vx += (s_gravity * std::tan(roll) - model.drag * vx + wind) * model.dt;
+        vy += (s_gravity * std::tan(pitch) - model.drag * vy) * model.dt;
+        x += vx * model.dt;
+        y += vy * model.dt;
+
+        const double error = std::hypot(x, y);
+        if (!std::isfinite(error) || error > 10.0 * startDistance)
+        {
+            diverged = true;
+            break;
+        }
+
+        squaredError += error * error;
+        overshoot = std::max(overshoot, x * towardX + y * towardY);
+        if (error > model.settleBand)
+        {
+            lastOutsideBand = i;
+        }
+    }
+
+    Score score{};
+    score.gains = gains;
+    score.diverged = diverged;
+    score.settlingTime = (lastOutsideBand + 1) * model.dt;
+    score.overshoot = overshoot;
+    score.rmsError = std::sqrt(squaredError / steps);
+    // Never settling costs the whole run; overshoot and RMS break ties between
+    // gain sets that settle alike
+    score.cost = diverged
+        ? std::numeric_limits<double>::infinity()
+        : score.settlingTime + 10.0 * score.overshoot + 5.0 * score.rmsError;
+    return score;
+}
+
+// Each worker owns a contiguous range of run indices and takes from its front;
+// an idle worker steals the back half of the fullest remaining range
+class WorkStealingScheduler
+{
+public:
+    WorkStealingScheduler(const std::size_t tasks, const unsigned workers) :
+        m_ranges(workers)
+    {
+        for (unsigned w = 0; w < workers; ++w)
+        {
+            m_ranges[w].begin = tasks * w / workers;
+            m_ranges[w].end = tasks * (w + 1) / workers;
+        }
+    }
+
+    template <class Task>
+    void run(Task&& task)
+    {
+        std::vector<std::thread> threads;
+        for (unsigned w = 1; w < m_ranges.size(); ++w)
+        {
+            threads.emplace_back([this, w, &task] { work(w, task); });
+        }
+        work(0, task);
+        for (std::thread& thread : threads)
+        {
+            thread.join();
+        }
+    }
+
+private:
+    struct WorkerRange
+    {
+        std::mutex mutex;
+        std::size_t begin = 0;
+        std::size_t end = 0;
+    };
+
+    template <class Task>
+    void work(const unsigned self, Task& task)
+    {
+        for (;;)
+        {
+            std::size_t index;
+            if (pop(self, index) || steal(self, index))
+            {
+                task(index);
+                continue;
+            }
+            return;
+        }
+    }
+
+    bool pop(const unsigned self, std::size_t& index)
+    {
+        WorkerRange& range = m_ranges[self];
+        std::lock_guard<std::mutex> lock(range.mutex);
+        if (range.begin == range.end)
+        {
+            return false;
+        }
+        index = range.begin++;
+        return true;
+    }
+
+    bool steal(const unsigned self, std::size_t& index)
+    {
+        for (;;)
+        {
+            unsigned victim = self;
+            std::size_t largest = 0;
+            for (unsigned w = 0; w < m_ranges.size(); ++w)
+            {
+                std::lock_guard<std::mutex> lock(m_ranges[w].mutex);
+                const std::size_t remaining = m_ranges[w].end - m_ranges[w].begin;
+                if (w != self && remaining > largest)
+                {
+                    victim = w;
+                    largest = remaining;
+                }
+            }
+            if (largest == 0)
+            {
+                return false;
+            }
+
+            std::size_t stolenBegin;
+            std::size_t stolenEnd;
+            {
+                WorkerRange& range = m_ranges[victim];
+                std::lock_guard<std::mutex> lock(range.mutex);
+                if (range.begin == range.end)
+                {
+                    continue; // drained meanwhile, look again
+                }
+                // A single remaining index is taken whole
+                stolenEnd = range.end;
+                stolenBegin = range.begin + (range.end - range.begin) / 2;
+                range.end = stolenBegin;
+            }
+
+            WorkerRange& own = m_ranges[self];
+            std::lock_guard<std::mutex> lock(own.mutex);
+            index = stolenBegin;
+            own.begin = stolenBegin + 1;
+            own.end = stolenEnd;
+            return true;
+        }
+    }
+
+    std::vector<WorkerRange> m_ranges;
+};
+
+bool parseRange(const char* text, Range& range)
+{
+    return std::sscanf(text, "%lf:%lf:%d", &range.min, &range.max, &range.steps) == 3 && range.steps > 0;
+}
+
+void writeTrajectory(const std::string& path, const Model& model, const Trajectory& trajectory)
+{
+    std::FILE* file = std::fopen(path.c_str(), "w");
+    if (file == nullptr)
+    {
+        std::cerr << "Error: Could not write " << path << '\n';
+        return;
+    }
+
+    std::fprintf(file, "{\n  \"target\": [0.0, 0.0],\n  \"start\": [%.9g, %.9g],\n  \"path\": [",
+                 model.startX, model.startY);
+    for (std::size_t i = 0; i < trajectory.x.size(); ++i)
+    {
+        std::fprintf(file, "%s\n    [%.9g, %.9g]", i == 0 ? "" : ",", trajectory.x[i], trajectory.y[i]);
+    }
+    std::fprintf(file, "\n  ]\n}\n");
+    std::fclose(file);
+}
+
+void usage(const char* program)
+{
+    std::cerr << "Usage: " << program << " [options]\n"
+              << "  --kp|--ki|--kd|--kdf MIN:MAX:STEPS  gain grid\n"
+              << "  --dt S --duration S --latency S --noise M --tau S --drag K --max-angle DEG\n"
+              << "  --camera-rate HZ [--multi-rate]   measurement rate; controller every dt on a prediction\n"
+              << "  --flow                            multi-rate frames as displacements, not positions\n"
+              << "  --accel-noise A                   estimator process noise with --multi-rate, m/s^2\n"
+              << "  --gust A --gust-period S          wind along x, reversing every half period\n"
+              << "  --start X,Y --settle-band M --seed N\n"
+              << "  --threads N --top N --csv FILE\n"
+              << "  --trajectories N --path-out FILE   (best N runs, plot_path.py format)\n";
+}
+
+} // namespace
+
+int main(int argc, char* argv[])
+{
+    Model model;
+    Range kp{ 20.0, 400.0, 20 };
+    Range ki{ 0.0, 50.0, 6 };
+    Range kd{ 0.0, 300.0, 16 };
+    Range kdf{ 0.1, 0.9, 5 };
+    unsigned threads = std::max(1u, std::thread::hardware_concurrency());
+    std::size_t top = 20;
+    std::size_t trajectories = 1;
+    std::string csvPath;
+    std::string pathOut = "src/pid/path_data.json";
+
+    for (int i = 1; i < argc; ++i)
+    {
+        const std::string option = argv[i];
+        if (option == "--multi-rate")
+        {
+            model.multiRate = true;
+            continue;
+        }
+        if (option == "--flow")
+        {
+            model.flow = true;
+            continue;
+        }
+        if (i + 1 >= argc)
+        {
+            usage(argv[0]);
+            return 2;
+        }
+        const char* value = argv[++i];
+        bool ok = true;
+        if (option == "--kp") ok = parseRange(value, kp);
+        else if (option == "--ki") ok = parseRange(value, ki);
+        else if (option == "--kd") ok = parseRange(value, kd);
+        else if (option == "--kdf") ok = parseRange(value, kdf);
+        else if (option == "--dt") model.dt = std::atof(value);
+        else if (option == "--duration") model.duration = std::atof(value);
+        else if (option == "--latency") model.latency = std::atof(value);
+        else if (option == "--noise") model.noise = std::atof(value);
+        else if (option == "--camera-rate") model.cameraRate = std::atof(value);
+        else if (option == "--tau") model.attitudeTau = std::atof(value);
+        else if (option == "--gust") model.gust = std::atof(value);
+        else if (option == "--gust-period") model.gustPeriod = std::atof(value);
+        else if (option == "--accel-noise") model.accelNoise = std::atof(value);
+        else if (option == "--drag") model.drag = std::atof(value);
+        else if (option == "--max-angle") model.maxAngle = std::atof(value);
+        else if (option == "--start") ok = std::sscanf(value, "%lf,%lf", &model.startX, &model.startY) == 2;
+        else if (option == "--settle-band") model.settleBand = std::atof(value);
+        else if (option == "--seed") model.seed = static_cast<unsigned>(std::atoi(value));
+        else if (option == "--threads") threads = static_cast<unsigned>(std::max(1, std::atoi(value)));
+        else if (option == "--top") top = static_cast<std::size_t>(std::atoi(value));
+        else if (option == "--csv") csvPath = value;
+        else if (option == "--trajectories") trajectories = static_cast<std::size_t>(std::atoi(value));
+        else if (option == "--path-out") pathOut = value;
+        else ok = false;
+
+        if (!ok || model.dt <= 0.0 || model.duration < model.dt || std::hypot(model.startX, model.startY) == 0.0)
+        {
+            usage(argv[0]);
+            return 2;
+        }
+    }
+
+    const std::size_t runs = static_cast<std::size_t>(kp.steps) * ki.steps * kd.steps * kdf.steps;
+    std::vector<Score> scores(runs);
+
+    const auto start = std::chrono::steady_clock::now();
+    WorkStealingScheduler scheduler(runs, static_cast<unsigned>(std::min<std::size_t>(threads, runs)));
+    scheduler.run([&](const std::size_t index)
+    {
+        std::size_t rest = index;
+        Gains gains{};
+        gains.kdf = static_cast<float>(kdf.at(static_cast<int>(rest % kdf.steps)));
+        rest /= kdf.steps;
+        gains.kd = static_cast<float>(kd.at(static_cast<int>(rest % kd.steps)));
+        rest /= kd.steps;
+        gains.ki = static_cast<float>(ki.at(static_cast<int>(rest % ki.steps)));
+        rest /= ki.steps;
+        gains.kp = static_cast<float>(kp.at(static_cast<int>(rest)));
+        scores[index] = simulate(model, gains, nullptr);
+    });
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    std::sort(scores.begin(), scores.end(), [](const Score& a, const Score& b) { return a.cost < b.cost; });
+
+    std::printf("%zu runs of %.1f s simulated in %.2f s on %u threads\n\n",
+                runs, model.duration, seconds, threads);
+    std::printf("%5s %9s %9s %9s %6s %10s %10s %9s %9s\n",
+                "rank", "k_p", "k_i", "k_d", "k_df", "settle_s", "overshoot", "rms_m", "cost");
+    for (std::size_t i = 0; i < std::min(top, scores.size()); ++i)
+    {
+        const Score& s = scores[i];
+        if (s.diverged)
+        {
+            std::printf("%5zu %9.3f %9.3f %9.3f %6.3f %10s\n", i + 1, s.gains.kp, s.gains.ki, s.gains.kd, s.gains.kdf,
+                        "diverged");
+            continue;
+        }
+        std::printf("%5zu %9.3f %9.3f %9.3f %6.3f %10.2f %10.3f %9.4f %9.3f\n",
+                    i + 1, s.gains.kp, s.gains.ki, s.gains.kd, s.gains.kdf,
+                    s.settlingTime, s.overshoot, s.rmsError, s.cost);
+    }
+
+    if (!csvPath.empty())
+    {
+        std::FILE* csv = std::fopen(csvPath.c_str(), "w");
+        if (csv == nullptr)
+        {
+            std::cerr << "Error: Could not write " << csvPath << '\n';
+            return 1;
+        }
+        std::fprintf(csv, "rank,k_p,k_i,k_d,k_df,settling_time,overshoot,rms_error,diverged,cost\n");
+        for (std::size_t i = 0; i < scores.size(); ++i)
+        {
+            const Score& s = scores[i];
+            std::fprintf(csv, "%zu,%.9g,%.9g,%.9g,%.9g,%.9g,%.9g,%.9g,%d,%.9g\n",
+                         i + 1, s.gains.kp, s.gains.ki, s.gains.kd, s.gains.kdf,
+                         s.settlingTime, s.overshoot, s.rmsError, s.diverged ? 1 : 0, s.cost);
+        }
+        std::fclose(csv);
+    }
+
+    // Best run goes to pathOut; the following ones get their rank appended
+    for (std::size_t i = 0; i < std::min(trajectories, scores.size()); ++i)
+    {
+        Trajectory trajectory;
+        simulate(model, scores[i].gains, &trajectory);
+
+        std::string path = pathOut;
+        if (i > 0)
+        {
+            const std::size_t dot = path.rfind('.');
+            const std::string suffix = "_rank" + std::to_string(i + 1);
+            path = dot == std::string::npos ? path + suffix : path.substr(0, dot) + suffix + path.substr(dot);
+        }
+        writeTrajectory(path, model, trajectory);
+    }
+
+    return 0;
+}
@@ -0,0 +1,347 @@
+// Offline replay of recorded flights through VecDown/VecMove, the state
+// estimator and the PID controller.
+//
+// Every log directory holds video.mp4 and telemetry.csv (see ReplayDrone.h).
+// The controller clock is the recorded frame timestamp, so a replay produces
+// the same dt sequence as the flight however fast it runs. Logs are spread over
+// worker threads and each one writes replay.csv next to its inputs, one row per
+// frame, for diffing between builds or gain sets, plus the same results as a
+// flight log (replay.phlog, see include/flightlog/flight_log.hpp).
+//
+// --telemetry publishes every iteration to a live telemetry segment (see
+// include/telemetry/live_telemetry.hpp) for poshold_telemetry_view; the
+// segment has a single writer, so logs then replay one at a time.
+//
+// --tiles sets the optical-flow tiles VecMove computes per frame (see
+// CameraOpticalFlow.h), one by default. --keyframe measures the flow against a
+// cached keyframe instead of the previous frame (CameraOpticalFlow::Mode).
+//
+// Frames are allocated from FramePool. --check-allocations fails the replay if
+// any frame after the warm-up calls operator new; it needs a build with
+// -DPOSHOLD_COUNT_ALLOCATIONS=ON and replays one log at a time, since the
+// count is process-wide.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <opencv2/opencv.hpp>
+
+#include "flightlog/flight_log.hpp"
+#include "pid/pid.hpp"
+#include "posHold/AllocationCounter.h"
+#include "posHold/FramePool.h"
+#include "posHold/StateEstimator.h"
+#include "posHold/VecMove.h"
+#include "replay/ReplayDrone.h"
+#include "telemetry/live_telemetry.hpp"
+
+namespace {
+
+struct ReplayResult
+{
+    std::size_t frames = 0;
+    double seconds = 0.0;
+    std::uint64_t steadyStateAllocations = 0;
+    int allocatingFrames = 0;
+};
+
+std::uint32_t microsecondsBetween(const std::chrono::steady_clock::time_point from,
+                                  const std::chrono::steady_clock::time_point to)
+{
+    return static_cast<std::uint32_t>(std::chrono::duration_cast<std::chrono::microseconds>(to - from).count());
+}
+
+ReplayResult replayLog(const std::string& directory, telemetry::LiveTelemetryWriter* live, const int flowTiles,
+                       const CameraOpticalFlow::Mode flowMode)
+{
+    ReplayDrone drone(directory + "/video.mp4", directory + "/telemetry.csv");
+    VecMove vecMove(drone, flowTiles, flowMode);
+    StateEstimator estimator;
+    PidController controller(1.0f, 0.0f, 0.0f, 0.0f,
+                             [&drone] { return drone.getFrameTimestamp(); });
+
+    const std::string outputPath = directory + "/replay.csv";
+    std::FILE* output = std::fopen(outputPath.c_str(), "w");
+    if (output == nullptr)
+    {
+        throw std::runtime_error("cannot create " + outputPath);
+    }
+
+    flightlog::FlightLogWriter log((directory + "/replay.phlog").c_str());
+
+    std::fprintf(output,
+                 "frame,timestamp_us,interval,skipped,vec_down_x,vec_down_y,vec_move_x,vec_move_y,"
+                 "pos_x,pos_y,vel_x,vel_y,altitude,roll_pwm,pitch_pwm\n");
+
+    const auto start = std::chrono::steady_clock::now();
+    ReplayResult result;
+    FrameAllocationCheck allocationCheck;
+
+    try
+    {
+        while (drone.hasNextFrame())
+        {
+            // Same order as the live loop: telemetry for the upcoming frame,
+            // then the vision stage, then fusion and control
+            allocationCheck.beginFrame();
+            const auto loopStart = std::chrono::steady_clock::now();
+            const Drone::GyroData attitude = drone.getGyroData();
+            const Drone::AltitudeData altitude = drone.getAltitudeData();
+
+            vecMove.calc();
+            const auto visionEnd = std::chrono::steady_clock::now();
+
+            const std::uint64_t timestampUs = flightlog::to_us(drone.getFrameTimestamp());
+            log.append(flightlog::TelemetryRecord{
+                timestampUs,
+                static_cast<float>(attitude.roll),
+                static_cast<float>(attitude.pitch),
+                static_cast<float>(attitude.yaw),
+                static_cast<float>(altitude.altitude),
+                static_cast<float>(altitude.vario),
+                0 });
+
+            estimator.predict(attitude, drone.getFrameInterval());
+            estimator.updateAltitude(altitude);
+            if (!vecMove.hasVecMove())
+            {
+                continue;
+            }
+            // Unmeasured flow (lost keyframe, down vector off frame) would
+            // pull the velocity to zero; prediction alone carries the frame
+            if (vecMove.getFlowConfidence() > 0.0)
+            {
+                estimator.updateFlow(vecMove.getVecMove(), vecMove.getSampleInterval());
+            }
+            const auto estimatorEnd = std::chrono::steady_clock::now();
+
+            const cv::Point2f position = estimator.getPosition();
+            const cv::Point2f velocity = estimator.getVelocity();
+            const simd::Vec2u rc = controller.calculate_raw_rc(
+                { position.x, position.y }, { velocity.x, velocity.y }, { 0.0f, 0.0f });
+            const auto controlEnd = std::chrono::steady_clock::now();
+
+            const cv::Point2f vecDown = vecMove.getVecDown();
+            const cv::Point2f move = vecMove.getVecMove();
+
+            log.append(flightlog::FlowRecord{
+                timestampUs,
+                static_cast<std::uint32_t>(drone.getFrameIndex()),
+                static_cast<std::uint32_t>(drone.getSkippedFrames()),
+                static_cast<float>(drone.getFrameInterval()),
+                vecDown.x, vecDown.y,
+                move.x, move.y,
+                0 });
+            log.append(flightlog::ControllerRecord{
+                timestampUs,
+                position.x, position.y,
+                velocity.x, velocity.y,
+                0.0f, 0.0f,
+                static_cast<float>(estimator.getAltitude()),
+                0 });
+            log.append(flightlog::RcRecord{
+                timestampUs,
+                { static_cast<std::uint16_t>(rc.x), static_cast<std::uint16_t>(rc.y) } });
+
+            if (live != nullptr)
+            {
+                const cv::Point2f flow = vecMove.getMeanFlow();
+                const PidController::Terms terms = controller.last_terms();
+                live->publish(telemetry::Snapshot{
+                    timestampUs,
+                    static_cast<std::uint32_t>(drone.getFrameIndex()),
+                    static_cast<std::uint32_t>(drone.getSkippedFrames()),
+                    static_cast<float>(attitude.roll),
+                    static_cast<float>(attitude.pitch),
+                    static_cast<float>(attitude.yaw),
+                    static_cast<float>(altitude.altitude),
+                    static_cast<float>(altitude.vario),
+                    static_cast<float>(drone.getFrameInterval()),
+                    flow.x, flow.y,
+                    vecDown.x, vecDown.y,
+                    move.x, move.y,
+                    position.x, position.y,
+                    velocity.x, velocity.y,
+                    0.0f, 0.0f,
+                    static_cast<float>(estimator.getAltitude()),
+                    { terms.p.x, terms.p.y },
+                    { terms.i.x, terms.i.y },
+                    { terms.d.x, terms.d.y },
+                    { static_cast<std::uint16_t>(rc.x), static_cast<std::uint16_t>(rc.y) },
+                    microsecondsBetween(loopStart, visionEnd),
+                    microsecondsBetween(visionEnd, estimatorEnd),
+                    microsecondsBetween(estimatorEnd, controlEnd),
+                    microsecondsBetween(loopStart, std::chrono::steady_clock::now()),
+                    0 });
+            }
+
+            std::fprintf(output,
+                         "%zu,%lld,%.9g,%d,%.9g,%.9g,%.9g,%.9g,%.9g,%.9g,%.9g,%.9g,%.9g,%u,%u\n",
+                         drone.getFrameIndex(),
+                         static_cast<long long>(timestampUs),
+                         drone.getFrameInterval(),
+                         drone.getSkippedFrames(),
+                         vecDown.x, vecDown.y,
+                         move.x, move.y,
+                         position.x, position.y,
+                         velocity.x, velocity.y,
+                         estimator.getAltitude(),
+                         static_cast<unsigned>(rc.x), static_cast<unsigned>(rc.y));
+            allocationCheck.endFrame();
+            ++result.frames;
+        }
+    }
+    catch (...)
+    {
+        std::fclose(output);
+        throw;
+    }
+
+    std::fclose(output);
+    result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    result.steadyStateAllocations = allocationCheck.getSteadyStateAllocations();
+    result.allocatingFrames = allocationCheck.getAllocatingFrames();
+    return result;
+}
+
+} // namespace
+
+int main(int argc, char* argv[])
+{
+    unsigned jobs = std::max(1u, std::thread::hardware_concurrency());
+    std::vector<std::string> logs;
+    const char* telemetryName = nullptr;
+    int flowTiles = 1;
+    CameraOpticalFlow::Mode flowMode = CameraOpticalFlow::Mode::Consecutive;
+    bool checkAllocations = false;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        if (std::strcmp(argv[i], "-j") == 0 && i + 1 < argc)
+        {
+            jobs = static_cast<unsigned>(std::max(1, std::atoi(argv[++i])));
+        }
+        else if (std::strcmp(argv[i], "--telemetry") == 0 && i + 1 < argc)
+        {
+            telemetryName = argv[++i];
+        }
+        else if (std::strcmp(argv[i], "--tiles") == 0 && i + 1 < argc)
+        {
+            flowTiles = std::max(1, std::atoi(argv[++i]));
+        }
+        else if (std::strcmp(argv[i], "--keyframe") == 0)
+        {
+            flowMode = CameraOpticalFlow::Mode::Keyframe;
+        }
+        else if (std::strcmp(argv[i], "--check-allocations") == 0)
+        {
+            checkAllocations = true;
+        }
+        else
+        {
+            logs.emplace_back(argv[i]);
+        }
+    }
+
+    if (logs.empty())
+    {
+        std::cerr << "Usage: " << argv[0] << " [-j jobs] [--telemetry SEGMENT] [--tiles N] [--keyframe]"
+                  << " [--check-allocations]"
+                  << " <log_dir>...\n";
+        return 2;
+    }
+
+    if (checkAllocations)
+    {
+        if (!AllocationCounter::enabled())
+        {
+            std::cerr << "--check-allocations needs a build with -DPOSHOLD_COUNT_ALLOCATIONS=ON\n";
+            return 2;
+        }
+        jobs = 1;
+    }
+
+    FramePool::install();
+
+    std::unique_ptr<telemetry::LiveTelemetryWriter> live;
+    if (telemetryName != nullptr)
+    {
+        try
+        {
+            live = std::make_unique<telemetry::LiveTelemetryWriter>(telemetryName);
+        }
+        catch (const std::exception& e)
+        {
+            std::cerr << e.what() << '\n';
+            return 1;
+        }
+        jobs = 1;
+    }
+
+    jobs = std::min<unsigned>(jobs, logs.size());
+    if (jobs > 1)
+    {
+        // Parallelism comes from running logs side by side; OpenCV's own
+        // worker pool would only oversubscribe the cores
+        cv::setNumThreads(1);
+    }
+
+    std::atomic<std::size_t> nextLog{ 0 };
+    std::atomic<int> failures{ 0 };
+    std::mutex reportMutex;
+
+    auto worker = [&]
+    {
+        for (std::size_t i = nextLog++; i < logs.size(); i = nextLog++)
+        {
+            try
+            {
+                const ReplayResult result = replayLog(logs[i], live.get(), flowTiles, flowMode);
+                std::lock_guard<std::mutex> lock(reportMutex);
+                std::cerr << logs[i] << ": " << result.frames << " frames in " << result.seconds << " s ("
+                          << (result.seconds > 0.0 ? result.frames / result.seconds : 0.0) << " fps)\n";
+                if (checkAllocations)
+                {
+                    std::cerr << logs[i] << ": " << result.steadyStateAllocations << " allocations in "
+                              << result.allocatingFrames << " steady-state frames\n";
+                    if (result.steadyStateAllocations > 0)
+                    {
+                        ++failures;
+                    }
+                }
+            }
+            catch (const std::exception& e)
+            {
+                ++failures;
+                std::lock_guard<std::mutex> lock(reportMutex);
+                std::cerr << logs[i] << ": " << e.what() << '\n';
+            }
+        }
+    };
+
+    std::vector<std::thread> workers;
+    for (unsigned i = 1; i < jobs; ++i)
+    {
+        workers.emplace_back(worker);
+    }
+    worker();
+    for (std::thread& thread : workers)
+    {
+        thread.join();
+    }
+
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,263 @@
+// Live view of the telemetry segment a running flight or replay publishes
+// (see include/telemetry/live_telemetry.hpp).
+//
+// Polls the segment at a fixed rate without ever blocking the writer. The
+// text view redraws one screen per poll; --csv prints one row per new
+// snapshot instead, for piping into plotting tools. The viewer waits for the
+// segment to appear and reattaches when a new writer replaces it.
+
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <system_error>
+#include <thread>
+
+#include <unistd.h>
+
+#include "telemetry/live_telemetry.hpp"
+
+namespace {
+
+volatile std::sig_atomic_t s_stop = 0;
+
+void onSignal(int)
+{
+    s_stop = 1;
+}
+
+bool writerAlive(const telemetry::LiveTelemetryReader& reader)
+{
+    return ::kill(static_cast<pid_t>(reader.writer_pid()), 0) == 0 || errno == EPERM;
+}
+
+void printCsvHeader()
+{
+    std::printf("count,timestamp_us,frame,skipped_frames,roll,pitch,yaw,altitude,vario,"
+                "frame_interval,flow_x,flow_y,vec_down_x,vec_down_y,vec_move_x,vec_move_y,"
+                "position_x,position_y,velocity_x,velocity_y,setpoint_x,setpoint_y,estimated_altitude,"
+                "p_roll,p_pitch,i_roll,i_pitch,d_roll,d_pitch,rc_roll,rc_pitch,rc_throttle,rc_yaw,"
+                "vision_us,estimator_us,control_us,loop_us\n");
+}
+
+void printCsvRow(const std::uint64_t count, const telemetry::Snapshot& s)
+{
+    std::printf("%llu,%llu,%u,%u,%.6g,%.6g,%.6g,%.6g,%.6g,"
+                "%.6g,%.6g,%.6g,%.6g,%.6g,%.6g,%.6g,"
+                "%.6g,%.6g,%.6g,%.6g,%.6g,%.6g,%.6g,"
+                "%.6g,%.6g,%.6g,%.6g,%.6g,%.6g,%u,%u,%u,%u,"
+                "%u,%u,%u,%u\n",
+                static_cast<unsigned long long>(count), static_cast<unsigned long long>(s.timestamp_us),
+                s.frame, s.skipped_frames, s.roll, s.pitch, s.yaw, s.altitude, s.vario,
+                s.frame_interval, s.flow_x, s.flow_y, s.vec_down_x, s.vec_down_y, s.vec_move_x, s.vec_move_y,
+                s.position_x, s.position_y, s.velocity_x, s.velocity_y, s.setpoint_x, s.setpoint_y,
+                s.estimated_altitude,
+                s.pid_p[0], s.pid_p[1], s.pid_i[0], s.pid_i[1], s.pid_d[0], s.pid_d[1],
+                s.rc[0], s.rc[1], s.rc[2], s.rc[3],
+                s.vision_us, s.estimator_us, s.control_us, s.loop_us);
+}
+
+void printScreen(const char* name, const telemetry::LiveTelemetryReader& reader, const std::uint64_t count,
+                 const double rate, const telemetry::Snapshot& s)
+{
+    constexpr double degrees = 180.0 / 3.14159265358979323846;
+    if (::isatty(STDOUT_FILENO))
+    {
+        // Home the cursor and clear the screen
+        std::printf("\033[H\033[2J");
+    }
+    std::printf("%s  writer %u  snapshot %llu  %.1f Hz\n\n", name, reader.writer_pid(),
+                static_cast<unsigned long long>(count), rate);
+    std::printf("frame     %10u  skipped %u  interval %.1f ms\n", s.frame, s.skipped_frames,
+                1e3 * s.frame_interval);
+    std::printf("attitude  roll %+7.2f  pitch %+7.2f  yaw %+7.2f deg\n", degrees * s.roll,
+                degrees * s.pitch, degrees * s.yaw);
+    std::printf("altitude  %7.3f m  vario %+6.3f m/s  estimated %7.3f m\n", s.altitude, s.vario,
+                s.estimated_altitude);
+    std::printf("flow      %+8.2f %+8.2f px  vec down %8.1f %8.1f px\n", s.flow_x, s.flow_y, s.vec_down_x,
+                s.vec_down_y);
+    std::printf("vec move  %+8.4f %+8.4f m\n", s.vec_move_x, s.vec_move_y);
+    std::printf("position  %+8.3f %+8.3f m  setpoint %+8.3f %+8.3f m\n", s.position_x, s.position_y,
+                s.setpoint_x, s.setpoint_y);
+    std::printf("velocity  %+8.3f %+8.3f m/s\n", s.velocity_x, s.velocity_y);
+    std::printf("pid roll  P %+8.2f  I %+8.2f  D %+8.2f\n", s.pid_p[0], s.pid_i[0], s.pid_d[0]);
+    std::printf("pid pitch P %+8.2f  I %+8.2f  D %+8.2f\n", s.pid_p[1], s.pid_i[1], s.pid_d[1]);
+    std::printf("rc        %4u %4u %4u %4u  %4u %4u %4u %4u\n", s.rc[0], s.rc[1], s.rc[2], s.rc[3], s.rc[4],
+                s.rc[5], s.rc[6], s.rc[7]);
+    std::printf("timing    vision %6u us  estimator %5u us  control %5u us  loop %6u us\n", s.vision_us,
+                s.estimator_us, s.control_us, s.loop_us);
+    if (!writerAlive(reader))
+    {
+        std::printf("\nwriter exited; showing its last snapshot\n");
+    }
+}
+
+void usage(const char* program)
+{
+    std::cerr << "Usage: " << program << " [--rate HZ] [--csv] [--once] [segment]\n"
+              << "  segment     shm_open() name (default " << telemetry::DEFAULT_SEGMENT << ")\n"
+              << "  --rate HZ   polls per second (default 10)\n"
+              << "  --csv       one CSV row per new snapshot instead of the screen\n"
+              << "  --once      print the current snapshot and exit\n";
+}
+
+} // namespace
+
+int main(int argc, char* argv[])
+{
+    std::string name = telemetry::DEFAULT_SEGMENT;
+    double rate = 10.0;
+    bool csv = false;
+    bool once = false;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        if (std::strcmp(argv[i], "--rate") == 0 && i + 1 < argc)
+        {
+            rate = std::atof(argv[++i]);
+        }
+        else if (std::strcmp(argv[i], "--csv") == 0)
+        {
+            csv = true;
+        }
+        else if (std::strcmp(argv[i], "--once") == 0)
+        {
+            once = true;
+        }
+        else if (argv[i][0] != '-')
+        {
+            name = argv[i];
+        }
+        else
+        {
+            usage(argv[0]);
+            return 2;
+        }
+    }
+
+    if (rate <= 0.0)
+    {
+        usage(argv[0]);
+        return 2;
+    }
+
+    ::signal(SIGINT, onSignal);
+    ::signal(SIGTERM, onSignal);
+
+    const auto period = std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+        std::chrono::duration<double>(1.0 / rate));
+
+    std::unique_ptr<telemetry::LiveTelemetryReader> reader;
+    std::uint64_t lastCount = 0;
+    std::uint64_t rateCount = 0;
+    auto rateStart = std::chrono::steady_clock::now();
+    double publishRate = 0.0;
+    bool headerPrinted = false;
+    bool waiting = false;
+
+    for (auto next = std::chrono::steady_clock::now(); !s_stop; next += period)
+    {
+        std::this_thread::sleep_until(next);
+
+        // (Re)attach when the segment appears or its writer was replaced
+        if (reader && !writerAlive(*reader))
+        {
+            try
+            {
+                telemetry::LiveTelemetryReader fresh(name.c_str());
+                if (fresh.writer_pid() != reader->writer_pid())
+                {
+                    reader.reset();
+                }
+            }
+            catch (const std::exception&)
+            {
+                // Keep showing the last snapshot of the exited writer
+            }
+        }
+        if (!reader)
+        {
+            try
+            {
+                reader = std::make_unique<telemetry::LiveTelemetryReader>(name.c_str());
+                lastCount = 0;
+                rateCount = 0;
+                rateStart = std::chrono::steady_clock::now();
+                waiting = false;
+            }
+            catch (const std::system_error& e)
+            {
+                if (e.code().value() != ENOENT || once)
+                {
+                    std::cerr << e.what() << '\n';
+                    return 1;
+                }
+                if (!waiting)
+                {
+                    std::cerr << "waiting for " << name << "...\n";
+                    waiting = true;
+                }
+                continue;
+            }
+            catch (const std::exception& e)
+            {
+                std::cerr << e.what() << '\n';
+                return 1;
+            }
+        }
+
+        telemetry::Snapshot snapshot;
+        std::uint64_t count = 0;
+        if (!reader->read(&snapshot, &count))
+        {
+            if (once)
+            {
+                std::cerr << name << ": nothing published yet\n";
+                return 1;
+            }
+            continue;
+        }
+
+        const auto now = std::chrono::steady_clock::now();
+        const double window = std::chrono::duration<double>(now - rateStart).count();
+        if (window >= 1.0)
+        {
+            publishRate = (count - rateCount) / window;
+            rateCount = count;
+            rateStart = now;
+        }
+
+        if (csv)
+        {
+            if (!headerPrinted)
+            {
+                printCsvHeader();
+                headerPrinted = true;
+            }
+            if (count != lastCount)
+            {
+                printCsvRow(count, snapshot);
+            }
+        }
+        else
+        {
+            printScreen(name.c_str(), *reader, count, publishRate, snapshot);
+        }
+        std::fflush(stdout);
+        lastCount = count;
+
+        if (once)
+        {
+            break;
+        }
+    }
+
+    return 0;
+}